@@ -5,18 +5,27 @@
 */
 
 #include "Client.h"
+#include "CpuPlacement.h"
+#include <stdio.h>
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
 #include <iostream>
 #include <utility>
+#include <algorithm>
+#include <random>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
 
 extern "C" {
   #include "GlcMsg.h"
   #include "GlcLscsIf.h"
 }
 
-#define MAX_MESSAGE_SIZE (sizeof(SegRtDataMsg))
+#define IO_URING_ENTRIES (512)
 
 using namespace std;
 
@@ -29,12 +38,18 @@ using namespace std;
 * INPUTS:
 */
 
-tClient::tClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString) :
+tClient::tClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString,
+                 bool bOwnSocket) :
   _iPortNum(iPortNum),
-  _UdpClient(sServerIpAddressString, iPortNum, sClientIpAddressString),
+  _UdpClient(sServerIpAddressString, iPortNum, sClientIpAddressString, bOwnSocket),
   _bDebug(false),
-  _nSent(0)
+  _nSent(0),
+  _iClockId(TIMETAG_V1),
+  _szMsg(sizeof(SegRtDataMsg)),
+  _nsPhaseOffset(0),
+  _iSendGroup(0)
 {
+  bzero((char *) &_SegMsgV2, sizeof(_SegMsgV2));
 }
 
 /***************************************************
@@ -54,6 +69,11 @@ tClient::tClient(tClient &&other) noexcept :
   _iPortNum = other._iPortNum;
   _bDebug   = other._bDebug;
   _nSent    = other._nSent;
+  _iClockId = other._iClockId;
+  _szMsg    = other._szMsg;
+  _SegMsgV2 = other._SegMsgV2;
+  _nsPhaseOffset = other._nsPhaseOffset;
+  _iSendGroup    = other._iSendGroup;
 }
 
 
@@ -76,28 +96,99 @@ tClient::~tClient()
 
 int tClient::SendMessage()
 {
-    struct timeval tm;
-    SegRtDataMsg seg_msg;
-
-    gettimeofday (&tm, NULL);
-    seg_msg.hdr.time      = tm;
-    seg_msg.hdr.hdr.msgId = ++_nSent;
-    _UdpClient.SendMessage((uint8_t *) &seg_msg, sizeof(seg_msg));
+    _PrepareMessage();
+    _UdpClient.SendMessage((uint8_t *) &_SegMsg, _szMsg);
     // cout << "Send" << endl;
 
     return 0;
 }
 
 
+/*****************************
+* tClient::PrepareSend
+*
+* io_uring counterpart of SendMessage().  Queues the next message on the
+* ring; the caller submits it.
+*
+* RETURNS:
+*   true if queued, false if the ring's submission queue is full
+*/
+
+bool tClient::PrepareSend(tIoUring &Ring)
+{
+    if (!_UdpClient.PrepareSend(Ring, (uint8_t *) &_SegMsg, _szMsg, (uint64_t) (uintptr_t) this)) {
+      return false;
+    }
+
+    _PrepareMessage();
+    return true;
+}
+
+
+/*****************************
+* tClient::_PrepareMessage
+*
+* Stamps the next message with the send time and sequence number
+*/
+
+void tClient::_PrepareMessage()
+{
+    SetDataHdrTime((uint8_t *) &_SegMsg, _iClockId, TimeTagNowNs(_iClockId));
+    _SegMsg.hdr.hdr.msgId = ++_nSent;
+}
+
+
+/*****************************
+* tClient::UseTimeTags
+*
+* Chooses the message header layout and time tag clock
+*
+* INPUTS:
+*    iClockId - TIMETAG_V1 for the original DataHdr, stamped by
+*               gettimeofday(), else the TIME_CLOCK_ID of a DataHdrV2
+*/
+
+void tClient::UseTimeTags(int iClockId)
+{
+    _iClockId = iClockId;
+    _szMsg    = (iClockId == TIMETAG_V1) ? sizeof(SegRtDataMsg) : sizeof(SegRtDataMsgV2);
+}
+
+
+/***************************************************
+* tClientList destructor
+*
+*/
+
+tClientList::~tClientList()
+{
+  if (_sockShared >= 0)  close(_sockShared);
+}
+
+
 /***************************************************
 * tClientList::AddConnection
 *
 * INPUTS:
+* SIDE EFFECTS:
+*    Opens a socket for the client, except with a shared socket, or with
+*    batched sends and no source address, when its messages go out
+*    through a socket shared with other clients.
+*    With a shared socket, throws a tUdpConnectionException if the source
+*    address is not configured on this host
 */
 
 int tClientList::AddClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString)
 {
-  _ClientList.push_back(tClient(sServerIpAddressString, iPortNum, sClientIpAddressString));
+  bool bOwnSocket = !_bSharedSocket && !(_bBatched && sClientIpAddressString == NULL);
+
+  _ClientList.push_back(tClient(sServerIpAddressString, iPortNum, sClientIpAddressString, bOwnSocket));
+  _ClientList.back().UseTimeTags(_iClockId);
+
+  // Otherwise every one of its sends would fail, rather than its socket's bind()
+  if (_bSharedSocket && _ClientList.back()._UdpClient.SourceAddress() != NULL) {
+    tUdpSendBatch::CheckSourceAddress(*_ClientList.back()._UdpClient.SourceAddress());
+  }
 
   return 0;
 }
@@ -106,16 +197,1017 @@ int tClientList::AddClient(const std::string &sServerIpAddressString, int iPortN
 
 
 
+/***************************************************
+* tClientList::UseIoUring
+*
+* Switches EmitMessagesFromAll() from one sendto() per client to bulk
+* submission through io_uring.  Throws a tIoUringException if the kernel
+* does not support it.
+*/
+
+void tClientList::UseIoUring()
+{
+  _pRing.reset(new tIoUring(IO_URING_ENTRIES));
+}
+
+
+/***************************************************
+* tClientList::UseBatchedSends
+*
+* Sends each cycle's messages with one sendmmsg() per socket, rather than
+* one sendto() per client.  Clients with no source address share one
+* socket, so do not get one of their own.  Must be called before any
+* clients are added.
+*/
+
+void tClientList::UseBatchedSends()
+{
+  assert(_ClientList.empty());
+
+  _bBatched = true;
+}
+
+
+/***************************************************
+* tClientList::UseSharedSocket
+*
+* Sends every client's messages through a single socket, with the
+* client's source address attached to each message as IP_PKTINFO, rather
+* than through a socket per client bound to that address.  The source
+* addresses must still be configured on this host, as aliases if need be;
+* AddClient() checks each one.  Implies batched sends.
+* Must be called before any clients are added.
+*/
+
+void tClientList::UseSharedSocket()
+{
+  assert(_ClientList.empty());
+
+  _bSharedSocket = true;
+  _bBatched      = true;
+}
+
+
 /***************************************************
 * tClientList::EmitMessagesFromAll
-*    
+*
+* Sends one message from every client.  Clients with a phase offset wait
+* for it: each run of clients with the same offset goes out together
+* once the tick plus that offset is reached.  With no offsets set, that
+* is one burst at once.
+*
+* INPUTS:
+*    nsTick - CLOCK_MONOTONIC time of the cycle's tick, that phase offsets
+*             are measured from.  0 to ignore the offsets and send now.
 */
 
-int tClientList::EmitMessagesFromAll()
+int tClientList::EmitMessagesFromAll(int64_t nsTick)
 {
-  for (auto & Client : _ClientList) {
-    Client.SendMessage();
+  struct timespec tmSend;
+  int64_t         nsStart, nsOffset;
+  int64_t         nsSending = 0;
+  size_t          i, j;
+
+  if (_SendOrder.size() != _ClientList.size())  SortByPhase();
+
+  for (i=0; i<_SendOrder.size(); i=j) {
+    nsOffset = _SendOrder[i]->_nsPhaseOffset;
+    for (j=i+1; j<_SendOrder.size() && _SendOrder[j]->_nsPhaseOffset == nsOffset; j++) {
+    }
+
+    if (nsTick > 0 && nsOffset > 0) {
+      tmSend.tv_sec  = (nsTick + nsOffset) / 1000000000LL;
+      tmSend.tv_nsec = (nsTick + nsOffset) % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tmSend, NULL) == EINTR) {
+      }
+    }
+
+    // Only the sending is timed, not the waits for the phase offsets
+    nsStart = tPeriodicScheduler::NowNs();
+    _EmitRange(i, j);
+    nsSending += tPeriodicScheduler::NowNs() - nsStart;
   }
 
+  _BurstDuration.Record(nsSending);
+
+  _nMessages += _SendOrder.size();
+
   return 0;
-}
\ No newline at end of file
+}
+
+
+/***************************************************
+* tClientList::_EmitRange
+*
+* Sends the messages of _SendOrder[iFirst] up to, not including,
+* _SendOrder[iLast], by whichever means the list was set up for
+*/
+
+void tClientList::_EmitRange(size_t iFirst, size_t iLast)
+{
+  unsigned nInFlight = 0;
+  size_t   i;
+
+  if (_bBatched) {
+    _EmitBatched(iFirst, iLast);
+  }
+  else if (!_pRing) {
+    for (i=iFirst; i<iLast; i++) {
+      _SendOrder[i]->SendMessage();
+      _nSyscalls++;
+    }
+  }
+  else {
+    for (i=iFirst; i<iLast; i++) {
+      if (!_SendOrder[i]->PrepareSend(*_pRing)) {
+        // Submission queue full, so flush it and try again
+        _SubmitAndReapSends(nInFlight);
+        nInFlight = 0;
+        _SendOrder[i]->PrepareSend(*_pRing);
+      }
+      nInFlight++;
+    }
+    _SubmitAndReapSends(nInFlight);
+  }
+}
+
+
+/***************************************************
+* tClientList::SetPhaseOffsets
+*
+* Spreads this list's clients over the period.  To spread the clients of
+* several lists as one, use AssignPhaseOffsets() on all of them and then
+* SortByPhase() on each list.
+*/
+
+void tClientList::SetPhaseOffsets(tPhaseMode Mode, int64_t nsPeriod)
+{
+  vector<tClient *> Clients;
+
+  GetClients(Clients);
+  AssignPhaseOffsets(Clients, Mode, nsPeriod);
+  SortByPhase();
+}
+
+
+/***************************************************
+* tClientList::GetClients
+*
+* Appends pointers to the list's clients, in the order they were added
+*/
+
+void tClientList::GetClients(vector<tClient *> &Clients)
+{
+  for (auto & Client : _ClientList)  Clients.push_back(&Client);
+}
+
+
+/***************************************************
+* tClientList::SortByPhase
+*
+* Puts the clients in the order of their phase offsets, which is the
+* order they are sent in.  Must be called again if the offsets change.
+*/
+
+void tClientList::SortByPhase()
+{
+  _SendOrder.clear();
+  GetClients(_SendOrder);
+  stable_sort(_SendOrder.begin(), _SendOrder.end(),
+              [](const tClient *pA, const tClient *pB) { return pA->_nsPhaseOffset < pB->_nsPhaseOffset; });
+}
+
+
+/***************************************************
+* tClientList::AssignPhaseOffsets
+*
+* Gives each client the time after every tick that it sends, to model
+* LSCS units whose clocks are not locked together:
+*
+*   PHASE_NONE    - all at the tick, one burst per cycle
+*   PHASE_UNIFORM - client i of n at i/n of the period
+*   PHASE_RANDOM  - uniformly at random within the period, the same on
+*                   every run
+*   PHASE_SUBNET  - clients whose source addresses share a /24 send
+*                   together, the subnets spread evenly over the period.
+*                   Clients with no source address form one group.
+*
+* INPUTS:
+*    Clients  - the clients, in the order the offsets are dealt out in
+*    Mode     - as above
+*    nsPeriod - time between ticks
+*/
+
+void tClientList::AssignPhaseOffsets(vector<tClient *> &Clients, tPhaseMode Mode, int64_t nsPeriod)
+{
+  size_t                                 n = Clients.size();
+  size_t                                 i, iSubnet;
+  std::mt19937_64                        Rng(PHASE_RANDOM_SEED);
+  std::uniform_int_distribution<int64_t> Random(0, nsPeriod - 1);
+  vector<uint32_t>                       Subnets;
+  vector<size_t>                         iSubnetOf(n);
+  const struct in_addr                  *pSource;
+  uint32_t                               uSubnet;
+
+  for (i=0; i<n; i++) {
+    switch (Mode) {
+      case PHASE_UNIFORM:
+        Clients[i]->_nsPhaseOffset = (int64_t) (nsPeriod * (double) i / n);
+        break;
+
+      case PHASE_RANDOM:
+        Clients[i]->_nsPhaseOffset = Random(Rng);
+        break;
+
+      case PHASE_SUBNET:
+        // Number the subnets in the order they are first seen; the offsets need their count
+        pSource = Clients[i]->_UdpClient.SourceAddress();
+        uSubnet = pSource ? (ntohl(pSource->s_addr) >> 8) : UINT32_MAX;
+        iSubnet = find(Subnets.begin(), Subnets.end(), uSubnet) - Subnets.begin();
+        if (iSubnet == Subnets.size())  Subnets.push_back(uSubnet);
+        iSubnetOf[i] = iSubnet;
+        break;
+
+      default:
+        Clients[i]->_nsPhaseOffset = 0;
+        break;
+    }
+  }
+
+  if (Mode == PHASE_SUBNET) {
+    for (i=0; i<n; i++) {
+      Clients[i]->_nsPhaseOffset = (int64_t) (nsPeriod * (double) iSubnetOf[i] / Subnets.size());
+    }
+  }
+}
+
+
+/***************************************************
+* tClientList::PhaseModeName
+*
+*/
+
+const char *tClientList::PhaseModeName(tPhaseMode Mode)
+{
+  switch (Mode) {
+    case PHASE_UNIFORM: return "uniform";
+    case PHASE_RANDOM:  return "random";
+    case PHASE_SUBNET:  return "subnet";
+    default:            return "none";
+  }
+}
+
+
+/***************************************************
+* tClientList::UseTimeTags
+*
+* Sets the header layout and time tag clock of every client, including
+* any added later.  See tClient::UseTimeTags().
+*/
+
+void tClientList::UseTimeTags(int iClockId)
+{
+  _iClockId = iClockId;
+  for (auto & Client : _ClientList)  Client.UseTimeTags(iClockId);
+}
+
+
+/***************************************************
+* tClientList::_BuildSendGroups
+*
+* Sorts the clients by the socket their messages must leave from.  A
+* client bound to a source address must use its own socket; all of the
+* others share one unbound socket, so that a whole cycle of their
+* messages can go out in a single sendmmsg().  With UseSharedSocket(), no
+* client is bound, so there is just the one socket.
+*/
+
+void tClientList::_BuildSendGroups()
+{
+  size_t iShared = 0;
+
+  for (auto & Client : _ClientList) {
+    if (Client._UdpClient.IsBound()) {
+      _SendGroups.push_back(tSendGroup());
+      _SendGroups.back().sock = Client._UdpClient.GetSocket();
+      _SendGroups.back().Clients.push_back(&Client);
+      Client._iSendGroup = _SendGroups.size() - 1;
+    }
+    else {
+      if (_sockShared < 0) {
+        _sockShared = tUdpSendBatch::OpenSharedSocket();
+        iShared = _SendGroups.size();
+        _SendGroups.push_back(tSendGroup());
+        _SendGroups.back().sock = _sockShared;
+      }
+      _SendGroups[iShared].Clients.push_back(&Client);
+      Client._iSendGroup = iShared;
+    }
+  }
+
+  for (auto & Group : _SendGroups) {
+    Group.pBatch.reset(new tUdpSendBatch((int) Group.Clients.size()));
+  }
+  _TouchedGroups.reserve(_SendGroups.size());
+
+  cout << "Batched sends: " << _SendGroups.size() << " sockets for " << _ClientList.size() << " clients" << endl;
+}
+
+
+/***************************************************
+* tClientList::_EmitBatched
+*
+* Stamps the messages of _SendOrder[iFirst] up to, not including,
+* _SendOrder[iLast] first, then sends them, one socket at a time, so that
+* the sends follow each other as closely as possible.
+*/
+
+void tClientList::_EmitBatched(size_t iFirst, size_t iLast)
+{
+  tClient *pClient;
+  size_t   i;
+
+  if (_SendGroups.empty())  _BuildSendGroups();
+
+  for (i=iFirst; i<iLast; i++) {
+    pClient = _SendOrder[i];
+    tSendGroup &Group = _SendGroups[pClient->_iSendGroup];
+
+    if (Group.pBatch->NumMessages() == 0)  _TouchedGroups.push_back(pClient->_iSendGroup);
+
+    pClient->_PrepareMessage();
+    // Clients on the shared socket carry their source address with each message
+    Group.pBatch->Add((uint8_t *) &pClient->_SegMsg, pClient->_szMsg, pClient->_UdpClient.ServerAddress(),
+                      (Group.sock == _sockShared) ? pClient->_UdpClient.SourceAddress() : NULL);
+  }
+
+  for (auto iGroup : _TouchedGroups) {
+    _nSyscalls += _SendGroups[iGroup].pBatch->Send(_SendGroups[iGroup].sock);
+  }
+  _TouchedGroups.clear();
+}
+
+
+/***************************************************
+* tClientList::_SubmitAndReapSends
+*
+* Submits the queued sends and waits for all of them to complete
+*
+* INPUTS:
+*    nInFlight - number of sends queued
+* SIDE EFFECTS:
+*    Throws a tUdpConnectionException if any send failed
+*/
+
+void tClientList::_SubmitAndReapSends(unsigned nInFlight)
+{
+  struct io_uring_cqe *pCqe;
+  unsigned i;
+
+  if (nInFlight == 0)  return;
+
+  _pRing->Submit(nInFlight);
+  _nSyscalls++;
+
+  for (i=0; i<nInFlight; i++) {
+    // Submit() may return before the last completions are posted, so wait for any stragglers
+    while ((pCqe = _pRing->PeekCqe()) == nullptr) {
+      _pRing->Submit(1);
+      _nSyscalls++;
+    }
+
+    if (pCqe->res < 0) {
+      throw tUdpConnectionException(std::string("io_uring SendMessage: ") + strerror(-pCqe->res));
+    }
+    _pRing->AdvanceCq();
+  }
+}
+
+
+/***************************************************
+* tClientList::GetReplySockets
+*
+* Appends every socket the clients send from, which is where replies to
+* them arrive.  With batched sends, this opens the shared socket if it is
+* not yet open.
+*/
+
+void tClientList::GetReplySockets(vector<int> &Sockets)
+{
+  if (_bBatched && _SendGroups.empty())  _BuildSendGroups();
+
+  if (_bBatched) {
+    for (auto & Group : _SendGroups)  Sockets.push_back(Group.sock);
+  }
+  else {
+    for (auto & Client : _ClientList)  Sockets.push_back(Client._UdpClient.GetSocket());
+  }
+}
+
+
+/***************************************************
+* tClientList::PrintSyscallStatistics
+*
+* Reports how many send system calls were needed per message, and how
+* many messages could not be routed
+*/
+
+void tClientList::PrintSyscallStatistics()
+{
+  printf("Sent %ld messages with %ld send syscalls", _nMessages, _nSyscalls);
+  if (_nMessages > 0)  printf(" (%.3f syscalls per message)", (double) _nSyscalls / _nMessages);
+  printf("\n");
+  if (NumSendFailures() > 0)  printf("%ld messages could not be routed\n", NumSendFailures());
+}
+
+
+/***************************************************
+* tClientList::NumSendFailures
+*
+* The messages of batched sends that could not be routed, which are
+* included in NumMessages().  Call only while no cycle is being sent.
+*/
+
+long tClientList::NumSendFailures()
+{
+  long nFailed = 0;
+
+  for (auto & Group : _SendGroups)  nFailed += Group.pBatch->NumFailed();
+
+  return nFailed;
+}
+
+
+/***************************************************
+* tClientList::PrintBurstStatistics
+*
+* Reports how long each cycle's messages took to leave the program: the
+* time spent sending, summed over the cycle's runs of clients with the
+* same phase offset, leaving out the waits between them
+*/
+
+void tClientList::PrintBurstStatistics()
+{
+  _BurstDuration.Print(stdout, "Burst duration per cycle:");
+}
+
+
+/***************************************************
+* tClientList::WriteResults
+*
+* The send counts and burst durations, into the open result object
+*/
+
+void tClientList::WriteResults(tResultFile &Results)
+{
+  Results.Add("clients",  (long) _ClientList.size());
+  Results.Add("sent",     _nMessages);
+  Results.Add("syscalls", _nSyscalls);
+  Results.Add("send_failures", NumSendFailures());
+  Results.AddHistogram("burst_duration", _BurstDuration);
+}
+
+
+/***************************************************
+* tEmitterThread constructor
+*
+* INPUTS:
+*    pList      - list the emitter belongs to
+*    iThreadNum - identifies the emitter in messages
+*    iPriority  - RT priority, 0 for none
+*    iCpu       - CPU to pin the thread to, -1 for none
+*/
+
+tEmitterThread::tEmitterThread(tEmitterList *pList, int iThreadNum, int iPriority, int iCpu) :
+  tPThread(iPriority, false),
+  _pList(pList),
+  _iThreadNum(iThreadNum),
+  _nsStopTick(INT64_MAX)
+{
+  SetCpuAffinity(iCpu);
+}
+
+
+/***************************************************
+* tEmitterThread::_Thread
+*
+* Waits for each tick of the shared schedule, then sends the shard's
+* messages.  The start is only handed to the list once they have gone,
+* so that measuring the skew does not add to it.
+*/
+
+void *tEmitterThread::_Thread()
+{
+  int64_t nsTick, nsStart;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    if (_Scheduler.NextTick() >= _nsStopTick.load(memory_order_relaxed))  break;
+
+    nsTick  = _Scheduler.WaitForNextTick();
+    nsStart = tPeriodicScheduler::NowNs();
+    _Clients.EmitMessagesFromAll(nsTick);
+    _EndOffset.Record(tPeriodicScheduler::NowNs() - nsTick);
+    _pList->RecordCycleStart(nsTick, nsStart);
+    _Scheduler.EndOfWork();
+  }
+
+  return nullptr;
+}
+
+
+/***************************************************
+* tEmitterThread::PrintStatistics
+*
+*/
+
+void tEmitterThread::PrintStatistics()
+{
+  char sLabel[80];
+
+  printf("Emitter %d (cpus %s): ", _iThreadNum, ActualCpus().c_str());
+  _Clients.PrintSyscallStatistics();
+  printf("  ");
+  _Clients.PrintBurstStatistics();
+  snprintf(sLabel, sizeof(sLabel), "  start offset from tick:");
+  _Scheduler.Print(stdout, sLabel);
+  snprintf(sLabel, sizeof(sLabel), "  end offset from tick:  ");
+  _EndOffset.Print(stdout, sLabel);
+}
+
+
+/***************************************************
+* tEmitterThread::ActualCpus
+*
+* RETURNS:
+*   The CPUs the thread could run on, as a list, or "" if not started
+*/
+
+std::string tEmitterThread::ActualCpus() const
+{
+  cpu_set_t CpuSet;
+
+  return GetActualCpuAffinity(&CpuSet) ? tCpuPlacement::FormatCpuList(CpuSet) : "";
+}
+
+
+/***************************************************
+* tEmitterThread::WriteResults
+*
+* What PrintStatistics() shows, as one object
+*/
+
+void tEmitterThread::WriteResults(tResultFile &Results)
+{
+  Results.BeginObject();
+  Results.Add("thread", _iThreadNum);
+  Results.Add("cpus",   ActualCpus());
+  _Clients.WriteResults(Results);
+  _Scheduler.WriteResults(Results, "start_offset");
+  Results.AddHistogram("end_offset", _EndOffset);
+  Results.EndObject();
+}
+
+
+/***************************************************
+* tEmitterList constructor
+*
+* INPUTS:
+*    nThreads  - number of emitter threads
+*    iPriority - RT priority of each, 0 for none
+*    iFirstCpu - emitter i is pinned to CPU iFirstCpu + i, wrapping around
+*                the online CPUs.  -1 for no pinning.
+*/
+
+tEmitterList::tEmitterList(int nThreads, int iPriority, int iFirstCpu) :
+  _nClients(0),
+  _nsPeriod(0)
+{
+  long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int  i;
+
+  assert(nThreads > 0);
+
+  for (i=0; i<nThreads; i++) {
+    _Emitters.emplace_back(new tEmitterThread(this, i, iPriority, (iFirstCpu < 0) ? -1 : (int) ((iFirstCpu + i) % nCpus)));
+  }
+  for (auto & Cycle : _CycleStarts)  Cycle.nsTick = 0;
+}
+
+
+/***************************************************
+* tEmitterList::SetPlacement
+*
+* Places emitter i as the placement's thread i.  Overrides the first CPU
+* given to the constructor; call before StartThreads().
+*/
+
+void tEmitterList::SetPlacement(const tCpuPlacement &Placement)
+{
+  for (size_t i=0; i<_Emitters.size(); i++)  Placement.Place(*_Emitters[i], (int) i);
+}
+
+
+/***************************************************
+* tEmitterList::AddClient
+*
+* Gives the client to the next emitter in turn
+*/
+
+int tEmitterList::AddClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString)
+{
+  return _Emitters[_nClients++ % _Emitters.size()]->Clients().AddClient(sServerIpAddressString, iPortNum, sClientIpAddressString);
+}
+
+
+/***************************************************
+* tEmitterList::UseIoUring, UseBatchedSends, UseSharedSocket, UseTimeTags
+*
+* As for tClientList, applied to every emitter.  With UseBatchedSends()
+* or UseSharedSocket(), each emitter has a shared socket of its own.
+*/
+
+void tEmitterList::UseIoUring()
+{
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().UseIoUring();
+}
+
+
+void tEmitterList::UseBatchedSends()
+{
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().UseBatchedSends();
+}
+
+
+void tEmitterList::UseSharedSocket()
+{
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().UseSharedSocket();
+}
+
+
+void tEmitterList::UseTimeTags(int iClockId)
+{
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().UseTimeTags(iClockId);
+}
+
+
+/***************************************************
+* tEmitterList::SetPhaseOffsets
+*
+* Assigns phase offsets across all of the emitters' clients, in the order
+* the clients were added, so that the spread is the same however many
+* emitters share them out
+*/
+
+void tEmitterList::SetPhaseOffsets(tPhaseMode Mode, int64_t nsPeriod)
+{
+  vector<vector<tClient *>> Shards(_Emitters.size());
+  vector<tClient *>         Clients;
+  int                       i;
+
+  for (size_t iEmitter=0; iEmitter<_Emitters.size(); iEmitter++) {
+    _Emitters[iEmitter]->Clients().GetClients(Shards[iEmitter]);
+  }
+
+  // Undo the round-robin of AddClient()
+  for (i=0; i<_nClients; i++) {
+    Clients.push_back(Shards[i % _Emitters.size()][i / _Emitters.size()]);
+  }
+
+  tClientList::AssignPhaseOffsets(Clients, Mode, nsPeriod);
+
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().SortByPhase();
+}
+
+
+/***************************************************
+* tEmitterList::GetReplySockets, NumMessages
+*
+* As for tClientList, over all of the emitters
+*/
+
+void tEmitterList::GetReplySockets(vector<int> &Sockets)
+{
+  for (auto & pEmitter : _Emitters)  pEmitter->Clients().GetReplySockets(Sockets);
+}
+
+
+long tEmitterList::NumMessages()
+{
+  long nMessages = 0;
+
+  for (auto & pEmitter : _Emitters)  nMessages += pEmitter->Clients().NumMessages();
+  return nMessages;
+}
+
+
+/***************************************************
+* tEmitterList::StartThreads
+*
+* Starts every emitter, all with the same first cycle time.  SIGINT is
+* blocked in the emitters, so that Ctrl-C goes to the calling thread.
+*
+* INPUTS:
+*    nsPeriod - time between cycles
+*/
+
+void tEmitterList::StartThreads(int64_t nsPeriod)
+{
+  int64_t  nsFirstTick = tPeriodicScheduler::NowNs() + EMITTER_START_DELAY_MS * 1000000LL;
+  sigset_t sigset, sigsetOld;
+
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &sigset, &sigsetOld);
+
+  _nsPeriod = nsPeriod;
+  for (auto & pEmitter : _Emitters) {
+    pEmitter->SetSchedule(nsFirstTick, nsPeriod);
+    pEmitter->StartThread();
+  }
+
+  pthread_sigmask(SIG_SETMASK, &sigsetOld, NULL);
+
+  if (!tPThread::HaveAllBeenStartedWithRequestedAttributes()) {
+    cerr << "** Warning: Some threads not created with desired attributes **" << endl;
+    if (tPThread::HaveAnyLostPriority())  cerr << "   You probably need to run as root." << endl;
+    else                                  cerr << "   The requested CPUs are not all available." << endl;
+  }
+
+  if (_Emitters[0]->HasCpuAffinity()) {
+    std::vector<const tPThread *> Threads;
+
+    for (auto & pEmitter : _Emitters)  Threads.push_back(pEmitter.get());
+    tCpuPlacement::PrintActual(stdout, "Emitter threads per CPU set:", Threads);
+  }
+}
+
+
+/***************************************************
+* tEmitterList::StopThreads
+*
+* Stops the emitters at a common cycle boundary a period from now, so
+* that every emitter has sent the same cycles and the last ones are not
+* left partly sent
+*/
+
+void tEmitterList::StopThreads()
+{
+  int64_t nsStop = tPeriodicScheduler::NowNs() + _nsPeriod;
+
+  for (auto & pEmitter : _Emitters) {
+    pEmitter->StopBefore(nsStop);
+  }
+  for (auto & pEmitter : _Emitters) {
+    if (pEmitter->IsRunning())  pEmitter->WaitForExit();
+  }
+}
+
+
+/***************************************************
+* tEmitterList::RecordCycleStart
+*
+* Called by each emitter once per cycle.  When the last of them has
+* started the cycle, the spread of their start times goes into the
+* start skew.  A cycle that some emitter skipped, having woken too late
+* for it, is left out once newer cycles need its slot.
+*
+* INPUTS:
+*    nsTick  - the cycle's scheduled time
+*    nsStart - CLOCK_MONOTONIC time the emitter started sending it
+*/
+
+void tEmitterList::RecordCycleStart(int64_t nsTick, int64_t nsStart)
+{
+  std::lock_guard<std::mutex> Lock(_SkewMutex);
+  tCycleStarts *pCycle = nullptr;
+
+  for (auto & Cycle : _CycleStarts) {
+    if (Cycle.nsTick == nsTick) {
+      pCycle = &Cycle;
+      break;
+    }
+    // Else the free slot, or failing that, the oldest cycle
+    if (pCycle == nullptr || (pCycle->nsTick != 0 && Cycle.nsTick < pCycle->nsTick))  pCycle = &Cycle;
+  }
+
+  if (pCycle->nsTick != nsTick) {
+    pCycle->nsTick   = nsTick;
+    pCycle->nsFirst  = nsStart;
+    pCycle->nsLast   = nsStart;
+    pCycle->nStarted = 0;
+  }
+
+  pCycle->nsFirst = std::min(pCycle->nsFirst, nsStart);
+  pCycle->nsLast  = std::max(pCycle->nsLast,  nsStart);
+
+  if (++pCycle->nStarted == _Emitters.size()) {
+    _StartSkew.Record(pCycle->nsLast - pCycle->nsFirst);
+    pCycle->nsTick = 0;
+  }
+}
+
+
+/***************************************************
+* tEmitterList::PrintStatistics
+*
+* Per-emitter syscall counts and timing, then the spread across all of
+* them.  The start offsets show how closely the emitters manage to begin
+* each cycle together, and the start skew, by how much the first and last
+* of them differ in each cycle; the end offsets, when the last message of
+* the cycle has left.
+*/
+
+void tEmitterList::PrintStatistics()
+{
+  tLatencyHistogram StartOffset, EndOffset;
+
+  for (auto & pEmitter : _Emitters) {
+    pEmitter->PrintStatistics();
+    StartOffset.Add(pEmitter->Scheduler().Lateness());
+    EndOffset  .Add(pEmitter->EndOffset());
+  }
+
+  printf("All %zu emitters:\n", _Emitters.size());
+  StartOffset.Print(stdout, "  start offset from tick:");
+  _StartSkew .Print(stdout, "  start skew per cycle:  ");
+  EndOffset  .Print(stdout, "  end offset from tick:  ");
+}
+
+
+/***************************************************
+* tEmitterList::WriteResults
+*
+* Totals and the spread over all emitters, then each emitter's own
+*/
+
+void tEmitterList::WriteResults(tResultFile &Results)
+{
+  tLatencyHistogram StartOffset, EndOffset;
+  long              nSendFailures = 0;
+
+  for (auto & pEmitter : _Emitters) {
+    StartOffset.Add(pEmitter->Scheduler().Lateness());
+    EndOffset  .Add(pEmitter->EndOffset());
+    nSendFailures += pEmitter->Clients().NumSendFailures();
+  }
+
+  Results.Add("clients", (long) _nClients);
+  Results.Add("sent",    NumMessages());
+  Results.Add("send_failures", nSendFailures);
+  Results.AddHistogram("start_offset", StartOffset);
+  Results.AddHistogram("start_skew",   _StartSkew);
+  Results.AddHistogram("end_offset",   EndOffset);
+
+  Results.BeginArray("emitters");
+  for (auto & pEmitter : _Emitters)  pEmitter->WriteResults(Results);
+  Results.EndArray();
+}
+
+
+/***************************************************
+* tReplyReceiver constructor
+*
+* INPUTS:
+*    iPriority - RT priority, 0 for none
+* SIDE EFFECTS:
+*    Throws a tUdpConnectionException if the epoll set cannot be created
+*/
+
+tReplyReceiver::tReplyReceiver(int iPriority) :
+  tPThread(iPriority, false),
+  _nSockets(0),
+  _nReplies(0),
+  _nBadReplies(0)
+{
+  _fdEpoll = epoll_create1(0);
+  if (_fdEpoll < 0) {
+    throw tUdpConnectionException(std::string("epoll_create1: ") + strerror(errno));
+  }
+}
+
+
+/***************************************************
+* tReplyReceiver destructor
+*
+*/
+
+tReplyReceiver::~tReplyReceiver()
+{
+  if (_fdEpoll >= 0)  close(_fdEpoll);
+}
+
+
+/***************************************************
+* tReplyReceiver::AddSocket
+*
+* Adds a socket to listen on.  Must be called before Start().  The socket
+* is left in blocking mode for its sender; replies are read with
+* MSG_DONTWAIT instead.
+*/
+
+void tReplyReceiver::AddSocket(int sock)
+{
+  struct epoll_event Event;
+
+  Event.events  = EPOLLIN;
+  Event.data.fd = sock;
+  if (epoll_ctl(_fdEpoll, EPOLL_CTL_ADD, sock, &Event) < 0) {
+    throw tUdpConnectionException(std::string("epoll_ctl: ") + strerror(errno));
+  }
+  _nSockets++;
+}
+
+
+/***************************************************
+* tReplyReceiver::Start
+*
+* Starts the thread with SIGINT blocked, so that Ctrl-C goes to the
+* calling thread
+*/
+
+void tReplyReceiver::Start()
+{
+  sigset_t sigset, sigsetOld;
+
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &sigset, &sigsetOld);
+
+  StartThread();
+
+  pthread_sigmask(SIG_SETMASK, &sigsetOld, NULL);
+}
+
+
+/***************************************************
+* tReplyReceiver::_Thread
+*
+* Drains each socket epoll reports as readable, timing every reply
+*/
+
+void *tReplyReceiver::_Thread()
+{
+  struct epoll_event Events[REPLY_MAX_EVENTS];
+  ActTargetMsgV2     Reply;       // The larger layout, so either fits
+  int64_t            nsEcho;
+  ssize_t            len;
+  int                iClockId;
+  int                i, n;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    n = epoll_wait(_fdEpoll, Events, REPLY_MAX_EVENTS, REPLY_POLL_MS);
+
+    for (i=0; i<n; i++) {
+      while ((len = recv(Events[i].data.fd, &Reply, sizeof(Reply), MSG_DONTWAIT)) >= 0) {
+        if (!GetDataHdrTime((uint8_t *) &Reply, len, sizeof(ActTargetMsg), sizeof(ActTargetMsgV2), &nsEcho, &iClockId)) {
+          _nBadReplies.store(_nBadReplies.load(memory_order_relaxed) + 1, memory_order_relaxed);
+          continue;
+        }
+        _RoundTrip.Record(TimeTagNowNs(iClockId) - nsEcho);
+        _nReplies.store(_nReplies.load(memory_order_relaxed) + 1, memory_order_relaxed);
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+
+/***************************************************
+* tReplyReceiver::PrintStatistics
+*
+* INPUTS:
+*    nMessagesSent - messages the replies answer, to count those missing.
+*                    With replies per cycle, messages of incomplete cycles
+*                    are never answered.
+*/
+
+void tReplyReceiver::PrintStatistics(long nMessagesSent)
+{
+  long nReplies = NumReplies();
+
+  printf("Replies: %ld on %d sockets for %ld messages sent (%ld unanswered)",
+         nReplies, _nSockets, nMessagesSent, nMessagesSent - nReplies);
+  if (_nBadReplies.load(memory_order_relaxed) > 0)  printf(", %ld not ActTargetMsgs", _nBadReplies.load(memory_order_relaxed));
+  printf("\n");
+  _RoundTrip.Print(stdout, "Round trip time:");
+}
+
+
+/***************************************************
+* tReplyReceiver::WriteResults
+*
+* INPUTS:
+*    nMessagesSent - as for PrintStatistics()
+*/
+
+void tReplyReceiver::WriteResults(tResultFile &Results, long nMessagesSent)
+{
+  Results.BeginObject("replies");
+  Results.Add("sockets",    _nSockets);
+  Results.Add("received",   NumReplies());
+  Results.Add("unanswered", nMessagesSent - NumReplies());
+  Results.Add("bad",        _nBadReplies.load(memory_order_relaxed));
+  Results.AddHistogram("round_trip", _RoundTrip);
+  Results.EndObject();
+}
@@ -9,20 +9,42 @@
 
 #include <string>
 #include <list>
+#include <memory>
 #include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <sys/time.h>
+#include <vector>
 #include "PThread.h"
 #include "UdpConnection.h"
+#include "IoUring.h"
+#include "LatencyHistogram.h"
+#include "PeriodicScheduler.h"
+#include "ResultFile.h"
 
+class tCpuPlacement;
+class tEmitterList;
+#include "TimeTag.h"
+
+extern "C" {
+  #include "GlcMsg.h"
+  #include "GlcLscsIf.h"
+}
+
+
+// Where in each period a client's message is sent.  See tClientList::AssignPhaseOffsets().
+enum tPhaseMode { PHASE_NONE, PHASE_UNIFORM, PHASE_RANDOM, PHASE_SUBNET };
+
+// Seed for PHASE_RANDOM, fixed so that a run can be repeated with the same offsets
+#define PHASE_RANDOM_SEED  (1)
 
 
 class tClient {
 friend class tClientList;
 public:
-  tClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL);
+  tClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL,
+          bool bOwnSocket = true);
 
   tClient(tClient &&obj) noexcept;  // Move constructor - needed so that destruction of temporary does not close file.
   // tHostConnection& operator=(tHostConnection&& other); // Move assignment operator, will add if needed
@@ -33,30 +55,218 @@ public:
 
   ~tClient();
   
-  int SendMessage();
+  int  SendMessage();
+  bool PrepareSend(tIoUring &Ring);
+  void UseTimeTags(int iClockId);
 
 protected:
   //virtual void *_Thread();
+  void          _PrepareMessage();
+
   int           _iPortNum;
   tUdpClient    _UdpClient;
   bool          _bDebug;
   int           _nSent;
+  int           _iClockId;     // Time tag clock, or TIMETAG_V1 for the original header layout
+  size_t        _szMsg;        // Of the layout in use
+  union {                      // Kept here, not on the stack, so that an io_uring send can complete later
+    SegRtDataMsg   _SegMsg;
+    SegRtDataMsgV2 _SegMsgV2;
+  };
+  int64_t       _nsPhaseOffset; // Time after each tick that the message is sent
+  size_t        _iSendGroup;   // Index into tClientList::_SendGroups, with batched sends
 };
 
 
 
 class tClientList {
 public:
-  tClientList() : _bExit(false) {}
+  tClientList() : _bExit(false), _bBatched(false), _bSharedSocket(false), _sockShared(-1), _iClockId(TIMETAG_V1), 
+                  _nMessages(0), _nSyscalls(0) {}
+  ~tClientList();
   int AddClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL);
 
   bool IsEmpty() { return _ClientList.empty(); }
 
-  int EmitMessagesFromAll();
+  void UseIoUring();
+  void UseBatchedSends();
+  void UseSharedSocket();
+  void UseTimeTags(int iClockId);
+  int  EmitMessagesFromAll(int64_t nsTick = 0);
+  void SetPhaseOffsets(tPhaseMode Mode, int64_t nsPeriod);
+  void GetClients(std::vector<tClient *> &Clients);
+  void SortByPhase();
+  void GetReplySockets(std::vector<int> &Sockets);
+  long NumMessages() { return _nMessages; }
+  long NumSendFailures();
+  void PrintSyscallStatistics();
+  void PrintBurstStatistics();
+  void WriteResults(tResultFile &Results);
+
+  static void        AssignPhaseOffsets(std::vector<tClient *> &Clients, tPhaseMode Mode, int64_t nsPeriod);
+  static const char *PhaseModeName(tPhaseMode Mode);
 
 protected:
+  // Clients whose messages go out through the same socket, and so can share sendmmsg() calls
+  struct tSendGroup {
+    int                            sock;
+    std::vector<tClient *>         Clients;
+    std::unique_ptr<tUdpSendBatch> pBatch;
+  };
+
+  void _SubmitAndReapSends(unsigned nInFlight);
+  void _BuildSendGroups();
+  void _EmitRange(size_t iFirst, size_t iLast);
+  void _EmitBatched(size_t iFirst, size_t iLast);
+
   std::list<tClient> _ClientList;
   bool _bExit;
+  std::unique_ptr<tIoUring> _pRing;   // When set, sends are submitted in bulk through io_uring
+  bool _bBatched;                      // Send with sendmmsg(), one call per socket
+  bool _bSharedSocket;                 // All clients send through _sockShared, source address set per message
+  int  _sockShared;                    // Unbound socket shared by batched clients with no source address
+  int  _iClockId;                      // Given to each client; see TimeTag.h
+  std::vector<tSendGroup> _SendGroups;
+  std::vector<size_t> _TouchedGroups;  // Groups with messages waiting in their batch
+  std::vector<tClient *> _SendOrder;   // Clients in order of phase offset
+  long _nMessages;                     // Number of messages sent
+  long _nSyscalls;                     // Number of send system calls made
+  tLatencyHistogram _BurstDuration;    // Time spent sending each cycle, the waits for phase offsets left out
+};
+
+
+/****************************************************
+* tEmitterThread
+*
+* Sends the messages of a shard of the clients, every period, from a
+* thread of its own.  All of the emitters' schedulers share one first
+* tick, so that the shards transmit at as nearly the same moment as their
+* CPUs allow, the way independent LSCS boxes would.
+*/
+
+// How long after the emitters are started that their first cycle begins, so that all are waiting for it
+#define EMITTER_START_DELAY_MS  (50)
+
+// Cycles whose start skew across the emitters can be pending at once, waiting for a slow emitter
+#define EMITTER_SKEW_CYCLES     (8)
+
+class tEmitterThread : public tPThread {
+public:
+  tEmitterThread(tEmitterList *pList, int iThreadNum, int iPriority = 0, int iCpu = -1);
+
+  // Held by pointer, so neither copied nor moved
+  tEmitterThread(const tEmitterThread &) = delete;
+  tEmitterThread& operator=(const tEmitterThread &) = delete;
+
+  tClientList &Clients() { return _Clients; }
+  void SetSchedule(int64_t nsFirstTick, int64_t nsPeriod) { _Scheduler.Start(nsFirstTick, nsPeriod); }
+  void StopBefore(int64_t nsTick) { _nsStopTick.store(nsTick, std::memory_order_relaxed); }
+  std::string ActualCpus() const;
+  void PrintStatistics();
+  void WriteResults(tResultFile &Results);
+
+  const tPeriodicScheduler &Scheduler() const { return _Scheduler; }
+  const tLatencyHistogram  &EndOffset() const { return _EndOffset; }
+
+protected:
+  virtual void *_Thread();
+
+  tEmitterList     *_pList;        // That the thread belongs to, which measures the start skew
+  int               _iThreadNum;
+  tClientList       _Clients;
+  tPeriodicScheduler   _Scheduler;   // Its lateness is each cycle's start offset from the shared tick
+  std::atomic<int64_t> _nsStopTick;  // No cycle scheduled at or after this time is sent
+  tLatencyHistogram    _EndOffset;   // Each cycle's last send returning, less the cycle's scheduled time
+};
+
+
+/****************************************************
+* tEmitterList
+*
+* Deals clients out round-robin to a set of tEmitterThreads and runs them
+*/
+
+class tEmitterList {
+public:
+  tEmitterList(int nThreads, int iPriority = 0, int iFirstCpu = -1);
+  int AddClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL);
+
+  void UseIoUring();
+  void UseBatchedSends();
+  void UseSharedSocket();
+  void UseTimeTags(int iClockId);
+  void SetPhaseOffsets(tPhaseMode Mode, int64_t nsPeriod);
+  void GetReplySockets(std::vector<int> &Sockets);
+  long NumMessages();
+
+  void SetPlacement(const tCpuPlacement &Placement);
+  void StartThreads(int64_t nsPeriod);
+  void StopThreads();
+  void PrintStatistics();
+  void WriteResults(tResultFile &Results);
+
+  void RecordCycleStart(int64_t nsTick, int64_t nsStart);
+
+protected:
+  // The starts of one cycle by the emitters that have reached it so far
+  struct tCycleStarts {
+    int64_t nsTick;                    // 0 if the slot is free
+    int64_t nsFirst;
+    int64_t nsLast;
+    size_t  nStarted;
+  };
+
+  std::vector<std::unique_ptr<tEmitterThread>> _Emitters;
+  int     _nClients;
+  int64_t _nsPeriod;
+  std::mutex        _SkewMutex;        // Guards _CycleStarts
+  tCycleStarts      _CycleStarts[EMITTER_SKEW_CYCLES];
+  tLatencyHistogram _StartSkew;        // Each cycle's last emitter start less its first
+};
+
+
+
+/****************************************************
+* tReplyReceiver
+*
+* Receives the ActTargetMsg replies that rtc_udp -R sends back, on the
+* sockets the clients send from, and times each round trip.  A reply
+* echoes the send time tag of the message it answers, so the round trip
+* is measured on this host's clock alone.  One thread multiplexes all of
+* the sockets with epoll.
+*/
+
+// How often the receive thread looks at its exit flag when no replies arrive
+#define REPLY_POLL_MS       (100)
+#define REPLY_MAX_EVENTS    (64)
+
+// How long to keep listening once sending has stopped, for the last replies
+#define REPLY_DRAIN_MS      (100)
+
+class tReplyReceiver : public tPThread {
+public:
+  tReplyReceiver(int iPriority = 0);
+  ~tReplyReceiver();
+
+  // Held by pointer, so neither copied nor moved
+  tReplyReceiver(const tReplyReceiver &) = delete;
+  tReplyReceiver& operator=(const tReplyReceiver &) = delete;
+
+  void AddSocket(int sock);
+  void Start();
+
+  long NumReplies()  { return _nReplies.load(std::memory_order_relaxed); }
+  void PrintStatistics(long nMessagesSent);
+  void WriteResults(tResultFile &Results, long nMessagesSent);
+
+protected:
+  virtual void *_Thread();
+
+  int               _fdEpoll;
+  int               _nSockets;
+  std::atomic<long> _nReplies;
+  std::atomic<long> _nBadReplies;   // Neither ActTargetMsg layout
+  tLatencyHistogram _RoundTrip;
 };
 
 
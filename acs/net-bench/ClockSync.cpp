@@ -0,0 +1,381 @@
+/* tClockSync - Estimates a peer host's clock offset, for one-way latency
+*
+* See ClockSync.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "ClockSync.h"
+#include "TimeTag.h"
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+
+/*******************************************************
+* NowNs
+*
+* Full resolution time on a clock id's clock.  Unlike TimeTagNowNs(),
+* not truncated for TIMETAG_V1, which matters for the exchange.
+*/
+
+static int64_t NowNs(int iClockId)
+{
+  struct timespec tmNow;
+
+  clock_gettime(TimeTagClock(iClockId), &tmNow);
+  return (int64_t) tmNow.tv_sec * 1000000000LL + tmNow.tv_nsec;
+}
+
+
+/*******************************************************
+* tClockSyncResponder constructor
+*
+* INPUTS:
+*   iPortNum - port to answer on
+*   iClockId - clock to stamp t2 and t3 from; the same as the messages'
+*/
+
+tClockSyncResponder::tClockSyncResponder(int iPortNum, int iClockId) :
+  tPThread(0, true),   // Blocks in recvfrom(), so is cancelled to stop it
+  _UdpServer(iPortNum),
+  _iClockId(iClockId),
+  _nAnswered(0)
+{
+}
+
+
+/*******************************************************
+* tClockSyncResponder::Start
+*
+* Starts the thread with SIGINT blocked, so that Ctrl-C goes to the
+* calling thread
+*/
+
+void tClockSyncResponder::Start()
+{
+  sigset_t sigset, sigsetOld;
+
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &sigset, &sigsetOld);
+
+  StartThread();
+
+  pthread_sigmask(SIG_SETMASK, &sigsetOld, NULL);
+}
+
+
+/*******************************************************
+* tClockSyncResponder::_Thread
+*
+* Stamps each request as close to its arrival and its reply as possible
+*/
+
+void *tClockSyncResponder::_Thread()
+{
+  tClockSyncMsg      Msg;
+  struct sockaddr_in PeerAddress;
+  ssize_t            len;
+  int64_t            nsT2;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    len  = _UdpServer.ReceiveMessage(&Msg, sizeof(Msg), &PeerAddress);
+    nsT2 = NowNs(_iClockId);
+
+    if (len != sizeof(Msg) || Msg.uMagic != CLOCK_SYNC_MAGIC)  continue;
+
+    Msg.nsT2 = nsT2;
+    Msg.nsT3 = NowNs(_iClockId);
+    if (_UdpServer.SendMessage(&Msg, sizeof(Msg), PeerAddress)) {
+      _nAnswered.store(_nAnswered.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+  }
+
+  return nullptr;
+}
+
+
+/*******************************************************
+* tClockSync constructor
+*
+* INPUTS:
+*   sPeerIpAddressString - host running the tClockSyncResponder
+*   iPortNum             - its port
+*   iClockId             - local clock to compare with the peer's
+*/
+
+tClockSync::tClockSync(const string &sPeerIpAddressString, int iPortNum, int iClockId) :
+  tPThread(0, false),
+  _sPeer(sPeerIpAddressString),
+  _iPortNum(iPortNum),
+  _iClockId(iClockId),
+  _UdpClient(sPeerIpAddressString, iPortNum),
+  _nWindow(0),
+  _iNext(0),
+  _uSeq(0),
+  _nsRef(0),
+  _nsOffset(0),
+  _nDriftPpt(0),
+  _nsBound(0),
+  _nsMinDelay(0),
+  _nExchanges(0),
+  _nTimeouts(0)
+{
+}
+
+
+/*******************************************************
+* tClockSync::ToPeerClock
+*
+* Translates a time on the local clock onto the peer's.  Safe to call
+* from any thread.
+*
+* RETURNS:
+*   The time on the peer's clock, or nsLocal unchanged if there is no
+*   estimate yet
+*/
+
+int64_t tClockSync::ToPeerClock(int64_t nsLocal) const
+{
+  uint32_t uSeq;
+  int64_t  nsRef, nsOffset, nDriftPpt;
+
+  do {
+    uSeq      = _uSeq    .load(memory_order_acquire);
+    nsRef     = _nsRef   .load(memory_order_relaxed);
+    nsOffset  = _nsOffset.load(memory_order_relaxed);
+    nDriftPpt = _nDriftPpt.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while ((uSeq & 1) || uSeq != _uSeq.load(memory_order_relaxed));
+
+  if (uSeq == 0)  return nsLocal;
+
+  return nsLocal + nsOffset + (int64_t) ((double) (nsLocal - nsRef) * nDriftPpt / 1e12);
+}
+
+
+/*******************************************************
+* tClockSync::_Thread
+*
+* One exchange every period, the filter rerun after each that succeeds
+*/
+
+void *tClockSync::_Thread()
+{
+  struct timespec tmSleep;
+  tExchange       Exchange;
+  uint32_t        uSeq = 0;
+
+  tmSleep.tv_sec  = 0;
+  tmSleep.tv_nsec = CLOCK_SYNC_PERIOD_MS * 1000000L;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    if (_Exchange(++uSeq, Exchange)) {
+      _Window[_iNext] = Exchange;
+      _iNext = (_iNext + 1) % CLOCK_SYNC_WINDOW;
+      if (_nWindow < CLOCK_SYNC_WINDOW)  _nWindow++;
+
+      _Delay.Record(Exchange.nsDelay);
+      _nExchanges.store(_nExchanges.load(memory_order_relaxed) + 1, memory_order_relaxed);
+      _Update();
+    }
+    else {
+      _nTimeouts.store(_nTimeouts.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    nanosleep(&tmSleep, NULL);
+  }
+
+  return nullptr;
+}
+
+
+/*******************************************************
+* tClockSync::_Exchange
+*
+* Sends one request and waits for its reply.  Replies to earlier requests
+* that arrive late are skipped.  A request that cannot be sent, or a
+* receive that fails, such as when the peer is not listening, counts as
+* a lost exchange; the next one may fare better.
+*
+* INPUTS:
+*   uSeq - identifies the request
+* OUTPUTS:
+*   Exchange - the exchange's offset and delay
+* RETURNS:
+*   false if no reply came within CLOCK_SYNC_TIMEOUT_MS, or the exchange failed
+*/
+
+bool tClockSync::_Exchange(uint32_t uSeq, tExchange &Exchange)
+{
+  tClockSyncMsg Msg;
+  struct pollfd Poll;
+  int64_t       nsT1, nsT4, nsDeadline;
+  ssize_t       len;
+
+  bzero((char *) &Msg, sizeof(Msg));
+  Msg.uMagic = CLOCK_SYNC_MAGIC;
+  Msg.uSeq   = uSeq;
+
+  nsT1       = NowNs(_iClockId);
+  Msg.nsT1   = nsT1;
+  try {
+    _UdpClient.SendMessage((uint8_t *) &Msg, sizeof(Msg));
+  }
+  catch (const tUdpConnectionException &) {
+    return false;
+  }
+  nsDeadline = nsT1 + CLOCK_SYNC_TIMEOUT_MS * 1000000LL;
+
+  Poll.fd     = _UdpClient.GetSocket();
+  Poll.events = POLLIN;
+
+  for (;;) {
+    len = recv(Poll.fd, &Msg, sizeof(Msg), MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)  return false;
+      nsT4 = NowNs(_iClockId);
+      if (nsT4 >= nsDeadline)  return false;
+      poll(&Poll, 1, (int) ((nsDeadline - nsT4 + 999999) / 1000000));
+      continue;
+    }
+
+    nsT4 = NowNs(_iClockId);
+    if (len == sizeof(Msg) && Msg.uMagic == CLOCK_SYNC_MAGIC && Msg.uSeq == uSeq && Msg.nsT1 == nsT1)  break;
+  }
+
+  Exchange.nsLocal  = nsT1 + (nsT4 - nsT1) / 2;
+  Exchange.nsOffset = ((Msg.nsT2 - nsT1) + (Msg.nsT3 - nsT4)) / 2;
+  Exchange.nsDelay  = (nsT4 - nsT1) - (Msg.nsT3 - Msg.nsT2);
+
+  return true;
+}
+
+
+/*******************************************************
+* tClockSync::_Update
+*
+* Refits the offset and drift to the least-delayed exchanges in the
+* window, and publishes them
+*/
+
+void tClockSync::_Update()
+{
+  tExchange Kept[CLOCK_SYNC_WINDOW];
+  int       nKept, i;
+  int64_t   nsRef;
+  double    fSpan, fX, fY, fMeanX = 0, fMeanY = 0, fSxx = 0, fSxy = 0, fResidual = 0;
+  double    fDrift = 0;        // ns per s
+  double    fOffset;
+  uint32_t  uSeq;
+
+  copy(_Window, _Window + _nWindow, Kept);
+  sort(Kept, Kept + _nWindow, [](const tExchange &A, const tExchange &B) { return A.nsDelay < B.nsDelay; });
+
+  nKept = max(min(_nWindow, 4), (int) (_nWindow * CLOCK_SYNC_KEEP_FRACTION));
+
+  // Fit about the newest exchange, so the offset published is the current one
+  nsRef = _Window[(_iNext + CLOCK_SYNC_WINDOW - 1) % CLOCK_SYNC_WINDOW].nsLocal;
+
+  for (i=0; i<nKept; i++) {
+    fMeanX += (Kept[i].nsLocal - nsRef) / 1e9;
+    fMeanY += Kept[i].nsOffset;
+  }
+  fMeanX /= nKept;
+  fMeanY /= nKept;
+
+  for (i=0; i<nKept; i++) {
+    fX    = (Kept[i].nsLocal - nsRef) / 1e9 - fMeanX;
+    fY    = Kept[i].nsOffset - fMeanY;
+    fSxx += fX * fX;
+    fSxy += fX * fY;
+  }
+
+  fSpan = (Kept[0].nsLocal - nsRef) / 1e9;
+  for (i=1; i<nKept; i++)  fSpan = min(fSpan, (Kept[i].nsLocal - nsRef) / 1e9);
+  fSpan = -fSpan;  // nsRef is the newest, so the oldest kept is furthest behind it
+
+  if (nKept >= 3 && fSpan * 1000 >= CLOCK_SYNC_MIN_SPAN_MS && fSxx > 0)  fDrift = fSxy / fSxx;
+  fOffset = fMeanY - fDrift * fMeanX;
+
+  for (i=0; i<nKept; i++) {
+    fY         = Kept[i].nsOffset - (fOffset + fDrift * (Kept[i].nsLocal - nsRef) / 1e9);
+    fResidual += fY * fY;
+  }
+  fResidual = sqrt(fResidual / nKept);
+
+  // Publish under the sequence lock
+  uSeq = _uSeq.load(memory_order_relaxed);
+  _uSeq.store(uSeq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  _nsRef     .store(nsRef, memory_order_relaxed);
+  _nsOffset  .store((int64_t) fOffset, memory_order_relaxed);
+  _nDriftPpt .store((int64_t) (fDrift * 1000), memory_order_relaxed);
+  _nsBound   .store(Kept[0].nsDelay / 2 + (int64_t) (2 * fResidual), memory_order_relaxed);
+  _nsMinDelay.store(Kept[0].nsDelay, memory_order_relaxed);
+
+  _uSeq.store(uSeq + 2, memory_order_release);
+}
+
+
+/*******************************************************
+* tClockSync::PrintSummary
+*
+* The current estimate and its bound, on one line
+*/
+
+void tClockSync::PrintSummary(FILE *pFile) const
+{
+  fprintf(pFile, "  clock sync with %s:%d (%s): ", _sPeer.c_str(), _iPortNum,
+          TimeTagClockName((_iClockId == TIMETAG_V1) ? TIME_CLOCK_REALTIME : _iClockId));
+
+  if (!IsValid()) {
+    fprintf(pFile, "no estimate yet, %ld timeouts; latencies not recorded\n", _nTimeouts.load(memory_order_relaxed));
+    return;
+  }
+
+  fprintf(pFile, "offset %+.1f +/- %.1f us, drift %+.3f ppm, min delay %.1f us, %ld exchanges, %ld timeouts\n",
+          _nsOffset.load(memory_order_relaxed) / 1e3, _nsBound.load(memory_order_relaxed) / 1e3,
+          _nDriftPpt.load(memory_order_relaxed) / 1e6, _nsMinDelay.load(memory_order_relaxed) / 1e3,
+          _nExchanges.load(memory_order_relaxed), _nTimeouts.load(memory_order_relaxed));
+}
+
+
+/*******************************************************
+* tClockSync::WriteResults
+*
+* The estimate as PrintSummary() gives it, and the delay of every exchange
+*/
+
+void tClockSync::WriteResults(tResultFile &Results) const
+{
+  Results.BeginObject("clock_sync");
+  Results.Add("peer",      _sPeer);
+  Results.Add("port",      _iPortNum);
+  Results.Add("valid",     IsValid());
+  Results.Add("offset_ns", _nsOffset.load(memory_order_relaxed));
+  Results.Add("bound_ns",  _nsBound.load(memory_order_relaxed));
+  Results.Add("drift_ppm", _nDriftPpt.load(memory_order_relaxed) / 1e6);
+  Results.Add("exchanges", _nExchanges.load(memory_order_relaxed));
+  Results.Add("timeouts",  _nTimeouts.load(memory_order_relaxed));
+  Results.AddHistogram("delay", _Delay);
+  Results.EndObject();
+}
@@ -0,0 +1,163 @@
+/* tClockSync - Estimates a peer host's clock offset, for one-way latency
+*
+* A one-way latency is a receive time on one host less a send time on
+* another, so any offset between the two clocks goes straight into it.
+* tClockSync measures that offset with an NTP-style exchange of four
+* timestamps over a side socket, and translates local times onto the
+* peer's clock.
+*
+* Every CLOCK_SYNC_PERIOD_MS the local host sends a request at t1; the
+* peer's tClockSyncResponder stamps its arrival t2 and its reply t3; the
+* reply arrives back at t4.  Each exchange gives
+*
+*   offset = ((t2 - t1) + (t3 - t4)) / 2     peer clock less local clock
+*   delay  =  (t4 - t1) - (t3 - t2)          round trip on the wire
+*
+* An exchange's offset is exact if the two legs took equal time, and off
+* by at most delay / 2 if they did not.  Queueing makes the legs unequal,
+* so the filter trusts the exchanges that met the least of it: of the last
+* CLOCK_SYNC_WINDOW, it keeps the CLOCK_SYNC_KEEP_FRACTION with the
+* smallest delay and fits a line through their offsets by least squares,
+* giving the offset now and the drift between the clocks.
+*
+* The confidence bound reported is half the smallest delay kept, which is
+* the most that path asymmetry can hide, plus twice the RMS scatter of the
+* kept offsets about the fitted line.
+*
+* The estimate is published with a sequence lock, so the receive threads
+* read it without locks or system calls.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TCLOCKSYNC_H_
+#define TCLOCKSYNC_H_
+
+#include <atomic>
+#include <string>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include "PThread.h"
+#include "UdpConnection.h"
+#include "LatencyHistogram.h"
+#include "ResultFile.h"
+#include "UdpPorts.h"
+
+// Time between exchanges
+#define CLOCK_SYNC_PERIOD_MS      (100)
+
+// How long to wait for a reply before counting the exchange lost
+#define CLOCK_SYNC_TIMEOUT_MS     (50)
+
+// Exchanges the filter looks at: 6.4 s at the default period
+#define CLOCK_SYNC_WINDOW         (64)
+
+// Share of the window, by least delay, that the offset and drift are fitted to
+#define CLOCK_SYNC_KEEP_FRACTION  (0.25)
+
+// Drift is only fitted once the exchanges kept span this long; until then it is taken as zero
+#define CLOCK_SYNC_MIN_SPAN_MS    (1000)
+
+#define CLOCK_SYNC_MAGIC          (0x434C4B53)   // "CLKS"
+
+
+// The exchange, in both directions.  The requester fills in t1; the responder, t2 and t3.
+struct tClockSyncMsg {
+  uint32_t uMagic;
+  uint32_t uSeq;
+  int64_t  nsT1;
+  int64_t  nsT2;
+  int64_t  nsT3;
+} __attribute__((packed));
+
+
+/****************************************************
+* tClockSyncResponder
+*
+* The peer's half: answers requests on a port of its own
+*/
+
+class tClockSyncResponder : public tPThread {
+public:
+  tClockSyncResponder(int iPortNum, int iClockId);
+
+  // Held by pointer, so neither copied nor moved
+  tClockSyncResponder(const tClockSyncResponder &) = delete;
+  tClockSyncResponder& operator=(const tClockSyncResponder &) = delete;
+
+  void Start();
+  long NumAnswered() { return _nAnswered.load(std::memory_order_relaxed); }
+
+protected:
+  virtual void *_Thread();
+
+  tUdpServer        _UdpServer;
+  int               _iClockId;
+  std::atomic<long> _nAnswered;
+};
+
+
+/****************************************************
+* tClockSync
+*
+* The local half: runs the exchanges and the filter
+*/
+
+class tClockSync : public tPThread {
+public:
+  tClockSync(const std::string &sPeerIpAddressString, int iPortNum, int iClockId);
+
+  // Held by pointer, so neither copied nor moved
+  tClockSync(const tClockSync &) = delete;
+  tClockSync& operator=(const tClockSync &) = delete;
+
+  bool    IsValid() const { return _uSeq.load(std::memory_order_acquire) != 0; }
+  int64_t ToPeerClock(int64_t nsLocal) const;
+
+  void PrintSummary(FILE *pFile) const;
+  void WriteResults(tResultFile &Results) const;
+
+protected:
+  struct tExchange {
+    int64_t nsLocal;    // Midpoint of t1 and t4
+    int64_t nsOffset;
+    int64_t nsDelay;
+  };
+
+  virtual void *_Thread();
+  bool          _Exchange(uint32_t uSeq, tExchange &Exchange);
+  void          _Update();
+
+  std::string      _sPeer;
+  int              _iPortNum;
+  int              _iClockId;
+  tUdpClient       _UdpClient;
+
+  // Written by the sync thread only
+  tExchange        _Window[CLOCK_SYNC_WINDOW];
+  int              _nWindow;
+  int              _iNext;
+  tLatencyHistogram _Delay;         // Round trip of every exchange
+
+  // The published estimate.  _uSeq is odd while it is being written, and 0 until the first.
+  std::atomic<uint32_t> _uSeq;
+  std::atomic<int64_t>  _nsRef;     // Local time the fit is taken about
+  std::atomic<int64_t>  _nsOffset;  // Offset at _nsRef
+  std::atomic<int64_t>  _nDriftPpt; // Drift, in parts per trillion
+  std::atomic<int64_t>  _nsBound;   // Confidence bound on the offset
+  std::atomic<int64_t>  _nsMinDelay;
+  std::atomic<long>     _nExchanges;
+  std::atomic<long>     _nTimeouts;
+};
+
+
+#endif /* TCLOCKSYNC_H_ */
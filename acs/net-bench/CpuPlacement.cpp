@@ -0,0 +1,307 @@
+/* tCpuPlacement - Which CPUs a program's threads run on
+*
+* See CpuPlacement.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "CpuPlacement.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+
+/*******************************************************
+* ReadFirstLine
+*
+* RETURNS:
+*   The first line of a (sysfs or procfs) file, or "" if it cannot be read
+*/
+
+static string ReadFirstLine(const string &sPath)
+{
+  ifstream File(sPath);
+  string   sLine;
+
+  getline(File, sLine);
+  return sLine;
+}
+
+
+/*******************************************************
+* tCpuPlacement constructor
+*
+* INPUTS:
+*   sSpec - the placement, as described in CpuPlacement.h
+* SIDE EFFECTS:
+*   Throws a std::runtime_error if the spec is not understood, or names
+*   no CPUs
+*/
+
+tCpuPlacement::tCpuPlacement(const string &sSpec) :
+  _sSpec(sSpec),
+  _Policy(PLACE_NONE)
+{
+  size_t iColon = sSpec.find(':');
+  string sPolicy = sSpec.substr(0, iColon);
+  string sArg    = (iColon == string::npos) ? "" : sSpec.substr(iColon + 1);
+
+  if (sPolicy == "rr" || sPolicy == "set" || sPolicy == "core") {
+    if (!ParseCpuList(sArg, _Cpus) || (sPolicy == "core" && _Cpus.size() != 1)) {
+      throw std::runtime_error("Invalid CPU list in placement " + sSpec);
+    }
+    _Policy = (sPolicy == "rr") ? PLACE_ROUND_ROBIN : PLACE_SHARED;
+  }
+  else if (sPolicy == "isolated" && sArg.empty()) {
+    ParseCpuList(ReadFirstLine("/sys/devices/system/cpu/isolated"), _Cpus);
+    _Policy  = PLACE_ROUND_ROBIN;
+    _sSource = "isolated CPUs";
+  }
+  else if (sPolicy == "irq" && !sArg.empty()) {
+    _ReadIrqCpus(sArg);
+    _Policy = PLACE_ROUND_ROBIN;
+  }
+  else {
+    throw std::runtime_error("Unknown placement " + sSpec + "; use rr:LIST, set:LIST, core:N, isolated or irq:IFACE");
+  }
+
+  if (_Cpus.empty()) {
+    throw std::runtime_error("Placement " + sSpec + " names no CPUs");
+  }
+}
+
+
+/*******************************************************
+* tCpuPlacement::_ReadIrqCpus
+*
+* Collects the CPUs that an interface's MSI interrupts are delivered to.
+* Each interrupt's effective affinity is what the kernel actually uses;
+* older kernels only have the requested one.
+*
+* INPUTS:
+*   sInterface - network interface name, e.g. eth0
+*/
+
+void tCpuPlacement::_ReadIrqCpus(const string &sInterface)
+{
+  string         sDevice = "/sys/class/net/" + sInterface + "/device/";
+  DIR           *pDir;
+  struct dirent *pEntry;
+  vector<int>    IrqCpus;
+  string         sList;
+
+  pDir = opendir((sDevice + "msi_irqs").c_str());
+  if (pDir != NULL) {
+    while ((pEntry = readdir(pDir)) != NULL) {
+      if (pEntry->d_name[0] == '.')  continue;
+
+      sList = ReadFirstLine(string("/proc/irq/") + pEntry->d_name + "/effective_affinity_list");
+      if (sList.empty())  sList = ReadFirstLine(string("/proc/irq/") + pEntry->d_name + "/smp_affinity_list");
+      if (ParseCpuList(sList, IrqCpus))  _Cpus.insert(_Cpus.end(), IrqCpus.begin(), IrqCpus.end());
+    }
+    closedir(pDir);
+  }
+
+  sort(_Cpus.begin(), _Cpus.end());
+  _Cpus.erase(unique(_Cpus.begin(), _Cpus.end()), _Cpus.end());
+  _sSource = "CPUs of " + sInterface + "'s interrupts";
+
+  // Virtual devices have no interrupts of their own; use the NIC's NUMA node, if anything
+  if (_Cpus.empty()) {
+    ParseCpuList(ReadFirstLine(sDevice + "local_cpulist"), _Cpus);
+    _sSource = "CPUs local to " + sInterface;
+  }
+}
+
+
+/*******************************************************
+* tCpuPlacement::Describe
+*
+* RETURNS:
+*   The policy and the CPUs it came to, for printing
+*/
+
+string tCpuPlacement::Describe() const
+{
+  cpu_set_t CpuSet;
+  string    sDescription;
+
+  if (!IsSet())  return "none";
+
+  CPU_ZERO(&CpuSet);
+  for (int iCpu : _Cpus)  CPU_SET(iCpu, &CpuSet);
+
+  sDescription  = (_Policy == PLACE_ROUND_ROBIN) ? "one thread per CPU, round robin over " : "all threads sharing ";
+  sDescription += FormatCpuList(CpuSet);
+  if (!_sSource.empty())  sDescription += " (" + _sSource + ")";
+
+  return sDescription;
+}
+
+
+/*******************************************************
+* tCpuPlacement::GetCpuSet
+*
+* INPUTS:
+*   iThread - index of the thread among those being placed
+* OUTPUTS:
+*   *pCpuSet - the CPUs that thread should run on; empty if no placement
+*/
+
+void tCpuPlacement::GetCpuSet(int iThread, cpu_set_t *pCpuSet) const
+{
+  CPU_ZERO(pCpuSet);
+
+  if (_Policy == PLACE_ROUND_ROBIN) {
+    CPU_SET(_Cpus[iThread % _Cpus.size()], pCpuSet);
+  }
+  else if (_Policy == PLACE_SHARED) {
+    for (int iCpu : _Cpus)  CPU_SET(iCpu, pCpuSet);
+  }
+}
+
+
+/*******************************************************
+* tCpuPlacement::Place
+*
+* Sets a thread's affinity.  Must be called before the thread is started.
+*/
+
+void tCpuPlacement::Place(tPThread &Thread, int iThread) const
+{
+  cpu_set_t CpuSet;
+
+  if (!IsSet())  return;
+
+  GetCpuSet(iThread, &CpuSet);
+  Thread.SetCpuAffinity(CpuSet);
+}
+
+
+/*******************************************************
+* tCpuPlacement::PlaceCallingThread
+*
+* For a loop that runs in the main thread rather than a tPThread
+*
+* RETURNS:
+*   false if the kernel refused
+*/
+
+bool tCpuPlacement::PlaceCallingThread(int iThread) const
+{
+  cpu_set_t CpuSet;
+
+  if (!IsSet())  return true;
+
+  GetCpuSet(iThread, &CpuSet);
+  return (pthread_setaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet) == 0);
+}
+
+
+/*******************************************************
+* tCpuPlacement::PrintActual
+*
+* Reports where a set of running threads may actually run, as the number
+* of threads with each distinct affinity
+*/
+
+void tCpuPlacement::PrintActual(FILE *pFile, const char *sLabel, const vector<const tPThread *> &Threads)
+{
+  map<string, int> Counts;
+  cpu_set_t        CpuSet;
+
+  for (auto pThread : Threads) {
+    if (pThread->GetActualCpuAffinity(&CpuSet))  Counts[FormatCpuList(CpuSet)]++;
+  }
+
+  fprintf(pFile, "%s", sLabel);
+  for (auto & Count : Counts) {
+    fprintf(pFile, " [%s] %d", Count.first.c_str(), Count.second);
+  }
+  fprintf(pFile, "\n");
+}
+
+
+/*******************************************************
+* tCpuPlacement::ParseCpuList
+*
+* Reads a CPU list in the kernel's format: comma separated CPUs and
+* ranges, e.g. 0-3,8,10-11
+*
+* OUTPUTS:
+*   Cpus - the CPUs, in the order listed
+* RETURNS:
+*   false if the list is empty or malformed
+*/
+
+bool tCpuPlacement::ParseCpuList(const string &sList, vector<int> &Cpus)
+{
+  const char *s = sList.c_str();
+  char       *pEnd;
+  long        iFirst, iLast;
+
+  Cpus.clear();
+
+  while (*s != '\0' && *s != '\n') {
+    iFirst = strtol(s, &pEnd, 10);
+    if (pEnd == s || iFirst < 0)  return false;
+
+    iLast = iFirst;
+    s = pEnd;
+    if (*s == '-') {
+      iLast = strtol(s + 1, &pEnd, 10);
+      if (pEnd == s + 1 || iLast < iFirst)  return false;
+      s = pEnd;
+    }
+    if (iLast >= CPU_SETSIZE)  return false;
+
+    for (long iCpu=iFirst; iCpu<=iLast; iCpu++)  Cpus.push_back((int) iCpu);
+
+    if (*s == ',')  s++;
+    else if (*s != '\0' && *s != '\n')  return false;
+  }
+
+  return !Cpus.empty();
+}
+
+
+/*******************************************************
+* tCpuPlacement::FormatCpuList
+*
+* RETURNS:
+*   A CPU set in the kernel's list format, with runs as ranges
+*/
+
+string tCpuPlacement::FormatCpuList(const cpu_set_t &CpuSet)
+{
+  string sList;
+  int    iCpu, iLast;
+
+  for (iCpu=0; iCpu<CPU_SETSIZE; iCpu++) {
+    if (!CPU_ISSET(iCpu, &CpuSet))  continue;
+
+    for (iLast=iCpu; iLast+1<CPU_SETSIZE && CPU_ISSET(iLast+1, &CpuSet); iLast++) {
+    }
+
+    if (!sList.empty())  sList += ",";
+    sList += to_string(iCpu);
+    if (iLast > iCpu)  sList += "-" + to_string(iLast);
+    iCpu = iLast;
+  }
+
+  return sList;
+}
@@ -0,0 +1,72 @@
+/* tCpuPlacement - Which CPUs a program's threads run on
+*
+* Left to itself the scheduler moves threads between CPUs freely, which
+* with hundreds of receive threads costs cache misses and adds jitter.  A
+* placement names the CPUs to use and how to share them out, and is
+* applied to each thread, by its index, before it is started:
+*
+*   rr:LIST     Round robin: thread i is pinned to the i'th CPU of LIST,
+*               wrapping around.  LIST is as in cpuset(7), e.g. 2-5,8.
+*   set:LIST    Every thread may run on any CPU of LIST.
+*   core:N      Every thread on CPU N alone, e.g. one isolated core.
+*   isolated    Round robin over the CPUs the kernel was told to isolate
+*               (isolcpus=), from /sys/devices/system/cpu/isolated.
+*   irq:IFACE   Round robin over the CPUs that network interface IFACE's
+*               interrupts are steered to, so that each message is
+*               handled on a CPU whose cache the kernel has just filled.
+*               Falls back to the CPUs local to the NIC's NUMA node.
+*
+* The kernel can narrow a request (cpusets, offline CPUs), so what took
+* effect is read back from the running threads and reported.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TCPUPLACEMENT_H_
+#define TCPUPLACEMENT_H_
+
+#include <sched.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "PThread.h"
+
+
+class tCpuPlacement {
+public:
+  tCpuPlacement() : _Policy(PLACE_NONE) { }
+  tCpuPlacement(const std::string &sSpec);
+
+  bool               IsSet() const       { return _Policy != PLACE_NONE; }
+  const std::string &Spec() const        { return _sSpec; }
+  std::string        Describe() const;
+
+  void GetCpuSet(int iThread, cpu_set_t *pCpuSet) const;
+  void Place(tPThread &Thread, int iThread) const;
+  bool PlaceCallingThread(int iThread) const;
+
+  static void        PrintActual(FILE *pFile, const char *sLabel, const std::vector<const tPThread *> &Threads);
+  static bool        ParseCpuList(const std::string &sList, std::vector<int> &Cpus);
+  static std::string FormatCpuList(const cpu_set_t &CpuSet);
+
+protected:
+  enum tPolicy { PLACE_NONE, PLACE_ROUND_ROBIN, PLACE_SHARED };
+
+  void _ReadIrqCpus(const std::string &sInterface);
+
+  std::string      _sSpec;
+  tPolicy          _Policy;
+  std::vector<int> _Cpus;
+  std::string      _sSource;   // Where the CPUs came from, for Describe()
+};
+
+
+#endif /* TCPUPLACEMENT_H_ */
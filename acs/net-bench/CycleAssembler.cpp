@@ -0,0 +1,441 @@
+/* tCycleAssembler - Gathers each control cycle's segment messages into a frame
+*
+* See CycleAssembler.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "CycleAssembler.h"
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+
+/*******************************************************
+* tCycleAssembler constructor
+*
+* INPUTS:
+*   nSegments - segments expected in every cycle, numbered 0 to nSegments-1
+*   nsPeriod  - cycle period of the senders
+*   iPriority - RT priority of the sweeper thread, 0 for none
+*/
+
+tCycleAssembler::tCycleAssembler(int nSegments, int64_t nsPeriod, int iPriority) :
+  tPThread(iPriority, false),
+  _nSegments(nSegments),
+  _nWords((nSegments + 63) / 64),
+  _nsPeriod(nsPeriod),
+  _pSlots(new tSlot[CYCLE_NUM_SLOTS]),
+  _uNewest(0),
+  _nLate(0),
+  _nStale(0),
+  _nMistimed(0),
+  _nOverrun(0),
+  _nDuplicates(0),
+  _nBadSegment(0),
+  _nComplete(0),
+  _nIncomplete(0),
+  _nUntimed(0),
+  _nMissingSegments(0),
+  _nMostMissing(0),
+  _pnLast   (new long[nSegments]()),
+  _pnMissing(new long[nSegments]()),
+  _pnArrived(new long[nSegments]()),
+  _pnsLagSum(new long[nSegments]())
+{
+  int i, j;
+
+  for (i=0; i<CYCLE_NUM_SLOTS; i++) {
+    tSlot &Slot = _pSlots[i];
+
+    Slot.iState  .store(SLOT_FREE, memory_order_relaxed);
+    Slot.uCycle  .store(0, memory_order_relaxed);   // Message ids start at 1, so anything is newer
+    Slot.nWriters.store(0, memory_order_relaxed);
+    Slot.nArrived.store(0, memory_order_relaxed);
+    Slot.nsOpened    = 0;
+    Slot.nsFirstSent = 0;
+    Slot.pBits  .reset(new std::atomic<uint64_t>[_nWords]);
+    Slot.pnsSent.reset(new int64_t[nSegments]);
+    Slot.pnsRcv .reset(new int64_t[nSegments]);
+
+    for (j=0; j<_nWords; j++) {
+      Slot.pBits[j].store(0, memory_order_relaxed);
+    }
+  }
+}
+
+
+/*******************************************************
+* tCycleAssembler::AddSegment
+*
+* Records a segment's message for a cycle.  Called from the receive
+* threads, several at once.  Never blocks.
+*
+* INPUTS:
+*   uCycle   - cycle number, from the message id
+*   iSegment - which segment sent the message
+*   nsSent   - the message's send time tag
+*   nsRcv    - when the message was received, or 0 if that is not known
+*   pnsCycleSent - if not nullptr, and this message completes the cycle,
+*              filled in with every segment's send time tag
+* RETURNS:
+*   true if this message completed the cycle
+*/
+
+bool tCycleAssembler::AddSegment(uint32_t uCycle, int iSegment, int64_t nsSent, int64_t nsRcv, int64_t *pnsCycleSent)
+{
+  tSlot    &Slot = _pSlots[uCycle & (CYCLE_NUM_SLOTS - 1)];
+  uint64_t  uBit = (uint64_t) 1 << (iSegment & 63);
+  uint32_t  uSlotCycle;
+  uint32_t  uNewest;
+  int       iState;
+  bool      bComplete = false;
+
+  if (iSegment < 0 || iSegment >= _nSegments) {
+    _nBadSegment.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  // Move the window up to a newer cycle, or drop a message from behind it
+  uNewest = _uNewest.load(memory_order_relaxed);
+  while ((uNewest == 0 || (int32_t) (uCycle - uNewest) > 0) &&
+         !_uNewest.compare_exchange_weak(uNewest, uCycle, memory_order_relaxed)) {
+  }
+  if (uNewest != 0 && (int32_t) (uNewest - uCycle) >= CYCLE_NUM_SLOTS) {
+    _nStale.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  for (;;) {
+    iState     = Slot.iState.load(memory_order_acquire);
+    uSlotCycle = Slot.uCycle.load(memory_order_relaxed);
+
+    if (iState == SLOT_OPEN && uSlotCycle == uCycle) {
+      // Register as a writer, then check the sweeper has not started closing the slot meanwhile.
+      // Both sides use sequentially consistent operations, so one of them sees the other.
+      Slot.nWriters.fetch_add(1);
+      if (Slot.iState.load() == SLOT_OPEN && Slot.uCycle.load(memory_order_relaxed) == uCycle) {
+        if (nsSent - Slot.nsFirstSent > _nsPeriod || Slot.nsFirstSent - nsSent > _nsPeriod) {
+          // Same message id, but from another tick
+          _nMistimed.fetch_add(1, memory_order_relaxed);
+        }
+        else if (Slot.pBits[iSegment >> 6].fetch_or(uBit, memory_order_relaxed) & uBit) {
+          _nDuplicates.fetch_add(1, memory_order_relaxed);
+        }
+        else {
+          Slot.pnsSent[iSegment] = nsSent;
+          Slot.pnsRcv [iSegment] = nsRcv;
+          // Acquire too, so that the last to arrive sees every other segment's times
+          bComplete = (Slot.nArrived.fetch_add(1, memory_order_acq_rel) + 1 == _nSegments);
+          if (bComplete && pnsCycleSent != nullptr) {
+            // Copied while still registered as a writer, so the sweeper cannot free the slot meanwhile
+            memcpy(pnsCycleSent, Slot.pnsSent.get(), _nSegments * sizeof(int64_t));
+          }
+        }
+        Slot.nWriters.fetch_sub(1, memory_order_release);
+        return bComplete;
+      }
+      Slot.nWriters.fetch_sub(1, memory_order_release);
+      continue;
+    }
+
+    if (iState == SLOT_FREE && (int32_t) (uCycle - uSlotCycle) > 0) {
+      // First message of a new cycle.  Only one thread wins the right to open it.
+      if (Slot.iState.compare_exchange_strong(iState, SLOT_OPENING)) {
+        Slot.uCycle.store(uCycle, memory_order_relaxed);
+        Slot.nsOpened    = _NowNs();
+        Slot.nsFirstSent = nsSent;
+        Slot.iState.store(SLOT_OPEN, memory_order_release);
+      }
+      continue;
+    }
+
+    if (iState == SLOT_OPENING)  continue;  // Another receive thread is a few instructions from opening it
+
+    // The slot holds, or last held, some other cycle
+    if ((int32_t) (uCycle - uSlotCycle) > 0)  _nOverrun.fetch_add(1, memory_order_relaxed);
+    else                                      _nLate   .fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+}
+
+
+/*******************************************************
+* tCycleAssembler::_Thread
+*
+* The sweeper.  Polls rather than being woken by the receive threads, so
+* that they never make a system call on its behalf.  Completion latency is
+* taken from the messages' timestamps, so the polling delay does not
+* affect it.
+*/
+
+void *tCycleAssembler::_Thread()
+{
+  struct timespec tmSleep;
+
+  tmSleep.tv_sec  = 0;
+  tmSleep.tv_nsec = CYCLE_SWEEP_PERIOD_MS * 1000000L;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    _Sweep(false);
+    nanosleep(&tmSleep, NULL);
+  }
+
+  return nullptr;
+}
+
+
+/*******************************************************
+* tCycleAssembler::CloseAll
+*
+* Closes every open cycle, complete or not.  For the end of a run, once
+* the sweeper thread has stopped.
+*/
+
+void tCycleAssembler::CloseAll()
+{
+  _Sweep(true);
+}
+
+
+/*******************************************************
+* tCycleAssembler::_Sweep
+*
+* Closes the open cycles that are complete, have timed out, or that the
+* window has moved past, so that their slot is free for the cycle
+* CYCLE_NUM_SLOTS newer
+*/
+
+void tCycleAssembler::_Sweep(bool bCloseAll)
+{
+  int64_t  nsNow   = _NowNs();
+  uint32_t uNewest = _uNewest.load(memory_order_relaxed);
+  int      i;
+
+  for (i=0; i<CYCLE_NUM_SLOTS; i++) {
+    tSlot &Slot = _pSlots[i];
+
+    if (Slot.iState.load(memory_order_acquire) != SLOT_OPEN)  continue;
+
+    if (bCloseAll ||
+        Slot.nArrived.load(memory_order_acquire) >= _nSegments ||
+        nsNow - Slot.nsOpened > CYCLE_TIMEOUT_MS * 1000000L ||
+        (int32_t) (uNewest - Slot.uCycle.load(memory_order_relaxed)) >= CYCLE_NUM_SLOTS) {
+      _Close(Slot);
+    }
+  }
+}
+
+
+/*******************************************************
+* tCycleAssembler::_Close
+*
+* Takes a cycle out of the ring, once any receive thread part way through
+* recording into it has finished, and records its statistics.
+*/
+
+void tCycleAssembler::_Close(tSlot &Slot)
+{
+  int      iExpected = SLOT_OPEN;
+  int64_t  nsFirstSent = INT64_MAX;
+  int64_t  nsFirstRcv  = INT64_MAX;
+  int64_t  nsLastRcv   = INT64_MIN;
+  int      iLast       = -1;
+  long     nMissing    = 0;
+  bool     bUntimed    = false;
+  uint64_t uBits;
+  int      i;
+
+  if (!Slot.iState.compare_exchange_strong(iExpected, SLOT_CLOSING))  return;
+  while (Slot.nWriters.load() != 0) {
+    sched_yield();
+  }
+
+  for (i=0; i<_nSegments; i++) {
+    if ((Slot.pBits[i >> 6].load(memory_order_acquire) >> (i & 63)) & 1) {
+      if (Slot.pnsRcv[i] == 0)  bUntimed = true;
+      nsFirstSent = std::min(nsFirstSent, Slot.pnsSent[i]);
+      nsFirstRcv  = std::min(nsFirstRcv,  Slot.pnsRcv[i]);
+      if (Slot.pnsRcv[i] > nsLastRcv) {
+        nsLastRcv = Slot.pnsRcv[i];
+        iLast     = i;
+      }
+    }
+    else {
+      _pnMissing[i]++;
+      nMissing++;
+    }
+  }
+
+  for (i=0; i<_nSegments && !bUntimed; i++) {
+    uBits = Slot.pBits[i >> 6].load(memory_order_relaxed);
+    if ((uBits >> (i & 63)) & 1) {
+      _pnArrived[i]++;
+      _pnsLagSum[i] += Slot.pnsRcv[i] - nsFirstRcv;
+    }
+  }
+
+  if (bUntimed)  _Increment(_nUntimed);
+
+  if (nMissing == 0) {
+    if (!bUntimed) {
+      _Completion.Record(nsLastRcv - nsFirstSent);
+      _Spread    .Record(nsLastRcv - nsFirstRcv);
+      _pnLast[iLast]++;
+    }
+    _Increment(_nComplete);
+  }
+  else {
+    _nMissingSegments.store(_nMissingSegments.load(memory_order_relaxed) + nMissing, memory_order_relaxed);
+    if (nMissing > _nMostMissing.load(memory_order_relaxed))  _nMostMissing.store(nMissing, memory_order_relaxed);
+    _Increment(_nIncomplete);
+  }
+
+  for (i=0; i<_nWords; i++) {
+    Slot.pBits[i].store(0, memory_order_relaxed);
+  }
+  Slot.nArrived.store(0, memory_order_relaxed);
+
+  // Keep uCycle, so that stragglers for this cycle are recognised as late
+  Slot.iState.store(SLOT_FREE, memory_order_release);
+}
+
+
+/*******************************************************
+* tCycleAssembler::_NowNs
+*
+*/
+
+int64_t tCycleAssembler::_NowNs()
+{
+  struct timespec tmNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &tmNow);
+  return (int64_t) tmNow.tv_sec * 1000000000LL + tmNow.tv_nsec;
+}
+
+
+/*******************************************************
+* tCycleAssembler::PrintSummary
+*
+* One-line summary of completed cycles, for printing while running
+*/
+
+void tCycleAssembler::PrintSummary(FILE *pFile, const char *sLabel) const
+{
+  char sCompletion[160];
+
+  snprintf(sCompletion, sizeof(sCompletion), "%s cycles complete=%ld incomplete=%ld  completion",
+           sLabel, NumComplete(), NumIncomplete());
+  _Completion.Print(pFile, sCompletion);
+}
+
+
+/*******************************************************
+* tCycleAssembler::PrintReport
+*
+* Full report for the end of the run.  Reads the per-segment tables,
+* which the sweeper writes without synchronization, so only call once the
+* sweeper thread has stopped.
+*/
+
+void tCycleAssembler::PrintReport(FILE *pFile) const
+{
+  std::vector<long> MeanLag(_nSegments);
+  long nIncomplete = NumIncomplete();
+  int  i;
+
+  fprintf(pFile, "Cycle assembly over %d segments:\n", _nSegments);
+  PrintSummary(pFile, " ");
+  _Spread.Print(pFile, "  arrival spread (first to last segment):");
+  if (nIncomplete > 0) {
+    fprintf(pFile, "  missing segments: %ld in %ld incomplete cycles (mean %.1f, most %ld)\n",
+            _nMissingSegments.load(memory_order_relaxed), nIncomplete,
+            (double) _nMissingSegments.load(memory_order_relaxed) / nIncomplete,
+            _nMostMissing.load(memory_order_relaxed));
+  }
+  if (_nUntimed.load(memory_order_relaxed) > 0) {
+    fprintf(pFile, "  untimed: %ld cycles, received before the first clock offset estimate\n",
+            _nUntimed.load(memory_order_relaxed));
+  }
+  fprintf(pFile, "  late %ld  stale %ld  mistimed %ld  duplicate %ld  overrun %ld  bad segment %ld\n",
+          _nLate.load(memory_order_relaxed), _nStale.load(memory_order_relaxed), _nMistimed.load(memory_order_relaxed),
+          _nDuplicates.load(memory_order_relaxed), _nOverrun.load(memory_order_relaxed),
+          _nBadSegment.load(memory_order_relaxed));
+
+  for (i=0; i<_nSegments; i++) {
+    MeanLag[i] = (_pnArrived[i] > 0) ? _pnsLagSum[i] / _pnArrived[i] : 0;
+  }
+
+  _PrintWorst(pFile, "most often last",        _pnLast.get(),    "cycles", 1.0);
+  _PrintWorst(pFile, "most often missing",     _pnMissing.get(), "cycles", 1.0);
+  _PrintWorst(pFile, "largest mean lag",       MeanLag.data(),   "us",     1000.0);
+}
+
+
+/*******************************************************
+* tCycleAssembler::WriteResults
+*
+* The counts and distributions of PrintReport(), under the same
+* conditions
+*/
+
+void tCycleAssembler::WriteResults(tResultFile &Results) const
+{
+  Results.BeginObject("cycles");
+  Results.Add("segments",         _nSegments);
+  Results.Add("period_ms",        _nsPeriod / 1e6);
+  Results.Add("complete",         NumComplete());
+  Results.Add("incomplete",       NumIncomplete());
+  Results.Add("missing_segments", _nMissingSegments.load(memory_order_relaxed));
+  Results.Add("untimed",          _nUntimed.load(memory_order_relaxed));
+  Results.Add("late",             _nLate.load(memory_order_relaxed));
+  Results.Add("stale",            _nStale.load(memory_order_relaxed));
+  Results.Add("mistimed",         _nMistimed.load(memory_order_relaxed));
+  Results.Add("duplicate",        _nDuplicates.load(memory_order_relaxed));
+  Results.Add("overrun",          _nOverrun.load(memory_order_relaxed));
+  Results.Add("bad_segment",      _nBadSegment.load(memory_order_relaxed));
+  Results.AddHistogram("completion", _Completion);
+  Results.AddHistogram("spread",     _Spread);
+  Results.EndObject();
+}
+
+
+/*******************************************************
+* tCycleAssembler::_PrintWorst
+*
+* Lists the CYCLE_NUM_WORST segments with the largest non-zero values
+*/
+
+void tCycleAssembler::_PrintWorst(FILE *pFile, const char *sTitle, const long *pnValues, const char *sUnits, double fScale) const
+{
+  std::vector<int> Order(_nSegments);
+  int              nShow;
+  int              i;
+
+  for (i=0; i<_nSegments; i++) {
+    Order[i] = i;
+  }
+  nShow = std::min(_nSegments, CYCLE_NUM_WORST);
+  std::partial_sort(Order.begin(), Order.begin() + nShow, Order.end(),
+                    [pnValues](int a, int b) { return pnValues[a] > pnValues[b]; });
+
+  fprintf(pFile, "  %-20s", sTitle);
+  for (i=0; i<nShow && pnValues[Order[i]] > 0; i++) {
+    fprintf(pFile, "  seg %d: %.1f %s", Order[i], pnValues[Order[i]] / fScale, sUnits);
+  }
+  if (i == 0)  fprintf(pFile, "  none");
+  fprintf(pFile, "\n");
+}
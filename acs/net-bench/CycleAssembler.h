@@ -0,0 +1,151 @@
+/* tCycleAssembler - Gathers each control cycle's segment messages into a frame
+*
+* The RTC cannot compute a control cycle until it has every segment's
+* SegRtDataMsg for that cycle, so what matters is when the last one
+* arrives, not the latency of any one message.  The receive threads hand
+* each message's cycle number, segment and timestamps to AddSegment(); a
+* sweeper thread of the assembler's own closes each cycle once it is
+* complete or has timed out, and records:
+*
+*   - completion latency: last segment received less first segment sent
+*   - the number of segments missing from incomplete cycles
+*   - per segment, how often it was the last to arrive, how often it was
+*     missing, and its mean lag behind the first arrival of its cycle
+*
+* Open cycles live in a ring of slots indexed by cycle number.  A slot's
+* state word moves FREE -> OPENING -> OPEN -> CLOSING -> FREE.  Receive
+* threads set segment bits in an OPEN slot with atomic ors, registering as
+* writers while they do, and the sweeper waits for the writer count to
+* drain after moving the slot to CLOSING, so a cycle is never closed with
+* a message half-recorded.  Receive threads never wait on the sweeper.
+*
+* Messages for a cycle that has already closed are counted as late.
+* The window of cycles that may be open follows the newest cycle number
+* seen.  A message for a cycle the window has moved past, such as from a
+* sender that has restarted its numbering, is counted as stale and
+* dropped, rather than opening a slot that another sender's cycle of the
+* same number could then be merged into.  A cycle still open when the
+* window moves past it is closed at once.
+*
+* Message ids alone do not tie messages to a cycle: two senders need not
+* number their cycles alike, and a sender may restart its numbering.  So
+* a message whose send time tag is more than one period from that of the
+* message that opened its cycle is counted as mistimed and dropped.
+*
+* A message received before its time could be put on the sender's clock
+* has a receive time of 0.  Its cycle counts as complete or not as usual,
+* but adds nothing to the completion, spread or lag figures.
+*
+* The receive thread whose message completes a cycle is told so, and can
+* be handed every segment's send time, so that it can answer the whole
+* cycle at once.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TCYCLEASSEMBLER_H_
+#define TCYCLEASSEMBLER_H_
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include "PThread.h"
+#include "LatencyHistogram.h"
+#include "ResultFile.h"
+
+// Cycles that can be open at once.  At 50 Hz, 64 slots cover 1.28 s.  Must be a power of two.
+#define CYCLE_NUM_SLOTS        (64)
+
+// A cycle still missing segments this long after its first message arrived is closed incomplete
+#define CYCLE_TIMEOUT_MS       (100)
+
+// How often the sweeper looks for cycles to close
+#define CYCLE_SWEEP_PERIOD_MS  (5)
+
+// Segments listed in each of the "worst" tables of the final report
+#define CYCLE_NUM_WORST        (5)
+
+
+class tCycleAssembler : public tPThread {
+public:
+  tCycleAssembler(int nSegments, int64_t nsPeriod, int iPriority = 0);
+
+  // Held by pointer, so neither copied nor moved
+  tCycleAssembler(const tCycleAssembler &) = delete;
+  tCycleAssembler& operator=(const tCycleAssembler &) = delete;
+
+  bool AddSegment(uint32_t uCycle, int iSegment, int64_t nsSent, int64_t nsRcv, int64_t *pnsCycleSent = nullptr);
+  void CloseAll();
+
+  const tLatencyHistogram &Completion() const { return _Completion; }
+  long NumComplete()   const { return _nComplete  .load(std::memory_order_relaxed); }
+  long NumIncomplete() const { return _nIncomplete.load(std::memory_order_relaxed); }
+
+  void PrintSummary(FILE *pFile, const char *sLabel) const;
+  void PrintReport(FILE *pFile) const;
+  void WriteResults(tResultFile &Results) const;
+
+protected:
+  enum { SLOT_FREE, SLOT_OPENING, SLOT_OPEN, SLOT_CLOSING };
+
+  struct tSlot {
+    std::atomic<int>      iState;
+    std::atomic<uint32_t> uCycle;     // Cycle held, or last held when FREE
+    std::atomic<int>      nWriters;   // Receive threads part way through recording into the slot
+    std::atomic<int>      nArrived;
+    int64_t               nsOpened;   // CLOCK_MONOTONIC; set before the slot is published OPEN
+    int64_t               nsFirstSent;  // Send time tag of the message that opened the slot; likewise
+    std::unique_ptr<std::atomic<uint64_t>[]> pBits;    // Segments arrived
+    std::unique_ptr<int64_t[]>               pnsSent;  // Written by whichever thread set the bit
+    std::unique_ptr<int64_t[]>               pnsRcv;
+  };
+
+  virtual void *_Thread();
+  void          _Sweep(bool bCloseAll);
+  void          _Close(tSlot &Slot);
+  void          _PrintWorst(FILE *pFile, const char *sTitle, const long *pnValues, const char *sUnits, double fScale) const;
+  static int64_t _NowNs();
+  static void   _Increment(std::atomic<long> &Count) {
+    Count.store(Count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  int                      _nSegments;
+  int                      _nWords;      // 64-bit words per slot bitmap
+  int64_t                  _nsPeriod;    // Cycle period of the senders
+  std::unique_ptr<tSlot[]> _pSlots;
+
+  std::atomic<uint32_t>    _uNewest;     // Newest cycle seen, 0 before the first
+
+  // Counted by the receive threads, so real atomic adds
+  std::atomic<long>        _nLate;       // Arrived after their cycle closed
+  std::atomic<long>        _nStale;      // For a cycle CYCLE_NUM_SLOTS or more behind _uNewest
+  std::atomic<long>        _nMistimed;   // Sent more than a period apart from the cycle's first message
+  std::atomic<long>        _nOverrun;    // Slot still held by a cycle CYCLE_NUM_SLOTS older
+  std::atomic<long>        _nDuplicates;
+  std::atomic<long>        _nBadSegment;
+
+  // Written by the sweeper only
+  tLatencyHistogram        _Completion;  // Complete cycles only
+  tLatencyHistogram        _Spread;      // Last arrival less first arrival, complete cycles only
+  std::atomic<long>        _nComplete;
+  std::atomic<long>        _nIncomplete;
+  std::atomic<long>        _nUntimed;    // Cycles with a message that has no receive time
+  std::atomic<long>        _nMissingSegments;
+  std::atomic<long>        _nMostMissing;
+  std::unique_ptr<long[]>  _pnLast;      // Per segment: times it was the last to arrive
+  std::unique_ptr<long[]>  _pnMissing;   // Per segment: times it was missing
+  std::unique_ptr<long[]>  _pnArrived;   // Per segment: cycles it arrived in
+  std::unique_ptr<long[]>  _pnsLagSum;   // Per segment: total lag behind its cycle's first arrival
+};
+
+
+#endif /* TCYCLEASSEMBLER_H_ */
@@ -0,0 +1,389 @@
+/* tIoUring - Minimal io_uring submission/completion ring
+*
+* See IoUring.h for a description.  The ring handling here follows the
+* same protocol as liburing: the application owns the SQ tail and the CQ
+* head, the kernel owns the SQ head and the CQ tail, and each side
+* publishes its index with a release store and reads the other side's
+* with an acquire load.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "IoUring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+using namespace std;
+
+
+#ifdef HAVE_IO_URING_MULTISHOT
+
+/*******************************************************
+* Raw system call wrappers - glibc does not provide these
+*/
+
+static int io_uring_setup(unsigned nEntries, struct io_uring_params *pParams)
+{
+  return (int) syscall(__NR_io_uring_setup, nEntries, pParams);
+}
+
+static int io_uring_enter(int fd, unsigned nToSubmit, unsigned nMinComplete, unsigned uFlags, 
+                          struct io_uring_getevents_arg *pArg)
+{
+  return (int) syscall(__NR_io_uring_enter, fd, nToSubmit, nMinComplete, uFlags, pArg, 
+                       (pArg != NULL) ? sizeof(*pArg) : 0);
+}
+
+static int io_uring_register(int fd, unsigned uOpcode, void *pArg, unsigned nArgs)
+{
+  return (int) syscall(__NR_io_uring_register, fd, uOpcode, pArg, nArgs);
+}
+
+
+/*******************************************************
+* tIoUring constructor
+*
+* Creates the ring and maps its submission and completion queues.
+*
+* INPUTS:
+*   nEntries - number of SQ entries.  The kernel rounds this up to a power
+*              of two, and sizes the CQ at twice that.
+* SIDE EFFECTS:
+*   Throws a tIoUringException if the ring cannot be created.
+*/
+
+tIoUring::tIoUring(unsigned nEntries) :
+  _fdRing(-1),
+  _uSqeHead(0),
+  _uSqeTail(0),
+  _pSqRingMap(MAP_FAILED),
+  _pCqRingMap(MAP_FAILED),
+  _pSqesMap(MAP_FAILED),
+  _pBufRing(nullptr),
+  _szBufRingMap(0),
+  _nBuffers(0),
+  _szBuffer(0),
+  _uBufferGroup(0),
+  _nEnterCalls(0)
+{
+  struct io_uring_params Params;
+  uint8_t *pSq, *pCq;
+
+  bzero(&Params, sizeof(Params));
+
+  _fdRing = io_uring_setup(nEntries, &Params);
+  if (_fdRing < 0) {
+    throw tIoUringException(string("io_uring_setup: ") + strerror(errno));
+  }
+
+  _szSqRingMap = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+  _szCqRingMap = Params.cq_off.cqes  + Params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // With IORING_FEAT_SINGLE_MMAP, both rings live in one mapping
+  if (Params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (_szCqRingMap > _szSqRingMap)  _szSqRingMap = _szCqRingMap;
+    _szCqRingMap = _szSqRingMap;
+  }
+
+  _pSqRingMap = mmap(NULL, _szSqRingMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     _fdRing, IORING_OFF_SQ_RING);
+  if (_pSqRingMap == MAP_FAILED) {
+    close(_fdRing);
+    throw tIoUringException(string("mmap SQ ring: ") + strerror(errno));
+  }
+
+  if (Params.features & IORING_FEAT_SINGLE_MMAP) {
+    _pCqRingMap = _pSqRingMap;
+  }
+  else {
+    _pCqRingMap = mmap(NULL, _szCqRingMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       _fdRing, IORING_OFF_CQ_RING);
+    if (_pCqRingMap == MAP_FAILED) {
+      munmap(_pSqRingMap, _szSqRingMap);
+      close(_fdRing);
+      throw tIoUringException(string("mmap CQ ring: ") + strerror(errno));
+    }
+  }
+
+  _szSqesMap = Params.sq_entries * sizeof(struct io_uring_sqe);
+  _pSqesMap  = mmap(NULL, _szSqesMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    _fdRing, IORING_OFF_SQES);
+  if (_pSqesMap == MAP_FAILED) {
+    if (_pCqRingMap != _pSqRingMap)  munmap(_pCqRingMap, _szCqRingMap);
+    munmap(_pSqRingMap, _szSqRingMap);
+    close(_fdRing);
+    throw tIoUringException(string("mmap SQEs: ") + strerror(errno));
+  }
+
+  pSq = (uint8_t *) _pSqRingMap;
+  _pSqHead    = (unsigned *) (pSq + Params.sq_off.head);
+  _pSqTail    = (unsigned *) (pSq + Params.sq_off.tail);
+  _pSqMask    = (unsigned *) (pSq + Params.sq_off.ring_mask);
+  _pSqArray   = (unsigned *) (pSq + Params.sq_off.array);
+  _nSqEntries = Params.sq_entries;
+  _pSqes      = (struct io_uring_sqe *) _pSqesMap;
+
+  pCq = (uint8_t *) _pCqRingMap;
+  _pCqHead    = (unsigned *) (pCq + Params.cq_off.head);
+  _pCqTail    = (unsigned *) (pCq + Params.cq_off.tail);
+  _pCqMask    = (unsigned *) (pCq + Params.cq_off.ring_mask);
+  _pCqes      = (struct io_uring_cqe *) (pCq + Params.cq_off.cqes);
+}
+
+
+/*******************************************************
+* tIoUring destructor
+*
+* SIDE EFFECTS:
+*   Unmaps the rings and closes the ring descriptor, which cancels any
+*   requests still armed.
+*/
+
+tIoUring::~tIoUring()
+{
+  if (_pBufRing != nullptr)  munmap(_pBufRing, _szBufRingMap);
+  munmap(_pSqesMap, _szSqesMap);
+  if (_pCqRingMap != _pSqRingMap)  munmap(_pCqRingMap, _szCqRingMap);
+  munmap(_pSqRingMap, _szSqRingMap);
+  close(_fdRing);
+}
+
+
+/*******************************************************
+* tIoUring::GetSqe
+*
+* RETURNS:
+*   A zeroed SQE for the caller to fill in, or nullptr if the submission
+*   queue is full.  In that case, call Submit() and try again.
+*/
+
+struct io_uring_sqe *tIoUring::GetSqe()
+{
+  unsigned uHead = __atomic_load_n(_pSqHead, __ATOMIC_ACQUIRE);
+  struct io_uring_sqe *pSqe;
+
+  if (_uSqeTail - uHead >= _nSqEntries)  return nullptr;
+
+  pSqe = &_pSqes[_uSqeTail & *_pSqMask];
+  _uSqeTail++;
+
+  bzero(pSqe, sizeof(*pSqe));
+  return pSqe;
+}
+
+
+/*******************************************************
+* tIoUring::Submit
+*
+* Publishes all SQEs obtained since the last call, then makes a single
+* io_uring_enter() call to submit them and, optionally, wait for
+* completions.
+*
+* INPUTS:
+*   nWaitFor   - block until at least this many completions are available
+*   iTimeoutMs - give up waiting after this long; negative waits forever
+* RETURNS:
+*   The number of SQEs consumed by the kernel
+* SIDE EFFECTS:
+*   Throws a tIoUringException on error
+*/
+
+int tIoUring::Submit(unsigned nWaitFor, int iTimeoutMs)
+{
+  unsigned uTail = *_pSqTail;
+  unsigned nToSubmit;
+  unsigned uFlags = 0;
+  int      retval;
+  struct __kernel_timespec     Timeout;
+  struct io_uring_getevents_arg Arg;
+  struct io_uring_getevents_arg *pArg = NULL;
+
+  // Fill in the indirection array for the new SQEs, then publish the new tail
+  while (_uSqeHead != _uSqeTail) {
+    _pSqArray[uTail & *_pSqMask] = _uSqeHead & *_pSqMask;
+    uTail++;
+    _uSqeHead++;
+  }
+  __atomic_store_n(_pSqTail, uTail, __ATOMIC_RELEASE);
+
+  nToSubmit = uTail - __atomic_load_n(_pSqHead, __ATOMIC_ACQUIRE);
+
+  if (nToSubmit == 0 && nWaitFor == 0)  return 0;
+
+  if (nWaitFor > 0)  uFlags |= IORING_ENTER_GETEVENTS;
+
+  if (nWaitFor > 0 && iTimeoutMs >= 0) {
+    Timeout.tv_sec  = iTimeoutMs / 1000;
+    Timeout.tv_nsec = (iTimeoutMs % 1000) * 1000000L;
+    bzero(&Arg, sizeof(Arg));
+    Arg.ts  = (uint64_t) (uintptr_t) &Timeout;
+    pArg    = &Arg;
+    uFlags |= IORING_ENTER_EXT_ARG;
+  }
+
+  do {
+    retval = io_uring_enter(_fdRing, nToSubmit, nWaitFor, uFlags, pArg);
+    _nEnterCalls++;
+  } while (retval < 0 && errno == EINTR);
+
+  if (retval < 0 && errno == ETIME)  return 0;
+
+  if (retval < 0) {
+    throw tIoUringException(string("io_uring_enter: ") + strerror(errno));
+  }
+
+  return retval;
+}
+
+
+/*******************************************************
+* tIoUring::PeekCqe
+*
+* RETURNS:
+*   The oldest unconsumed completion, or nullptr if there is none.  Call
+*   AdvanceCq() once done with it.
+*/
+
+struct io_uring_cqe *tIoUring::PeekCqe()
+{
+  unsigned uHead = *_pCqHead;
+
+  if (uHead == __atomic_load_n(_pCqTail, __ATOMIC_ACQUIRE))  return nullptr;
+
+  return &_pCqes[uHead & *_pCqMask];
+}
+
+
+/*******************************************************
+* tIoUring::AdvanceCq
+*
+* Hands the CQE returned by PeekCqe() back to the kernel.
+*/
+
+void tIoUring::AdvanceCq()
+{
+  __atomic_store_n(_pCqHead, *_pCqHead + 1, __ATOMIC_RELEASE);
+}
+
+
+/*******************************************************
+* tIoUring::RegisterBufferRing
+*
+* Creates a pool of receive buffers and registers it with the kernel as a
+* provided buffer ring.  Requests submitted with IOSQE_BUFFER_SELECT and
+* this group pick a buffer from the ring when data arrives, and report its
+* id in the CQE flags.
+*
+* INPUTS:
+*   uBufferGroup - buffer group id to register under
+*   nBuffers     - number of buffers; must be a power of two, at most 32768
+*   szBuffer     - size of each buffer
+* SIDE EFFECTS:
+*   Throws a tIoUringException on error
+*/
+
+void tIoUring::RegisterBufferRing(uint16_t uBufferGroup, unsigned nBuffers, size_t szBuffer)
+{
+  struct io_uring_buf_reg Reg;
+  unsigned i;
+
+  if (_pBufRing != nullptr)  throw tIoUringException("Only one buffer ring is supported");
+  if (nBuffers == 0 || (nBuffers & (nBuffers - 1)) != 0 || nBuffers > 32768) {
+    throw tIoUringException("Buffer ring size must be a power of two, at most 32768");
+  }
+
+  _szBufRingMap = nBuffers * sizeof(struct io_uring_buf);
+  _pBufRing = (struct io_uring_buf_ring *) mmap(NULL, _szBufRingMap, PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (_pBufRing == MAP_FAILED) {
+    _pBufRing = nullptr;
+    throw tIoUringException(string("mmap buffer ring: ") + strerror(errno));
+  }
+
+  bzero(&Reg, sizeof(Reg));
+  Reg.ring_addr    = (uint64_t) (uintptr_t) _pBufRing;
+  Reg.ring_entries = nBuffers;
+  Reg.bgid         = uBufferGroup;
+
+  if (io_uring_register(_fdRing, IORING_REGISTER_PBUF_RING, &Reg, 1) < 0) {
+    munmap(_pBufRing, _szBufRingMap);
+    _pBufRing = nullptr;
+    throw tIoUringException(string("IORING_REGISTER_PBUF_RING: ") + strerror(errno));
+  }
+
+  _nBuffers     = nBuffers;
+  _szBuffer     = szBuffer;
+  _uBufferGroup = uBufferGroup;
+  _Buffers = tRtBuffer(nBuffers * szBuffer);
+
+  // Hand every buffer to the kernel
+  for (i=0; i<nBuffers; i++) {
+    RecycleBuffer(i);
+  }
+}
+
+
+/*******************************************************
+* tIoUring::RecycleBuffer
+*
+* Returns a provided buffer to the kernel.  The kernel may pick it for the
+* next datagram as soon as the tail is published, so only call once the
+* contents are consumed.  Buffers not yet returned are simply missing from
+* the ring; should it run dry, multishot receives end with -ENOBUFS and the
+* datagrams wait in the socket until the receive is re-armed.
+*
+* INPUTS:
+*   uBufferId - buffer id, from the upper bits of the CQE flags
+*/
+
+void tIoUring::RecycleBuffer(uint16_t uBufferId)
+{
+  unsigned short   uTail = _pBufRing->tail;
+  struct io_uring_buf *pBuf;
+
+  assert(uBufferId < _nBuffers);
+
+  // Index from the ring base rather than through bufs[], which the kernel header's
+  // flexible array macro places at the wrong offset when compiled as C++
+  pBuf = (struct io_uring_buf *) _pBufRing + (uTail & (_nBuffers - 1));
+  pBuf->addr = (uint64_t) (uintptr_t) ProvidedBuffer(uBufferId);
+  pBuf->len  = _szBuffer;
+  pBuf->bid  = uBufferId;
+
+  __atomic_store_n(&_pBufRing->tail, (unsigned short) (uTail + 1), __ATOMIC_RELEASE);
+}
+
+
+#else  // HAVE_IO_URING_MULTISHOT
+
+/*******************************************************
+* Kernel headers too old for multishot receive.  Anything that tries to
+* use io_uring gets an exception from the constructor.
+*/
+
+tIoUring::tIoUring(unsigned nEntries)
+{
+  throw tIoUringException("Not supported: built against kernel headers without multishot receive");
+}
+
+tIoUring::~tIoUring()                                         { }
+struct io_uring_sqe *tIoUring::GetSqe()                        { return nullptr; }
+int  tIoUring::Submit(unsigned, int)                            { return -1; }
+struct io_uring_cqe *tIoUring::PeekCqe()                       { return nullptr; }
+void tIoUring::AdvanceCq()                                     { }
+void tIoUring::RegisterBufferRing(uint16_t, unsigned, size_t)  { }
+void tIoUring::RecycleBuffer(uint16_t)                         { }
+
+#endif  // HAVE_IO_URING_MULTISHOT
@@ -0,0 +1,121 @@
+/* tIoUring - Minimal io_uring submission/completion ring
+*
+* A thin wrapper around the raw io_uring system calls, so that the benchmark
+* does not depend on liburing being installed on the target.  It provides
+* just what the UDP benchmark needs:
+*
+*   - getting and submitting SQEs, and reaping CQEs
+*   - a provided buffer ring, from which multishot receives pick their
+*     buffers, and which buffers are recycled back into once processed
+*
+* The ring is not thread safe.  Each thread that wants to use io_uring
+* should own its own tIoUring.
+*
+* Multishot receive and provided buffer rings need kernel 6.0 or later, and
+* kernel headers to match.  When built against older headers, the class
+* still compiles, but the constructor throws.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TIOURING_H_
+#define TIOURING_H_
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "RtMemory.h"
+
+// Multishot receive (6.0) arrived after provided buffer rings (5.19), and the
+// latter are enum values, so cannot be tested for here
+#if defined(IORING_RECV_MULTISHOT)
+#define HAVE_IO_URING_MULTISHOT (1)
+#endif
+
+
+/*********************
+* tIoUringException - Exception thrown by the class
+*/
+
+class tIoUringException : public std::runtime_error {
+public:
+  tIoUringException(const std::string &s) : std::runtime_error(std::string("tIoUring: ") + s) { }
+};
+
+
+/*********************
+* tIoUring
+*/
+
+class tIoUring {
+public:
+  tIoUring(unsigned nEntries);
+  ~tIoUring();
+
+  // The ring is mapped from the kernel, so it can be neither copied nor moved
+  tIoUring(const tIoUring &) = delete;
+  tIoUring& operator=(const tIoUring &) = delete;
+
+  struct io_uring_sqe *GetSqe();
+  int                  Submit(unsigned nWaitFor = 0, int iTimeoutMs = -1);
+  struct io_uring_cqe *PeekCqe();
+  void                 AdvanceCq();
+
+  void     RegisterBufferRing(uint16_t uBufferGroup, unsigned nBuffers, size_t szBuffer);
+  uint8_t *ProvidedBuffer(uint16_t uBufferId)  { return &_Buffers[uBufferId * _szBuffer]; }
+  size_t   ProvidedBufferSize()                { return _szBuffer; }
+  void     RecycleBuffer(uint16_t uBufferId);
+
+  unsigned NumSqEntries()  { return _nSqEntries; }
+  long     NumEnterCalls() { return _nEnterCalls; }
+
+protected:
+  int                  _fdRing;
+
+  // Submission queue, as mapped from the kernel
+  unsigned            *_pSqHead;
+  unsigned            *_pSqTail;
+  unsigned            *_pSqMask;
+  unsigned            *_pSqArray;
+  unsigned             _nSqEntries;
+  struct io_uring_sqe *_pSqes;
+  unsigned             _uSqeHead;      // SQEs handed out but not yet published to the kernel
+  unsigned             _uSqeTail;      //    run from _uSqeHead to _uSqeTail
+
+  // Completion queue, as mapped from the kernel
+  unsigned            *_pCqHead;
+  unsigned            *_pCqTail;
+  unsigned            *_pCqMask;
+  struct io_uring_cqe *_pCqes;
+
+  void                *_pSqRingMap;
+  size_t               _szSqRingMap;
+  void                *_pCqRingMap;
+  size_t               _szCqRingMap;
+  void                *_pSqesMap;
+  size_t               _szSqesMap;
+
+  // Provided buffer ring
+  struct io_uring_buf_ring *_pBufRing;
+  size_t               _szBufRingMap;
+  unsigned             _nBuffers;
+  size_t               _szBuffer;
+  uint16_t             _uBufferGroup;
+  tRtBuffer            _Buffers;
+
+  long                 _nEnterCalls;
+};
+
+
+#endif /* TIOURING_H_ */
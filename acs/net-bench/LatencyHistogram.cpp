@@ -0,0 +1,243 @@
+/* tLatencyHistogram - Log-bucketed latency histogram
+*
+* See LatencyHistogram.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+
+/*******************************************************
+* tLatencyHistogram constructor
+*
+*/
+
+tLatencyHistogram::tLatencyHistogram()
+{
+  Reset();
+}
+
+
+/*******************************************************
+* tLatencyHistogram::BucketIndex
+*
+* Values below 2 * HIST_SUB_BUCKETS map one-to-one.  Above that, the bucket
+* is picked by the position of the top bit (the power of two) and the next
+* HIST_SUB_BUCKET_BITS bits below it (the linear sub-bucket).
+*/
+
+int tLatencyHistogram::BucketIndex(int64_t nsValue)
+{
+  int iShift;
+
+  if (nsValue < 2 * HIST_SUB_BUCKETS)  return (int) nsValue;
+  if (nsValue >= HIST_MAX_VALUE)       return HIST_NUM_BUCKETS - 1;
+
+  iShift = (63 - __builtin_clzll((uint64_t) nsValue)) - HIST_SUB_BUCKET_BITS;
+  return HIST_SUB_BUCKETS * iShift + (int) (nsValue >> iShift);
+}
+
+
+/*******************************************************
+* tLatencyHistogram::BucketHighestValue
+*
+* RETURNS:
+*   The largest value that falls into the bucket
+*/
+
+int64_t tLatencyHistogram::BucketHighestValue(int iBucket)
+{
+  int     iShift;
+  int64_t nMantissa;
+
+  if (iBucket < 2 * HIST_SUB_BUCKETS)  return iBucket;
+
+  iShift    = iBucket / HIST_SUB_BUCKETS - 1;
+  nMantissa = iBucket - HIST_SUB_BUCKETS * iShift;
+  return ((nMantissa + 1) << iShift) - 1;
+}
+
+
+/*******************************************************
+* tLatencyHistogram::Record
+*
+* Called from the receive thread, so must stay cheap.  Only one thread
+* may record into a given histogram.
+*/
+
+void tLatencyHistogram::Record(int64_t nsValue)
+{
+  std::atomic<uint64_t> &Bucket = _Counts[BucketIndex((nsValue < 0) ? 0 : nsValue)];
+
+  // Single writer, so a relaxed load and store is enough - no need for a locked add
+  if (nsValue < 0) {
+    _nNegative.store(_nNegative.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    nsValue = 0;
+  }
+  Bucket .store(Bucket .load(memory_order_relaxed) + 1,       memory_order_relaxed);
+  _nsSum .store(_nsSum .load(memory_order_relaxed) + nsValue, memory_order_relaxed);
+  _nCount.store(_nCount.load(memory_order_relaxed) + 1,       memory_order_relaxed);
+}
+
+
+/*******************************************************
+* tLatencyHistogram::Reset
+*
+* Not safe against a concurrent Record()
+*/
+
+void tLatencyHistogram::Reset()
+{
+  int i;
+
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    _Counts[i].store(0, memory_order_relaxed);
+  }
+  _nCount   .store(0, memory_order_relaxed);
+  _nNegative.store(0, memory_order_relaxed);
+  _nsSum    .store(0, memory_order_relaxed);
+}
+
+
+/*******************************************************
+* tLatencyHistogram::CopyFrom, Add, Subtract
+*
+* For building aggregates of several histograms, and for taking the
+* difference between two snapshots of a running histogram, to get the
+* distribution over an interval.  Other may be recording concurrently;
+* this histogram may not.
+*/
+
+void tLatencyHistogram::CopyFrom(const tLatencyHistogram &Other)
+{
+  Reset();
+  Add(Other);
+}
+
+
+void tLatencyHistogram::Add(const tLatencyHistogram &Other)
+{
+  int i;
+
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    _Counts[i].store(_Counts[i].load(memory_order_relaxed) + Other._Counts[i].load(memory_order_relaxed), memory_order_relaxed);
+  }
+  _nCount   .store(_nCount   .load(memory_order_relaxed) + Other._nCount   .load(memory_order_relaxed), memory_order_relaxed);
+  _nNegative.store(_nNegative.load(memory_order_relaxed) + Other._nNegative.load(memory_order_relaxed), memory_order_relaxed);
+  _nsSum    .store(_nsSum    .load(memory_order_relaxed) + Other._nsSum    .load(memory_order_relaxed), memory_order_relaxed);
+}
+
+
+void tLatencyHistogram::Subtract(const tLatencyHistogram &Other)
+{
+  int i;
+
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    _Counts[i].store(_Counts[i].load(memory_order_relaxed) - Other._Counts[i].load(memory_order_relaxed), memory_order_relaxed);
+  }
+  _nCount   .store(_nCount   .load(memory_order_relaxed) - Other._nCount   .load(memory_order_relaxed), memory_order_relaxed);
+  _nNegative.store(_nNegative.load(memory_order_relaxed) - Other._nNegative.load(memory_order_relaxed), memory_order_relaxed);
+  _nsSum    .store(_nsSum    .load(memory_order_relaxed) - Other._nsSum    .load(memory_order_relaxed), memory_order_relaxed);
+}
+
+
+/*******************************************************
+* tLatencyHistogram::Percentile
+*
+* INPUTS:
+*   fPercent - e.g. 99.9
+* RETURNS:
+*   The highest value in the bucket that holds the given percentile, or 0
+*   if the histogram is empty
+*/
+
+int64_t tLatencyHistogram::Percentile(double fPercent) const
+{
+  uint64_t nTotal = 0;
+  uint64_t nTarget;
+  uint64_t nSoFar = 0;
+  int      i;
+
+  // Sum the buckets rather than using _nCount, which a concurrent Record() may have got ahead of
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    nTotal += _Counts[i].load(memory_order_relaxed);
+  }
+  if (nTotal == 0)  return 0;
+
+  nTarget = (uint64_t) (fPercent / 100.0 * nTotal + 0.5);
+  if (nTarget < 1)       nTarget = 1;
+  if (nTarget > nTotal)  nTarget = nTotal;
+
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    nSoFar += _Counts[i].load(memory_order_relaxed);
+    if (nSoFar >= nTarget)  return BucketHighestValue(i);
+  }
+
+  return BucketHighestValue(HIST_NUM_BUCKETS - 1);
+}
+
+
+/*******************************************************
+* tLatencyHistogram::Min, Max, Mean
+*
+* Min and Max are to bucket precision
+*/
+
+int64_t tLatencyHistogram::Min() const
+{
+  int i;
+
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    if (_Counts[i].load(memory_order_relaxed) > 0)  return BucketHighestValue(i);
+  }
+  return 0;
+}
+
+
+int64_t tLatencyHistogram::Max() const
+{
+  int i;
+
+  for (i=HIST_NUM_BUCKETS-1; i>=0; i--) {
+    if (_Counts[i].load(memory_order_relaxed) > 0)  return BucketHighestValue(i);
+  }
+  return 0;
+}
+
+
+double tLatencyHistogram::Mean() const
+{
+  uint64_t n = Count();
+
+  return (n > 0) ? (double) _nsSum.load(memory_order_relaxed) / n : 0.0;
+}
+
+
+/*******************************************************
+* tLatencyHistogram::Print
+*
+* One-line summary, in microseconds
+*/
+
+void tLatencyHistogram::Print(FILE *pFile, const char *sLabel) const
+{
+  fprintf(pFile, "%s n=%llu  mean %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f us",
+          sLabel, (unsigned long long) Count(),
+          Mean() / 1000.0,
+          Percentile(50.0)  / 1000.0,
+          Percentile(99.0)  / 1000.0,
+          Percentile(99.9)  / 1000.0,
+          Max() / 1000.0);
+  if (NumNegative() > 0)  fprintf(pFile, "  (%llu negative)", (unsigned long long) NumNegative());
+  fprintf(pFile, "\n");
+}
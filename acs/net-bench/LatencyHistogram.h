@@ -0,0 +1,77 @@
+/* tLatencyHistogram - Log-bucketed latency histogram
+*
+* An HDR-style histogram of nanosecond values.  Values below 64 ns get a
+* bucket each; above that, every power of two is split into 32 linear
+* sub-buckets, so any recorded value is known to within about 3%, over a
+* range of 0 to 2^40 ns (about 18 minutes).  Recording is O(1), with no
+* allocation and no locks.
+*
+* One thread records; any thread may read.  The counts are relaxed
+* atomics, so a reader sees a consistent-enough picture for reporting
+* without slowing the recording thread down.
+*
+* Negative values, which happen when the sender's clock is ahead of ours,
+* are recorded as zero and counted separately.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TLATENCYHISTOGRAM_H_
+#define TLATENCYHISTOGRAM_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BUCKET_BITS   (5)
+#define HIST_SUB_BUCKETS       (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_MAX_VALUE_BITS    (40)
+#define HIST_NUM_BUCKETS       (HIST_SUB_BUCKETS * (HIST_MAX_VALUE_BITS - HIST_SUB_BUCKET_BITS + 1))
+#define HIST_MAX_VALUE         ((int64_t) 1 << HIST_MAX_VALUE_BITS)
+
+
+class tLatencyHistogram {
+public:
+  tLatencyHistogram();
+
+  // Counts are atomics, so use CopyFrom() rather than copying
+  tLatencyHistogram(const tLatencyHistogram &) = delete;
+  tLatencyHistogram& operator=(const tLatencyHistogram &) = delete;
+
+  void Record(int64_t nsValue);
+
+  void Reset();
+  void CopyFrom(const tLatencyHistogram &Other);
+  void Add(const tLatencyHistogram &Other);
+  void Subtract(const tLatencyHistogram &Other);
+
+  uint64_t Count()      const { return _nCount.load(std::memory_order_relaxed); }
+  uint64_t NumNegative() const { return _nNegative.load(std::memory_order_relaxed); }
+  int64_t  Percentile(double fPercent) const;
+  int64_t  Min() const;
+  int64_t  Max() const;
+  double   Mean() const;
+  uint64_t BucketCount(int iBucket) const { return _Counts[iBucket].load(std::memory_order_relaxed); }
+
+  void Print(FILE *pFile, const char *sLabel) const;
+
+  static int     BucketIndex(int64_t nsValue);
+  static int64_t BucketHighestValue(int iBucket);
+
+protected:
+  std::atomic<uint64_t> _Counts[HIST_NUM_BUCKETS];
+  std::atomic<uint64_t> _nCount;
+  std::atomic<uint64_t> _nNegative;
+  std::atomic<int64_t>  _nsSum;
+};
+
+
+#endif /* TLATENCYHISTOGRAM_H_ */
@@ -45,6 +45,7 @@
 #include <ctime>
 #include <cmath>
 #include <time.h>
+#include <alloca.h>
 
 using namespace std;
 
@@ -61,6 +62,8 @@ using namespace std;
 */
 
 bool       tPThread::_bAllHaveBeenStartedWithRequestedAttributes = true;
+bool       tPThread::_bAnyHaveLostPriority = false;
+bool       tPThread::_bPrefaultStacks = false;
 std::mutex tPThread::_ThreadCreationMutex;
 
 
@@ -88,6 +91,10 @@ tPThread::tPThread(int iPriority, bool bForceKillOnStopRequest) :
   _bForceKillOnStopRequest(bForceKillOnStopRequest)
 {
   _szStackSize = THREAD_DEFAULT_STACK_SIZE;
+  _bCpuSet     = false;
+  CPU_ZERO(&_CpuSet);
+  _bActualCpuSet = false;
+  CPU_ZERO(&_ActualCpuSet);
   _ThePthread  = 0;
   _bExit       = false;
   _bWasStartedWithRequestedAttributes = false;
@@ -122,6 +129,10 @@ tPThread::tPThread(tPThread &&other) :
 
   // Copy values from the other thread 
   _iPriority                           = other._iPriority;
+  _CpuSet                              = other._CpuSet;
+  _bCpuSet                             = other._bCpuSet;
+  _ActualCpuSet                        = other._ActualCpuSet;
+  _bActualCpuSet                       = other._bActualCpuSet;
   _szStackSize                         = other._szStackSize;
   _ThePthread                          = other._ThePthread;
   _bExit                               = other._bExit;
@@ -161,6 +172,10 @@ tPThread& tPThread::operator=(tPThread&& other)
   if (this != &other) {
     // Copy values from the other thread 
     _iPriority                           = other._iPriority;
+    _CpuSet                              = other._CpuSet;
+    _bCpuSet                             = other._bCpuSet;
+    _ActualCpuSet                        = other._ActualCpuSet;
+    _bActualCpuSet                       = other._bActualCpuSet;
     _szStackSize                         = other._szStackSize;
     _ThePthread                          = other._ThePthread;
     _bExit                               = other._bExit;
@@ -221,12 +236,109 @@ void *PThreadHelper(void *pPThread) {
   // tPThread *pThread = * reinterpret_cast<tPThread **> (ppPThread);
    tPThread *pThread = reinterpret_cast<tPThread *> (pPThread);
 
+  // Before the unlock, so that it is there by the time StartThread() returns
+  pThread->_bActualCpuSet = (pthread_getaffinity_np(pthread_self(), sizeof(pThread->_ActualCpuSet),
+                                                    &pThread->_ActualCpuSet) == 0);
+
   tPThread::_ThreadCreationMutex.unlock();
 
+  if (tPThread::_bPrefaultStacks) {
+    pthread_attr_t attr;
+    size_t         szStack = 0;
+
+    // What was actually allocated, which may be rounded up from _szStackSize
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      pthread_attr_getstacksize(&attr, &szStack);
+      pthread_attr_destroy(&attr);
+    }
+    if (szStack > THREAD_STACK_PREFAULT_MARGIN)  tPThread::PrefaultStack(szStack - THREAD_STACK_PREFAULT_MARGIN);
+  }
+
   return  pThread->_Thread();
 }
 
 
+/*******************************************************
+* tPThread::PrefaultStack
+*
+* Touches one byte in every page of the next szBytes of the calling thread's
+* stack, from the top down, as the stack would grow.  Kept out of line, so
+* that the space is given back as soon as it returns.
+*/
+
+void tPThread::PrefaultStack(size_t szBytes)
+{
+  volatile uint8_t *pStack = (volatile uint8_t *) alloca(szBytes);
+  size_t            szPage = (size_t) sysconf(_SC_PAGESIZE);
+  size_t            i;
+
+  for (i=szBytes; i>=szPage; i-=szPage) {
+    pStack[i - 1] = 0;
+  }
+  pStack[0] = 0;
+}
+
+
+/*******************************************************
+* tPThread::SetCpuAffinity
+*
+* INPUTS:
+*   iCpu   - the one CPU to run on, or -1 to run anywhere
+*   CpuSet - the CPUs to run on; empty to run anywhere
+*/
+
+void tPThread::SetCpuAffinity(int iCpu)
+{
+  CPU_ZERO(&_CpuSet);
+  if (iCpu >= 0 && iCpu < CPU_SETSIZE)  CPU_SET(iCpu, &_CpuSet);
+  _bCpuSet = (CPU_COUNT(&_CpuSet) > 0);
+}
+
+
+void tPThread::SetCpuAffinity(const cpu_set_t &CpuSet)
+{
+  _CpuSet  = CpuSet;
+  _bCpuSet = (CPU_COUNT(&_CpuSet) > 0);
+}
+
+
+/*******************************************************
+* tPThread::GetActualCpuAffinity
+*
+* OUTPUTS:
+*   *pCpuSet - the CPUs the thread was allowed to run on as it started
+* RETURNS:
+*   false if the thread has not been started
+*/
+
+bool tPThread::GetActualCpuAffinity(cpu_set_t *pCpuSet) const
+{
+  if (!_bActualCpuSet)  return false;
+
+  *pCpuSet = _ActualCpuSet;
+  return true;
+}
+
+
+/*******************************************************
+* tPThread::_SetAttrAffinity
+*
+* Adds the CPU affinity, if one was requested, to a thread attributes object
+*/
+
+void tPThread::_SetAttrAffinity(pthread_attr_t *pAttr)
+{
+  int retval;
+
+  if (!_bCpuSet)  return;
+
+  retval = pthread_attr_setaffinity_np(pAttr, sizeof(_CpuSet), &_CpuSet);
+  if (retval != 0) {
+    fprintf(stderr, "tPThread: Could not set CPU affinity: %s\n", strerror(retval));
+  }
+}
+
+
 /*******************************************************
 * tPThread::StartThread
 *
@@ -241,6 +353,7 @@ pthread_t tPThread::StartThread()
   pthread_attr_t attr;
   struct sched_param param;
   int retval = 0;
+  bool bAffinityDropped = false;
 
   // Protection against starting more than one thread at a time
   std::scoped_lock lock(_ThreadCreationMutex);
@@ -289,23 +402,41 @@ pthread_t tPThread::StartThread()
       return _ThePthread;
     }
 
+    _SetAttrAffinity(&attr);
+
     /***
     * And now create the thread.  Instead of passing in the this pointer as the arg,
     * we pass in a pointer to the this pointer.  See the comments for PThreadHelper 
     * for the explanation as to why.
     */
     retval = pthread_create(&_ThePthread, &attr, PThreadHelper, this); // _pThis);
+
+    // EINVAL here means none of the CPUs asked for are available to us, e.g. outside our cpuset.
+    // Drop only the affinity: rebuild attr with the same RT policy and priority, and no CPU set.
+    if (retval == EINVAL && _bCpuSet) {
+      fprintf(stderr, "tPThread: Requested CPU set rejected, starting RT thread without affinity\n");
+      pthread_attr_destroy(&attr);
+      pthread_attr_init(&attr);
+      pthread_attr_setstacksize(&attr, _szStackSize);
+      pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+      pthread_attr_setschedparam(&attr, &param);
+      pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+      retval = pthread_create(&_ThePthread, &attr, PThreadHelper, this);
+      bAffinityDropped = true;
+    }
     pthread_attr_destroy(&attr);
     
     if (retval == 0)  {
       /*** Realtime thread successfully created, go ahead and exit ***/
-      _bWasStartedWithRequestedAttributes = true;
+      _bWasStartedWithRequestedAttributes = !bAffinityDropped;
+      if (bAffinityDropped)  _bAllHaveBeenStartedWithRequestedAttributes = false;
       return _ThePthread;
     }
 
     // If we got here, we failed
     _bWasStartedWithRequestedAttributes = false;
     _bAllHaveBeenStartedWithRequestedAttributes = false;
+    _bAnyHaveLostPriority = true;
   }
 
   /*** Create a standard (non-realtime) thread ***/
@@ -314,15 +445,29 @@ pthread_t tPThread::StartThread()
     fprintf(stderr, "   Thread stack size set to %lu failed: %s.\n", _szStackSize, strerror(retval));
     throw std::runtime_error("Could not set stack size");
   }
+  _SetAttrAffinity(&attr);
   retval = pthread_create(&_ThePthread, &attr, PThreadHelper, this); // _pThis);
+
+
+  // EINVAL here means none of the CPUs asked for are available to us, e.g. outside our cpuset.
+  // Better to run unpinned, flagged as not as requested, than not at all.
+  if (retval == EINVAL && _bCpuSet) {
+    fprintf(stderr, "tPThread: Requested CPUs not available, starting thread without affinity\n");
+    pthread_attr_destroy(&attr);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, _szStackSize);
+    retval = pthread_create(&_ThePthread, &attr, PThreadHelper, this);
+    bAffinityDropped = true;
+  }
   // Use NULL to get the standard stack size
   // retval = pthread_create(&_ThePthread, NULL, PThreadHelper, _pThis);
   if (retval == 0)  { 
     // Success
-    if (_iPriority <= 0) {
+    if (_iPriority <= 0 && !bAffinityDropped) {
       // We wanted a standard thread, and that's what was created
       _bWasStartedWithRequestedAttributes = true;
     }
+    if (bAffinityDropped)  _bAllHaveBeenStartedWithRequestedAttributes = false;
   } // fprintf(stderr, "   ...Success!\n");
   else {
     fprintf(stderr, "   Thread creation failed: %s.\n", strerror(retval));
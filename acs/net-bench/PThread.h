@@ -50,6 +50,10 @@
 // rather than in LsebConfig.h, so that this class can live as a standalone library.
 #define THREAD_DEFAULT_STACK_SIZE          (2000000)
 
+// Left untouched at the top of a stack when prefaulting it: what the thread has already used
+// to get there, and, in glibc, its TLS and thread descriptor, which share the allocation
+#define THREAD_STACK_PREFAULT_MARGIN       (64 * 1024)
+
 
 
 // A C helper function to allow the OS to spawn tPThread::_Thread() as a thread.
@@ -80,6 +84,15 @@ public:
   // If you want a non-default stack size, this must be called prior to StartThread
   void SetStackSize(size_t szStackSizeToUse) { _szStackSize = szStackSizeToUse; }
 
+  // To pin the thread to one CPU, or confine it to a set, call prior to StartThread.  -1 for no pinning.
+  void SetCpuAffinity(int iCpu);
+  void SetCpuAffinity(const cpu_set_t &CpuSet);
+  bool HasCpuAffinity() const { return _bCpuSet; }
+
+  // The CPUs the thread could actually use when it started, which is what the kernel made of the
+  // request.  Still available once the thread has exited.
+  bool GetActualCpuAffinity(cpu_set_t *pCpuSet) const;
+
   pthread_t StartThread();
   virtual void StopThread(bool bWaitForExit = false);
   void *WaitForExit();
@@ -96,20 +109,37 @@ public:
     return _bAllHaveBeenStartedWithRequestedAttributes;
   }
 
+  // Whether any RT thread could not be given its priority, as opposed to only its CPUs
+  static bool HaveAnyLostPriority() { return _bAnyHaveLostPriority; }
+
+  // Whether threads started from now on touch their whole stack before running _Thread(),
+  // so that they take no page faults on it later
+  static void SetPrefaultStacks(bool bPrefault) { _bPrefaultStacks = bPrefault; }
+
+  // Touches the next szBytes of the calling thread's stack
+  static void PrefaultStack(size_t szBytes) __attribute__((noinline));
+
   // A zombie object is one whose contents have been moved to another
   // tPThread, but the tPThread is not yet destroyed.
   bool IsZombieObject() const { return (_ThePthread == 0); }  //_pThis == nullptr); }
 
 protected:
   virtual void *_Thread() = 0;
+  void _SetAttrAffinity(pthread_attr_t *pAttr);
   
   int                 _iPriority;
+  cpu_set_t           _CpuSet;        // CPUs to confine the thread to, if _bCpuSet
+  bool                _bCpuSet;
+  cpu_set_t           _ActualCpuSet;  // Read by the thread itself as it starts
+  bool                _bActualCpuSet;
   size_t              _szStackSize;
   pthread_t           _ThePthread;
   bool                _bExit;
   bool                _bForceKillOnStopRequest;
   bool                _bWasStartedWithRequestedAttributes;
   static bool         _bAllHaveBeenStartedWithRequestedAttributes;
+  static bool         _bAnyHaveLostPriority;
+  static bool         _bPrefaultStacks;
 
 
   // TODO - I think this is unnecessary now that there are no copy constructors,
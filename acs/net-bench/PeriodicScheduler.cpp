@@ -0,0 +1,161 @@
+/* tPeriodicScheduler - Fixed-rate ticks on absolute deadlines
+*
+* See PeriodicScheduler.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "PeriodicScheduler.h"
+
+#include <time.h>
+#include <errno.h>
+#include <stdexcept>
+
+using namespace std;
+
+
+/*******************************************************
+* tPeriodicScheduler constructor
+*
+*/
+
+tPeriodicScheduler::tPeriodicScheduler() :
+  _nsPeriod(0),
+  _nsNextTick(0),
+  _nsTick(0),
+  _nTicks(0),
+  _nMissed(0),
+  _nOverruns(0)
+{
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::Start
+*
+* INPUTS:
+*   nsFirstTick - CLOCK_MONOTONIC time of the first tick.  Loops that are
+*                 to tick together should be given the same time.
+*   nsPeriod    - time between ticks
+* SIDE EFFECTS:
+*   Throws a std::invalid_argument if nsPeriod is not positive
+*/
+
+void tPeriodicScheduler::Start(int64_t nsFirstTick, int64_t nsPeriod)
+{
+  if (nsPeriod <= 0) {
+    throw std::invalid_argument("tPeriodicScheduler: period must be positive");
+  }
+
+  _nsNextTick = nsFirstTick;
+  _nsPeriod   = nsPeriod;
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::WaitForNextTick
+*
+* Sleeps until the next deadline and records how late the wake-up was.
+* If a whole period or more has been lost, the ticks that are already
+* past are counted as missed and skipped, so the loop resumes on the
+* latest deadline rather than trying to catch up.
+*
+* RETURNS:
+*   The deadline of the tick to run now, CLOCK_MONOTONIC ns
+*/
+
+int64_t tPeriodicScheduler::WaitForNextTick()
+{
+  struct timespec tmDeadline;
+  int64_t         nsLate;
+  int64_t         nMissed;
+
+  tmDeadline.tv_sec  = _nsNextTick / 1000000000LL;
+  tmDeadline.tv_nsec = _nsNextTick % 1000000000LL;
+
+  // Restart after a signal; the deadline is absolute, so nothing is lost
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tmDeadline, NULL) == EINTR) {
+  }
+
+  nsLate = NowNs() - _nsNextTick;
+  _Lateness.Record(nsLate);
+
+  _nsTick = _nsNextTick;
+  if (nsLate >= _nsPeriod) {
+    nMissed  = nsLate / _nsPeriod;
+    _nsTick += nMissed * _nsPeriod;
+    _Add(_nMissed, nMissed);
+  }
+
+  _nsNextTick = _nsTick + _nsPeriod;
+  _Add(_nTicks, 1);
+
+  return _nsTick;
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::EndOfWork
+*
+* Call when the tick's work is done, to detect overruns
+*/
+
+void tPeriodicScheduler::EndOfWork()
+{
+  if (NowNs() > _nsNextTick)  _Add(_nOverruns, 1);
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::NowNs
+*
+* RETURNS:
+*   CLOCK_MONOTONIC time in ns
+*/
+
+int64_t tPeriodicScheduler::NowNs()
+{
+  struct timespec tmNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &tmNow);
+  return (int64_t) tmNow.tv_sec * 1000000000LL + tmNow.tv_nsec;
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::Print
+*
+* One-line summary of the wake-up lateness, then the tick counts
+*/
+
+void tPeriodicScheduler::Print(FILE *pFile, const char *sLabel) const
+{
+  _Lateness.Print(pFile, sLabel);
+  fprintf(pFile, "    period %.3f ms: %ld ticks, %ld missed, %ld overruns\n",
+          _nsPeriod / 1e6, NumTicks(), NumMissed(), NumOverruns());
+}
+
+
+/*******************************************************
+* tPeriodicScheduler::WriteResults
+*
+* What Print() shows, as an object named sKey
+*/
+
+void tPeriodicScheduler::WriteResults(tResultFile &Results, const char *sKey) const
+{
+  Results.BeginObject(sKey);
+  Results.Add("period_ns", _nsPeriod);
+  Results.Add("ticks",     NumTicks());
+  Results.Add("missed",    NumMissed());
+  Results.Add("overruns",  NumOverruns());
+  Results.AddHistogram("lateness", _Lateness);
+  Results.EndObject();
+}
@@ -0,0 +1,78 @@
+/* tPeriodicScheduler - Fixed-rate ticks on absolute deadlines
+*
+* Paces a periodic loop.  Each tick's deadline is the first tick's time
+* plus a whole number of periods, and the loop sleeps to it with
+* clock_nanosleep(TIMER_ABSTIME) on CLOCK_MONOTONIC, so that lateness in
+* one cycle never pushes back the next.
+*
+* The scheduler measures its own timing error rather than absorbing it:
+*
+*   - wake-up lateness: how long after each deadline the loop got going
+*   - missed ticks: deadlines that had already passed by a whole period
+*     when the loop woke, which are skipped rather than run back to back
+*   - overruns: cycles whose work was still going at the next deadline
+*
+* Nothing allocates, locks or blocks other than the sleep itself, so it
+* is safe to use from an RT thread.  Only the thread running the loop may
+* call WaitForNextTick() and EndOfWork(); any thread may read the counts.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TPERIODICSCHEDULER_H_
+#define TPERIODICSCHEDULER_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include "LatencyHistogram.h"
+#include "ResultFile.h"
+
+
+class tPeriodicScheduler {
+public:
+  tPeriodicScheduler();
+
+  tPeriodicScheduler(const tPeriodicScheduler &) = delete;
+  tPeriodicScheduler& operator=(const tPeriodicScheduler &) = delete;
+
+  void    Start(int64_t nsFirstTick, int64_t nsPeriod);
+  int64_t WaitForNextTick();
+  void    EndOfWork();
+
+  int64_t NextTick()     const { return _nsNextTick; }
+  int64_t Period()       const { return _nsPeriod; }
+  long    NumTicks()     const { return _nTicks   .load(std::memory_order_relaxed); }
+  long    NumMissed()    const { return _nMissed  .load(std::memory_order_relaxed); }
+  long    NumOverruns()  const { return _nOverruns.load(std::memory_order_relaxed); }
+  const tLatencyHistogram &Lateness() const { return _Lateness; }
+
+  void Print(FILE *pFile, const char *sLabel) const;
+  void WriteResults(tResultFile &Results, const char *sKey) const;
+
+  static int64_t NowNs();
+
+protected:
+  static void _Add(std::atomic<long> &Count, long n) {
+    Count.store(Count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  int64_t           _nsPeriod;
+  int64_t           _nsNextTick;   // CLOCK_MONOTONIC deadline of the next tick
+  int64_t           _nsTick;       // Deadline of the tick being run
+  std::atomic<long> _nTicks;       // Ticks run
+  std::atomic<long> _nMissed;      // Ticks skipped because the loop woke a whole period or more late
+  std::atomic<long> _nOverruns;    // Ticks whose work ran past the next deadline
+  tLatencyHistogram _Lateness;     // Wake-up time less deadline, per tick run
+};
+
+
+#endif /* TPERIODICSCHEDULER_H_ */
@@ -0,0 +1,80 @@
+/****************************************************
+* ResourceUsage
+*
+* Process-wide resource usage reporting, shared by the benchmark programs
+*/
+
+#include "ResourceUsage.h"
+#include <stdio.h>
+#include <sys/resource.h>
+
+
+// Fault counts when the measurement started, or -1 if it has not
+static long nWindowStartMinorFaults = -1;
+static long nWindowStartMajorFaults = -1;
+
+
+/*****************************
+* PrintResourceUsage
+*
+* CPU time, context switches and peak resident memory for the whole 
+* process, for comparing the I/O backends.
+*/
+
+void PrintResourceUsage()
+{
+  struct rusage Usage;
+  long nMinorFaults, nMajorFaults;
+
+  if (getrusage(RUSAGE_SELF, &Usage) < 0)  return;
+
+  printf("CPU time: user %ld.%06ld s, system %ld.%06ld s\n",
+         Usage.ru_utime.tv_sec, Usage.ru_utime.tv_usec,
+         Usage.ru_stime.tv_sec, Usage.ru_stime.tv_usec);
+  printf("Context switches: %ld voluntary, %ld involuntary\n", Usage.ru_nvcsw, Usage.ru_nivcsw);
+  printf("Max resident set size: %ld kB\n", Usage.ru_maxrss);
+  printf("Page faults: %ld minor, %ld major", Usage.ru_minflt, Usage.ru_majflt);
+  if (GetMeasurementWindowFaults(&nMinorFaults, &nMajorFaults)) {
+    printf("; %ld minor, %ld major after setup", nMinorFaults, nMajorFaults);
+  }
+  printf("\n");
+}
+
+
+/*****************************
+* StartMeasurementWindow
+*
+* Marks the end of setup: every thread started, every buffer made.  Page
+* faults from here on are ones the real-time loops may have waited on.
+*/
+
+void StartMeasurementWindow()
+{
+  struct rusage Usage;
+
+  if (getrusage(RUSAGE_SELF, &Usage) < 0)  return;
+
+  nWindowStartMinorFaults = Usage.ru_minflt;
+  nWindowStartMajorFaults = Usage.ru_majflt;
+}
+
+
+/*****************************
+* GetMeasurementWindowFaults
+*
+* OUTPUTS:
+*   *pnMinorFaults, *pnMajorFaults - page faults since StartMeasurementWindow()
+* RETURNS:
+*   false if StartMeasurementWindow() was never called
+*/
+
+bool GetMeasurementWindowFaults(long *pnMinorFaults, long *pnMajorFaults)
+{
+  struct rusage Usage;
+
+  if (nWindowStartMinorFaults < 0 || getrusage(RUSAGE_SELF, &Usage) < 0)  return false;
+
+  *pnMinorFaults = Usage.ru_minflt - nWindowStartMinorFaults;
+  *pnMajorFaults = Usage.ru_majflt - nWindowStartMajorFaults;
+  return true;
+}
@@ -0,0 +1,16 @@
+/****************************************************
+* ResourceUsage
+*
+* Process-wide resource usage reporting, shared by the benchmark programs
+*/
+
+#ifndef INC_ResourceUsage_h
+#define INC_ResourceUsage_h
+
+void PrintResourceUsage();
+
+// Page faults are also counted from this point on, once setup is done
+void StartMeasurementWindow();
+bool GetMeasurementWindowFaults(long *pnMinorFaults, long *pnMajorFaults);
+
+#endif  // INC_ResourceUsage_h
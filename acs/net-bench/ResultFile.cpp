@@ -0,0 +1,268 @@
+/* tResultFile - Machine-readable record of a benchmark run
+*
+* See ResultFile.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "ResultFile.h"
+#include "ResourceUsage.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+
+/*******************************************************
+* tResultFile constructor
+*
+* Opens the file and starts the object with what identifies the run
+*
+* INPUTS:
+*   sFilename    - file to write, replaced if it exists
+*   sProgramName - program writing it
+* SIDE EFFECTS:
+*   Throws a std::runtime_error if the file cannot be created
+*/
+
+tResultFile::tResultFile(const string &sFilename, const char *sProgramName)
+{
+  struct utsname Uname;
+  char           sTime[32];
+  time_t         tNow = time(NULL);
+
+  _pFile = fopen(sFilename.c_str(), "w");
+  if (_pFile == NULL) {
+    throw std::runtime_error("Cannot create result file " + sFilename + ": " + strerror(errno));
+  }
+
+  BeginObject();
+  Add("format", RESULT_FILE_FORMAT);
+  Add("program", sProgramName);
+
+  strftime(sTime, sizeof(sTime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&tNow));
+  Add("time", sTime);
+
+  if (uname(&Uname) == 0) {
+    Add("host", Uname.nodename);
+    Add("kernel", Uname.release);
+  }
+  Add("cpus", sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+
+/*******************************************************
+* tResultFile destructor
+*
+* Closes whatever is still open, and the file
+*/
+
+tResultFile::~tResultFile()
+{
+  while (!_bFirst.empty()) {
+    EndObject();
+  }
+  fprintf(_pFile, "\n");
+  fclose(_pFile);
+}
+
+
+/*******************************************************
+* tResultFile::BeginObject, EndObject, BeginArray, EndArray
+*
+* EndObject() and EndArray() close whichever was opened last
+*/
+
+void tResultFile::BeginObject(const char *sKey)
+{
+  _Key(sKey);
+  fprintf(_pFile, "{");
+  _bFirst.push_back(true);
+}
+
+
+void tResultFile::EndObject()
+{
+  _bFirst.pop_back();
+  fprintf(_pFile, "\n%*s}", (int) _bFirst.size() * 2, "");
+}
+
+
+void tResultFile::BeginArray(const char *sKey)
+{
+  _Key(sKey);
+  fprintf(_pFile, "[");
+  _bFirst.push_back(true);
+}
+
+
+void tResultFile::EndArray()
+{
+  _bFirst.pop_back();
+  fprintf(_pFile, "]");
+}
+
+
+/*******************************************************
+* tResultFile::Add
+*
+* One value, as a member of the open object, or an element of the open
+* array if sKey is nullptr
+*/
+
+void tResultFile::Add(const char *sKey, long nValue)
+{
+  _Key(sKey);
+  fprintf(_pFile, "%ld", nValue);
+}
+
+
+void tResultFile::Add(const char *sKey, double fValue)
+{
+  _Key(sKey);
+  // JSON has no nan or inf
+  if (std::isfinite(fValue))  fprintf(_pFile, "%.9g", fValue);
+  else                        fprintf(_pFile, "null");
+}
+
+
+void tResultFile::Add(const char *sKey, bool bValue)
+{
+  _Key(sKey);
+  fprintf(_pFile, bValue ? "true" : "false");
+}
+
+
+void tResultFile::Add(const char *sKey, const char *sValue)
+{
+  _Key(sKey);
+  _String(sValue);
+}
+
+
+/*******************************************************
+* tResultFile::AddHistogram
+*
+* A latency histogram: the count, the summary values, then the non-empty
+* buckets as [highest value, count] pairs
+*/
+
+void tResultFile::AddHistogram(const char *sKey, const tLatencyHistogram &Histogram)
+{
+  int      i;
+  uint64_t nCount;
+
+  BeginObject(sKey);
+  Add("count",    (long) Histogram.Count());
+  Add("negative", (long) Histogram.NumNegative());
+  if (Histogram.Count() > 0) {
+    Add("mean_ns",   (long) Histogram.Mean());
+    Add("min_ns",    Histogram.Min());
+    Add("p50_ns",    Histogram.Percentile(50.0));
+    Add("p90_ns",    Histogram.Percentile(90.0));
+    Add("p99_ns",    Histogram.Percentile(99.0));
+    Add("p99_9_ns",  Histogram.Percentile(99.9));
+    Add("p99_99_ns", Histogram.Percentile(99.99));
+    Add("max_ns",    Histogram.Max());
+  }
+
+  BeginArray("buckets");
+  for (i=0; i<HIST_NUM_BUCKETS; i++) {
+    nCount = Histogram.BucketCount(i);
+    if (nCount == 0)  continue;
+
+    BeginArray();
+    Add(nullptr, tLatencyHistogram::BucketHighestValue(i));
+    Add(nullptr, (long) nCount);
+    EndArray();
+  }
+  EndArray();
+  EndObject();
+}
+
+
+/*******************************************************
+* tResultFile::AddResourceUsage
+*
+* The whole process's getrusage() counts, as PrintResourceUsage() prints
+*/
+
+void tResultFile::AddResourceUsage()
+{
+  struct rusage Usage;
+  long nMinorFaults, nMajorFaults;
+
+  if (getrusage(RUSAGE_SELF, &Usage) < 0)  return;
+
+  BeginObject("rusage");
+  Add("user_ns",                 (long) Usage.ru_utime.tv_sec * 1000000000L + Usage.ru_utime.tv_usec * 1000L);
+  Add("system_ns",               (long) Usage.ru_stime.tv_sec * 1000000000L + Usage.ru_stime.tv_usec * 1000L);
+  Add("voluntary_switches",      Usage.ru_nvcsw);
+  Add("involuntary_switches",    Usage.ru_nivcsw);
+  Add("minor_faults",            Usage.ru_minflt);
+  Add("major_faults",            Usage.ru_majflt);
+  Add("max_rss_kb",              Usage.ru_maxrss);
+  if (GetMeasurementWindowFaults(&nMinorFaults, &nMajorFaults)) {
+    Add("window_minor_faults",   nMinorFaults);
+    Add("window_major_faults",   nMajorFaults);
+  }
+  EndObject();
+}
+
+
+/*******************************************************
+* tResultFile::_Key
+*
+* Separates from the previous member or element, and writes the key
+*/
+
+void tResultFile::_Key(const char *sKey)
+{
+  if (_bFirst.empty())  return;
+
+  if (!_bFirst.back())  fprintf(_pFile, ",");
+  _bFirst.back() = false;
+
+  if (sKey != nullptr) {
+    fprintf(_pFile, "\n%*s", (int) _bFirst.size() * 2, "");
+    _String(sKey);
+    fprintf(_pFile, ": ");
+  }
+}
+
+
+/*******************************************************
+* tResultFile::_String
+*
+* Writes a JSON string, escaping quotes, backslashes and control
+* characters, since values such as file names come from the command line
+*/
+
+void tResultFile::_String(const char *sValue)
+{
+  const unsigned char *p;
+
+  fputc('"', _pFile);
+  for (p = (const unsigned char *) sValue; *p != '\0'; p++) {
+    if      (*p == '"' || *p == '\\')  fprintf(_pFile, "\\%c", *p);
+    else if (*p == '\n')               fprintf(_pFile, "\\n");
+    else if (*p == '\t')               fprintf(_pFile, "\\t");
+    else if (*p < 0x20)                fprintf(_pFile, "\\u%04x", *p);
+    else                               fputc(*p, _pFile);
+  }
+  fputc('"', _pFile);
+}
@@ -0,0 +1,72 @@
+/* tResultFile - Machine-readable record of a benchmark run
+*
+* Writes one JSON object to a file, for compare_results.py to check one
+* run against another.  The programs write it at shutdown, alongside the
+* usual printed summaries: the run's configuration, then whatever each
+* part of the program measured, each part through a WriteResults() method
+* beside its Print method.
+*
+* Latency histograms are written with their summary percentiles and their
+* non-empty buckets, so that other percentiles can be worked out later.
+* All times are integer nanoseconds.
+*
+* Keys and string values are written as given, so must not need escaping.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TRESULTFILE_H_
+#define TRESULTFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "LatencyHistogram.h"
+
+// Version of the layout, for the comparison tool
+#define RESULT_FILE_FORMAT  (1)
+
+
+class tResultFile {
+public:
+  tResultFile(const std::string &sFilename, const char *sProgramName);
+  ~tResultFile();
+
+  tResultFile(const tResultFile &) = delete;
+  tResultFile& operator=(const tResultFile &) = delete;
+
+  // Keys are left out (nullptr) inside arrays
+  void BeginObject(const char *sKey = nullptr);
+  void EndObject();
+  void BeginArray(const char *sKey = nullptr);
+  void EndArray();
+
+  void Add(const char *sKey, long nValue);
+  void Add(const char *sKey, int nValue)  { Add(sKey, (long) nValue); }
+  void Add(const char *sKey, double fValue);
+  void Add(const char *sKey, bool bValue);
+  void Add(const char *sKey, const char *sValue);
+  void Add(const char *sKey, const std::string &sValue) { Add(sKey, sValue.c_str()); }
+
+  void AddHistogram(const char *sKey, const tLatencyHistogram &Histogram);
+  void AddResourceUsage();
+
+protected:
+  void _Key(const char *sKey);
+  void _String(const char *sValue);
+
+  FILE             *_pFile;
+  std::vector<bool> _bFirst;   // Per open object or array, whether nothing is in it yet
+};
+
+
+#endif /* TRESULTFILE_H_ */
@@ -0,0 +1,262 @@
+/* RtMemory - Keeping page faults out of the real-time loops
+*
+* See RtMemory.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "RtMemory.h"
+#include "PThread.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <mutex>
+
+using namespace std;
+
+
+// Alignment of each buffer carved from the arena, a cache line
+#define RT_BUFFER_ALIGNMENT  (64)
+
+
+/*******************************************************
+* Huge page arena
+*
+* Buffers are carved off the current chunk in turn; when one does not fit,
+* a new chunk is mapped.  Only made at startup, but guarded all the same.
+*/
+
+static std::mutex ArenaMutex;
+static bool       bArenaEnabled   = false;
+static uint8_t   *pArenaChunk     = nullptr;
+static size_t     szArenaChunk    = 0;
+static size_t     szArenaUsed     = 0;
+static int        nHugeTlbChunks  = 0;     // Explicit huge pages
+static int        nThpChunks      = 0;     // Transparent huge pages asked for
+static size_t     szArenaMapped   = 0;
+static size_t     szArenaHanded   = 0;
+static size_t     szHeapBuffers   = 0;
+
+
+/*******************************************************
+* MapArenaChunk
+*
+* Maps a chunk of at least szMin bytes, a whole number of huge pages,
+* from the reserved huge page pool if it has any free, else as ordinary
+* memory aligned to a huge page and marked for transparent huge pages.
+*
+* RETURNS:
+*   The chunk, already faulted in, or nullptr if even that failed
+*/
+
+static uint8_t *MapArenaChunk(size_t szMin, size_t *pszChunk)
+{
+  size_t   szChunk = (szMin + RT_HUGE_PAGE_SIZE - 1) / RT_HUGE_PAGE_SIZE * RT_HUGE_PAGE_SIZE;
+  void    *p;
+  uint8_t *pAligned;
+  size_t   szLead;
+
+  p = mmap(NULL, szChunk, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+  if (p != MAP_FAILED) {
+    nHugeTlbChunks++;
+  }
+  else {
+    // Over-allocate by a huge page, and trim both ends so the chunk starts on one
+    p = mmap(NULL, szChunk + RT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)  return nullptr;
+
+    pAligned = (uint8_t *) (((uintptr_t) p + RT_HUGE_PAGE_SIZE - 1) & ~((uintptr_t) RT_HUGE_PAGE_SIZE - 1));
+    szLead   = pAligned - (uint8_t *) p;
+    if (szLead > 0)  munmap(p, szLead);
+    munmap(pAligned + szChunk, RT_HUGE_PAGE_SIZE - szLead);
+    p = pAligned;
+
+    madvise(p, szChunk, MADV_HUGEPAGE);
+    nThpChunks++;
+  }
+
+  memset(p, 0, szChunk);
+  szArenaMapped += szChunk;
+  *pszChunk = szChunk;
+  return (uint8_t *) p;
+}
+
+
+/*******************************************************
+* InitRtMemory
+*
+* Locks the process's memory and arranges for stacks and buffers to be
+* faulted in up front, as described in RtMemory.h.  Call from main()
+* before any threads or buffers are made.
+*
+* INPUTS:
+*   bUseHugePages - whether to put packet buffers in huge pages
+* RETURNS:
+*   false if memory could not be locked, after printing why.  The rest is
+*   still done, since faulting in early is worth having on its own.
+*/
+
+bool InitRtMemory(bool bUseHugePages)
+{
+  bool bLocked = true;
+
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    fprintf(stderr, "** Warning: Could not lock memory: %s **\n", strerror(errno));
+    fprintf(stderr, "   You probably need to run as root, or raise \"ulimit -l\".\n");
+    bLocked = false;
+  }
+
+  tPThread::SetPrefaultStacks(true);
+  tPThread::PrefaultStack(MAIN_THREAD_STACK_PREFAULT_SIZE);
+  tRtBuffer::UseHugePages(bUseHugePages);
+
+  printf("Memory %s, thread stacks prefaulted, packet buffers in %s pages\n",
+         bLocked ? "locked" : "NOT locked", bUseHugePages ? "huge" : "normal");
+
+  return bLocked;
+}
+
+
+/*******************************************************
+* tRtBuffer constructor
+*
+* INPUTS:
+*   szSize - bytes wanted
+* SIDE EFFECTS:
+*   Throws std::bad_alloc if there is no memory
+*/
+
+tRtBuffer::tRtBuffer(size_t szSize) :
+  _pData(nullptr),
+  _szSize(szSize),
+  _bFromArena(false)
+{
+  size_t szNeeded = (szSize + RT_BUFFER_ALIGNMENT - 1) / RT_BUFFER_ALIGNMENT * RT_BUFFER_ALIGNMENT;
+  size_t szChunk;
+
+  if (szSize == 0)  return;
+
+  {
+    std::scoped_lock lock(ArenaMutex);
+
+    if (bArenaEnabled) {
+      if (pArenaChunk == nullptr || szArenaUsed + szNeeded > szArenaChunk) {
+        pArenaChunk = MapArenaChunk(szNeeded, &szChunk);
+        szArenaChunk = (pArenaChunk != nullptr) ? szChunk : 0;
+        szArenaUsed  = 0;
+      }
+      if (pArenaChunk != nullptr) {
+        _pData       = pArenaChunk + szArenaUsed;
+        _bFromArena  = true;
+        szArenaUsed   += szNeeded;
+        szArenaHanded += szSize;
+        return;
+      }
+    }
+    szHeapBuffers += szSize;
+  }
+
+  // Zero-filled, so that every page has been touched
+  _pData = (uint8_t *) aligned_alloc(RT_BUFFER_ALIGNMENT, szNeeded);
+  if (_pData == nullptr)  throw std::bad_alloc();
+  memset(_pData, 0, szNeeded);
+}
+
+
+/*******************************************************
+* tRtBuffer move constructor and assignment
+*
+* The data stays where it is; the other buffer is left empty.
+*/
+
+tRtBuffer::tRtBuffer(tRtBuffer &&other) :
+  _pData      (other._pData),
+  _szSize     (other._szSize),
+  _bFromArena (other._bFromArena)
+{
+  other._pData  = nullptr;
+  other._szSize = 0;
+}
+
+tRtBuffer& tRtBuffer::operator=(tRtBuffer &&other)
+{
+  if (this != &other) {
+    _Free();
+    _pData        = other._pData;
+    _szSize       = other._szSize;
+    _bFromArena   = other._bFromArena;
+    other._pData  = nullptr;
+    other._szSize = 0;
+  }
+  return *this;
+}
+
+
+/*******************************************************
+* tRtBuffer destructor
+*/
+
+tRtBuffer::~tRtBuffer()
+{
+  _Free();
+}
+
+
+/*******************************************************
+* tRtBuffer::_Free
+*
+* Arena memory is not reused, so only heap buffers are actually freed
+*/
+
+void tRtBuffer::_Free()
+{
+  if (_pData != nullptr && !_bFromArena)  free(_pData);
+  _pData = nullptr;
+}
+
+
+/*******************************************************
+* tRtBuffer::UseHugePages
+*
+* Whether buffers made from now on come from the huge page arena
+*/
+
+void tRtBuffer::UseHugePages(bool bUseHugePages)
+{
+  std::scoped_lock lock(ArenaMutex);
+
+  bArenaEnabled = bUseHugePages;
+}
+
+
+/*******************************************************
+* tRtBuffer::PrintSummary
+*
+* Where the packet buffers ended up
+*/
+
+void tRtBuffer::PrintSummary(FILE *pFile)
+{
+  std::scoped_lock lock(ArenaMutex);
+
+  if (nHugeTlbChunks + nThpChunks > 0) {
+    fprintf(pFile, "Packet buffers: %zu kB in %zu kB of huge pages (%d chunks reserved, %d transparent)\n",
+            szArenaHanded / 1024, szArenaMapped / 1024, nHugeTlbChunks, nThpChunks);
+  }
+  if (szHeapBuffers > 0) {
+    fprintf(pFile, "Packet buffers: %zu kB on the heap\n", szHeapBuffers / 1024);
+  }
+}
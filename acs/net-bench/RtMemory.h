@@ -0,0 +1,98 @@
+/* RtMemory - Keeping page faults out of the real-time loops
+*
+* A page is only given to the process the first time it is touched, and
+* can later be paged out again.  Either way the thread touching it waits
+* in the kernel, for microseconds at best and milliseconds if the page has
+* to be read back.  For a receive loop that shows up as rare outliers,
+* mostly in the first seconds of a run, as each thread first reaches the
+* deeper parts of its 2 MB stack and each packet buffer is first used.
+*
+* InitRtMemory(), called once at startup before any threads or buffers
+* are made, takes the usual steps against that:
+*
+*   - mlockall(MCL_CURRENT | MCL_FUTURE), so that everything mapped now or
+*     later is faulted in at once and stays resident.  Needs root or a
+*     large enough "ulimit -l".  Every thread stack is then resident in
+*     full, so with one thread per port use -w workers on a small board.
+*   - malloc is told never to give memory back to the kernel, nor to use
+*     a fresh mmap() for big blocks, so that freeing and allocating again
+*     does not fault.
+*   - Each tPThread touches its whole stack before it enters its loop, and
+*     the main thread touches the top of its own.
+*   - Optionally, packet buffers (tRtBuffer) are carved from 2 MB huge
+*     pages, so that they take a handful of TLB entries rather than one
+*     per 4 kB.  Explicit huge pages (vm.nr_hugepages) are used if any are
+*     reserved, else transparent huge pages are asked for.
+*
+* The page faults taken during the measurement itself are reported by
+* PrintResourceUsage(), so that it can be seen whether this worked.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef RTMEMORY_H_
+#define RTMEMORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// How much of the main thread's stack to fault in; it grows on demand beyond that
+#define MAIN_THREAD_STACK_PREFAULT_SIZE  (256 * 1024)
+
+// Huge page size, for the buffer arena
+#define RT_HUGE_PAGE_SIZE                (2 * 1024 * 1024)
+
+
+bool InitRtMemory(bool bUseHugePages);
+
+
+/*******************************
+* tRtBuffer
+*
+* A zero-filled, and so already faulted in, block of memory for packets.
+* Usually from the heap; after tRtBuffer::UseHugePages(), carved from a
+* process-wide arena of huge pages instead, which is never given back
+* (the buffers are made once at startup and last the whole run).
+*
+* Move only, like the std::vector it stands in for, and likewise the data
+* does not move when the tRtBuffer does.
+*/
+
+class tRtBuffer {
+public:
+  tRtBuffer() : _pData(nullptr), _szSize(0), _bFromArena(false) { }
+  tRtBuffer(size_t szSize);
+  ~tRtBuffer();
+
+  tRtBuffer(const tRtBuffer &) = delete;
+  tRtBuffer& operator=(const tRtBuffer &) = delete;
+
+  tRtBuffer(tRtBuffer &&other);
+  tRtBuffer& operator=(tRtBuffer &&other);
+
+  uint8_t *Data()                      { return _pData; }
+  size_t   Size() const                { return _szSize; }
+  uint8_t &operator[](size_t i)        { return _pData[i]; }
+
+  static void UseHugePages(bool bUseHugePages);
+  static void PrintSummary(FILE *pFile);
+
+protected:
+  void _Free();
+
+  uint8_t *_pData;
+  size_t   _szSize;
+  bool     _bFromArena;
+};
+
+
+#endif /* RTMEMORY_H_ */
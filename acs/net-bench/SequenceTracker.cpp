@@ -0,0 +1,211 @@
+/* tSequenceTracker - Loss, duplicate and reorder detection for one stream
+*
+* See SequenceTracker.h
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+#include "SequenceTracker.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+/*******************************************************
+* tSequenceTracker constructor
+*
+*/
+
+tSequenceTracker::tSequenceTracker() :
+  _bStarted(false),
+  _uHighest(0),
+  _uWindow(0),
+  _nWindowValid(0),
+  _nCurrentBurst(0),
+  _uFirst(0),
+  _uLast(0),
+  _nReceived(0),
+  _nDuplicates(0),
+  _nReordered(0),
+  _nTooLate(0),
+  _nLongestGap(0),
+  _nBursts(0)
+{
+  int i;
+
+  for (i=0; i<SEQ_NUM_BURST_BUCKETS; i++) {
+    _BurstLengths[i].store(0, memory_order_relaxed);
+  }
+}
+
+
+/*******************************************************
+* tSequenceTracker::Update
+*
+* Accounts for the arrival of one message.  Sequence numbers may wrap.
+* A message from behind the window cannot be told apart from a duplicate
+* of one already retired, so it is only counted as too late, not as
+* received, and cannot make the loss count go down.
+*
+* INPUTS:
+*   uSeq - the message's sequence number
+*/
+
+void tSequenceTracker::Update(uint32_t uSeq)
+{
+  uint32_t uAdvance, uAge;
+  int      iBit;
+
+  if (!_bStarted) {
+    _Increment(_nReceived);
+    _bStarted     = true;
+    _uHighest     = uSeq;
+    _uWindow      = 1;
+    _nWindowValid = 1;
+    _uFirst.store(uSeq, memory_order_relaxed);
+    _uLast .store(uSeq, memory_order_relaxed);
+    return;
+  }
+
+  if ((int32_t) (uSeq - _uHighest) > 0) {
+    _Increment(_nReceived);
+
+    // New highest.  Slide the window up, retiring the oldest entries, oldest first.
+    uAdvance = uSeq - _uHighest;
+
+    for (iBit=_nWindowValid-1; iBit>=0 && (uint32_t) iBit >= SEQ_WINDOW_SIZE - std::min(uAdvance, (uint32_t) SEQ_WINDOW_SIZE); iBit--) {
+      _Retire(1, (_uWindow >> iBit) & 1);
+    }
+    if (uAdvance > SEQ_WINDOW_SIZE)  _Retire(uAdvance - SEQ_WINDOW_SIZE, false);
+
+    _uWindow      = (uAdvance >= SEQ_WINDOW_SIZE) ? 1 : ((_uWindow << uAdvance) | 1);
+    _nWindowValid = (int) std::min((uint32_t) SEQ_WINDOW_SIZE, _nWindowValid + uAdvance);
+    _uHighest     = uSeq;
+    _uLast.store(uSeq, memory_order_relaxed);
+  }
+  else {
+    uAge = _uHighest - uSeq;
+
+    if (uAge >= (uint32_t) _nWindowValid) {
+      // Already retired, whether as lost or received, or from before the stream started
+      _Increment(_nTooLate);
+    }
+    else if ((_uWindow >> uAge) & 1) {
+      _Increment(_nReceived);
+      _Increment(_nDuplicates);
+    }
+    else {
+      _Increment(_nReceived);
+      _uWindow |= (uint64_t) 1 << uAge;
+      _Increment(_nReordered);
+    }
+  }
+}
+
+
+/*******************************************************
+* tSequenceTracker::Finish
+*
+* Retires everything left in the window, so that a loss burst at the end
+* of the run is counted.  Call only once Update() will not be called again.
+*/
+
+void tSequenceTracker::Finish()
+{
+  int iBit;
+
+  for (iBit=_nWindowValid-1; iBit>=0; iBit--) {
+    _Retire(1, (_uWindow >> iBit) & 1);
+  }
+  _Retire(1, true);  // Close off any burst in progress
+
+  _uWindow      = 0;
+  _nWindowValid = 0;
+}
+
+
+/*******************************************************
+* tSequenceTracker::_Retire
+*
+* Accounts for sequence numbers leaving the window
+*
+* INPUTS:
+*   nCount    - how many
+*   bReceived - whether they arrived
+*/
+
+void tSequenceTracker::_Retire(unsigned nCount, bool bReceived)
+{
+  if (!bReceived) {
+    _nCurrentBurst += nCount;
+  }
+  else if (_nCurrentBurst > 0) {
+    _RecordBurst(_nCurrentBurst);
+    _nCurrentBurst = 0;
+  }
+}
+
+
+/*******************************************************
+* tSequenceTracker::_RecordBurst
+*
+*/
+
+void tSequenceTracker::_RecordBurst(long nLength)
+{
+  int iBucket;
+
+  // Bucket by the power of two at or above the length: 1, 2, 3-4, 5-8, ...
+  iBucket = (nLength <= 1) ? 0 : (64 - __builtin_clzll((uint64_t) (nLength - 1)));
+  if (iBucket >= SEQ_NUM_BURST_BUCKETS)  iBucket = SEQ_NUM_BURST_BUCKETS - 1;
+
+  _Increment(_BurstLengths[iBucket]);
+  _Increment(_nBursts);
+  if (nLength > _nLongestGap.load(memory_order_relaxed))  _nLongestGap.store(nLength, memory_order_relaxed);
+}
+
+
+/*******************************************************
+* tSequenceTracker::NumLost
+*
+* RETURNS:
+*   Sequence numbers from the first to the highest seen that have not
+*   arrived.  Messages still within the window may yet turn up.
+*/
+
+long tSequenceTracker::NumLost() const
+{
+  long nSpan, nUnique;
+
+  if (NumReceived() == 0)  return 0;
+
+  nSpan   = (long) (uint32_t) (_uLast.load(memory_order_relaxed) - _uFirst.load(memory_order_relaxed)) + 1;
+  nUnique = NumReceived() - NumDuplicates();
+
+  return (nSpan > nUnique) ? (nSpan - nUnique) : 0;
+}
+
+
+/*******************************************************
+* tSequenceTracker::Print
+*
+* One-line summary
+*/
+
+void tSequenceTracker::Print(FILE *pFile, const char *sLabel) const
+{
+  fprintf(pFile, "%s rcvd=%ld lost=%ld dup=%ld reord=%ld late=%ld  bursts=%ld longest=%ld [1:%ld 2:%ld 3-4:%ld 5-8:%ld 9-16:%ld 17+:%ld]\n",
+          sLabel, NumReceived(), NumLost(), NumDuplicates(), NumReordered(), NumTooLate(),
+          _nBursts.load(memory_order_relaxed), LongestGap(),
+          _BurstLengths[0].load(memory_order_relaxed), _BurstLengths[1].load(memory_order_relaxed),
+          _BurstLengths[2].load(memory_order_relaxed), _BurstLengths[3].load(memory_order_relaxed),
+          _BurstLengths[4].load(memory_order_relaxed), _BurstLengths[5].load(memory_order_relaxed));
+}
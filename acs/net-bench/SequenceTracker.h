@@ -0,0 +1,85 @@
+/* tSequenceTracker - Loss, duplicate and reorder detection for one stream
+*
+* Follows the sequence numbers of one sender's messages.  A 64-bit bitmap
+* remembers which of the last 64 sequence numbers below the highest seen
+* have arrived, so a message up to 64 places late is recognised as
+* reordered rather than lost, and a repeat within that window as a
+* duplicate.  Memory is constant per stream and each message costs a few
+* shifts and compares.
+*
+* Loss bursts are measured as sequence numbers leave the window still
+* unreceived, so a gap that a late message fills in is not counted.
+*
+* One thread calls Update(); other threads may read the counts.  Counts
+* are relaxed atomics for that reason.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TSEQUENCETRACKER_H_
+#define TSEQUENCETRACKER_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SEQ_WINDOW_SIZE        (64)
+
+// Loss burst length ranges reported: 1, 2, 3-4, 5-8, 9-16, 17+
+#define SEQ_NUM_BURST_BUCKETS  (6)
+
+
+class tSequenceTracker {
+public:
+  tSequenceTracker();
+
+  tSequenceTracker(const tSequenceTracker &) = delete;
+  tSequenceTracker& operator=(const tSequenceTracker &) = delete;
+
+  void Update(uint32_t uSeq);
+  void Finish();
+
+  long NumReceived()   const { return _nReceived  .load(std::memory_order_relaxed); }
+  long NumDuplicates() const { return _nDuplicates.load(std::memory_order_relaxed); }
+  long NumReordered()  const { return _nReordered .load(std::memory_order_relaxed); }
+  long NumTooLate()    const { return _nTooLate   .load(std::memory_order_relaxed); }
+  long NumLost()       const;
+  long LongestGap()    const { return _nLongestGap.load(std::memory_order_relaxed); }
+
+  void Print(FILE *pFile, const char *sLabel) const;
+
+protected:
+  void _Retire(unsigned nCount, bool bReceived);
+  void _RecordBurst(long nLength);
+  void _Increment(std::atomic<long> &Count, long n = 1) {
+    Count.store(Count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // Receive thread only
+  bool                  _bStarted;
+  uint32_t              _uHighest;      // Highest sequence number seen
+  uint64_t              _uWindow;       // Bit i set if _uHighest - i has arrived
+  int                   _nWindowValid;  // Bits of _uWindow at or after the first message
+  long                  _nCurrentBurst; // Unreceived sequence numbers retired in a row so far
+
+  std::atomic<uint32_t> _uFirst;        // First sequence number seen
+  std::atomic<uint32_t> _uLast;         // Copy of _uHighest for readers
+  std::atomic<long>     _nReceived;     // Includes duplicates, but not those too late
+  std::atomic<long>     _nDuplicates;
+  std::atomic<long>     _nReordered;    // Arrived late, but within the window
+  std::atomic<long>     _nTooLate;      // Arrived too late to tell whether reordered or duplicate; not received
+  std::atomic<long>     _nLongestGap;   // Longest run of lost messages
+  std::atomic<long>     _nBursts;       // Number of loss bursts
+  std::atomic<long>     _BurstLengths[SEQ_NUM_BURST_BUCKETS];
+};
+
+
+#endif /* TSEQUENCETRACKER_H_ */
@@ -5,18 +5,40 @@
 */
 
 #include "Server.h"
+#include "ResourceUsage.h"
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <iostream>
 #include <utility>
+#include <algorithm>
 
 extern "C" {
   #include "GlcMsg.h"
   #include "GlcLscsIf.h"
 }
 
-#define MAX_MESSAGE_SIZE (sizeof(SegRtDataMsg))
+// Room for either layout.  See TimeTag.h
+#define MAX_MESSAGE_SIZE (sizeof(SegRtDataMsgV2))
+#define MAX_EPOLL_EVENTS (64)
+
+#define TIMESPEC_NS(ts)         ((int64_t) (ts).tv_sec * 1000000000LL + (int64_t) (ts).tv_nsec)
+
+// Seconds and microseconds of a time in ns, for printf("%02ld.%06ld")
+#define NS_SEC(ns)              ((long) ((ns) / 1000000000LL))
+#define NS_USEC(ns)             ((long) (((ns) % 1000000000LL) / 1000))
+
+// io_uring worker sizing.  Each provided buffer holds an io_uring_recvmsg_out
+// header, the source address and any control data ahead of the message.
+#define IO_URING_ENTRIES       (512)
+#define IO_URING_NUM_BUFFERS   (1024)
+#define IO_URING_BUFFER_SIZE   (MAX_MESSAGE_SIZE + 128)
+#define IO_URING_BUFFER_GROUP  (0)
+#define IO_URING_EXIT_POLL_MS  (100)
 
 using namespace std;
 
@@ -24,16 +46,20 @@ using namespace std;
 /***************************************************
 * tSampleLogger constructor
 *
+* A logger can serve one port or many, so each sample carries its own
+* port number.
+*
 * INPUTS:
-*    sServer   - string descriptor of the service we are connecting to,
-*                e.g., "app_srv19"
-*    sHostname - hostname or dot-separated IP address
+*    nRingCapacity - how many samples can wait to be printed, a power of two
 */
 
-tSampleLogger::tSampleLogger(int iPortNum) :
-  _SampleQueue(),
+tSampleLogger::tSampleLogger(size_t nRingCapacity) :
+  _pSampleRing(new tSpscRing<tLatencySample>(nRingCapacity)),
   _thread(),  // Thread creation is deferred.  See tSampleLogger::StartLoggerThread()
-  _iPortNum(iPortNum)
+  _bExit(false),
+  _fdWake(-1),
+  _nHighWater(nRingCapacity / 4),
+  _bWakePending(false)
 {
 }
 
@@ -52,18 +78,34 @@ tSampleLogger::tSampleLogger(int iPortNum) :
 */
 
 tSampleLogger::tSampleLogger(tSampleLogger &&other) noexcept :
-  _SampleQueue(move(other._SampleQueue)),
-  // Mutex and condition variable cannot be moved.  
+  _pSampleRing(move(other._pSampleRing)),
   _thread     (move(other._thread)),
-  _iPortNum   (other._iPortNum)
+  _bExit      (other._bExit.load()),
+  _fdWake     (other._fdWake),
+  _nHighWater (other._nHighWater),
+  _bWakePending(other._bWakePending.load())
 {
+  other._fdWake = -1;
 }
 
 
 
+/***************************************************
+* tSampleLogger destructor
+*
+* Tells the logger thread to exit once it has drained the ring, and
+* waits for it.  A std::thread that is still joinable when destroyed
+* calls std::terminate().
+*/
+
 tSampleLogger::~tSampleLogger() 
 {
-  // _thread.join(); 
+  if (_thread.joinable()) {
+    _bExit = true;
+    _Wake();
+    _thread.join(); 
+  }
+  if (_fdWake >= 0)  close(_fdWake);
 }
 
 
@@ -71,82 +113,128 @@ tSampleLogger::~tSampleLogger()
 * tSampleLogger::StartLoggerThread
 *
 * Actually starts the logger thread running.  This has to wait until
-* after construction, because mutexes and condition variables cannot
-* be moved or copied.  Since temporaries are created and moved during
+* after construction, since the thread is handed a pointer to this
+* object.  Since temporaries are created and moved during
 * AddConnection, we have to postpone starting the thread until that
 * is complete.
 */
 
 void tSampleLogger::StartLoggerThread()
 {
-   _thread = std::thread(&tSampleLogger::PrintSamples, this);
+  _fdWake = eventfd(0, EFD_CLOEXEC);
+  if (_fdWake < 0) {
+    throw std::runtime_error(std::string("tSampleLogger: eventfd: ") + strerror(errno));
+  }
+  _thread = std::thread(&tSampleLogger::PrintSamples, this);
 }
 
 
 /***************************************************
 * tSampleLogger LogSample
 *
-* INPUTS:
-*    
+* Called on the receive thread.  Never blocks; if the ring is full the
+* sample is dropped and counted.  Makes a system call only to wake the
+* logger thread, the first time the ring passes its high-water mark
+* since the logger last drained it.
+*/
+
+void tSampleLogger::LogSample(int iPortNum, int nRcvdByServer, int nSentByClient, int64_t nsRcv, int64_t nsKernelRcv,
+                              int64_t nsSent, struct sockaddr_in &ClientAddress)
+{
+  _pSampleRing->TryPush(tLatencySample(iPortNum, nRcvdByServer, nSentByClient, nsRcv, nsKernelRcv, nsSent, ClientAddress));
+
+  if (!_bWakePending.load(memory_order_relaxed) && _pSampleRing->HasAtLeast(_nHighWater)) {
+    _bWakePending.store(true, memory_order_relaxed);
+    _Wake();
+  }
+}
+
+
+/***************************************************
+* tSampleLogger::_Wake
+*
+* Wakes the logger thread, if it has started
 */
 
-void tSampleLogger::LogSample(int nRcvdByServer, int nSentByClient, struct timeval &tmRcv, struct timeval &tmSent, struct sockaddr_in &ClientAddress)
+void tSampleLogger::_Wake()
 {
-  std::lock_guard<std::mutex> cvLock(_SampleQueueMutex);
-  _SampleQueue.push(tLatencySample(nRcvdByServer, nSentByClient, tmRcv, tmSent, ClientAddress));
-  _SampleQueueCondition.notify_one();
+  uint64_t u = 1;
+
+  if (_fdWake >= 0)  (void) write(_fdWake, &u, sizeof(u));
 }
 
 
 /***************************************************
 * tSampleLogger PrintSamples
 *
-* INPUTS:
+* The logger thread.  Prints whatever has accumulated in the ring, then
+* sleeps until woken or SAMPLE_LOGGER_IDLE_MS has passed, if there was
+* nothing.
 */
 
 void tSampleLogger::PrintSamples()
 {
-  tLatencySample Sample;
-  struct timeval tmDiff;
-  char sHostIpString[40];
+  struct pollfd Poll;
+  uint64_t      u;
+  bool          bExit;
+  size_t        n;
+
+  Poll.fd     = _fdWake;
+  Poll.events = POLLIN;
 
   while (1) {
-    {
-      std::unique_lock cvLock(_SampleQueueMutex);
-      // Block until notified that there is something in the queue.  This will unlock the 
-      // mutex and then block.  
-      // There's actually no need to specify a predicate here, but we do anyway.  (We don't
-      // really care if we are spuriously awakened since we immediately test for our 
-      // predicate in the while loop below.)
-      _SampleQueueCondition.wait(cvLock, [this] { return !_SampleQueue.empty(); } );
-      // The mutex is now locked, but will be unlocked when the scoped_lock is destroyed
+    // Read the flag before draining, so that every sample logged before the
+    // exit request is printed
+    bExit = _bExit;
+
+    // Cleared before draining, so a sample pushed meanwhile can signal again
+    _bWakePending.store(false, memory_order_relaxed);
+    n = _pSampleRing->Drain(_PrintSample);
+    if (n == 0) {
+      if (bExit)  break;
+      if (poll(&Poll, 1, SAMPLE_LOGGER_IDLE_MS) > 0)  (void) read(_fdWake, &u, sizeof(u));
     }
+  }
 
-    // Drain the queue
-    while (!_SampleQueue.empty()) {
-      {
-        std::scoped_lock cvLock(_SampleQueueMutex);
-        Sample = _SampleQueue.front();
-        _SampleQueue.pop();
-      }
-
-      // Sample._ClientAddress is a sockaddr_in.  inet_ntop wants a struct in_addr, which is 
-      // the sin_addr member of the sockaddr_in
+  if (NumDropped() > 0) {
+    (void) printf("** Sample logger dropped %ld samples **\n", NumDropped());
+  }
+}
 
 
+/***************************************************
+* tSampleLogger::_PrintSample
+*
+*/
 
-      inet_ntop(AF_INET, &Sample._ClientAddress.sin_addr, sHostIpString, 40);
+void tSampleLogger::_PrintSample(const tLatencySample &Sample)
+{
+  int64_t nsDiff, nsNet, nsHost;
+  char sHostIpString[40];
 
-      timersub(&Sample._tmRcv, &Sample._tmSent, &tmDiff);
-      (void) printf("%s::(%d): Sent: %02ld.%06ld  Rcvd: %02ld.%06ld  Lat: %02ld.%06ld  Nrcvd:%3d   NSent:%3d\n", 
-                     sHostIpString, _iPortNum,
-                     Sample._tmSent.tv_sec, Sample._tmSent.tv_usec, 
-                     Sample._tmRcv .tv_sec, Sample._tmRcv .tv_usec,
-                     tmDiff.tv_sec, tmDiff.tv_usec, 
-                     ((Sample._nRcvdByServer-1)%50)+1,
-                     ((Sample._nSentByClient-1)%50)+1);
-    }
+  // Sample._ClientAddress is a sockaddr_in.  inet_ntop wants a struct in_addr, which is 
+  // the sin_addr member of the sockaddr_in
+  inet_ntop(AF_INET, &Sample._ClientAddress.sin_addr, sHostIpString, 40);
+
+  nsDiff = Sample._nsRcv - Sample._nsSent;
+  (void) printf("%s::(%d): Sent: %02ld.%06ld  Rcvd: %02ld.%06ld  Lat: %02ld.%06ld  Nrcvd:%3d   NSent:%3d", 
+                 sHostIpString, Sample._iPortNum,
+                 NS_SEC(Sample._nsSent), NS_USEC(Sample._nsSent), 
+                 NS_SEC(Sample._nsRcv),  NS_USEC(Sample._nsRcv),
+                 NS_SEC(nsDiff), NS_USEC(nsDiff), 
+                 ((Sample._nRcvdByServer-1)%50)+1,
+                 ((Sample._nSentByClient-1)%50)+1);
+
+  // With a kernel timestamp, split the latency into network (sent to arrival
+  // at the socket) and host (arrival at the socket to pickup by the thread)
+  if (Sample._nsKernelRcv != 0) {
+    nsNet  = Sample._nsKernelRcv - Sample._nsSent;
+    nsHost = Sample._nsRcv       - Sample._nsKernelRcv;
+    (void) printf("  Net: %02ld.%06ld  Host: %02ld.%06ld", 
+                   NS_SEC(nsNet),  NS_USEC(nsNet),
+                   NS_SEC(nsHost), NS_USEC(nsHost));
   }
+  (void) printf("\n");
 }
 
 
@@ -155,17 +243,44 @@ void tSampleLogger::PrintSamples()
 * tServer constructor
 *
 * INPUTS:
+*    iPortNum - port to serve
+*    Config   - options shared by all of the servers
 */
 
-tServer::tServer(int iPortNum, int iReceiveThreadPriority) :
-  tPThread(iReceiveThreadPriority, true),
+tServer::tServer(int iPortNum, const tServerConfig &Config) :
+  tPThread(Config.iReceiveThreadPriority, true),
   _iPortNum(iPortNum),
+  _iClockId(Config.iClockId),
+  _pClockSync(nullptr),
   _UdpServer(iPortNum),
-  _SampleLogger(iPortNum),
-  _nReceived(0)
+  _bDebug(Config.bDebug),
+  _SampleLogger(),
+  _pSharedSampleLogger(nullptr),
+  _nReceived(0),
+  _iBatchSize(Config.iBatchSize),
+  _nSyscalls(0),
+  _nReceiveErrors(0),
+  _nUntimed(0),
+  _Batch(Config.iBatchSize, MAX_MESSAGE_SIZE),
+  _pLatency(new tLatencyHistogram()),
+  _pSourceKeys(new uint64_t[MAX_SOURCES_PER_PORT]),
+  _pSequence(new tSequenceTracker[MAX_SOURCES_PER_PORT]),
+  _nSources(0),
+  _nUntracked(0),
+  _pAssembler(nullptr),
+  _iSegment(0),
+  _ReplyMode(Config.ReplyMode),
+  _uLastSourceKey(0),
+  _iLastClockId(TIMETAG_V1),
+  _pSegmentServers(nullptr),
+  _nReplies(0),
+  _nReplyDrops(0)
 {
-  
-
+  if (Config.bKernelTimestamps) {
+    _UdpServer.EnableKernelTimestamps();
+    _pNetLatency .reset(new tLatencyHistogram());
+    _pHostLatency.reset(new tLatencyHistogram());
+  }
 }
 
 
@@ -183,11 +298,35 @@ tServer::tServer(int iPortNum, int iReceiveThreadPriority) :
 tServer::tServer(tServer &&other) noexcept :
   tPThread     (move(other)),
   _UdpServer   (move(other._UdpServer)),
-  _SampleLogger(move(other._SampleLogger))
+  _SampleLogger(move(other._SampleLogger)),
+  _Batch       (move(other._Batch)),
+  _pLatency    (move(other._pLatency)),
+  _pNetLatency (move(other._pNetLatency)),
+  _pHostLatency(move(other._pHostLatency)),
+  _pSourceKeys (move(other._pSourceKeys)),
+  _pSequence   (move(other._pSequence)),
+  _nSources    (other._nSources.load()),
+  _nUntracked  (other._nUntracked.load()),
+  _uLastSourceKey(other._uLastSourceKey.load()),
+  _iLastClockId(other._iLastClockId.load()),
+  _pnsCycleSent(move(other._pnsCycleSent)),
+  _nReplies    (other._nReplies.load()),
+  _nReplyDrops (other._nReplyDrops.load())
 {
+  _pSharedSampleLogger = other._pSharedSampleLogger;
   _bDebug       = other._bDebug;
   _nReceived    = other._nReceived;
   _iPortNum     = other._iPortNum;
+  _iClockId     = other._iClockId;
+  _pClockSync   = other._pClockSync;
+  _iBatchSize   = other._iBatchSize;
+  _nSyscalls    = other._nSyscalls;
+  _nReceiveErrors = other._nReceiveErrors;
+  _nUntimed     = other._nUntimed;
+  _pAssembler   = other._pAssembler;
+  _iSegment     = other._iSegment;
+  _ReplyMode    = other._ReplyMode;
+  _pSegmentServers = other._pSegmentServers;
 }
 
 
@@ -225,62 +364,753 @@ void *tServer::_Thread()
 int tServer::ProcessIncomingMessages()
 {
   ssize_t  len;;
-  char buf[MAX_MESSAGE_SIZE];
-  int            nSent;
-  struct timeval tmRcv, tmSent;
+  uint8_t buf[MAX_MESSAGE_SIZE];
+  int64_t nsRcv;
+  struct timespec tmKernelRcv;
   struct sockaddr_in ClientAddress;
 
+  if (_iBatchSize > 1)  return _ProcessIncomingMessagesBatched();
+
+  while (!_bExit) {  // Flag from base tPThread class
+    len = _ReceiveMessage(buf, sizeof(buf), &ClientAddress, &tmKernelRcv);
+    if (len < 0)  continue;
+
+    nsRcv = TimeTagNowNs(_iClockId);
+    _LogMessage(buf, len, nsRcv, tmKernelRcv, ClientAddress);
+  }
+
+  return 0;
+}
+
+
+/*****************************
+* tServer::_ProcessIncomingMessagesBatched
+*
+* Batch mode: each wakeup drains everything queued on the socket, up to
+* _iBatchSize messages, with a single recvmmsg() call.  All messages in
+* a batch share one receive time stamp, since they were all picked up at
+* the same moment.
+*/
+
+int tServer::_ProcessIncomingMessagesBatched()
+{
+  int  i, n;
+  int64_t nsRcv;
+
   while (!_bExit) {  // Flag from base tPThread class
-    len = _UdpServer.ReceiveMessage(buf, sizeof(buf), &ClientAddress);
+    n = _ReceiveBatch();
+
+    nsRcv = TimeTagNowNs(_iClockId);
+    for (i=0; i<n; i++) {
+      _LogMessage(_Batch.Buffer(i), _Batch.Length(i), nsRcv, _Batch.KernelTime(i), _Batch.ClientAddress(i));
+    }
+  }
+
+  return 0;
+}
+
+
+/*****************************
+* tServer::ProcessAvailableMessages
+*
+* Event-loop counterpart of ProcessIncomingMessages().  The socket must be
+* non-blocking.  Reads until the socket is empty, which is what an edge-
+* triggered epoll requires, and then returns.
+*
+* RETURNS:
+*   The number of messages processed
+*/
+
+int tServer::ProcessAvailableMessages()
+{
+  int     i, n;
+  int     nProcessed = 0;
+  ssize_t len;
+  uint8_t buf[MAX_MESSAGE_SIZE];
+  int64_t nsRcv = 0;
+  struct timespec tmKernelRcv;
+  struct sockaddr_in ClientAddress;
+
+  do {
+    if (_iBatchSize > 1) {
+      n = _ReceiveBatch();
 
-    if (len != MAX_MESSAGE_SIZE) {
-      cerr << "Error: len = " << len << endl;
-      throw(std::runtime_error("ERROR: Bad Received Message Size"));
+      if (n > 0)  nsRcv = TimeTagNowNs(_iClockId);
+      for (i=0; i<n; i++) {
+        _LogMessage(_Batch.Buffer(i), _Batch.Length(i), nsRcv, _Batch.KernelTime(i), _Batch.ClientAddress(i));
+      }
+    }
+    else {
+      len = _ReceiveMessage(buf, sizeof(buf), &ClientAddress, &tmKernelRcv);
+
+      n = (len > 0) ? 1 : (len < 0) ? -1 : 0;
+      if (n > 0) {
+        nsRcv = TimeTagNowNs(_iClockId);
+        _LogMessage(buf, len, nsRcv, tmKernelRcv, ClientAddress);
+      }
     }
+    if (n > 0)  nProcessed += n;
+  } while (n != 0);  // After an error there may still be messages queued, and the edge will not fire again
+
+  return nProcessed;
+}
+
+
+/*****************************
+* tServer::_ReceiveMessage
+*
+* One receive, as tUdpServer::ReceiveMessage().  A receive that fails is
+* counted and skipped, rather than ending the receive thread.
+*
+* RETURNS:
+*   The length of the message, 0 if none is waiting, or -1 on error
+*/
+
+ssize_t tServer::_ReceiveMessage(uint8_t *buf, size_t szBufSize, struct sockaddr_in *pClientAddress, 
+                                 struct timespec *pKernelTime)
+{
+  _nSyscalls++;
+  try {
+    return _UdpServer.ReceiveMessage(buf, szBufSize, pClientAddress, pKernelTime);
+  }
+  catch (const tUdpConnectionException &) {
+    _nReceiveErrors++;
+    return -1;
+  }
+}
+
+
+/*****************************
+* tServer::_ReceiveBatch
+*
+* One recvmmsg() into _Batch, with errors handled as in _ReceiveMessage()
+*
+* RETURNS:
+*   The number of messages received, 0 if none is waiting, or -1 on error
+*/
+
+int tServer::_ReceiveBatch()
+{
+  _nSyscalls++;
+  try {
+    return _UdpServer.ReceiveBatch(_Batch);
+  }
+  catch (const tUdpConnectionException &) {
+    _nReceiveErrors++;
+    return -1;
+  }
+}
 
-    gettimeofday(&tmRcv, NULL);
-    tmSent = ((DataHdr *) buf)->time;
-    nSent  = ((DataHdr *) buf)->hdr.msgId;
 
-    _SampleLogger.LogSample(++_nReceived, nSent, tmRcv, tmSent, ClientAddress);
+/*****************************
+* tServer::_LogMessage
+*
+* Validates a received message and records its latency.  Messages may
+* have either header layout.  One whose time tag is on a different clock
+* from the receive time is stamped again on its own clock, so that old
+* and new senders can share a server.  Otherwise, with a clock sync, the
+* receive times are translated onto the sender's clock, so that the
+* latencies are one-way.  The send times echoed in replies are untouched.
+* Until the clock sync has its first estimate there is nothing to
+* translate with, so those messages are counted but not timed.
+*/
+
+void tServer::_LogMessage(const uint8_t *buf, ssize_t len, int64_t nsRcv, const struct timespec &tmKernelRcv, 
+                          struct sockaddr_in &ClientAddress)
+{
+  int               nSent;
+  int64_t           nsSent;
+  int64_t           nsKernelRcv = 0;
+  int               iClockId;
+  tSequenceTracker *pSequence;
+
+  if (!GetDataHdrTime(buf, len, sizeof(SegRtDataMsg), sizeof(SegRtDataMsgV2), &nsSent, &iClockId)) {
+    cerr << "Error: len = " << len << endl;
+    throw(std::runtime_error("ERROR: Bad Received Message Size"));
+  }
+
+  if (!SameClock(iClockId, _iClockId)) {
+    nsRcv = TimeTagNowNs(iClockId);
+  }
+  else if (_pClockSync != nullptr) {
+    if (_pClockSync->IsValid())  nsRcv = _pClockSync->ToPeerClock(nsRcv);
+    else                         nsRcv = 0;   // Untimed
+  }
+
+  nSent = ((MsgHdr *) buf)->msgId;
+
+  ++_nReceived;
+
+  pSequence = _FindSequenceTracker(ClientAddress);
+  if (pSequence != nullptr) {
+    pSequence->Update(nSent);
+  }
+  else {
+    _nUntracked.store(_nUntracked.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  }
+
+  if (_ReplyMode == tServerConfig::REPLY_PER_CYCLE) {
+    // Ordered before AddSegment(), so whichever thread completes the cycle sees them
+    _uLastSourceKey.store(((uint64_t) ClientAddress.sin_addr.s_addr << 16) | ClientAddress.sin_port, memory_order_relaxed);
+    _iLastClockId  .store(iClockId, memory_order_relaxed);
+  }
+
+  if (_pAssembler != nullptr) {
+    if (_pAssembler->AddSegment(nSent, _iSegment, nsSent, nsRcv, _pnsCycleSent.get()) && _pnsCycleSent) {
+      _ReplyToCycle(nSent);
+    }
+  }
+
+  if (_ReplyMode == tServerConfig::REPLY_PER_MESSAGE)  _SendReply(nSent, nsSent, iClockId, ClientAddress);
+
+  if (nsRcv == 0) {
+    _nUntimed++;
+    return;
+  }
+
+  _pLatency->Record(nsRcv - nsSent);
+
+  // Kernel timestamps are CLOCK_REALTIME, so only split the latency of messages tagged on that clock
+  if (tmKernelRcv.tv_sec != 0 || tmKernelRcv.tv_nsec != 0) {
+    if (TimeTagClock(iClockId) == CLOCK_REALTIME)  nsKernelRcv = TIMESPEC_NS(tmKernelRcv);
+    if (nsKernelRcv != 0 && _pClockSync != nullptr && SameClock(iClockId, _iClockId)) {
+      nsKernelRcv = _pClockSync->ToPeerClock(nsKernelRcv);
+    }
+  }
+  if (_pNetLatency && nsKernelRcv != 0) {
+    _pNetLatency ->Record(nsKernelRcv - nsSent);
+    _pHostLatency->Record(nsRcv - nsKernelRcv);
+  }
+
+  // Per-packet printing is for debugging only; the histograms are the real output
+  if (_bDebug) {
+    _Logger().LogSample(_iPortNum, _nReceived, nSent, nsRcv, nsKernelRcv, nsSent, ClientAddress);
+  }
+}
+
+
+/*****************************
+* tServer::_FindSequenceTracker
+*
+* Looks up the tracker for a client, claiming a free one the first time
+* the client is heard from.  A port has only a handful of clients, so a
+* linear search beats hashing.  Receive thread only.
+*
+* RETURNS:
+*   The client's tracker, or nullptr if all are taken
+*/
+
+tSequenceTracker *tServer::_FindSequenceTracker(const struct sockaddr_in &ClientAddress)
+{
+  uint64_t uKey     = ((uint64_t) ClientAddress.sin_addr.s_addr << 16) | ClientAddress.sin_port;
+  int      nSources = _nSources.load(memory_order_relaxed);
+  int      i;
+
+  for (i=0; i<nSources; i++) {
+    if (_pSourceKeys[i] == uKey)  return &_pSequence[i];
+  }
+
+  if (nSources >= MAX_SOURCES_PER_PORT)  return nullptr;
+
+  _pSourceKeys[nSources] = uKey;
+  _nSources.store(nSources + 1, memory_order_release);
+  return &_pSequence[nSources];
+}
+
+
+/*****************************
+* tServer::SetSegmentServers
+*
+* Needed for replies per cycle, once all of the servers are created
+*
+* INPUTS:
+*    pSegmentServers - every segment's server, by segment number.  Must
+*                      outlive the receive threads.
+*/
+
+void tServer::SetSegmentServers(const std::vector<tServer *> *pSegmentServers)
+{
+  _pSegmentServers = pSegmentServers;
+  _pnsCycleSent.reset(new int64_t[pSegmentServers->size()]);
+}
+
+
+/*****************************
+* tServer::_SendReply
+*
+* Answers a client with an ActTargetMsg from this server's port.  The
+* reply carries the cycle number and echoes the time tag of the message
+* being answered, in the same header layout, so the client can time the
+* round trip on its own clock.  May be called from any receive thread.
+* A reply that cannot be sent is counted as dropped, never thrown.
+*
+* INPUTS:
+*    uCycle        - cycle being answered
+*    nsEcho        - the client's time tag for the cycle
+*    iClockId      - its clock id, which also picks the reply's layout
+*    ClientAddress - where to send the reply
+*/
+
+void tServer::_SendReply(uint32_t uCycle, int64_t nsEcho, int iClockId, const struct sockaddr_in &ClientAddress)
+{
+  union {
+    ActTargetMsg   V1;
+    ActTargetMsgV2 V2;
+  }            Reply;
+  ActTarget   *pTarget;
+  size_t       szReply;
+  long         nDrops;
+  int          iError;
+  char         sAddress[INET_ADDRSTRLEN];
+  int          i;
+
+  bzero((char *) &Reply, sizeof(Reply));
+  SetDataHdrTime((uint8_t *) &Reply, iClockId, nsEcho);
+  Reply.V1.hdr.hdr.msgId = uCycle;
+  Reply.V1.hdr.hdr.srcId = _iPortNum;
+
+  pTarget = (iClockId == TIMETAG_V1) ? Reply.V1.target : Reply.V2.target;
+  szReply = (iClockId == TIMETAG_V1) ? sizeof(Reply.V1) : sizeof(Reply.V2);
+  for (i=0; i<ACT_PER_SEG; i++) {
+    pTarget[i].frameCount = uCycle;
+  }
+
+  if (_UdpServer.SendMessage(&Reply, szReply, ClientAddress)) {
+    _nReplies.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+
+  iError = errno;
+  nDrops = _nReplyDrops.fetch_add(1, memory_order_relaxed) + 1;
+
+  // A full buffer is expected under load; anything else is worth a word, at the 1st, 2nd, 4th, ... drop
+  if (iError != EAGAIN && iError != EWOULDBLOCK && iError != ENOBUFS && (nDrops & (nDrops - 1)) == 0) {
+    inet_ntop(AF_INET, &ClientAddress.sin_addr, sAddress, sizeof(sAddress));
+    (void) fprintf(stderr, "** Warning: port %d reply to %s:%d failed: %s (%ld replies dropped) **\n", 
+                   _iPortNum, sAddress, ntohs(ClientAddress.sin_port), strerror(iError), nDrops);
+  }
+}
+
+
+/*****************************
+* tServer::_ReplyToCycle
+*
+* Called by the receive thread whose message completed a cycle.  Answers
+* every segment's client, each through its own segment's server, echoing
+* each client's own time tag.  The replies all go out at once, as the
+* RTC's actuator targets would once the cycle could be computed.
+*
+* INPUTS:
+*    uCycle - the cycle just completed; _pnsCycleSent holds its time tags
+*/
+
+void tServer::_ReplyToCycle(uint32_t uCycle)
+{
+  struct sockaddr_in ClientAddress;
+  uint64_t           uKey;
+  tServer           *pServer;
+  size_t             i;
+
+  bzero((char *) &ClientAddress, sizeof(ClientAddress));
+  ClientAddress.sin_family = AF_INET;
+
+  for (i=0; i<_pSegmentServers->size(); i++) {
+    pServer = (*_pSegmentServers)[i];
+    uKey    = pServer->_uLastSourceKey.load(memory_order_relaxed);
+
+    ClientAddress.sin_addr.s_addr = (in_addr_t) (uKey >> 16);
+    ClientAddress.sin_port        = (in_port_t) uKey;
+
+    pServer->_SendReply(uCycle, _pnsCycleSent[i], pServer->_iLastClockId.load(memory_order_relaxed), ClientAddress);
+  }
+}
+
+
+/*****************************
+* tServer::NumLost, NumDuplicates, NumReordered
+*
+* Totals over all of the port's clients.  Messages still within a
+* tracker's reorder window when this is called may yet arrive.
+*/
+
+long tServer::NumLost()
+{
+  int  nSources = _nSources.load(memory_order_acquire);
+  long nLost    = 0;
+  int  i;
+
+  for (i=0; i<nSources; i++) {
+    nLost += _pSequence[i].NumLost();
+  }
+  return nLost;
+}
+
+
+long tServer::NumDuplicates()
+{
+  int  nSources = _nSources.load(memory_order_acquire);
+  long n        = 0;
+  int  i;
+
+  for (i=0; i<nSources; i++) {
+    n += _pSequence[i].NumDuplicates();
+  }
+  return n;
+}
+
+
+long tServer::NumReordered()
+{
+  int  nSources = _nSources.load(memory_order_acquire);
+  long n        = 0;
+  int  i;
+
+  for (i=0; i<nSources; i++) {
+    n += _pSequence[i].NumReordered();
+  }
+  return n;
+}
+
+
+/*****************************
+* tServer::PrintSequenceStatistics
+*
+* Prints loss, duplicate and reorder counts for each client of the port.
+* Closes off each tracker's window first, so only call once the receive
+* thread has stopped.
+*/
+
+void tServer::PrintSequenceStatistics(FILE *pFile)
+{
+  int      nSources = _nSources.load(memory_order_acquire);
+  char     sLabel[80];
+  char     sAddress[INET_ADDRSTRLEN];
+  in_addr  Address;
+  int      i;
+
+  for (i=0; i<nSources; i++) {
+    _pSequence[i].Finish();
+
+    Address.s_addr = (in_addr_t) (_pSourceKeys[i] >> 16);
+    inet_ntop(AF_INET, &Address, sAddress, sizeof(sAddress));
+    snprintf(sLabel, sizeof(sLabel), "    from %s:%d:", sAddress, ntohs((uint16_t) _pSourceKeys[i]));
+    _pSequence[i].Print(pFile, sLabel);
+  }
+
+  if (_nUntracked.load(memory_order_relaxed) > 0) {
+    fprintf(pFile, "    %ld messages from clients beyond the first %d not tracked\n", 
+            _nUntracked.load(memory_order_relaxed), MAX_SOURCES_PER_PORT);
+  }
+}
+
+
+/***************************************************
+* tReceiveWorker constructor
+*
+* INPUTS:
+*    iWorkerNum              - identifies the worker in messages
+*    iReceiveThreadPriority  - RT priority for the worker thread, 0 for none
+*    bForceKillOnStopRequest - cancel the thread to stop it, rather than
+*                              asking it to exit
+*/
+
+tReceiveWorker::tReceiveWorker(int iWorkerNum, int iReceiveThreadPriority, bool bForceKillOnStopRequest) :
+  tPThread(iReceiveThreadPriority, bForceKillOnStopRequest),
+  _iWorkerNum(iWorkerNum),
+  _Servers(),
+  _SampleLogger(SHARED_SAMPLE_RING_SIZE),
+  _iClockId(TIMETAG_V1)
+{
+}
+
+
+/***************************************************
+* tReceiveWorker::AddServer
+*
+* Puts a server into this worker's shard, with its samples routed to the 
+* worker's logger.  The server must not move after this call.
+*
+* INPUTS:
+*    pServer - server to add
+*/
+
+void tReceiveWorker::AddServer(tServer *pServer)
+{
+  pServer->SetSharedSampleLogger(&_SampleLogger);
+  _Servers.push_back(pServer);
+  _iClockId = pServer->_iClockId;
+}
+
+
+/***************************************************
+* tEpollWorker constructor
+*
+* SIDE EFFECTS:
+*    Creates the epoll set.  Throws a runtime_error if that fails.
+*/
+
+tEpollWorker::tEpollWorker(int iWorkerNum, int iReceiveThreadPriority) :
+  tReceiveWorker(iWorkerNum, iReceiveThreadPriority),
+  _nEpollWaits(0)
+{
+  _fdEpoll = epoll_create1(0);
+  if (_fdEpoll < 0) {
+    throw std::runtime_error(std::string("tEpollWorker: epoll_create1: ") + strerror(errno));
+  }
+}
+
+
+/***************************************************
+* tEpollWorker destructor
+*
+*/
+
+tEpollWorker::~tEpollWorker()
+{
+  if (_fdEpoll >= 0)  close(_fdEpoll);
+}
+
+
+/***************************************************
+* tEpollWorker::AddServer
+*
+* The server's socket is made non-blocking and registered edge-triggered.
+*
+* INPUTS:
+*    pServer - server to add
+*/
+
+void tEpollWorker::AddServer(tServer *pServer)
+{
+  struct epoll_event Event;
+
+  pServer->_UdpServer.SetNonBlocking();
+
+  Event.events   = EPOLLIN | EPOLLET;
+  Event.data.ptr = pServer;
+  if (epoll_ctl(_fdEpoll, EPOLL_CTL_ADD, pServer->_UdpServer.GetSocket(), &Event) < 0) {
+    throw std::runtime_error(std::string("tEpollWorker: epoll_ctl: ") + strerror(errno));
+  }
+
+  tReceiveWorker::AddServer(pServer);
+}
+
+
+/***************************************************
+* tEpollWorker::_Thread
+*
+* Waits for any socket in the shard to become readable, then drains each
+* ready socket completely before waiting again.
+*/
+
+void *tEpollWorker::_Thread()
+{
+  struct epoll_event Events[MAX_EPOLL_EVENTS];
+  int i, n;
+
+  cout << "Starting epoll worker " << _iWorkerNum << " with " << _Servers.size() << " ports" << endl;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    n = epoll_wait(_fdEpoll, Events, MAX_EPOLL_EVENTS, -1);
+    _nEpollWaits++;
+
+    if (n < 0) {
+      if (errno == EINTR)  continue;
+      throw std::runtime_error(std::string("tEpollWorker: epoll_wait: ") + strerror(errno));
+    }
+
+    for (i=0; i<n; i++) {
+      ((tServer *) Events[i].data.ptr)->ProcessAvailableMessages();
+    }
   }
 
   return 0;
 }
 
 
+/***************************************************
+* tIoUringWorker constructor
+*
+* The thread blocks in io_uring_enter(), which is not a cancellation
+* point, so it is asked to exit rather than canceled.
+*
+* SIDE EFFECTS:
+*    Creates the ring and its provided buffers.  Throws a tIoUringException 
+*    if the kernel does not support it.
+*/
+
+tIoUringWorker::tIoUringWorker(int iWorkerNum, int iReceiveThreadPriority) :
+  tReceiveWorker(iWorkerNum, iReceiveThreadPriority, false),
+  _pRing(new tIoUring(IO_URING_ENTRIES))
+{
+  _pRing->RegisterBufferRing(IO_URING_BUFFER_GROUP, IO_URING_NUM_BUFFERS, IO_URING_BUFFER_SIZE);
+}
+
+
+/***************************************************
+* tIoUringWorker::AddServer
+*
+* Queues the server's multishot receive.  It is submitted to the kernel
+* with the first io_uring_enter() of the worker thread.
+*
+* INPUTS:
+*    pServer - server to add
+*/
+
+void tIoUringWorker::AddServer(tServer *pServer)
+{
+  tReceiveWorker::AddServer(pServer);
+  _Arm(pServer);
+}
+
+
+/***************************************************
+* tIoUringWorker::_Arm
+*
+* Queues a multishot receive for a server, making room in the submission
+* queue first if need be.
+*/
+
+void tIoUringWorker::_Arm(tServer *pServer)
+{
+  while (!pServer->_UdpServer.ArmMultishotReceive(*_pRing, IO_URING_BUFFER_GROUP, (uint64_t) (uintptr_t) pServer)) {
+    _pRing->Submit();
+  }
+}
+
+
+/***************************************************
+* tIoUringWorker::_Thread
+*
+* Each pass makes one io_uring_enter(), which submits any pending
+* (re-)arms and waits for at least one completion, then reaps every
+* completion that is ready.  Each buffer goes back to the ring as soon as
+* its message has been logged.
+*/
+
+void *tIoUringWorker::_Thread()
+{
+  struct io_uring_cqe *pCqe;
+  int64_t              nsRcv;
+  struct timespec      tmKernelRcv;
+  struct sockaddr_in   ClientAddress;
+  tServer             *pServer;
+  uint16_t             uBufferId;
+  uint8_t             *pPayload;
+  ssize_t              len;
+
+  cout << "Starting io_uring worker " << _iWorkerNum << " with " << _Servers.size() << " ports" << endl;
+
+  while (!_bExit) {  // Flag from base tPThread class
+    // io_uring_enter() is not a cancellation point, so wake up now and then to check _bExit
+    _pRing->Submit(1, IO_URING_EXIT_POLL_MS);
+    nsRcv = TimeTagNowNs(_iClockId);
+
+    while ((pCqe = _pRing->PeekCqe()) != nullptr) {
+      pServer = (tServer *) (uintptr_t) pCqe->user_data;
+
+      if (pCqe->res >= 0 && (pCqe->flags & IORING_CQE_F_BUFFER)) {
+        uBufferId = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        len = pServer->_UdpServer.ParseMultishotReceive(_pRing->ProvidedBuffer(uBufferId), pCqe->res, &pPayload, 
+                                                        &ClientAddress, &tmKernelRcv);
+        if (len >= 0)  pServer->_LogMessage(pPayload, len, nsRcv, tmKernelRcv, ClientAddress);
+        else           pServer->_nReceiveErrors++;   // Truncated
+        _pRing->RecycleBuffer(uBufferId);
+      }
+      else if (pCqe->res < 0 && pCqe->res != -ENOBUFS) {
+        // Counted and skipped, as in the other receive paths; the receive is re-armed below
+        pServer->_nReceiveErrors++;
+      }
+
+      // The kernel disarms a multishot receive when it runs out of buffers, among other reasons
+      if (!(pCqe->flags & IORING_CQE_F_MORE))  _Arm(pServer);
+
+      _pRing->AdvanceCq();
+    }
+  }
+
+  return 0;
+}
+
+
+
 /***************************************************
 * tServerList constructor
 *
+* Creates one tServer per port in the configured range.  With no workers,
+* each server gets its own thread; otherwise the ports are dealt
+* round-robin to the workers.
+*
 * INPUTS:
-*    
+*    Config - see tServerConfig
 */
 
-tServerList::tServerList(int iFirstPortNum, int iLastPortNum, int iReceiveThreadPriority)
+tServerList::tServerList(const tServerConfig &Config) :
+  _Config(Config),
+  _nPrevLost(0)
 {
   int iPortNum;
+  int i;
 
   _bExit = false;
 
-  for (iPortNum=iFirstPortNum; iPortNum<=iLastPortNum; iPortNum++) {
-    AddServer(iPortNum, iReceiveThreadPriority);
+  // Before any thread or buffer is made
+  if (_Config.bLockMemory)  InitRtMemory(_Config.bHugePages);
+
+  if (!_Config.sPlacement.empty())  _Placement = tCpuPlacement(_Config.sPlacement);
+
+  // Each port stands for one segment, so a cycle is complete when every port has its message
+  if (_Config.bAssembleCycles) {
+    _pAssembler.reset(new tCycleAssembler(_Config.iLastPortNum - _Config.iFirstPortNum + 1,
+                                          (int64_t) (_Config.fCyclePeriodMs * 1e6)));
+  }
+
+  // Times are compared on the clock the servers stamp with, which is the one the senders should tag with
+  if (!_Config.sClockSyncPeer.empty()) {
+    _pClockSync.reset(new tClockSync(_Config.sClockSyncPeer, _Config.iClockSyncPort, _Config.iClockId));
+  }
+
+  for (i=0; i<_Config.nWorkers; i++) {
+    if (_Config.WorkerType == tServerConfig::WORKER_IO_URING) {
+      _WorkerList.emplace_back(new tIoUringWorker(i, _Config.iReceiveThreadPriority));
+    }
+    else {
+      _WorkerList.emplace_back(new tEpollWorker(i, _Config.iReceiveThreadPriority));
+    }
+    _Placement.Place(*_WorkerList.back(), i);
+    if (_Config.bDebug)  _WorkerList.back()->StartSampleLoggerThread();
+  }
+
+  for (iPortNum=_Config.iFirstPortNum; iPortNum<=_Config.iLastPortNum; iPortNum++) {
+    AddServer(iPortNum);
   }
 }
 
 
 /***************************************************
-* tServerList::AddConnection
+* tServerList::AddServer
 *
 * INPUTS:
-*    sServer   - string descriptor of the service we are connecting to,
-*                e.g., "app_srv19"
-*    sHostname - hostname or dot-separated IP address
+*    iPortNum - port to serve
 */
 
-int tServerList::AddServer(int iPortNum, int iReceiveThreadPriority)
+int tServerList::AddServer(int iPortNum)
 {
-  _ServerList.push_back(tServer(iPortNum, iReceiveThreadPriority));
-  _ServerList.back().StartSampleLoggerThread();
+  _ServerList.push_back(tServer(iPortNum, _Config));
+  if (_pAssembler)  _ServerList.back().SetCycleAssembler(_pAssembler.get(), iPortNum - _Config.iFirstPortNum);
+  if (_pClockSync)  _ServerList.back().SetClockSync(_pClockSync.get());
+  _SegmentServers.push_back(&_ServerList.back());
+
+  if (_WorkerList.empty()) {
+    _Placement.Place(_ServerList.back(), (int) _ServerList.size() - 1);
+    if (_Config.bDebug)  _ServerList.back().StartSampleLoggerThread();
+  }
+  else {
+    // Deal the servers out to the workers round-robin
+    auto itWorker = _WorkerList.begin();
+    std::advance(itWorker, (_ServerList.size() - 1) % _WorkerList.size());
+    (*itWorker)->AddServer(&_ServerList.back());
+  }
 
   return 0;
 }
@@ -298,29 +1128,338 @@ int tServerList::AddServer(int iPortNum, int iReceiveThreadPriority)
 int tServerList::ProcessTelemetry()
 {
   sigset_t  sigset;
-  int       sig;
+  int       sig = 0;
+  struct timespec tmNow, tmWait;
+  int64_t   nsPeriod, nsWait, nsEnd = 0;
 
-  for (auto & Server : _ServerList) {
-    Server.StartThread();
+  if (_Config.ReplyMode == tServerConfig::REPLY_PER_CYCLE) {
+    for (auto & Server : _ServerList)  Server.SetSegmentServers(&_SegmentServers);
+  }
+
+  // First, so that an estimate is ready as soon as possible
+  if (_pClockSync)  _pClockSync->StartThread();
+
+  if (_WorkerList.empty()) {
+    for (auto & Server : _ServerList) {
+      Server.StartThread();
+    }
+  }
+  else {
+    for (auto & pWorker : _WorkerList) {
+      pWorker->StartThread();
+    }
   }
+  if (_pAssembler)  _pAssembler->StartThread();
 
   if (!tPThread::HaveAllBeenStartedWithRequestedAttributes()) {
     cerr << "** Warning: Some threads not created with desired attributes **" << endl;
-    cerr << "   You probably need to run as root." << endl;
+    if (tPThread::HaveAnyLostPriority())  cerr << "   You probably need to run as root." << endl;
+    else                                  cerr << "   The requested CPUs are not all available." << endl;
   }
 
-  // Wait for Ctrl-C
+  if (_Placement.IsSet()) {
+    vector<const tPThread *> Threads;
+
+    if (_WorkerList.empty())  for (auto & Server  : _ServerList)  Threads.push_back(&Server);
+    else                      for (auto & pWorker : _WorkerList)  Threads.push_back(pWorker.get());
+
+    printf("Receive thread placement: %s\n", _Placement.Describe().c_str());
+    tCpuPlacement::PrintActual(stdout, "Receive threads per CPU set:", Threads);
+    fflush(stdout);
+  }
+
+  if (_Config.bLockMemory)  tRtBuffer::PrintSummary(stdout);
+  StartMeasurementWindow();
+
+  // Wait for Ctrl-C, printing a summary every report period meanwhile
   /* Set up the mask of signals to temporarily block. */
   sigemptyset(&sigset);
   sigaddset(&sigset, SIGINT);
 
-  /* Wait for a signal to arrive. */
-  sigwait(&sigset, &sig);
-  cout << "Ctrl-C, exiting..." << endl;
+  clock_gettime(CLOCK_MONOTONIC, &_tmStart);
+  nsPeriod = (int64_t) (_Config.fReportPeriod * 1e9);
+  if (_Config.fDuration > 0)  nsEnd = TIMESPEC_NS(_tmStart) + (int64_t) (_Config.fDuration * 1e9);
+
+  /* Wait for a signal to arrive, or for the run time to be up */
+  do {
+    if (nsPeriod > 0 || nsEnd != 0) {
+      nsWait = (nsPeriod > 0) ? nsPeriod : INT64_MAX;
+      if (nsEnd != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &tmNow);
+        if (TIMESPEC_NS(tmNow) >= nsEnd)  break;
+        nsWait = min<int64_t>(nsWait, nsEnd - TIMESPEC_NS(tmNow));
+      }
+      tmWait.tv_sec  = nsWait / 1000000000LL;
+      tmWait.tv_nsec = nsWait % 1000000000LL;
+
+      // A wait cut short by the end of the run is not a whole interval, so the final summary covers it
+      sig = sigtimedwait(&sigset, NULL, &tmWait);
+      if (sig < 0 && errno == EAGAIN && nsWait == nsPeriod)  PrintIntervalSummary();
+    }
+    else {
+      sigwait(&sigset, &sig);
+    }
+  } while (sig != SIGINT);
+  cout << ((sig == SIGINT) ? "Ctrl-C, exiting..." : "Run time up, exiting...") << endl;
 
-  for (auto & Server : _ServerList) {
-    if (Server.IsRunning())  Server.StopThread(true);
+  if (_WorkerList.empty()) {
+    for (auto & Server : _ServerList) {
+      if (Server.IsRunning())  Server.StopThread(true);
+    }
+  }
+  else {
+    for (auto & pWorker : _WorkerList) {
+      if (pWorker->IsRunning())  pWorker->StopThread(true);
+    }
   }
 
+  // Only once nothing more can arrive, so that the last cycles are closed with all they will get
+  if (_pAssembler) {
+    _pAssembler->StopThread(true);
+    _pAssembler->CloseAll();
+  }
+  if (_pClockSync)  _pClockSync->StopThread(true);
+
+  PrintFinalSummary();
+  PrintSyscallStatistics();
+
   return 0;
+}
+
+
+/***************************************************
+* tServerList::_Aggregate
+*
+* Sums the latency histograms of all of the servers.  The net and host
+* histograms are left empty unless kernel timestamps are on.
+*
+* RETURNS:
+*    Estimated number of messages lost, over all of the servers
+*/
+
+long tServerList::_Aggregate(tLatencyHistogram &Latency, tLatencyHistogram &NetLatency, tLatencyHistogram &HostLatency)
+{
+  long nLost = 0;
+
+  Latency.Reset();
+  NetLatency.Reset();
+  HostLatency.Reset();
+
+  for (auto & Server : _ServerList) {
+    Latency.Add(*Server._pLatency);
+    if (Server._pNetLatency) {
+      NetLatency .Add(*Server._pNetLatency);
+      HostLatency.Add(*Server._pHostLatency);
+    }
+    nLost += Server.NumLost();
+  }
+
+  return nLost;
+}
+
+
+/***************************************************
+* tServerList::PrintIntervalSummary
+*
+* Prints the latency distribution over all ports since the last summary.
+* Called from the main thread while the receive threads are running.
+*/
+
+void tServerList::PrintIntervalSummary()
+{
+  tLatencyHistogram Latency, NetLatency, HostLatency, Interval;
+  struct timespec   tmNow;
+  long              nLost;
+  char              sLabel[80];
+
+  nLost = _Aggregate(Latency, NetLatency, HostLatency);
+
+  Interval.CopyFrom(Latency);
+  Interval.Subtract(_PrevLatency);
+
+  clock_gettime(CLOCK_MONOTONIC, &tmNow);
+  snprintf(sLabel, sizeof(sLabel), "[%8.1f s] all ports: lost=%ld ", 
+           (tmNow.tv_sec - _tmStart.tv_sec) + (tmNow.tv_nsec - _tmStart.tv_nsec) / 1e9, nLost - _nPrevLost);
+  Interval.Print(stdout, sLabel);
+
+  if (_pAssembler) {
+    Interval.CopyFrom(_pAssembler->Completion());
+    Interval.Subtract(_PrevCompletion);
+    _PrevCompletion.Add(Interval);
+    Interval.Print(stdout, "             cycle completion:");
+  }
+  if (_pClockSync)  _pClockSync->PrintSummary(stdout);
+  fflush(stdout);
+
+  _PrevLatency.CopyFrom(Latency);
+  _nPrevLost = nLost;
+}
+
+
+/***************************************************
+* tServerList::PrintFinalSummary
+*
+* Prints the latency distribution of each port, and of all ports
+* together, over the whole run.
+*/
+
+void tServerList::PrintFinalSummary()
+{
+  tLatencyHistogram Latency, NetLatency, HostLatency;
+  long              nLost;
+  long              nDuplicates = 0;
+  long              nReordered  = 0;
+  char              sLabel[80];
+
+  printf("Latency summary per port:\n");
+  for (auto & Server : _ServerList) {
+    snprintf(sLabel, sizeof(sLabel), "  port %5d: lost=%ld ", Server._iPortNum, Server.NumLost());
+    Server._pLatency->Print(stdout, sLabel);
+    Server.PrintSequenceStatistics(stdout);
+    nDuplicates += Server.NumDuplicates();
+    nReordered  += Server.NumReordered();
+  }
+
+  nLost = _Aggregate(Latency, NetLatency, HostLatency);
+
+  snprintf(sLabel, sizeof(sLabel), "All ports: lost=%ld dup=%ld reord=%ld ", nLost, nDuplicates, nReordered);
+  Latency.Print(stdout, sLabel);
+  if (NetLatency.Count() > 0) {
+    NetLatency .Print(stdout, "  network (send to socket):   ");
+    HostLatency.Print(stdout, "  host (socket to thread):    ");
+  }
+
+  if (_pAssembler)  _pAssembler->PrintReport(stdout);
+  if (_pClockSync) {
+    long nUntimed = 0;
+
+    for (auto & Server : _ServerList) {
+      nUntimed += Server._nUntimed;
+    }
+    _pClockSync->PrintSummary(stdout);
+    if (nUntimed > 0)  printf("  %ld messages arrived before the first offset estimate, and are not in the latencies\n", nUntimed);
+  }
+
+  if (_Config.ReplyMode != tServerConfig::REPLY_NONE) {
+    long nReplies = 0, nReplyDrops = 0;
+
+    for (auto & Server : _ServerList) {
+      nReplies    += Server.NumReplies();
+      nReplyDrops += Server.NumReplyDrops();
+    }
+    printf("Replies sent: %ld, dropped: %ld\n", nReplies, nReplyDrops);
+  }
+}
+
+
+/***************************************************
+* tServerList::WriteResults
+*
+* Writes the configuration and everything the final summaries print to a
+* result file.  Only once the threads have stopped.
+*
+* INPUTS:
+*    sFilename - result file to write
+*/
+
+void tServerList::WriteResults(const std::string &sFilename)
+{
+  tResultFile       Results(sFilename, "rtc_udp");
+  tLatencyHistogram Latency, NetLatency, HostLatency;
+  long              nLost;
+  long              nDuplicates = 0, nReordered = 0, nReceived = 0, nSyscalls = 0;
+  long              nReplies = 0, nReplyDrops = 0, nErrors = 0, nUntimed = 0;
+  const char       *sBackend;
+
+  if      (_WorkerList.empty())                                  sBackend = "threads";
+  else if (_Config.WorkerType == tServerConfig::WORKER_IO_URING)  sBackend = "io_uring";
+  else                                                           sBackend = "epoll";
+
+  Results.BeginObject("config");
+  Results.Add("first_port",        _Config.iFirstPortNum);
+  Results.Add("last_port",         _Config.iLastPortNum);
+  Results.Add("priority",          _Config.iReceiveThreadPriority);
+  Results.Add("backend",           sBackend);
+  Results.Add("workers",           _Config.nWorkers);
+  Results.Add("batch_size",        _Config.iBatchSize);
+  Results.Add("kernel_timestamps", _Config.bKernelTimestamps);
+  Results.Add("assemble_cycles",   _Config.bAssembleCycles);
+  Results.Add("reply",             (_Config.ReplyMode == tServerConfig::REPLY_PER_CYCLE)   ? "cycle" :
+                                   (_Config.ReplyMode == tServerConfig::REPLY_PER_MESSAGE) ? "msg" : "none");
+  Results.Add("clock",             TimeTagClockName(_Config.iClockId));
+  Results.Add("clock_sync_peer",   _Config.sClockSyncPeer);
+  Results.Add("placement",         _Config.sPlacement);
+  Results.Add("lock_memory",       _Config.bLockMemory);
+  Results.Add("huge_pages",        _Config.bHugePages);
+  Results.EndObject();
+
+  for (auto & Server : _ServerList) {
+    nDuplicates += Server.NumDuplicates();
+    nReordered  += Server.NumReordered();
+    nReceived   += Server._nReceived;
+    nSyscalls   += Server._nSyscalls;
+    nErrors     += Server._nReceiveErrors;
+    nUntimed    += Server._nUntimed;
+    nReplies    += Server.NumReplies();
+    nReplyDrops += Server.NumReplyDrops();
+  }
+  for (auto & pWorker : _WorkerList) {
+    nSyscalls += pWorker->NumSyscalls();
+  }
+  nLost = _Aggregate(Latency, NetLatency, HostLatency);
+
+  Results.Add("received",   nReceived);
+  Results.Add("lost",       nLost);
+  Results.Add("duplicate",  nDuplicates);
+  Results.Add("reordered",  nReordered);
+  Results.Add("syscalls",   nSyscalls);
+  Results.Add("receive_errors", nErrors);
+  Results.AddHistogram("latency", Latency);
+  if (NetLatency.Count() > 0) {
+    Results.AddHistogram("network_latency", NetLatency);
+    Results.AddHistogram("host_latency",    HostLatency);
+  }
+
+  if (_pAssembler)  _pAssembler->WriteResults(Results);
+  if (_pClockSync) {
+    _pClockSync->WriteResults(Results);
+    Results.Add("untimed", nUntimed);
+  }
+  if (_Config.ReplyMode != tServerConfig::REPLY_NONE) {
+    Results.Add("replies",      nReplies);
+    Results.Add("reply_drops",  nReplyDrops);
+  }
+
+  Results.AddResourceUsage();
+}
+
+
+/***************************************************
+* tServerList::PrintSyscallStatistics
+*
+* Reports how many receive system calls were needed per message, summed
+* over all of the servers.  Only meaningful once the threads have stopped.
+*/
+
+void tServerList::PrintSyscallStatistics()
+{
+  long nReceived = 0;
+  long nSyscalls = 0;
+  long nErrors   = 0;
+
+  for (auto & Server : _ServerList) {
+    nReceived += Server._nReceived;
+    nSyscalls += Server._nSyscalls;
+    nErrors   += Server._nReceiveErrors;
+  }
+
+  // Workers add their epoll_wait() or io_uring_enter() calls on top of any receives
+  for (auto & pWorker : _WorkerList) {
+    nSyscalls += pWorker->NumSyscalls();
+  }
+
+  printf("Received %ld messages with %ld receive syscalls", nReceived, nSyscalls);
+  if (nReceived > 0)  printf(" (%.3f syscalls per message)", (double) nSyscalls / nReceived);
+  printf("\n");
+  if (nErrors > 0)  printf("%ld receives failed and were skipped\n", nErrors);
 }
\ No newline at end of file
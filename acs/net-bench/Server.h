@@ -9,31 +9,70 @@
 
 #include <string>
 #include <list>
-#include <queue>
+#include <vector>
+#include <memory>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
 #include <sys/time.h>
 #include "PThread.h"
+#include "SpscRing.h"
+#include "LatencyHistogram.h"
+#include "SequenceTracker.h"
+#include "CycleAssembler.h"
 #include "UdpConnection.h"
+#include "IoUring.h"
+#include "TimeTag.h"
+#include "ClockSync.h"
+#include "ResultFile.h"
+#include "CpuPlacement.h"
 
 
 struct tLatencySample {
   tLatencySample() {}
-  tLatencySample(int nRcvdByServer, int nSentByClient, struct timeval &tmRcv, struct timeval &tmSent, struct sockaddr_in &ClientAddress) :
-    _nRcvdByServer(nRcvdByServer), _nSentByClient(nSentByClient), _tmRcv(tmRcv), _tmSent(tmSent), _ClientAddress(ClientAddress) {}
+  tLatencySample(int iPortNum, int nRcvdByServer, int nSentByClient, int64_t nsRcv, int64_t nsKernelRcv, 
+                 int64_t nsSent, struct sockaddr_in &ClientAddress) :
+    _iPortNum(iPortNum), _nRcvdByServer(nRcvdByServer), _nSentByClient(nSentByClient), _nsRcv(nsRcv), _nsKernelRcv(nsKernelRcv), 
+    _nsSent(nsSent), _ClientAddress(ClientAddress) {}
 
+  int                _iPortNum;
   int                _nRcvdByServer;
   int                _nSentByClient;
-  struct timeval     _tmRcv;
-  struct timeval     _tmSent;
+  int64_t            _nsRcv;         // When the application picked up the message
+  int64_t            _nsKernelRcv;   // When the message reached the socket; zero if kernel timestamps are off
+  int64_t            _nsSent;
   struct sockaddr_in _ClientAddress;
 };
 
 
+/****************************************************
+* tSampleLogger
+*
+* Takes latency samples from a receive thread and prints them from a
+* thread of its own.  Samples pass through a lock-free ring, so logging
+* costs the receive thread no lock.  The logger thread sleeps on an
+* eventfd, which the receive thread signals once the ring fills past a
+* high-water mark, at most once per drain; below that, the logger wakes
+* every SAMPLE_LOGGER_IDLE_MS of its own accord.  If the logger falls
+* behind, samples are dropped and counted rather than blocking the
+* receive thread.
+*
+* Only one thread may call LogSample() on a given logger.
+*/
+
+// Sample ring sizes: 50 Hz per port, so a per-port logger can fall ~5 s
+// behind, and a logger shared by a worker for the whole mirror ~0.3 s.
+#define SAMPLE_RING_SIZE         (256)
+#define SHARED_SAMPLE_RING_SIZE  (8192)
+
+// Longest a sample waits to be printed while the ring is below its high-water mark
+#define SAMPLE_LOGGER_IDLE_MS    (250)
+
+// Clients sending to one port that get their own sequence tracking; any more are only counted
+#define MAX_SOURCES_PER_PORT     (8)
+
 class tSampleLogger {
 public:
-  tSampleLogger(int iPortNum);
+  tSampleLogger(size_t nRingCapacity = SAMPLE_RING_SIZE);
 
   tSampleLogger(tSampleLogger &&obj) noexcept;  // Move constructor - needed so that destruction of temporary does not close file.
   // tSampleLogger& operator=(tSampleLogger&& other); // Move assignment operator, will add if needed
@@ -46,26 +85,66 @@ public:
 
   void StartLoggerThread();
 
-  void LogSample(int nRcvdByServer, int nSentByClient, struct timeval &tmRcv, struct timeval &tmSent, struct sockaddr_in &ClientAddr);
+  void LogSample(int iPortNum, int nRcvdByServer, int nSentByClient, int64_t nsRcv, int64_t nsKernelRcv,
+                 int64_t nsSent, struct sockaddr_in &ClientAddr);
   void PrintSamples();
 
+  long NumDropped() { return _pSampleRing->NumDropped(); }
+
 protected:
-  std::queue<tLatencySample> _SampleQueue;
+  static void _PrintSample(const tLatencySample &Sample);
 
-  // Mutex and condition variable to allow queue-draining method to block waiting on samples
-  std::mutex              _SampleQueueMutex;
-  std::condition_variable _SampleQueueCondition;
+  std::unique_ptr<tSpscRing<tLatencySample>> _pSampleRing;   // By pointer, since the ring cannot move
 
-  std::thread _thread;
+  void _Wake();
 
-  int _iPortNum;
+  std::thread       _thread;
+  std::atomic<bool> _bExit;     // Tells the logger thread to exit once the ring is empty
+  int               _fdWake;    // eventfd the logger thread sleeps on; -1 until it starts
+  size_t            _nHighWater;
+  std::atomic<bool> _bWakePending;  // Set by the receive thread when it signals, cleared by the logger
+};
+
+
+/****************************************************
+* tServerConfig
+*
+* Options for a tServerList and its servers, as set on the command line
+*/
+
+struct tServerConfig {
+  enum tWorkerType { WORKER_EPOLL, WORKER_IO_URING };
+  enum tReplyMode  { REPLY_NONE, REPLY_PER_MESSAGE, REPLY_PER_CYCLE };
+
+  int         iFirstPortNum          = 0;
+  int         iLastPortNum           = -1;
+  int         iReceiveThreadPriority = 0;      // RT priority of the receive threads, 0 for none
+  int         iBatchSize             = 1;      // Max messages per receive syscall
+  int         nWorkers               = 0;      // 0 runs one thread per port
+  tWorkerType WorkerType             = WORKER_EPOLL;
+  bool        bKernelTimestamps      = false;  // Also record when each message reached the socket
+  bool        bAssembleCycles        = false;  // Gather each cycle's messages from all ports into a frame
+  double      fCyclePeriodMs         = 20;     // Senders' cycle period, to tell their cycles apart
+  tReplyMode  ReplyMode              = REPLY_NONE;  // Answer with an ActTargetMsg; per cycle needs bAssembleCycles
+  int         iClockId               = TIMETAG_V1;  // Clock receive times are taken from; see TimeTag.h
+  std::string sClockSyncPeer;                   // Sender's host, to correct receive times onto its clock; empty for none
+  int         iClockSyncPort         = M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT;
+  bool        bDebug                 = false;  // Print every sample, not just the summaries
+  double      fReportPeriod          = 1.0;    // Seconds between summaries, 0 for none
+  double      fDuration              = 0;      // Seconds to run before stopping as on Ctrl-C, 0 to wait for Ctrl-C
+  std::string sPlacement;                       // CPUs for the receive threads, as in CpuPlacement.h; empty for any
+  bool        bLockMemory            = false;  // Lock memory and prefault stacks, as in RtMemory.h
+  bool        bHugePages             = false;  // Also put the receive buffers in huge pages
 };
 
 
 class tServer : public tPThread {
 friend class tServerList;
+friend class tReceiveWorker;
+friend class tEpollWorker;
+friend class tIoUringWorker;
 public:
-  tServer(int iPortNum, int iReceiveThreadPriority = 0);
+  tServer(int iPortNum, const tServerConfig &Config);
 
   tServer(tServer &&obj) noexcept;  // Move constructor - needed so that destruction of temporary does not close file.
   // tHostConnection& operator=(tHostConnection&& other); // Move assignment operator, will add if needed
@@ -78,31 +157,194 @@ public:
   
   void StartSampleLoggerThread() { _SampleLogger.StartLoggerThread(); }
 
+  // Servers driven by a tReceiveWorker log to the worker's logger rather than their own
+  void SetSharedSampleLogger(tSampleLogger *pLogger) { _pSharedSampleLogger = pLogger; }
+
+  // Hands every message to the assembler too, as segment iSegment
+  void SetCycleAssembler(tCycleAssembler *pAssembler, int iSegment) { _pAssembler = pAssembler; _iSegment = iSegment; }
+
+  // With REPLY_PER_CYCLE, the server completing a cycle answers every segment through its server here
+  void SetSegmentServers(const std::vector<tServer *> *pSegmentServers);
+
+  // Receive times on the senders' clock are translated onto it through here before use
+  void SetClockSync(const tClockSync *pClockSync) { _pClockSync = pClockSync; }
+
   int ProcessIncomingMessages();
+  int ProcessAvailableMessages();
+
+  long NumLost();
+  long NumDuplicates();
+  long NumReordered();
+  void PrintSequenceStatistics(FILE *pFile);
+
+  long NumReplies()     { return _nReplies    .load(std::memory_order_relaxed); }
+  long NumReplyDrops()  { return _nReplyDrops .load(std::memory_order_relaxed); }
 
 protected:
   virtual void *_Thread();
+  int           _ProcessIncomingMessagesBatched();
+  ssize_t       _ReceiveMessage(uint8_t *buf, size_t szBufSize, struct sockaddr_in *pClientAddress, 
+                                struct timespec *pKernelTime);
+  int           _ReceiveBatch();
+  void          _LogMessage(const uint8_t *buf, ssize_t len, int64_t nsRcv, const struct timespec &tmKernelRcv, 
+                            struct sockaddr_in &ClientAddress);
+  tSequenceTracker *_FindSequenceTracker(const struct sockaddr_in &ClientAddress);
+  void          _SendReply(uint32_t uCycle, int64_t nsEcho, int iClockId, const struct sockaddr_in &ClientAddress);
+  void          _ReplyToCycle(uint32_t uCycle);
+  tSampleLogger &_Logger() { return (_pSharedSampleLogger != nullptr) ? *_pSharedSampleLogger : _SampleLogger; }
+
   int           _iPortNum;
+  int           _iClockId;     // Clock the receive threads stamp messages with
+  const tClockSync *_pClockSync;  // nullptr unless correcting for the senders' clock offset
   tUdpServer    _UdpServer;
   bool          _bDebug;
   tSampleLogger _SampleLogger;
+  tSampleLogger *_pSharedSampleLogger;
   int           _nReceived;
+  int           _iBatchSize;   // Max messages per recvmmsg(); 1 means one recvfrom() per message
+  long          _nSyscalls;    // Number of receive system calls made
+  long          _nReceiveErrors;  // Receives that failed, and were skipped
+  long          _nUntimed;     // Received before the clock sync's first estimate, so not in the latencies
+  tUdpReceiveBatch _Batch;     // Receive buffers for ProcessAvailableMessages()
+
+  // Latency distributions, by pointer since they cannot move.  Network and host
+  // latency are only recorded with kernel timestamps.
+  std::unique_ptr<tLatencyHistogram> _pLatency;
+  std::unique_ptr<tLatencyHistogram> _pNetLatency;
+  std::unique_ptr<tLatencyHistogram> _pHostLatency;
+
+  // Sequence tracking per client, keyed by address and port.  The receive thread
+  // claims slots in order and publishes them through _nSources, so the reporting
+  // thread only ever reads slots that are fully set up.
+  std::unique_ptr<uint64_t[]>         _pSourceKeys;
+  std::unique_ptr<tSequenceTracker[]> _pSequence;
+  std::atomic<int>                    _nSources;
+  std::atomic<long>                   _nUntracked;  // Messages from clients beyond MAX_SOURCES_PER_PORT
+
+  tCycleAssembler *_pAssembler;   // nullptr unless assembling cycles
+  int              _iSegment;
+
+  // Replies.  Any receive thread may reply through this server, so the counts are real atomic adds.
+  tServerConfig::tReplyMode      _ReplyMode;
+  std::atomic<uint64_t>          _uLastSourceKey;   // Client last heard from, as in _pSourceKeys
+  std::atomic<int>               _iLastClockId;     // Its time tag layout and clock, to answer in kind
+  const std::vector<tServer *>  *_pSegmentServers;  // Every segment's server, by segment number
+  std::unique_ptr<int64_t[]>     _pnsCycleSent;     // Send times of the cycle being answered
+  std::atomic<long>              _nReplies;
+  std::atomic<long>              _nReplyDrops;      // Replies not sent, for lack of socket buffer space or any other error
+};
+
+
+/****************************************************
+* tReceiveWorker
+*
+* Alternative to running one tServer thread per port.  Each worker owns a
+* shard of the servers and services all of their sockets from a single
+* thread.  All servers in the shard share the worker's sample logger.
+* Derived classes supply the multiplexing mechanism.
+*/
+
+class tReceiveWorker : public tPThread {
+friend class tServerList;
+public:
+  tReceiveWorker(int iWorkerNum, int iReceiveThreadPriority = 0, bool bForceKillOnStopRequest = true);
+
+  // Workers are held by pointer, so are neither copied nor moved
+  tReceiveWorker(const tReceiveWorker &) = delete;   
+  tReceiveWorker& operator=(const tReceiveWorker &) = delete;
+
+  virtual void AddServer(tServer *pServer);
+  void StartSampleLoggerThread() { _SampleLogger.StartLoggerThread(); }
+
+  virtual long NumSyscalls() = 0;   // Multiplexing syscalls made, on top of any the servers count
+
+protected:
+  int                    _iWorkerNum;
+  std::vector<tServer *> _Servers;
+  tSampleLogger          _SampleLogger;
+  int                    _iClockId;     // As the servers' own, to stamp receive times with
+};
+
+
+/****************************************************
+* tEpollWorker
+*
+* Multiplexes the shard's (non-blocking) sockets with an edge-triggered
+* epoll set.
+*/
+
+class tEpollWorker : public tReceiveWorker {
+public:
+  tEpollWorker(int iWorkerNum, int iReceiveThreadPriority = 0);
+  ~tEpollWorker();
+
+  virtual void AddServer(tServer *pServer);
+  virtual long NumSyscalls() { return _nEpollWaits; }
+
+protected:
+  virtual void *_Thread();
+
+  int                    _fdEpoll;
+  long                   _nEpollWaits;   // Number of epoll_wait() system calls made
+};
+
+
+/****************************************************
+* tIoUringWorker
+*
+* Keeps a multishot receive armed on every socket in the shard, with the
+* kernel picking receive buffers from a provided buffer ring.  One
+* io_uring_enter() can then reap completions for many datagrams on many
+* ports.
+*/
+
+class tIoUringWorker : public tReceiveWorker {
+public:
+  tIoUringWorker(int iWorkerNum, int iReceiveThreadPriority = 0);
+
+  virtual void AddServer(tServer *pServer);
+  virtual long NumSyscalls() { return _pRing->NumEnterCalls(); }
+
+protected:
+  virtual void *_Thread();
+  void          _Arm(tServer *pServer);
+
+  std::unique_ptr<tIoUring> _pRing;
 };
 
 
 
 class tServerList {
 public:
-  tServerList(int iFirstPortNum, int iLastPortNum, int iReceiveThreadPriority);
-  int AddServer(int iPortNum, int iReceiveThreadPriority);
+  tServerList(const tServerConfig &Config);
+  int AddServer(int iPortNum);
 
   bool IsEmpty() { return _ServerList.empty(); }
 
   int ProcessTelemetry();
+  void PrintSyscallStatistics();
+  void PrintIntervalSummary();
+  void PrintFinalSummary();
+  void WriteResults(const std::string &sFilename);
 
 protected:
-  std::list<tServer> _ServerList;
+  long _Aggregate(tLatencyHistogram &Latency, tLatencyHistogram &NetLatency, tLatencyHistogram &HostLatency);
+
+  tServerConfig           _Config;
+  std::list<tServer>      _ServerList;
+  std::list<std::unique_ptr<tReceiveWorker>> _WorkerList;   // Empty when running one thread per server
   bool _bExit;
+
+  std::unique_ptr<tCycleAssembler> _pAssembler;   // nullptr unless assembling cycles
+  std::vector<tServer *>  _SegmentServers;         // By segment number, for replies per cycle
+  std::unique_ptr<tClockSync> _pClockSync;         // nullptr unless correcting for the senders' clock offset
+  tCpuPlacement           _Placement;              // Of the receive threads, by worker or by port
+
+  // State at the previous interval summary, so that each summary covers just its interval
+  tLatencyHistogram       _PrevLatency;
+  tLatencyHistogram       _PrevCompletion;
+  long                    _nPrevLost;
+  struct timespec         _tmStart;
 };
 
 
@@ -0,0 +1,151 @@
+/* tSpscRing - Bounded lock-free single-producer/single-consumer ring
+*
+* Hands items from one thread to another without locks or system calls.
+* The producer never blocks: when the ring is full, the newest item is
+* dropped and counted, so a slow consumer costs samples rather than
+* stalling a realtime thread or growing memory.
+*
+* The producer and consumer indices live on separate cache lines.  The
+* producer keeps a private copy of the consumer's index, so that it only
+* reads the consumer's cache line when the ring looks full, and the
+* consumer reads the producer's index once per batch, not once per item.
+*
+* Exactly one thread may call TryPush(), and exactly one (possibly
+* different) thread may call Drain().  The capacity must be a power of two.
+*
+* The ring holds atomics, so it can be neither copied nor moved.  Hold it
+* by pointer if the owner needs to move.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TSPSCRING_H_
+#define TSPSCRING_H_
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <assert.h>
+
+// Size of a cache line on the targets we run on (x86-64 and Cortex-A53)
+#define SPSC_CACHE_LINE_SIZE (64)
+
+
+template <typename T>
+class tSpscRing {
+public:
+  tSpscRing(size_t nCapacity) :
+    _pItems(new T[nCapacity]),
+    _uMask(nCapacity - 1),
+    _uTail(0),
+    _uCachedHead(0),
+    _nDropped(0),
+    _uHead(0)
+  {
+    assert(nCapacity > 0 && (nCapacity & (nCapacity - 1)) == 0);
+  }
+
+  tSpscRing(const tSpscRing &) = delete;
+  tSpscRing& operator=(const tSpscRing &) = delete;
+
+
+  /*****************************
+  * tSpscRing::TryPush
+  *
+  * Producer side.  Never blocks.
+  *
+  * RETURNS:
+  *   true if queued, false if the ring was full and the item was dropped
+  */
+
+  bool TryPush(const T &Item)
+  {
+    size_t uTail = _uTail.load(std::memory_order_relaxed);
+
+    if (uTail - _uCachedHead > _uMask) {
+      // Looks full - refresh our view of how far the consumer has got
+      _uCachedHead = _uHead.load(std::memory_order_acquire);
+      if (uTail - _uCachedHead > _uMask) {
+        _nDropped.store(_nDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+
+    _pItems[uTail & _uMask] = Item;
+    _uTail.store(uTail + 1, std::memory_order_release);
+    return true;
+  }
+
+
+  /*****************************
+  * tSpscRing::Drain
+  *
+  * Consumer side.  Hands every item queued at the time of the call, up to
+  * nMax, to Fn, then releases them all to the producer at once.
+  *
+  * RETURNS:
+  *   The number of items drained
+  */
+
+  template <typename tFn>
+  size_t Drain(tFn Fn, size_t nMax = (size_t) -1)
+  {
+    size_t uHead = _uHead.load(std::memory_order_relaxed);
+    size_t n, i;
+
+    n = _uTail.load(std::memory_order_acquire) - uHead;
+    if (n > nMax)  n = nMax;
+
+    for (i=0; i<n; i++) {
+      Fn(_pItems[(uHead + i) & _uMask]);
+    }
+
+    if (n > 0)  _uHead.store(uHead + n, std::memory_order_release);
+    return n;
+  }
+
+
+  /*****************************
+  * tSpscRing::HasAtLeast
+  *
+  * Producer side.  Whether at least n items are queued.  Only reads the
+  * consumer's index when the producer's cached copy of it says so.
+  */
+
+  bool HasAtLeast(size_t n)
+  {
+    size_t uTail = _uTail.load(std::memory_order_relaxed);
+
+    if (uTail - _uCachedHead < n)  return false;
+    _uCachedHead = _uHead.load(std::memory_order_acquire);
+    return (uTail - _uCachedHead >= n);
+  }
+
+
+  size_t Capacity()   const { return _uMask + 1; }
+  long   NumDropped() const { return _nDropped.load(std::memory_order_relaxed); }
+
+protected:
+  std::unique_ptr<T[]> _pItems;
+  size_t               _uMask;
+
+  // Written by the producer
+  alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> _uTail;
+  size_t               _uCachedHead;
+  std::atomic<long>    _nDropped;
+
+  // Written by the consumer
+  alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> _uHead;
+  char                 _Pad[SPSC_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+
+#endif /* TSPSCRING_H_ */
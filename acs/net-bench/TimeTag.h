@@ -0,0 +1,199 @@
+/* TimeTag - Read and write the time tags of data messages
+*
+* A data message comes in two layouts.  The original begins with a
+* DataHdr, whose time tag is a gettimeofday() timeval: microseconds, on a
+* clock that NTP can step.  The V2 layout begins with a DataHdrV2, whose
+* time tag is in nanoseconds and names the clock it was taken from.
+*
+* Receivers accept both.  The V2 layout is longer by a fixed amount, so a
+* message is told apart by its length, and the magic number and version
+* in its header confirm it.  Senders that know only the original layout
+* therefore keep working.
+*
+* Inside the programs every time is an int64_t count of nanoseconds, on
+* the clock given by a clock id: one of TIME_CLOCK_ID for V2 headers, or
+* TIMETAG_V1 for the original, whose clock is CLOCK_REALTIME.
+*
+***
+*
+* Thirty Meter Telescope Project
+* Lower Segment Electronics Box Software
+*
+* Copyright 2022 California Institute of Technology
+* All rights reserved
+*
+*/
+
+
+#ifndef TTIMETAG_H_
+#define TTIMETAG_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+extern "C" {
+  #include "GlcMsg.h"
+}
+
+// Clock id of an original DataHdr time tag
+#define TIMETAG_V1  (-1)
+
+
+/*******************************************************
+* TimeTagClock
+*
+* RETURNS:
+*   The clock to read for a clock id
+*/
+
+static inline clockid_t TimeTagClock(int iClockId)
+{
+  switch (iClockId) {
+    case TIME_CLOCK_MONOTONIC_RAW:  return CLOCK_MONOTONIC_RAW;
+    case TIME_CLOCK_TAI:            return CLOCK_TAI;
+    default:                        return CLOCK_REALTIME;
+  }
+}
+
+
+/*******************************************************
+* TimeTagNowNs
+*
+* RETURNS:
+*   The time now on a clock id's clock, in ns.  For TIMETAG_V1, truncated
+*   to the microsecond, as gettimeofday() would give.
+*/
+
+static inline int64_t TimeTagNowNs(int iClockId)
+{
+  struct timespec tmNow;
+  int64_t         nsNow;
+
+  clock_gettime(TimeTagClock(iClockId), &tmNow);
+  nsNow = (int64_t) tmNow.tv_sec * 1000000000LL + tmNow.tv_nsec;
+
+  return (iClockId == TIMETAG_V1) ? nsNow - nsNow % 1000 : nsNow;
+}
+
+
+/*******************************************************
+* TimeTagClockName, TimeTagParseClock
+*
+* Command line names of the clock ids: v1, realtime, raw, tai
+*/
+
+static inline const char *TimeTagClockName(int iClockId)
+{
+  switch (iClockId) {
+    case TIME_CLOCK_REALTIME:       return "realtime";
+    case TIME_CLOCK_MONOTONIC_RAW:  return "raw";
+    case TIME_CLOCK_TAI:            return "tai";
+    default:                        return "v1";
+  }
+}
+
+
+static inline bool TimeTagParseClock(const char *sName, int *piClockId)
+{
+  int iClockId;
+
+  if (sName == NULL)  return false;
+
+  for (iClockId=TIMETAG_V1; iClockId<NUM_TIME_CLOCKS; iClockId++) {
+    if (!strcmp(sName, TimeTagClockName(iClockId))) {
+      *piClockId = iClockId;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/*******************************************************
+* SetDataHdrTime
+*
+* Writes a message's header layout and time tag.  The MsgHdr is at the
+* same place in both layouts and is left alone.
+*
+* INPUTS:
+*   pMsg     - the message, with room for the layout the clock id calls for
+*   iClockId - TIMETAG_V1 for a DataHdr, else a DataHdrV2 with this clock
+*   nsTime   - the time tag
+*/
+
+static inline void SetDataHdrTime(uint8_t *pMsg, int iClockId, int64_t nsTime)
+{
+  DataHdr   *pHdr   = (DataHdr *)   pMsg;
+  DataHdrV2 *pHdrV2 = (DataHdrV2 *) pMsg;
+
+  if (iClockId == TIMETAG_V1) {
+    pHdr->time.tv_sec  = nsTime / 1000000000LL;
+    pHdr->time.tv_usec = (nsTime % 1000000000LL) / 1000;
+  }
+  else {
+    pHdrV2->magic        = DATA_HDR_MAGIC;
+    pHdrV2->version      = DATA_HDR_VERSION_2;
+    pHdrV2->clockId      = (uint8_t) iClockId;
+    pHdrV2->spare        = 0;
+    pHdrV2->time.tv_sec  = nsTime / 1000000000LL;
+    pHdrV2->time.tv_nsec = nsTime % 1000000000LL;
+  }
+}
+
+
+/*******************************************************
+* GetDataHdrTime
+*
+* Reads a received message's time tag, whichever layout it has
+*
+* INPUTS:
+*   pMsg - the message
+*   len  - its length
+*   szV1 - length of this message type with a DataHdr
+*   szV2 - length of this message type with a DataHdrV2
+* OUTPUTS:
+*   *pnsTime   - the time tag, in ns
+*   *piClockId - TIMETAG_V1, or the DataHdrV2 clock id
+* RETURNS:
+*   false if the message is neither layout
+*/
+
+static inline bool GetDataHdrTime(const uint8_t *pMsg, ssize_t len, size_t szV1, size_t szV2, int64_t *pnsTime, int *piClockId)
+{
+  const DataHdr   *pHdr   = (const DataHdr *)   pMsg;
+  const DataHdrV2 *pHdrV2 = (const DataHdrV2 *) pMsg;
+
+  if (len == (ssize_t) szV1) {
+    *pnsTime   = (int64_t) pHdr->time.tv_sec * 1000000000LL + (int64_t) pHdr->time.tv_usec * 1000LL;
+    *piClockId = TIMETAG_V1;
+    return true;
+  }
+
+  if (len == (ssize_t) szV2 && pHdrV2->magic == DATA_HDR_MAGIC && pHdrV2->version == DATA_HDR_VERSION_2 &&
+      pHdrV2->clockId < NUM_TIME_CLOCKS) {
+    *pnsTime   = (int64_t) pHdrV2->time.tv_sec * 1000000000LL + (int64_t) pHdrV2->time.tv_nsec;
+    *piClockId = pHdrV2->clockId;
+    return true;
+  }
+
+  return false;
+}
+
+
+/*******************************************************
+* SameClock
+*
+* RETURNS:
+*   true if times tagged with the two clock ids can be subtracted
+*/
+
+static inline bool SameClock(int iClockIdA, int iClockIdB)
+{
+  return TimeTagClock(iClockIdA) == TimeTagClock(iClockIdB);
+}
+
+
+#endif /* TTIMETAG_H_ */
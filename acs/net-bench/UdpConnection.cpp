@@ -32,8 +32,11 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 
 #include <string>
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
 #include <cassert>
@@ -42,6 +45,7 @@
 #include <iostream>
 
 #include "UdpConnection.h"
+#include "IoUring.h"
 
 using namespace std;
 
@@ -59,18 +63,21 @@ using namespace std;
 * INPUTS:
 *   sServerIpAddressString - server to target
 *   iPortNum               - port number on server to target
+*   sClientIpAddressString - source address to send from, or NULL
+*   bOwnSocket             - if false, no socket is created; the caller sends the
+*                            client's messages through a shared socket instead
 * SIDE EFFECTS:
 *   Creates and binds the sockets.
 *   Will set _bInitSuccessfully if construction is successful
 *   Will throw a tUdpConnectionException if an error occurs.
 */
 
-tUdpClient::tUdpClient(const string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString) 
+tUdpClient::tUdpClient(const string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString,
+                       bool bOwnSocket) 
 {
 
   int iBroadcastEnable = (iPortNum == INADDR_ANY);
   in_addr_t ipServerAddressInBinary, ipClientAddressInBinary;
-  struct sockaddr_in siClientTx;
 
   _bInitSuccessfully = false;
 
@@ -86,7 +93,29 @@ tUdpClient::tUdpClient(const string &sServerIpAddressString, int iPortNum, const
   _SiHostTx.sin_addr.s_addr = ipServerAddressInBinary;
 
   // Initialize the socket to 0
-  _sockTx = 0;
+  _sockTx     = 0;
+  _bBound     = false;
+  _bHasSource = false;
+  bzero((char*)&_SiClientTx, sizeof(_SiClientTx));
+
+  if (sClientIpAddressString != NULL) {
+    // Use inet_pton() to go from string to binary from. Do not use inet_ntoa() or inet_aton(), they are deprecated.
+    if (inet_pton(AF_INET, sClientIpAddressString, &ipClientAddressInBinary) != 1) {
+      throw tUdpConnectionException(string("Error converting IP address ") + sClientIpAddressString + " to binary");
+    }
+    _SiClientTx.sin_family      = AF_INET;
+    _SiClientTx.sin_port        = 0;
+    _SiClientTx.sin_addr.s_addr = ipClientAddressInBinary;
+    _bHasSource = true;
+  }
+
+  // Without a socket of its own, the client's messages go out through a shared socket, with the
+  // source address set per message
+  if (!bOwnSocket) {
+    _ui8MsgIndex = 0;
+    _bInitSuccessfully = true;
+    return;
+  }
 
   // Create the socket for transmit 
   _sockTx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -100,19 +129,11 @@ tUdpClient::tUdpClient(const string &sServerIpAddressString, int iPortNum, const
 
 
   // If a client source IP address is provided, bind to it.
-  if (sClientIpAddressString != NULL) {
-    // Use inet_pton() to go from string to binary from. Do not use inet_ntoa() or inet_aton(), they are deprecated.
-    if (inet_pton(AF_INET, sClientIpAddressString, &ipClientAddressInBinary) != 1) {
-      throw tUdpConnectionException(string("Error converting IP address ") + sClientIpAddressString + " to binary");
-    }
-    bzero((char*)&siClientTx, sizeof(siClientTx));
-    siClientTx.sin_family      = AF_INET;
-    siClientTx.sin_port        = 0;
-    siClientTx.sin_addr.s_addr = ipClientAddressInBinary;
-
-    if (bind(_sockTx, (struct sockaddr *) &siClientTx, sizeof(siClientTx)) < 0) {
+  if (_bHasSource) {
+    if (bind(_sockTx, (struct sockaddr *) &_SiClientTx, sizeof(_SiClientTx)) < 0) {
       throw tUdpConnectionException("Error binding UDP transmit socket");
     }
+    _bBound = true;
     // cout << "Bound client to IP address " << sClientIpAddressString << endl;
 
   }
@@ -137,7 +158,12 @@ tUdpClient::tUdpClient(const string &sServerIpAddressString, int iPortNum, const
 
 tUdpClient::tUdpClient(tUdpClient &&other) noexcept :
   _sockTx           (other._sockTx),
+  _bBound           (other._bBound),
+  _bHasSource       (other._bHasSource),
+  _SiClientTx       (other._SiClientTx),
   _SiHostTx         (other._SiHostTx),
+  _MsgHdrTx         (other._MsgHdrTx),
+  _IovTx            (other._IovTx),
   _ui8MsgIndex      (other._ui8MsgIndex),
   _bInitSuccessfully(other._bInitSuccessfully)
 {
@@ -175,6 +201,52 @@ void tUdpClient::SendMessage(uint8_t *pMessage, int iNumBytes)
 
 
 
+/*********************************************
+* tUdpClient::PrepareSend
+*
+* io_uring alternative to SendMessage().  Queues a sendmsg of the message
+* on the ring, but does not submit it; the caller submits all of the
+* queued sends at once.  The message buffer, and this object, must not
+* change until the send completes.
+* 
+* INPUTS:
+*   Ring      - ring to queue the send on
+*   pMessage  - the message to send
+*   iNumBytes - the length of the message to send
+*   uUserData - returned in the send's completion
+* RETURNS:
+*   true if queued, false if the submission queue is full
+*/
+
+bool tUdpClient::PrepareSend(tIoUring &Ring, uint8_t *pMessage, int iNumBytes, uint64_t uUserData)
+{
+  struct io_uring_sqe *pSqe;
+
+  assert(pMessage != nullptr);
+  assert(iNumBytes > 0);
+
+  pSqe = Ring.GetSqe();
+  if (pSqe == nullptr)  return false;
+
+  _IovTx.iov_base = pMessage;
+  _IovTx.iov_len  = iNumBytes;
+
+  bzero((char *) &_MsgHdrTx, sizeof(_MsgHdrTx));
+  _MsgHdrTx.msg_name    = &_SiHostTx;
+  _MsgHdrTx.msg_namelen = sizeof(_SiHostTx);
+  _MsgHdrTx.msg_iov     = &_IovTx;
+  _MsgHdrTx.msg_iovlen  = 1;
+
+  pSqe->opcode    = IORING_OP_SENDMSG;
+  pSqe->fd        = _sockTx;
+  pSqe->addr      = (uint64_t) (uintptr_t) &_MsgHdrTx;
+  pSqe->len       = 1;
+  pSqe->user_data = uUserData;
+
+  return true;
+}
+
+
 /*********************************************
 * tUdpClient destructor 
 *
@@ -243,6 +315,7 @@ tUdpServer::tUdpServer(int iPortNum)
 		throw tUdpConnectionException("Error binding UDP receive socket");
 	}
 
+  _bKernelTimestamps = false;
   _ui8MsgIndex = 0;
   _bInitSuccessfully = true;
 }
@@ -261,6 +334,8 @@ tUdpServer::tUdpServer(int iPortNum)
 tUdpServer::tUdpServer(tUdpServer &&other) noexcept :
   _sockRx           (other._sockRx),
   _SiMe             (other._SiMe),
+  _MsgHdrRx         (other._MsgHdrRx),
+  _bKernelTimestamps(other._bKernelTimestamps),
   _ui8MsgIndex      (other._ui8MsgIndex),
   _bInitSuccessfully(other._bInitSuccessfully)
 {
@@ -288,25 +363,533 @@ tUdpServer::~tUdpServer()
 
 
 /*********************************************
-* tUdpServer::ReceiveMessage 
+* tUdpServer::SetNonBlocking 
+*
+* Puts the receive socket in non-blocking mode, for use with an event
+* loop such as epoll.  Once this is done, ReceiveMessage() and 
+* ReceiveBatch() return 0 instead of blocking when the socket is empty.
+*
+* SIDE EFFECTS:
+*   Throws a tUdpConnectionException if the mode cannot be set
+*/
+
+void tUdpServer::SetNonBlocking()
+{
+  int iFlags;
+
+  iFlags = fcntl(_sockRx, F_GETFL, 0);
+  if (iFlags < 0 || fcntl(_sockRx, F_SETFL, iFlags | O_NONBLOCK) < 0) {
+    throw tUdpConnectionException(std::string("SetNonBlocking: ") + strerror(errno));
+  }
+}
+
+
+/*********************************************
+* tUdpServer::EnableKernelTimestamps 
+*
+* Asks the kernel to stamp each datagram with the time it arrived at the
+* socket (SO_TIMESTAMPNS).  Comparing that with the time the application
+* gets hold of the datagram separates network latency from the host's
+* scheduling and socket queueing delay.
 *
 * SIDE EFFECTS:
+*   Throws a tUdpConnectionException if the option cannot be set
+*/
+
+void tUdpServer::EnableKernelTimestamps()
+{
+  int iEnable = 1;
+
+  if (setsockopt(_sockRx, SOL_SOCKET, SO_TIMESTAMPNS, &iEnable, sizeof(iEnable)) < 0) {
+    throw tUdpConnectionException(std::string("EnableKernelTimestamps: ") + strerror(errno));
+  }
+
+  _bKernelTimestamps = true;
+}
+
+
+/*********************************************
+* GetKernelTimestamp
 *
+* Digs the SO_TIMESTAMPNS timestamp out of a received message's control 
+* data.  Sets *pKernelTime to zero if there is none.
+*/
+
+static void GetKernelTimestamp(struct msghdr *pMsg, struct timespec *pKernelTime)
+{
+  struct cmsghdr *pCmsg;
+
+  bzero((char *) pKernelTime, sizeof(*pKernelTime));
+
+  for (pCmsg = CMSG_FIRSTHDR(pMsg); pCmsg != NULL; pCmsg = CMSG_NXTHDR(pMsg, pCmsg)) {
+    if (pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(pKernelTime, CMSG_DATA(pCmsg), sizeof(*pKernelTime));
+      return;
+    }
+  }
+}
+
+
+/*********************************************
+* tUdpServer::ReceiveMessage 
+*
+* INPUTS:
+*   pKernelTime - if not NULL, and kernel timestamps are enabled, receives
+*                 the time the datagram arrived at the socket
 * RETURNS:
 *   ssize_t
+*   0 if the socket is non-blocking and no message is waiting
 *   If not NULL, *pClientAddress is populated with info on the source of the packet
 */
 
-ssize_t tUdpServer::ReceiveMessage(void *buf, size_t szBufSize, struct sockaddr_in *pClientAddress)
+ssize_t tUdpServer::ReceiveMessage(void *buf, size_t szBufSize, struct sockaddr_in *pClientAddress, 
+                                   struct timespec *pKernelTime)
 {
   ssize_t n = 0;
   socklen_t sz = sizeof(*pClientAddress);
+  struct msghdr Msg;
+  struct iovec  Iov;
+  uint8_t       Control[UDP_RX_CONTROL_SIZE];
 
-  n = recvfrom(_sockRx, buf, szBufSize, 0, (struct sockaddr *) pClientAddress, &sz);
+  if (pKernelTime == NULL || !_bKernelTimestamps) {
+    if (pKernelTime != NULL)  bzero((char *) pKernelTime, sizeof(*pKernelTime));
+    n = recvfrom(_sockRx, buf, szBufSize, 0, (struct sockaddr *) pClientAddress, &sz);
+  }
+  else {
+    // The timestamp comes as a control message, which recvfrom() cannot return
+    Iov.iov_base = buf;
+    Iov.iov_len  = szBufSize;
+
+    bzero((char *) &Msg, sizeof(Msg));
+    Msg.msg_name       = pClientAddress;
+    Msg.msg_namelen    = sz;
+    Msg.msg_iov        = &Iov;
+    Msg.msg_iovlen     = 1;
+    Msg.msg_control    = Control;
+    Msg.msg_controllen = sizeof(Control);
+
+    n = recvmsg(_sockRx, &Msg, 0);
+    if (n >= 0)  GetKernelTimestamp(&Msg, pKernelTime);
+  }
 
   if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)  return 0;
 	  throw tUdpConnectionException(std::string("ReceiveMessage: ") + strerror(errno));
   }
 
   return n;
-}
\ No newline at end of file
+}
+
+
+/*********************************************
+* tUdpServer::SendMessage
+*
+* Sends a reply from the server's port.  Never blocks, since the caller
+* is a receive thread: a reply that does not fit in the socket's send
+* buffer is dropped.  Nor does it throw, so that one unreachable client
+* cannot end the thread; any failed send is simply not sent.  Safe to
+* call from any thread.
+*
+* INPUTS:
+*   pMessage    - the message to send
+*   szMessage   - its length
+*   Destination - where to send it
+* RETURNS:
+*   true if sent, false if dropped, with errno saying why
+*/
+
+bool tUdpServer::SendMessage(const void *pMessage, size_t szMessage, const struct sockaddr_in &Destination)
+{
+  return sendto(_sockRx, pMessage, szMessage, MSG_DONTWAIT, (const struct sockaddr *) &Destination, sizeof(Destination)) >= 0;
+}
+
+
+/*********************************************
+* tUdpSendBatch constructor 
+*
+* INPUTS:
+*   nMaxMessages - the most messages the batch will hold
+*/
+
+tUdpSendBatch::tUdpSendBatch(int nMaxMessages) :
+  _Destinations(nMaxMessages),
+  _Controls    (nMaxMessages * UDP_TX_CONTROL_SIZE),
+  _Iovecs      (nMaxMessages),
+  _Msgs        (nMaxMessages),
+  _nMessages   (0),
+  _nFailed     (0)
+{
+  int i;
+
+  assert(nMaxMessages > 0);
+
+  for (i=0; i<nMaxMessages; i++) {
+    bzero((char *) &_Msgs[i], sizeof(_Msgs[i]));
+    _Msgs[i].msg_hdr.msg_iov     = &_Iovecs[i];
+    _Msgs[i].msg_hdr.msg_iovlen  = 1;
+    _Msgs[i].msg_hdr.msg_name    = &_Destinations[i];
+    _Msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+  }
+}
+
+
+/*********************************************
+* tUdpSendBatch::Add 
+*
+* INPUTS:
+*   pMessage    - the message to send
+*   iNumBytes   - the length of the message to send
+*   Destination - where to send it
+*   pSource     - source address to send it from, or NULL for the socket's own
+* RETURNS:
+*   true if added, false if the batch is full
+*/
+
+bool tUdpSendBatch::Add(uint8_t *pMessage, int iNumBytes, const struct sockaddr_in &Destination, 
+                        const struct in_addr *pSource)
+{
+  struct msghdr     *pHdr;
+  struct cmsghdr    *pCmsg;
+  struct in_pktinfo *pPktInfo;
+
+  assert(pMessage != nullptr);
+  assert(iNumBytes > 0);
+
+  if (_nMessages >= MaxMessages())  return false;
+
+  _Iovecs[_nMessages].iov_base = pMessage;
+  _Iovecs[_nMessages].iov_len  = iNumBytes;
+  _Destinations[_nMessages]    = Destination;
+
+  pHdr = &_Msgs[_nMessages].msg_hdr;
+  if (pSource == NULL) {
+    pHdr->msg_control    = NULL;
+    pHdr->msg_controllen = 0;
+  }
+  else {
+    pHdr->msg_control    = &_Controls[_nMessages * UDP_TX_CONTROL_SIZE];
+    pHdr->msg_controllen = UDP_TX_CONTROL_SIZE;
+
+    pCmsg = CMSG_FIRSTHDR(pHdr);
+    pCmsg->cmsg_level = IPPROTO_IP;
+    pCmsg->cmsg_type  = IP_PKTINFO;
+    pCmsg->cmsg_len   = CMSG_LEN(sizeof(struct in_pktinfo));
+
+    pPktInfo = (struct in_pktinfo *) CMSG_DATA(pCmsg);
+    bzero((char *) pPktInfo, sizeof(*pPktInfo));
+    pPktInfo->ipi_spec_dst = *pSource;
+  }
+
+  _nMessages++;
+
+  return true;
+}
+
+
+/*********************************************
+* tUdpSendBatch::Send 
+*
+* Sends every message in the batch, then empties it.  sendmmsg() may stop
+* short, for instance when the socket buffer fills, so it is called again
+* for the remainder until all have gone.  It fails only for the first
+* message of a call; one that cannot be routed, such as from a source
+* address this host does not have, is counted in NumFailed() and skipped,
+* so that one bad client does not stop the others.
+*
+* INPUTS:
+*   sock - socket to send from
+* RETURNS:
+*   The number of sendmmsg() calls made
+* SIDE EFFECTS:
+*   Throws a tUdpConnectionException if there is any other sending error
+*/
+
+int tUdpSendBatch::Send(int sock)
+{
+  int nSent = 0;
+  int nCalls = 0;
+  int n;
+
+  while (nSent < _nMessages) {
+    n = sendmmsg(sock, &_Msgs[nSent], std::min(_nMessages - nSent, UDP_MAX_SEND_BATCH), 0);
+    nCalls++;
+    if (n < 0) {
+      if (errno == EINTR)  continue;
+      if (errno == ENETUNREACH || errno == EHOSTUNREACH || errno == EADDRNOTAVAIL) {
+        _nFailed++;
+        nSent++;
+        continue;
+      }
+      throw tUdpConnectionException(std::string("SendBatch: ") + strerror(errno));
+    }
+    nSent += n;
+  }
+
+  _nMessages = 0;
+
+  return nCalls;
+}
+
+
+/*********************************************
+* tUdpSendBatch::OpenSharedSocket 
+*
+* Opens an unbound transmit socket for many clients to share, with room
+* in its send buffer for a burst from all of them.  The source addresses
+* given with the messages must be configured on this host, as aliases if
+* need be; see CheckSourceAddress().
+*
+* RETURNS:
+*   The socket.  The caller closes it.
+* SIDE EFFECTS:
+*   Throws a tUdpConnectionException if the socket cannot be set up
+*/
+
+int tUdpSendBatch::OpenSharedSocket()
+{
+  int sock;
+  int iSendBufferSize = UDP_SHARED_SNDBUF_SIZE;
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    throw tUdpConnectionException(std::string("Error opening shared UDP transmit socket: ") + strerror(errno));
+  }
+
+  // Best effort - a smaller buffer only means sendmmsg() may block part way through a burst
+  setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &iSendBufferSize, sizeof(iSendBufferSize));
+
+  return sock;
+}
+
+
+/*********************************************
+* tUdpSendBatch::CheckSourceAddress 
+*
+* Checks that a message can be sent from the address, by binding a
+* scratch socket to it.  IP_PKTINFO only picks among the host's own
+* addresses, so a client given one it does not have would fail on every
+* send.
+*
+* INPUTS:
+*   Source - the client source address
+* SIDE EFFECTS:
+*   Throws a tUdpConnectionException naming the address if it is not
+*   configured on this host
+*/
+
+void tUdpSendBatch::CheckSourceAddress(const struct in_addr &Source)
+{
+  struct sockaddr_in SiSource;
+  char   sAddress[INET_ADDRSTRLEN];
+  int    sock;
+  int    iStatus;
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    throw tUdpConnectionException(std::string("Error opening UDP socket: ") + strerror(errno));
+  }
+
+  bzero((char *) &SiSource, sizeof(SiSource));
+  SiSource.sin_family = AF_INET;
+  SiSource.sin_port   = 0;
+  SiSource.sin_addr   = Source;
+
+  iStatus = bind(sock, (struct sockaddr *) &SiSource, sizeof(SiSource));
+  close(sock);
+
+  if (iStatus < 0) {
+    inet_ntop(AF_INET, &Source, sAddress, sizeof(sAddress));
+    throw tUdpConnectionException(std::string("Source address ") + sAddress + " is not configured on this host (" +
+                                  strerror(errno) + ").  Add it as an alias to send from it.");
+  }
+}
+
+
+/*********************************************
+* tUdpReceiveBatch constructor 
+*
+* Allocates the buffers and points each mmsghdr at its own buffer and
+* source address slot.
+*
+* INPUTS:
+*   nMaxMessages - the most messages a single ReceiveBatch() will return
+*   szBufSize    - size of each message buffer
+*/
+
+tUdpReceiveBatch::tUdpReceiveBatch(int nMaxMessages, size_t szBufSize) :
+  _szBufSize      (szBufSize),
+  _Buffers        (nMaxMessages * szBufSize),
+  _Controls       (nMaxMessages * UDP_RX_CONTROL_SIZE),
+  _ClientAddresses(nMaxMessages),
+  _Iovecs         (nMaxMessages),
+  _Msgs           (nMaxMessages),
+  _nMessages      (0)
+{
+  int i;
+
+  assert(nMaxMessages > 0);
+
+  for (i=0; i<nMaxMessages; i++) {
+    _Iovecs[i].iov_base = Buffer(i);
+    _Iovecs[i].iov_len  = _szBufSize;
+
+    bzero((char *) &_Msgs[i], sizeof(_Msgs[i]));
+    _Msgs[i].msg_hdr.msg_iov     = &_Iovecs[i];
+    _Msgs[i].msg_hdr.msg_iovlen  = 1;
+    _Msgs[i].msg_hdr.msg_name    = &_ClientAddresses[i];
+    _Msgs[i].msg_hdr.msg_control = &_Controls[i * UDP_RX_CONTROL_SIZE];
+  }
+}
+
+
+/*********************************************
+* tUdpReceiveBatch::KernelTime 
+*
+* RETURNS:
+*   The time message i arrived at the socket, or zero if kernel timestamps
+*   are not enabled on the receiving tUdpServer
+*/
+
+struct timespec tUdpReceiveBatch::KernelTime(int i)
+{
+  struct timespec tmKernel;
+
+  GetKernelTimestamp(&_Msgs[i].msg_hdr, &tmKernel);
+  return tmKernel;
+}
+
+
+/*********************************************
+* tUdpServer::ReceiveBatch 
+*
+* Receives as many messages as are queued on the socket, up to the size
+* of the batch, in a single recvmmsg() call.  Blocks until at least one
+* message is available; MSG_WAITFORONE then makes the call return as soon
+* as the socket queue is drained, rather than waiting for the batch to fill.
+*
+* INPUTS:
+*   Batch - caller-owned buffers, filled in with the received messages
+* RETURNS:
+*   The number of messages received, also available as Batch.NumMessages().
+*   0 if the socket is non-blocking and no message is waiting.
+* SIDE EFFECTS:
+*   Throws a tUdpConnectionException if there is a receive error
+*/
+
+int tUdpServer::ReceiveBatch(tUdpReceiveBatch &Batch)
+{
+  int n, i;
+
+  // recvmmsg() overwrites msg_namelen and msg_controllen on return, so they have to be reset every call
+  for (i=0; i<Batch.MaxMessages(); i++) {
+    Batch._Msgs[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr_in);
+    Batch._Msgs[i].msg_hdr.msg_controllen = _bKernelTimestamps ? UDP_RX_CONTROL_SIZE : 0;
+  }
+
+  n = recvmmsg(_sockRx, Batch._Msgs.data(), Batch.MaxMessages(), MSG_WAITFORONE, NULL);
+
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)  n = 0;
+    else  throw tUdpConnectionException(std::string("ReceiveBatch: ") + strerror(errno));
+  }
+
+  Batch._nMessages = n;
+
+  return n;
+}
+
+
+
+/*********************************************
+* tUdpServer::ArmMultishotReceive 
+*
+* io_uring alternative to ReceiveMessage().  Queues a multishot recvmsg on
+* the ring.  Once submitted, it produces one completion per datagram, each
+* in a buffer picked from the ring's provided buffer group, until it runs
+* out of buffers or fails.  A completion without IORING_CQE_F_MORE means
+* the receive is no longer armed and must be armed again.
+*
+* INPUTS:
+*   Ring         - ring to queue the receive on
+*   uBufferGroup - provided buffer group to receive into
+*   uUserData    - returned in every completion
+* RETURNS:
+*   true if queued, false if the submission queue is full
+*/
+
+bool tUdpServer::ArmMultishotReceive(tIoUring &Ring, uint16_t uBufferGroup, uint64_t uUserData)
+{
+#ifdef HAVE_IO_URING_MULTISHOT
+  struct io_uring_sqe *pSqe;
+
+  pSqe = Ring.GetSqe();
+  if (pSqe == nullptr)  return false;
+
+  // With buffer select, the kernel takes only the name and control lengths from the msghdr
+  bzero((char *) &_MsgHdrRx, sizeof(_MsgHdrRx));
+  _MsgHdrRx.msg_namelen    = sizeof(struct sockaddr_in);
+  _MsgHdrRx.msg_controllen = _bKernelTimestamps ? UDP_RX_CONTROL_SIZE : 0;
+
+  pSqe->opcode    = IORING_OP_RECVMSG;
+  pSqe->fd        = _sockRx;
+  pSqe->addr      = (uint64_t) (uintptr_t) &_MsgHdrRx;
+  pSqe->len       = 1;
+  pSqe->ioprio    = IORING_RECV_MULTISHOT;
+  pSqe->flags     = IOSQE_BUFFER_SELECT;
+  pSqe->buf_group = uBufferGroup;
+  pSqe->user_data = uUserData;
+
+  return true;
+#else
+  throw tUdpConnectionException("ArmMultishotReceive: not supported by this build");
+#endif
+}
+
+
+/*********************************************
+* tUdpServer::ParseMultishotReceive 
+*
+* A multishot recvmsg lays out its provided buffer as an io_uring_recvmsg_out
+* header, then space for the source address, then the control data, then
+* the payload.  This picks that apart.
+*
+* INPUTS:
+*   pBuffer  - the provided buffer named in the completion
+*   szBuffer - size of the provided buffer
+* RETURNS:
+*   ssize_t - length of the payload, or -1 if the datagram did not fit the buffer
+*   *ppPayload      - points at the payload within pBuffer
+*   *pClientAddress - populated with the source of the packet
+*   *pKernelTime    - if not NULL, populated with the kernel receive timestamp,
+*                     or zero if there is none
+*/
+
+ssize_t tUdpServer::ParseMultishotReceive(uint8_t *pBuffer, size_t szBuffer, uint8_t **ppPayload, struct sockaddr_in *pClientAddress,
+                                          struct timespec *pKernelTime)
+{
+#ifdef HAVE_IO_URING_MULTISHOT
+  struct io_uring_recvmsg_out *pOut = (struct io_uring_recvmsg_out *) pBuffer;
+  uint8_t *pName = pBuffer + sizeof(*pOut);
+  struct msghdr Msg;
+
+  if (pOut->flags & MSG_TRUNC)  return -1;
+
+  bzero((char *) pClientAddress, sizeof(*pClientAddress));
+  memcpy(pClientAddress, pName, std::min((size_t) pOut->namelen, sizeof(*pClientAddress)));
+
+  if (pKernelTime != NULL) {
+    // Wrap the control data in a msghdr so that the CMSG macros can walk it
+    bzero((char *) &Msg, sizeof(Msg));
+    Msg.msg_control    = pName + _MsgHdrRx.msg_namelen;
+    Msg.msg_controllen = pOut->controllen;
+    GetKernelTimestamp(&Msg, pKernelTime);
+  }
+
+  *ppPayload = pName + _MsgHdrRx.msg_namelen + _MsgHdrRx.msg_controllen;
+  assert(*ppPayload + pOut->payloadlen <= pBuffer + szBuffer);
+
+  return pOut->payloadlen;
+#else
+  throw tUdpConnectionException("ParseMultishotReceive: not supported by this build");
+#endif
+}
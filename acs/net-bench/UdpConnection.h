@@ -32,9 +32,13 @@
 
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <string>
+#include <vector>
+#include "RtMemory.h"
 
 class tLogger;
+class tIoUring;
 
 
 /*********************
@@ -57,7 +61,8 @@ public:
 
 class tUdpClient {
 public:
-  tUdpClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL);
+  tUdpClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL,
+             bool bOwnSocket = true);
 
   tUdpClient(tUdpClient &&obj) noexcept;  // Move constructor - needed so that destruction of temporary does not close file.
   // tHostConnection& operator=(tHostConnection&& other); // Move assignment operator, will add if needed
@@ -70,18 +75,116 @@ public:
 
 
   void SendMessage(uint8_t *pMessage, int iNumBytes);
+  bool PrepareSend(tIoUring &Ring, uint8_t *pMessage, int iNumBytes, uint64_t uUserData);
 
   bool IsInitialized()  { return _bInitSuccessfully; }
+  bool IsBound()        { return _bBound; }
+  int  GetSocket()      { return _sockTx; }
+  const struct sockaddr_in &ServerAddress() { return _SiHostTx; }
+
+  // Source address for a client without a socket of its own to bind; NULL if none was given
+  const struct in_addr *SourceAddress() { return _bHasSource ? &_SiClientTx.sin_addr : NULL; }
 
 protected:
-  int                _sockTx;
+  int                _sockTx;     // 0 if the client sends through a socket shared with others
+  bool               _bBound;     // To a client source IP address
+  bool               _bHasSource; // A client source IP address was given
+  struct sockaddr_in _SiClientTx;
   struct sockaddr_in _SiHostTx;
+  struct msghdr      _MsgHdrTx;   // Must outlive an io_uring send, so cannot live on the stack
+  struct iovec       _IovTx;
 
   uint8_t            _ui8MsgIndex;
   bool               _bInitSuccessfully;
 };
 
 
+// Control message space needed per received message for an SO_TIMESTAMPNS timestamp
+#define UDP_RX_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)))
+
+
+/*********************
+* tUdpReceiveBatch
+*
+* Caller-owned storage for tUdpServer::ReceiveBatch().  Holds an array of
+* message buffers and source addresses, along with the mmsghdr/iovec
+* bookkeeping that recvmmsg() needs.  The bookkeeping is set up once at
+* construction, so a batch can be reused for every receive without any
+* further allocation.
+*/
+
+class tUdpReceiveBatch {
+friend class tUdpServer;
+public:
+  tUdpReceiveBatch(int nMaxMessages, size_t szBufSize);
+
+  int                 MaxMessages()           { return (int) _Msgs.size(); }
+  int                 NumMessages()           { return _nMessages; }
+  uint8_t            *Buffer(int i)           { return &_Buffers[i * _szBufSize]; }
+  ssize_t             Length(int i)           { return _Msgs[i].msg_len; }
+  struct sockaddr_in &ClientAddress(int i)    { return _ClientAddresses[i]; }
+  struct timespec     KernelTime(int i);
+
+protected:
+  size_t                          _szBufSize;
+  tRtBuffer                       _Buffers;     // In huge pages, if asked for
+  std::vector<uint8_t>            _Controls;    // Control message space, UDP_RX_CONTROL_SIZE per message
+  std::vector<struct sockaddr_in> _ClientAddresses;
+  std::vector<struct iovec>       _Iovecs;
+  std::vector<struct mmsghdr>     _Msgs;
+  int                             _nMessages;
+};
+
+
+// Most messages one sendmmsg() will take (UIO_MAXIOV)
+#define UDP_MAX_SEND_BATCH (1024)
+
+// Control message space needed per sent message to set its source address with IP_PKTINFO
+#define UDP_TX_CONTROL_SIZE (CMSG_SPACE(sizeof(struct in_pktinfo)))
+
+// Send buffer requested for a socket shared by many clients, so that a whole
+// cycle's burst fits without sendmmsg() blocking.  The kernel caps it at wmem_max.
+#define UDP_SHARED_SNDBUF_SIZE (4 * 1024 * 1024)
+
+
+/*********************
+* tUdpSendBatch
+*
+* Transmit counterpart of tUdpReceiveBatch.  Collects messages, each with
+* its own destination, and sends them all from one socket with as few
+* sendmmsg() calls as possible.  The messages are not copied, so must not
+* change until Send() returns.
+*
+* A message may also carry a source address, sent as IP_PKTINFO ancillary
+* data, so that one socket can stand in for many clients.  The address
+* must be one of this host's own.
+*/
+
+class tUdpSendBatch {
+public:
+  tUdpSendBatch(int nMaxMessages);
+
+  int  MaxMessages()  { return (int) _Msgs.size(); }
+  int  NumMessages()  { return _nMessages; }
+  long NumFailed()    { return _nFailed; }
+  void Clear()        { _nMessages = 0; }
+  bool Add(uint8_t *pMessage, int iNumBytes, const struct sockaddr_in &Destination, 
+           const struct in_addr *pSource = NULL);
+  int  Send(int sock);
+
+  static int  OpenSharedSocket();
+  static void CheckSourceAddress(const struct in_addr &Source);
+
+protected:
+  std::vector<struct sockaddr_in> _Destinations;
+  std::vector<uint8_t>            _Controls;    // Control message space, UDP_TX_CONTROL_SIZE per message
+  std::vector<struct iovec>       _Iovecs;
+  std::vector<struct mmsghdr>     _Msgs;
+  int                             _nMessages;
+  long                            _nFailed;     // Messages that could not be routed, over every Send()
+};
+
+
 /*********************
 * tUdpServer
 *
@@ -101,13 +204,26 @@ public:
 
   virtual ~tUdpServer();
 
-  ssize_t ReceiveMessage(void *buf, size_t iBufSize, struct sockaddr_in *pClientAddress);
+  ssize_t ReceiveMessage(void *buf, size_t iBufSize, struct sockaddr_in *pClientAddress, 
+                         struct timespec *pKernelTime = NULL);
+  int     ReceiveBatch(tUdpReceiveBatch &Batch);
+  bool    SendMessage(const void *pMessage, size_t szMessage, const struct sockaddr_in &Destination);
+
+  bool    ArmMultishotReceive(tIoUring &Ring, uint16_t uBufferGroup, uint64_t uUserData);
+  ssize_t ParseMultishotReceive(uint8_t *pBuffer, size_t szBuffer, uint8_t **ppPayload, struct sockaddr_in *pClientAddress,
+                                struct timespec *pKernelTime = NULL);
+
+  void SetNonBlocking();
+  void EnableKernelTimestamps();
 
   bool IsInitialized()  { return _bInitSuccessfully; }
+  int  GetSocket()      { return _sockRx; }
 
 protected:
   int                _sockRx;
   struct sockaddr_in _SiMe;
+  struct msghdr      _MsgHdrRx;   // Read by the kernel for as long as a multishot receive is armed
+  bool               _bKernelTimestamps;
 
   uint8_t            _ui8MsgIndex;
   bool               _bInitSuccessfully;
@@ -0,0 +1,150 @@
+#!/bin/bash
+#
+# bench.sh - Runs lscs_udp against rtc_udp on one host, without the lab network
+#
+# Usage: bench.sh [-m lo|veth] [-n num_clients] [-d seconds] [-o results_dir]
+#                 [-r "rtc_udp args"] [-l "lscs_udp args"]
+#
+# Everything runs inside a private network namespace, made with
+# unshare -rn when not root, so nothing on the host is touched and no
+# privileges are needed.
+#
+#   lo   - Both programs on the namespace's loopback.  The clients send
+#          from 127.0.2.1, 127.0.2.2, ..., all of which are local already.
+#   veth - lscs_udp in a second namespace, joined to rtc_udp's by a veth
+#          pair, with the clients' 10.0.x.y addresses on its end, as in
+#          the lab.  The messages then cross a device queue and softirq
+#          on the way, as they would a NIC.
+#
+# rtc_udp serves ports 30000 on, one per client.  Extra arguments for
+# either program are passed with -r and -l, for example -r "-w 2 -k"
+# -l "-T 2 -P uniform".  Both programs' output, and the command lines,
+# are saved in results_dir (default bench-results/<date>-<time>), and the
+# final summaries printed.  So are the result files, rtc_udp.json and
+# lscs_udp.json, which compare_results.py checks against an earlier run's.
+#
+# From the build directory, "make -f ../../Makefile bench BENCH_ARGS=..."
+# builds and then runs this.
+#
+
+readonly FIRST_PORT=30000
+readonly RTC_HOST_VETH=10.0.0.1
+readonly IPS_PER_SUBNET=82      # As lscs_udp assigns them, from 10.0.2.1
+
+MODE=lo
+NUM_CLIENTS=100
+DURATION=10
+RESULTS_DIR=
+RTC_ARGS=
+LSCS_ARGS=
+BINDIR="${BINDIR:-$(cd "$(dirname "$0")/../.." && pwd)/bin}"
+
+usage() {
+  sed -n '4,5p' "$0" | sed 's/^# //'
+  exit 1
+}
+
+while getopts "m:n:d:o:r:l:h" opt; do
+  case $opt in
+    m) MODE=$OPTARG ;;
+    n) NUM_CLIENTS=$OPTARG ;;
+    d) DURATION=$OPTARG ;;
+    o) RESULTS_DIR=$OPTARG ;;
+    r) RTC_ARGS=$OPTARG ;;
+    l) LSCS_ARGS=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+[ "$MODE" = lo ] || [ "$MODE" = veth ] || usage
+[ "$NUM_CLIENTS" -ge 1 ] 2>/dev/null  || usage
+[ "$DURATION" -ge 1 ] 2>/dev/null     || usage
+
+for exe in rtc_udp lscs_udp; do
+  if [ ! -x "$BINDIR/$exe" ]; then
+    echo "bench.sh: $BINDIR/$exe not found; build first, or set BINDIR" >&2
+    exit 1
+  fi
+done
+
+# Re-run in a namespace of our own.  The results directory is made first,
+# so that it is named for the time it was asked for and owned by the caller.
+if [ -z "$BENCH_IN_NETNS" ]; then
+  RESULTS_DIR="${RESULTS_DIR:-bench-results/$(date +%Y%m%d-%H%M%S)}"
+  mkdir -p "$RESULTS_DIR" || exit 1
+  if [ "$(id -u)" -eq 0 ]; then UNSHARE="unshare -n"; else UNSHARE="unshare -rn"; fi
+  BENCH_IN_NETNS=1 exec $UNSHARE "$0" -m "$MODE" -n "$NUM_CLIENTS" -d "$DURATION" -o "$RESULTS_DIR" \
+                                      -r "$RTC_ARGS" -l "$LSCS_ARGS"
+fi
+
+ip link set lo up || exit 1
+
+LSCS_NETNS=
+LSCS_NETNS_PID=
+
+cleanup() {
+  [ -n "$LSCS_NETNS_PID" ] && kill "$LSCS_NETNS_PID" 2>/dev/null
+}
+trap cleanup EXIT
+
+if [ "$MODE" = lo ]; then
+  RTC_HOST=127.0.0.1
+  LSCS_SOURCES="-I 127.0"
+else
+  RTC_HOST=$RTC_HOST_VETH
+  LSCS_SOURCES=
+
+  # The second namespace lives as long as this placeholder process does
+  unshare -n sleep infinity &
+  LSCS_NETNS_PID=$!
+  while [ "$(readlink /proc/$LSCS_NETNS_PID/ns/net)" = "$(readlink /proc/self/ns/net)" ]; do
+    sleep 0.05
+  done
+  LSCS_NETNS="nsenter -t $LSCS_NETNS_PID -n --preserve-credentials"
+
+  ip link add bench0 type veth peer name bench1 || exit 1
+  ip link set bench1 netns "$LSCS_NETNS_PID"
+  ip addr add $RTC_HOST_VETH/16 dev bench0
+  ip link set bench0 up
+
+  # The clients' source addresses, which lscs_udp picks the same way
+  for ((i = 0; i < NUM_CLIENTS; i++)); do
+    echo "addr add 10.0.$((2 + i / IPS_PER_SUBNET)).$((1 + i % IPS_PER_SUBNET))/16 dev bench1"
+  done | $LSCS_NETNS ip -batch - || exit 1
+  $LSCS_NETNS ip link set lo up
+  $LSCS_NETNS ip link set bench1 up
+fi
+
+RTC_CMD="$BINDIR/rtc_udp -r 0 -D $((DURATION + 2)) -p $FIRST_PORT $((FIRST_PORT + NUM_CLIENTS - 1)) -o $RESULTS_DIR/rtc_udp.json $RTC_ARGS"
+LSCS_CMD="$BINDIR/lscs_udp -h $RTC_HOST $LSCS_SOURCES -p $FIRST_PORT -n $NUM_CLIENTS -o $RESULTS_DIR/lscs_udp.json $LSCS_ARGS"
+
+{
+  echo "mode:     $MODE"
+  echo "clients:  $NUM_CLIENTS"
+  echo "duration: $DURATION s"
+  echo "rtc_udp:  $RTC_CMD"
+  echo "lscs_udp: $LSCS_CMD"
+  echo "kernel:   $(uname -r), $(nproc) CPUs"
+} > "$RESULTS_DIR/scenario.txt"
+
+# rtc_udp stops itself a second after lscs_udp does, so it sees everything sent
+$RTC_CMD > "$RESULTS_DIR/rtc_udp.out" 2>&1 &
+RTC_PID=$!
+sleep 1
+
+$LSCS_NETNS timeout -s INT "$DURATION" $LSCS_CMD > "$RESULTS_DIR/lscs_udp.out" 2>&1
+wait $RTC_PID
+RTC_STATUS=$?
+
+cat "$RESULTS_DIR/scenario.txt"
+echo
+if [ $RTC_STATUS -ne 0 ] || ! grep -q "^All ports" "$RESULTS_DIR/rtc_udp.out"; then
+  echo "bench.sh: rtc_udp failed, see $RESULTS_DIR/rtc_udp.out" >&2
+  tail -5 "$RESULTS_DIR/rtc_udp.out" >&2
+  exit 1
+fi
+
+sed -n '/^All ports/,$p' "$RESULTS_DIR/rtc_udp.out"
+grep -E "Wake-up|period|Round trip|replies" "$RESULTS_DIR/lscs_udp.out"
+echo
+echo "Results in $RESULTS_DIR"
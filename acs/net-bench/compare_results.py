@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+#
+# compare_results.py - Compares two benchmark result files and flags regressions
+#
+# Usage: compare_results.py [-t tail_percent] [-f floor_us] [-l loss_percent]
+#                           baseline.json candidate.json
+#
+# The files are those that rtc_udp -o and lscs_udp -o write, from the same
+# program.  Every latency histogram in both is listed with its change, and
+# the run's losses and CPU use.  A regression is flagged when:
+#
+#   - a histogram's p99 or p99.9 grew by more than tail_percent (default
+#     10) and by more than floor_us (default 5), so that jitter in already
+#     small values is not flagged
+#   - a loss rate (messages lost, replies unanswered, cycles incomplete)
+#     grew by more than loss_percent points (default 0.01)
+#
+# Differences in configuration are listed first, since they usually
+# explain the rest.  Exits with 1 if anything was flagged, 2 on bad input.
+#
+
+import argparse
+import json
+import sys
+
+RESULT_FILE_FORMAT = 1
+
+TAIL_KEYS = ("p99_ns", "p99_9_ns")
+SHOWN_KEYS = ("p50_ns", "p99_ns", "p99_9_ns", "max_ns")
+
+# Loss rates: (name, path to the count lost, paths whose sum is the count it is out of)
+LOSS_RATES = (
+    ("messages lost",      ("lost",),                      (("received",), ("lost",))),
+    ("replies unanswered", ("replies", "unanswered"),      (("sent",),)),
+    ("cycles incomplete",  ("cycles", "incomplete"),       (("cycles", "complete"), ("cycles", "incomplete"))),
+    ("ticks missed",       ("scheduler", "missed"),        (("scheduler", "ticks"), ("scheduler", "missed"))),
+)
+
+
+def load(sFilename):
+    try:
+        with open(sFilename) as f:
+            Result = json.load(f)
+    except (OSError, ValueError) as e:
+        sys.exit("compare_results.py: cannot read %s: %s" % (sFilename, e))
+
+    if Result.get("format") != RESULT_FILE_FORMAT:
+        sys.exit("compare_results.py: %s is not a version %d result file" % (sFilename, RESULT_FILE_FORMAT))
+    return Result
+
+
+def lookup(Result, Path):
+    for sKey in Path:
+        if not isinstance(Result, dict) or sKey not in Result:
+            return None
+        Result = Result[sKey]
+    return Result
+
+
+def histograms(Result, sPrefix=""):
+    """Yields (path, histogram) for every histogram in the result, depth first"""
+    if isinstance(Result, dict):
+        if "buckets" in Result and "count" in Result:
+            yield sPrefix, Result
+            return
+        for sKey, Value in Result.items():
+            yield from histograms(Value, sPrefix + "." + sKey if sPrefix else sKey)
+    elif isinstance(Result, list):
+        for i, Value in enumerate(Result):
+            yield from histograms(Value, "%s[%d]" % (sPrefix, i))
+
+
+def percent_change(fOld, fNew):
+    if fOld == 0:
+        return 0.0 if fNew == 0 else float("inf")
+    return 100.0 * (fNew - fOld) / fOld
+
+
+def compare_config(Base, Cand):
+    BaseConfig = Base.get("config", {})
+    CandConfig = Cand.get("config", {})
+    Differences = [(sKey, BaseConfig.get(sKey), CandConfig.get(sKey))
+                   for sKey in sorted(set(BaseConfig) | set(CandConfig))
+                   if BaseConfig.get(sKey) != CandConfig.get(sKey)]
+
+    for sKey in ("kernel", "cpus", "host"):
+        if Base.get(sKey) != Cand.get(sKey):
+            Differences.append((sKey, Base.get(sKey), Cand.get(sKey)))
+
+    if Differences:
+        print("Configuration differs:")
+        for sKey, Old, New in Differences:
+            print("  %-20s %s -> %s" % (sKey, Old, New))
+        print()
+
+
+def compare_histograms(Base, Cand, Args):
+    Flagged = []
+    CandHistograms = dict(histograms(Cand))
+
+    print("%-36s %10s  %s" % ("Latency (us)", "count", "   ".join("%-20s" % s[:-3] for s in SHOWN_KEYS)))
+    for sPath, BaseHist in histograms(Base):
+        CandHist = CandHistograms.get(sPath)
+        if CandHist is None or BaseHist["count"] == 0 or CandHist["count"] == 0:
+            continue
+
+        Cells = []
+        for sKey in SHOWN_KEYS:
+            fOld, fNew = BaseHist[sKey] / 1e3, CandHist[sKey] / 1e3
+            fChange = percent_change(fOld, fNew)
+            bFlag = (sKey in TAIL_KEYS and fChange > Args.tail_percent and fNew - fOld > Args.floor_us)
+            if bFlag:
+                Flagged.append("%s %s %.1f -> %.1f us (%+.0f%%)" % (sPath, sKey[:-3], fOld, fNew, fChange))
+            Cells.append("%-20s" % ("%.1f->%.1f %+.0f%%%s" % (fOld, fNew, fChange, "!" if bFlag else "")))
+        print("%-36s %10d  %s" % (sPath, CandHist["count"], "   ".join(Cells)))
+    print()
+
+    return Flagged
+
+
+def loss_rate(Result, CountPath, TotalPaths):
+    nLost = lookup(Result, CountPath)
+    Totals = [lookup(Result, Path) for Path in TotalPaths]
+    if nLost is None or None in Totals or sum(Totals) == 0:
+        return None
+    return 100.0 * nLost / sum(Totals)
+
+
+def compare_losses(Base, Cand, Args):
+    Flagged = []
+
+    print("Losses:")
+    for sName, CountPath, TotalPaths in LOSS_RATES:
+        fOld = loss_rate(Base, CountPath, TotalPaths)
+        fNew = loss_rate(Cand, CountPath, TotalPaths)
+        if fOld is None or fNew is None:
+            continue
+
+        bFlag = fNew - fOld > Args.loss_percent
+        if bFlag:
+            Flagged.append("%s %.4f%% -> %.4f%%" % (sName, fOld, fNew))
+        print("  %-20s %.4f%% -> %.4f%%%s" % (sName, fOld, fNew, "  !" if bFlag else ""))
+    print()
+
+    return Flagged
+
+
+def compare_cpu(Base, Cand):
+    def per_message(Result, sKey):
+        nMessages = Result.get("received", Result.get("sent", 0))
+        fTotal = lookup(Result, ("rusage", sKey))
+        return None if fTotal is None or nMessages == 0 else fTotal / nMessages
+
+    print("Resource usage, per message:")
+    for sKey, sUnits, fScale in (("user_ns", "ns", 1), ("system_ns", "ns", 1),
+                                 ("voluntary_switches", "", 1), ("involuntary_switches", "", 1)):
+        fOld, fNew = per_message(Base, sKey), per_message(Cand, sKey)
+        if fOld is None or fNew is None:
+            continue
+        print("  %-22s %.3f -> %.3f %s (%+.0f%%)" % (sKey, fOld * fScale, fNew * fScale, sUnits,
+                                                    percent_change(fOld, fNew)))
+    print()
+
+
+def main():
+    Parser = argparse.ArgumentParser(description="Compares two rtc_udp or lscs_udp result files")
+    Parser.add_argument("baseline")
+    Parser.add_argument("candidate")
+    Parser.add_argument("-t", "--tail-percent", type=float, default=10.0,
+                        help="flag p99 or p99.9 growth beyond this percentage (default 10)")
+    Parser.add_argument("-f", "--floor-us", type=float, default=5.0,
+                        help="and beyond this many microseconds (default 5)")
+    Parser.add_argument("-l", "--loss-percent", type=float, default=0.01,
+                        help="flag loss rates growing by more than this many percentage points (default 0.01)")
+    Args = Parser.parse_args()
+
+    Base = load(Args.baseline)
+    Cand = load(Args.candidate)
+    if Base.get("program") != Cand.get("program"):
+        sys.exit("compare_results.py: %s is from %s, %s from %s" %
+                 (Args.baseline, Base.get("program"), Args.candidate, Cand.get("program")))
+
+    print("%s: %s (%s) -> %s (%s)\n" % (Base["program"], Args.baseline, Base.get("time"),
+                                        Args.candidate, Cand.get("time")))
+    compare_config(Base, Cand)
+    Flagged  = compare_histograms(Base, Cand, Args)
+    Flagged += compare_losses(Base, Cand, Args)
+    compare_cpu(Base, Cand)
+
+    if Flagged:
+        print("REGRESSIONS:")
+        for sLine in Flagged:
+            print("  " + sLine)
+        return 1
+
+    print("No regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except SystemExit as e:
+        # Bad input exits with a message; keep that distinct from a regression
+        if isinstance(e.code, str):
+            print(e.code, file=sys.stderr)
+            sys.exit(2)
+        raise
@@ -17,6 +17,7 @@
 
 
 
+#include <ctype.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,11 +31,17 @@
 #include <list>
 #include <iostream>
 #include <fstream>
-#include <chrono>
+#include <algorithm>
 
 #include "GlcMsg.h"
 #include "GlcLscsIf.h"
 #include "Client.h"
+#include "ClockSync.h"
+#include "ResultFile.h"
+#include "CpuPlacement.h"
+#include "ResourceUsage.h"
+#include "RtMemory.h"
+#include "PeriodicScheduler.h"
 #include "UdpPorts.h"
 
 #define MAXMSGLEN	1024
@@ -48,8 +55,28 @@ bool b_fFlagIsPresent = false;
 bool b_pFlagIsPresent = false;
 bool b_nFlagIsPresent = false;
 bool b_hFlagIsPresent = false;
+bool bUseIoUring = false;
+bool bUseSendmmsg = false;
+bool bUseSharedSocket = false;
+bool bReceiveReplies = false;
+bool bClockSyncResponder = false;
+bool bLockMemory = false;
+volatile sig_atomic_t bExitRequested = false;
 string sFilename;
+string sResultFile;
+tCpuPlacement Placement;
 tClientList ClientList;
+std::unique_ptr<tEmitterList> pEmitterList;   // Used instead of ClientList with -T
+std::unique_ptr<tReplyReceiver> pReplyReceiver; // Only with -R
+std::unique_ptr<tClockSyncResponder> pClockSyncResponder; // Only with -S
+int  nEmitterThreads = 0;
+int  iThreadPriority = 0;
+int  iFirstCpu       = -1;
+int  iClockSyncPort  = M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT;
+double fPeriodMs     = SEND_INTERVAL_IN_MILLISECONDS;
+int64_t nsSendPeriod = (int64_t) (SEND_INTERVAL_IN_MILLISECONDS * 1000000LL);
+tPhaseMode PhaseMode = PHASE_NONE;
+int  iClockId        = TIMETAG_V1;
 
 
 // Values when the info is not provided from a file
@@ -58,11 +85,10 @@ int iNumClients  = 0;
 int iNextPortNum = M1CS_DEFAULT_FIRST_UDP_PORT;
 int iLastPortNum = (M1CS_DEFAULT_FIRST_UDP_PORT + M1CS_DEFAULT_NUM_UDP_PORTS - 1);
 
-const char *sIpAddressBase[] = { "10.0.2.", 
-                                 "10.0.3.", 
-                                 "10.0.4.", 
-                                 "10.0.5.", 
-                                 "10.0.6." };
+// Source addresses are sIpAddressPrefix, then a subnet counting up from iFirstIpBase, then a host
+// number from 1 to iNumIpsPerBase.  With DO_ROUND_ROBIN, clients rotate among iNumIpBases subnets.
+string      sIpAddressPrefix = "10.0.";
+int         iFirstIpBase     =  2;
 int         iNumIpBases      =  5;
 int         iNumIpsPerBase   = 82;
 int         iCurBase         =  0;
@@ -70,6 +96,20 @@ int         iCurIpInBase     =  1;
 
 #define DO_ROUND_ROBIN (0)
 
+/*****************************
+* AddClient
+*
+* Adds a client to the emitter threads if there are any, else to the
+* single client list
+*/
+
+int AddClient(const std::string &sServerIpAddressString, int iPortNum, const char *sClientIpAddressString = NULL)
+{
+  if (pEmitterList)  return pEmitterList->AddClient(sServerIpAddressString, iPortNum, sClientIpAddressString);
+  else               return ClientList.AddClient(sServerIpAddressString, iPortNum, sClientIpAddressString);
+}
+
+
 /*****************************
 * PopulateFromFile
 *
@@ -86,7 +126,7 @@ int PopulateFromFile(string sFilename)
     if (iPortNum == -1) { // Port num not supplied, will autoincrement from defaults
       iPortNum = iNextPortNum++;
     }
-    ClientList.AddClient(sHostIpAddressString, iPortNum);
+    AddClient(sHostIpAddressString, iPortNum);
     iPortNum = -1;
   }
 
@@ -97,7 +137,8 @@ int PopulateFromFile(string sFilename)
 /*****************************
 * PopulateFromValues
 *
-* 
+* Adds a client for each port, each from the next source address.
+* Throws a std::runtime_error if the addresses run out.
 */
 
 int PopulateFromValues()
@@ -106,10 +147,14 @@ int PopulateFromValues()
 
   for ( ; iNextPortNum <= iLastPortNum; iNextPortNum++) {
 
+    if (iFirstIpBase + iCurBase > 255 || iCurIpInBase > 254) {
+      throw std::runtime_error("Too many clients for source addresses under " + sIpAddressPrefix + "0.0/16");
+    }
+
     // Create an IP address string
-    sClientIpAddress = sIpAddressBase[iCurBase] + to_string(iCurIpInBase);
+    sClientIpAddress = sIpAddressPrefix + to_string(iFirstIpBase + iCurBase) + "." + to_string(iCurIpInBase);
 
-    ClientList.AddClient(sHostIpAddressString, iNextPortNum, sClientIpAddress.c_str());
+    AddClient(sHostIpAddressString, iNextPortNum, sClientIpAddress.c_str());
     cout << "Added client on " << sClientIpAddress << " targeting " << sHostIpAddressString << "::" << iNextPortNum << endl;
 
     #if DO_ROUND_ROBIN == 1
@@ -143,19 +188,127 @@ int TraverseArgList(const char *sArgList[])
 
   while (sArg != NULL) {
     if (!strcmp(sArg, "-help")) {
-      cout << "Usage: " << sProgramName << " [-d] [-f client_ip_list_filename] [-h host_ip] [-p first_server_port] [-n num_clients] " << endl;
+      cout << "Usage: " << sProgramName << " [-d] [-f client_ip_list_filename] [-h host_ip] [-I source_ip_prefix] [-p first_server_port] [-n num_clients] [-u | -m | -s] [-T num_threads] [-t thread_priority] [-c first_cpu] [-i period_ms] [-P uniform|random|subnet] [-R] [-C realtime|raw|tai] [-S [port]] [-o result_file] [-A placement] [-M]" << endl;
       cout << "  You must either provide either -f or -h, not both" << endl;
       cout << "  The -p/-n are optional.  If you do not provide them, defaults will be used." << endl;
       cout << "  If you provide -f, you can include port numbers in the file, or use the -p argument" << endl;
       cout << "  * -f should provide the filename of a list of IP addresses to masquerade as, with optional server target ports" << endl;
       cout << "  * -p first_server_port numports" << endl;
-      cout << "  * If the -t option is provided the program will launch its server threads at that priority" << endl;
+      cout << "  * -I: Without -f, source addresses are source_ip_prefix.2.1 to .2.82, then" << endl;
+      cout << "        .3.1 to .3.82, and so on (default 10.0)." << endl;
+      cout << "        127.0 needs no configured addresses, since all of 127/8 is local." << endl;
+      cout << "  * If the -t option is provided the program will launch its emitter threads at that priority" << endl;
       cout << "    realtime priority thread_priority, from 1-99, with 99 being highest.   " << endl;
+      cout << "  * -T: Share the clients out among num_threads emitter threads, all starting" << endl;
+      cout << "        each cycle at the same moment, rather than sending from one loop" << endl;
+      cout << "  * -c: Pin emitter thread i to CPU first_cpu + i" << endl;
+      cout << "  * -A: Place the emitter threads, or without -T the send loop, on CPUs:" << endl;
+      cout << "        rr:LIST, set:LIST, core:N, isolated or irq:IFACE, as for rtc_udp -A." << endl;
+      cout << "        Overrides -c." << endl;
+      cout << "  * -M: Lock all memory, and fault in every thread's stack before it starts, so" << endl;
+      cout << "        that the send loops take no page faults.  Needs root or \"ulimit -l\"." << endl;
+      cout << "  * -i: Send a message from every client each period_ms (default " << SEND_INTERVAL_IN_MILLISECONDS << ")" << endl;
+      cout << "  * -P: Rather than every client sending at the start of the period, spread them" << endl;
+      cout << "        over it: evenly, at random, or one burst per source address /24 subnet" << endl;
       cout << "  * -p: One server thread will be created for each port in the range" << endl;
+      cout << "  * -u: Submit each round of sends in bulk through io_uring, rather than one" << endl;
+      cout << "        sendto() per client" << endl;
+      cout << "  * -m: Stamp every client's message, then send them with one sendmmsg() per" << endl;
+      cout << "        socket.  Clients without a source address share a single socket." << endl;
+      cout << "  * -s: Send every client's messages through one socket, setting each message's" << endl;
+      cout << "        source address with IP_PKTINFO, rather than opening a socket per source" << endl;
+      cout << "        address.  Each address must be configured on this host, as an alias if" << endl;
+      cout << "        need be; the run stops at the first that is not.  Implies -m." << endl;
+      cout << "  * -R: Receive the replies of rtc_udp -R on the sending sockets, and report" << endl;
+      cout << "        the round trip time from each message to its reply" << endl;
+      cout << "  * -C: Send the versioned header, with nanosecond time tags from this clock," << endl;
+      cout << "        instead of the original header's gettimeofday() time.  raw only compares" << endl;
+      cout << "        within one host; tai across hosts whose clocks are synchronized by PTP." << endl;
+      cout << "  * -S: Answer the clock offset exchanges of rtc_udp -S, on port " << M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT << " or the" << endl;
+      cout << "        port given, so that it can report one-way latencies against this host's clock" << endl;
+      cout << "  * -o: At the end, also write the configuration and results, as JSON, to" << endl;
+      cout << "        result_file, for compare_results.py" << endl;
       cout << "  * -d is the debug flag.  Doesn't do anything at present." << endl << endl;
 
       exit(0);
     }
+    else if (!strcmp(sArg, "-u"))  {
+      bUseIoUring = true;
+    }
+    else if (!strcmp(sArg, "-m"))  {
+      bUseSendmmsg = true;
+    }
+    else if (!strcmp(sArg, "-s"))  {
+      bUseSharedSocket = true;
+    }
+    else if (!strcmp(sArg, "-C"))  {
+      if (!TimeTagParseClock(*sArgList++, &iClockId) || iClockId == TIMETAG_V1) {
+        throw std::runtime_error("Invalid value for -C argument");
+      }
+    }
+    else if (!strcmp(sArg, "-R"))  {
+      bReceiveReplies = true;
+    }
+    else if (!strcmp(sArg, "-S"))  {
+      bClockSyncResponder = true;
+      if (*sArgList != NULL && isdigit((*sArgList)[0])) {
+        iClockSyncPort = atoi(*sArgList++);
+        if (iClockSyncPort <= 0) {
+          throw std::runtime_error("Invalid value for -S argument");
+        }
+      }
+    }
+    else if (!strcmp(sArg, "-o"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL) {
+        throw std::runtime_error("Missing value for -o argument");
+      }
+      sResultFile = sArg;
+    }
+    else if (!strcmp(sArg, "-T"))  {
+      nEmitterThreads = atoi(*sArgList++);
+      if (nEmitterThreads < 1) {
+        throw std::runtime_error("Invalid value for -T argument");
+      }
+    }
+    else if (!strcmp(sArg, "-t"))  {
+      iThreadPriority = atoi(*sArgList++);
+    }
+    else if (!strcmp(sArg, "-i"))  {
+      fPeriodMs = atof(*sArgList++);
+      // Checked in ns, since anything under 1e-6 ms truncates to 0; the upper bound keeps the cast defined
+      if (!(fPeriodMs > 0 && fPeriodMs < 1e9)) {
+        throw std::runtime_error("Invalid value for -i argument");
+      }
+      nsSendPeriod = (int64_t) (fPeriodMs * 1e6);
+      if (nsSendPeriod <= 0) {
+        throw std::runtime_error("Invalid value for -i argument");
+      }
+    }
+    else if (!strcmp(sArg, "-P"))  {
+      sArg = *sArgList++;
+      if      (sArg == NULL)                 throw std::runtime_error("Missing value for -P argument");
+      else if (!strcmp(sArg, "uniform"))     PhaseMode = PHASE_UNIFORM;
+      else if (!strcmp(sArg, "random"))      PhaseMode = PHASE_RANDOM;
+      else if (!strcmp(sArg, "subnet"))      PhaseMode = PHASE_SUBNET;
+      else                                   throw std::runtime_error("Invalid value for -P argument");
+    }
+    else if (!strcmp(sArg, "-A"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL) {
+        throw std::runtime_error("Missing value for -A argument");
+      }
+      Placement = tCpuPlacement(sArg);
+    }
+    else if (!strcmp(sArg, "-M"))  {
+      bLockMemory = true;
+    }
+    else if (!strcmp(sArg, "-c"))  {
+      iFirstCpu = atoi(*sArgList++);
+      if (iFirstCpu < 0) {
+        throw std::runtime_error("Invalid value for -c argument");
+      }
+    }
     else if (!strcmp(sArg, "-f"))  {
       b_fFlagIsPresent = true;
       sFilename = *sArgList++;
@@ -166,6 +319,14 @@ int TraverseArgList(const char *sArgList[])
       b_hFlagIsPresent = true;
     }
 
+    else if (!strcmp(sArg, "-I"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL || count(sArg, sArg + strlen(sArg), '.') != 1) {
+        throw std::runtime_error("Invalid value for -I argument");
+      }
+      sIpAddressPrefix = string(sArg) + ".";
+    }
+
     else if (!strcmp(sArg, "-p"))  {
       iNextPortNum = atoi(*sArgList++);
       if (iNextPortNum <=0) {
@@ -191,6 +352,7 @@ int TraverseArgList(const char *sArgList[])
 
   // Check for valid combinations
   if (b_hFlagIsPresent && b_fFlagIsPresent) return -1;
+  if (bUseIoUring && (bUseSendmmsg || bUseSharedSocket)) return -1;
 
   if (b_nFlagIsPresent)  iLastPortNum = iNextPortNum + iNumClients - 1;
 
@@ -198,6 +360,125 @@ int TraverseArgList(const char *sArgList[])
 }
 
 
+/*****************************
+* StartReplyReceiver
+*
+* Listens for replies on every socket the clients send from
+*/
+
+void StartReplyReceiver()
+{
+  vector<int> Sockets;
+
+  if (pEmitterList)  pEmitterList->GetReplySockets(Sockets);
+  else               ClientList.GetReplySockets(Sockets);
+
+  pReplyReceiver.reset(new tReplyReceiver(iThreadPriority));
+  for (auto sock : Sockets)  pReplyReceiver->AddSocket(sock);
+  pReplyReceiver->Start();
+
+  cout << "Receiving replies on " << Sockets.size() << " sockets" << endl;
+}
+
+
+/*****************************
+* StopReplyReceiver
+*
+* Once sending has stopped, waits for the last replies, then reports
+*/
+
+void StopReplyReceiver(long nMessagesSent)
+{
+  struct timespec tmDrain;
+
+  if (!pReplyReceiver)  return;
+
+  tmDrain.tv_sec  = 0;
+  tmDrain.tv_nsec = REPLY_DRAIN_MS * 1000000L;
+  nanosleep(&tmDrain, NULL);
+
+  pReplyReceiver->StopThread(true);
+  pReplyReceiver->PrintStatistics(nMessagesSent);
+}
+
+
+/*****************************
+* StopClockSyncResponder
+*
+*/
+
+void StopClockSyncResponder()
+{
+  if (!pClockSyncResponder)  return;
+
+  pClockSyncResponder->StopThread(true);
+  printf("Clock offset exchanges answered: %ld\n", pClockSyncResponder->NumAnswered());
+}
+
+
+/*****************************
+* WriteResults
+*
+* Writes the configuration and the send statistics to the -o file
+*
+* INPUTS:
+*   pScheduler - the send loop's, when not sending from emitter threads
+*/
+
+void WriteResults(const tPeriodicScheduler *pScheduler)
+{
+  tResultFile Results(sResultFile, "lscs_udp");
+  const char *sBackend;
+  long        nSent;
+
+  if      (bUseIoUring)       sBackend = "io_uring";
+  else if (bUseSharedSocket)  sBackend = "shared_socket";
+  else if (bUseSendmmsg)      sBackend = "sendmmsg";
+  else                        sBackend = "sendto";
+
+  Results.BeginObject("config");
+  Results.Add("target",          b_fFlagIsPresent ? sFilename : sHostIpAddressString);
+  Results.Add("period_ms",       fPeriodMs);
+  Results.Add("backend",         sBackend);
+  Results.Add("emitter_threads", nEmitterThreads);
+  Results.Add("priority",        iThreadPriority);
+  Results.Add("first_cpu",       iFirstCpu);
+  Results.Add("placement",       Placement.Spec());
+  Results.Add("lock_memory",     bLockMemory);
+  Results.Add("phase",           tClientList::PhaseModeName(PhaseMode));
+  Results.Add("clock",           TimeTagClockName(iClockId));
+  Results.Add("replies",         bReceiveReplies);
+  Results.EndObject();
+
+  if (pEmitterList) {
+    pEmitterList->WriteResults(Results);
+    nSent = pEmitterList->NumMessages();
+  }
+  else {
+    ClientList.WriteResults(Results);
+    pScheduler->WriteResults(Results, "scheduler");
+    nSent = ClientList.NumMessages();
+  }
+
+  if (pReplyReceiver)       pReplyReceiver->WriteResults(Results, nSent);
+  if (pClockSyncResponder)  Results.Add("clock_sync_answered", pClockSyncResponder->NumAnswered());
+
+  Results.AddResourceUsage();
+}
+
+
+/*****************************
+* HandleSigint
+*
+* Ctrl-C ends the send loop, so that statistics can be printed on the way out
+*/
+
+void HandleSigint(int sig)
+{
+  bExitRequested = true;
+}
+
+
 /*****************************
 * main
 *
@@ -206,21 +487,134 @@ int TraverseArgList(const char *sArgList[])
 
 int main (int argc, const char **argv)
 {
-  if (TraverseArgList(argv) < 0) {
-    cerr << "Error: Invalid switch combination supplied, try " << argv[0] << " -help" << endl;
+  tPeriodicScheduler Scheduler;
+  int64_t            nsPeriod;
+
+  try {
+    if (TraverseArgList(argv) < 0) {
+      cerr << "Error: Invalid switch combination supplied, try " << argv[0] << " -help" << endl;
+      return 1;
+    }
+  }
+  catch (const std::runtime_error &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
   }
 
-  if (b_fFlagIsPresent)  PopulateFromFile(sFilename);
-  else                   PopulateFromValues();
+  // Before any thread or buffer is made
+  if (bLockMemory)  InitRtMemory(false);
 
-  // Start periodic scheduling
-  std::chrono::steady_clock::time_point  schedTime = std::chrono::steady_clock::now();
-  std::chrono::duration<int, std::milli> intervalInMs(SEND_INTERVAL_IN_MILLISECONDS);  
+  if (nEmitterThreads > 0) {
+    pEmitterList.reset(new tEmitterList(nEmitterThreads, iThreadPriority, iFirstCpu));
+    if (Placement.IsSet())  pEmitterList->SetPlacement(Placement);
+    cout << "Sending from " << nEmitterThreads << " emitter threads" << endl;
+  }
 
-  while (1) { 
-    ClientList.EmitMessagesFromAll();
-    schedTime += intervalInMs;
-    std::this_thread::sleep_until(schedTime);
+  // Has to be decided before the clients are created, since it determines whether they open sockets
+  if (bUseSharedSocket) {
+    if (pEmitterList)  pEmitterList->UseSharedSocket();
+    else               ClientList.UseSharedSocket();
+    cout << "Sending through one socket, with per-message source addresses" << endl;
+  }
+  else if (bUseSendmmsg) {
+    if (pEmitterList)  pEmitterList->UseBatchedSends();
+    else               ClientList.UseBatchedSends();
+    cout << "Sending with sendmmsg" << endl;
   }
- 
+
+  if (iClockId != TIMETAG_V1) {
+    if (pEmitterList)  pEmitterList->UseTimeTags(iClockId);
+    else               ClientList.UseTimeTags(iClockId);
+    cout << "Time tags from the " << TimeTagClockName(iClockId) << " clock, in the versioned header" << endl;
+  }
+
+  try {
+    if (b_fFlagIsPresent)  PopulateFromFile(sFilename);
+    else                   PopulateFromValues();
+  }
+  catch (const std::runtime_error &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  if (bUseIoUring) {
+    if (pEmitterList)  pEmitterList->UseIoUring();
+    else               ClientList.UseIoUring();
+    cout << "Sending with io_uring" << endl;
+  }
+
+  signal(SIGINT, HandleSigint);
+
+  nsPeriod = nsSendPeriod;
+  cout << "Sending every " << fPeriodMs << " ms" << endl;
+
+  if (PhaseMode != PHASE_NONE) {
+    if (pEmitterList)  pEmitterList->SetPhaseOffsets(PhaseMode, nsPeriod);
+    else               ClientList.SetPhaseOffsets(PhaseMode, nsPeriod);
+    cout << "Phase offsets: " << tClientList::PhaseModeName(PhaseMode) << endl;
+  }
+
+  if (bReceiveReplies)  StartReplyReceiver();
+
+  // Stamps from the clock the time tags come from, which is what rtc_udp compares against
+  if (bClockSyncResponder) {
+    pClockSyncResponder.reset(new tClockSyncResponder(iClockSyncPort, iClockId));
+    pClockSyncResponder->Start();
+    cout << "Answering clock offset exchanges on port " << iClockSyncPort << endl;
+  }
+
+  if (pEmitterList) {
+    sigset_t sigset, sigsetWait;
+
+    // Block SIGINT while checking the flag, so that it cannot slip in between the check and the wait
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigset, &sigsetWait);
+    sigdelset(&sigsetWait, SIGINT);
+
+    pEmitterList->StartThreads(nsPeriod);
+    StartMeasurementWindow();
+    while (!bExitRequested) {
+      sigsuspend(&sigsetWait);
+    }
+    pEmitterList->StopThreads();
+    pEmitterList->PrintStatistics();
+    StopReplyReceiver(pEmitterList->NumMessages());
+    StopClockSyncResponder();
+    PrintResourceUsage();
+    if (!sResultFile.empty())  WriteResults(nullptr);
+    return 0;
+  }
+
+  // Pin the send loop after the helper threads have started, so that they do not inherit it
+  if (Placement.IsSet()) {
+    cpu_set_t CpuSet;
+
+    if (!Placement.PlaceCallingThread(0)) {
+      cerr << "** Warning: Could not place the send loop: " << Placement.Describe() << " **" << endl;
+    }
+    else if (pthread_getaffinity_np(pthread_self(), sizeof(CpuSet), &CpuSet) == 0) {
+      cout << "Send loop on CPUs " << tCpuPlacement::FormatCpuList(CpuSet) << endl;
+    }
+  }
+
+  StartMeasurementWindow();
+
+  // Start periodic scheduling.  The sleep restarts itself after Ctrl-C, so the flag is seen one tick later.
+  Scheduler.Start(tPeriodicScheduler::NowNs(), nsPeriod);
+
+  while (!bExitRequested) { 
+    ClientList.EmitMessagesFromAll(Scheduler.WaitForNextTick());
+    Scheduler.EndOfWork();
+  }
+
+  ClientList.PrintSyscallStatistics();
+  ClientList.PrintBurstStatistics();
+  Scheduler.Print(stdout, "Wake-up lateness:");
+  StopReplyReceiver(ClientList.NumMessages());
+  StopClockSyncResponder();
+  PrintResourceUsage();
+  if (!sResultFile.empty())  WriteResults(&Scheduler);
+
+  return 0;
 }
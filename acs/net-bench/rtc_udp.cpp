@@ -5,12 +5,14 @@
 */
 
 #include <string.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
 #include <netdb.h>
+#include <signal.h>
 
 extern "C" {
 #include "GlcMsg.h"
@@ -18,6 +20,7 @@ extern "C" {
 
 #include "rtc_udp.h"
 #include "Server.h"
+#include "ResourceUsage.h"
 #include <list>
 #include <iostream>
 #include <fstream>
@@ -26,6 +29,22 @@ using namespace std;
 
 bool bDebug                = false;
 int  iThreadPriority       = 0;
+int  iBatchSize            = 1;
+int  nWorkers              = 0;
+bool bUseIoUring           = false;
+bool bKernelTimestamps     = false;
+bool bAssembleCycles       = false;
+double fCyclePeriodMs      = 20;
+tServerConfig::tReplyMode ReplyMode = tServerConfig::REPLY_NONE;
+int  iClockId              = TIMETAG_V1;
+string sClockSyncPeer;
+int  iClockSyncPort        = M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT;
+double fReportPeriod       = 1.0;
+double fDuration           = 0;
+string sResultFile;
+string sPlacement;
+bool bLockMemory           = false;
+bool bHugePages            = false;
 int  iFirstPort            =  M1CS_DEFAULT_FIRST_UDP_PORT;
 int  iLastPort             = (M1CS_DEFAULT_FIRST_UDP_PORT + M1CS_DEFAULT_NUM_UDP_PORTS - 1);
 
@@ -45,18 +64,138 @@ int TraverseArgList(const char *sArgList[])
 
   while (sArg != NULL) {
     if (!strcmp(sArg, "-help")) {
-      cout << "Usage: " << sProgramName << " [-d] [-t thread_priority] -p first_server_port last_server_port" << endl;
+      cout << "Usage: " << sProgramName << " [-d] [-t thread_priority] [-b batch_size] [-w num_workers] [-u] [-k] [-a] [-c period_ms] [-R msg|cycle] [-C realtime|raw|tai] [-S lscs_host [port]] [-r report_period] [-D seconds] [-o result_file] [-A placement] [-M] [-H] -p first_server_port last_server_port" << endl;
       cout << "  * If the -t option is provided the program will launch its server threads at that priority" << endl;
       cout << "    realtime priority thread_priority, from 1-99, with 99 being highest.   " << endl;
       cout << "  * -p: One server thread will be created for each port in the range" << endl;
       cout << "        first_server_port last_server_port" << endl;
-      cout << "  * -d is the debug flag.  Doesn't do anything at present." << endl << endl;
+      cout << "  * -b: Receive up to batch_size queued messages per recvmmsg() call, rather than" << endl;
+      cout << "        one recvfrom() call per message" << endl;
+      cout << "  * -w: Instead of one thread per port, share the ports among num_workers threads," << endl;
+      cout << "        each multiplexing its sockets with epoll" << endl;
+      cout << "  * -u: Receive with io_uring multishot receives instead of epoll.  Uses the" << endl;
+      cout << "        -w worker count, or one worker if -w is not given" << endl;
+      cout << "  * -k: Also take the kernel receive timestamp of each message, to split its" << endl;
+      cout << "        latency into network and host scheduling parts" << endl;
+      cout << "  * -a: Gather each cycle's message from every port, as though each port were" << endl;
+      cout << "        one segment, and report when each cycle was complete and what was missing" << endl;
+      cout << "  * -c: The senders' cycle period, to match lscs_udp -i (default 20).  With -a," << endl;
+      cout << "        messages with the same id sent more than a period apart are different cycles" << endl;
+      cout << "  * -R: Answer each message (msg), or each complete cycle (cycle, implies -a)," << endl;
+      cout << "        with an ActTargetMsg to the sender, for lscs_udp to time the round trip" << endl;
+      cout << "  * -C: Take receive times from this clock, to match lscs_udp -C.  Messages" << endl;
+      cout << "        tagged on another clock, or with the original header, still work." << endl;
+      cout << "  * -S: Estimate the offset of lscs_host's clock from this one's, against" << endl;
+      cout << "        lscs_udp -S, and correct the latencies for it, so that they are one-way." << endl;
+      cout << "        The port defaults to " << M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT << "." << endl;
+      cout << "  * -r: Print a latency summary over all ports every report_period seconds" << endl;
+      cout << "        (default 1).  0 prints only the final summary." << endl;
+      cout << "  * -D: Stop after this many seconds, as though Ctrl-C had been pressed" << endl;
+      cout << "  * -o: At the end, also write the configuration and results, as JSON, to" << endl;
+      cout << "        result_file, for compare_results.py" << endl;
+      cout << "  * -A: Place the receive threads (the -w workers, else one per port) on CPUs:" << endl;
+      cout << "        rr:LIST   one per CPU of LIST in turn, e.g. rr:2-7" << endl;
+      cout << "        set:LIST  all free to use any CPU of LIST" << endl;
+      cout << "        core:N    all on CPU N" << endl;
+      cout << "        isolated  one per isolcpus= CPU in turn" << endl;
+      cout << "        irq:IFACE one per CPU that IFACE's interrupts go to, in turn" << endl;
+      cout << "  * -M: Lock all memory, and fault in every thread's stack before it starts, so" << endl;
+      cout << "        that the receive loops take no page faults.  Needs root or \"ulimit -l\";" << endl;
+      cout << "        every stack is then resident in full, so prefer -w with many ports." << endl;
+      cout << "  * -H: As -M, and also put the receive buffers in huge pages" << endl;
+      cout << "  * -d: Also print a line for every message received" << endl << endl;
 
       exit(0);
     }
     else if (!strcmp(sArg, "-t"))  {
       iThreadPriority = atoi(*sArgList++);
     } 
+    else if (!strcmp(sArg, "-b"))  {
+      iBatchSize = atoi(*sArgList++);
+      if (iBatchSize < 1) {
+        throw std::runtime_error("Invalid value for -b argument");
+      }
+    }
+    else if (!strcmp(sArg, "-w"))  {
+      nWorkers = atoi(*sArgList++);
+      if (nWorkers < 1) {
+        throw std::runtime_error("Invalid value for -w argument");
+      }
+    }
+    else if (!strcmp(sArg, "-u"))  {
+      bUseIoUring = true;
+    }
+    else if (!strcmp(sArg, "-k"))  {
+      bKernelTimestamps = true;
+    }
+    else if (!strcmp(sArg, "-M"))  {
+      bLockMemory = true;
+    }
+    else if (!strcmp(sArg, "-H"))  {
+      bLockMemory = true;
+      bHugePages  = true;
+    }
+    else if (!strcmp(sArg, "-a"))  {
+      bAssembleCycles = true;
+    }
+    else if (!strcmp(sArg, "-c"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL || !((fCyclePeriodMs = atof(sArg)) > 0 && fCyclePeriodMs < 1e9)) {
+        throw std::runtime_error("Invalid value for -c argument");
+      }
+    }
+    else if (!strcmp(sArg, "-R"))  {
+      sArg = *sArgList++;
+      if      (sArg == NULL)               throw std::runtime_error("Missing value for -R argument");
+      else if (!strcmp(sArg, "msg"))       ReplyMode = tServerConfig::REPLY_PER_MESSAGE;
+      else if (!strcmp(sArg, "cycle"))     ReplyMode = tServerConfig::REPLY_PER_CYCLE;
+      else                                 throw std::runtime_error("Invalid value for -R argument");
+    }
+    else if (!strcmp(sArg, "-C"))  {
+      if (!TimeTagParseClock(*sArgList++, &iClockId) || iClockId == TIMETAG_V1) {
+        throw std::runtime_error("Invalid value for -C argument");
+      }
+    }
+    else if (!strcmp(sArg, "-S"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL || sArg[0] == '-') {
+        throw std::runtime_error("Invalid value for -S argument");
+      }
+      sClockSyncPeer = sArg;
+      if (*sArgList != NULL && isdigit((*sArgList)[0])) {
+        iClockSyncPort = atoi(*sArgList++);
+        if (iClockSyncPort <= 0) {
+          throw std::runtime_error("Invalid value for -S argument");
+        }
+      }
+    }
+    else if (!strcmp(sArg, "-r"))  {
+      fReportPeriod = atof(*sArgList++);
+      if (fReportPeriod < 0) {
+        throw std::runtime_error("Invalid value for -r argument");
+      }
+    }
+    else if (!strcmp(sArg, "-D"))  {
+      fDuration = atof(*sArgList++);
+      if (fDuration <= 0) {
+        throw std::runtime_error("Invalid value for -D argument");
+      }
+    }
+    else if (!strcmp(sArg, "-o"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL) {
+        throw std::runtime_error("Missing value for -o argument");
+      }
+      sResultFile = sArg;
+    }
+    else if (!strcmp(sArg, "-A"))  {
+      sArg = *sArgList++;
+      if (sArg == NULL) {
+        throw std::runtime_error("Missing value for -A argument");
+      }
+      sPlacement = sArg;
+      tCpuPlacement Check(sPlacement);   // Throws if it makes no sense, before anything starts
+    }
     else if (!strcmp(sArg, "-p"))  {
       iFirstPort = atoi(*sArgList++);
       iLastPort  = atoi(*sArgList++);
@@ -71,7 +210,24 @@ int TraverseArgList(const char *sArgList[])
     sArg = *sArgList++;
   }
 
+  if (ReplyMode == tServerConfig::REPLY_PER_CYCLE)  bAssembleCycles = true;
+
   cout << "Ports " << iFirstPort << " through " << iLastPort << endl;
+  if (iBatchSize > 1)     cout << "Receiving in batches of up to " << iBatchSize << " messages" << endl;
+  if (bKernelTimestamps)  cout << "Using kernel receive timestamps" << endl;
+  if (bAssembleCycles) {
+    cout << "Assembling cycles over " << (iLastPort - iFirstPort + 1) << " segments, every " << fCyclePeriodMs << " ms" << endl;
+  }
+  if (ReplyMode != tServerConfig::REPLY_NONE) {
+    cout << "Replying to each " << ((ReplyMode == tServerConfig::REPLY_PER_CYCLE) ? "complete cycle" : "message") << endl;
+  }
+  if (iClockId != TIMETAG_V1)  cout << "Receive times from the " << TimeTagClockName(iClockId) << " clock" << endl;
+  if (!sClockSyncPeer.empty()) {
+    cout << "Correcting for the clock offset of " << sClockSyncPeer << ", port " << iClockSyncPort << endl;
+  }
+  if (fDuration > 0)  cout << "Running for " << fDuration << " s" << endl;
+  if (bUseIoUring && nWorkers == 0)  nWorkers = 1;
+  if (nWorkers > 0)  cout << "Using " << nWorkers << (bUseIoUring ? " io_uring" : " epoll") << " worker threads" << endl;
   return 0;
 }
 
@@ -84,14 +240,46 @@ int TraverseArgList(const char *sArgList[])
 
 int main(int argc, const char *argv[])
 {
+  sigset_t      sigset;
+  tServerConfig Config;
+
   if (TraverseArgList(argv) < 0) {
     cerr << "Error parsing args" << endl;
     exit(1);
   }
 
-  tServerList ServerList(iFirstPort, iLastPort, iThreadPriority);
+  // Block SIGINT before any threads are created, so that they all inherit the
+  // mask and Ctrl-C is delivered only to the sigwait() in ProcessTelemetry().
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  Config.iFirstPortNum          = iFirstPort;
+  Config.iLastPortNum           = iLastPort;
+  Config.iReceiveThreadPriority = iThreadPriority;
+  Config.iBatchSize             = iBatchSize;
+  Config.nWorkers               = nWorkers;
+  Config.WorkerType             = bUseIoUring ? tServerConfig::WORKER_IO_URING : tServerConfig::WORKER_EPOLL;
+  Config.bKernelTimestamps      = bKernelTimestamps;
+  Config.bAssembleCycles        = bAssembleCycles;
+  Config.fCyclePeriodMs         = fCyclePeriodMs;
+  Config.ReplyMode              = ReplyMode;
+  Config.iClockId               = iClockId;
+  Config.sClockSyncPeer         = sClockSyncPeer;
+  Config.iClockSyncPort         = iClockSyncPort;
+  Config.bDebug                 = bDebug;
+  Config.fReportPeriod          = fReportPeriod;
+  Config.fDuration              = fDuration;
+  Config.sPlacement             = sPlacement;
+  Config.bLockMemory            = bLockMemory;
+  Config.bHugePages             = bHugePages;
+
+  tServerList ServerList(Config);
   ServerList.ProcessTelemetry();
 
+  PrintResourceUsage();
+  if (!sResultFile.empty())  ServerList.WriteResults(sResultFile);
+
   return 0;
 }
 
@@ -0,0 +1,226 @@
+/**
+ *****************************************************************************
+ *
+ * @file cmdbench.c
+ *	Net Services Command Server Benchmark.
+ *
+ *	Times commands to a command server as the number of clients
+ *	connected to it grows, as when hundreds of segment HCDs are
+ *	connected to the LSCS.  For each client count, more clients are
+ *	connected, then commands are sent round robin, one at a time, and
+ *	each response timed.  With -b, every client sends a command at
+ *	once and the whole round is timed instead.  Run against cmdsrvsim:
+ *
+ *	    cmdsrvsim -q &
+ *	    cmdbench -h localhost -n 1,10,100,500 -c 10000
+ *
+ * @par Project
+ *	TMT Primary Mirror Control System (M1CS)
+ *	Jet Propulsion Laboratory, Pasadena, CA
+ *
+ * Copyright (c) 2015-2022, California Institute of Technology
+ *
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "net_glc.h"
+#include "GlcMsg.h"
+
+#define MAXCLIENTS	10000		/* also limited by ulimit -n */
+#define MAXSTEPS	32
+#define MAXSAMPLES	1000000
+
+int  clients[MAXCLIENTS];
+int  nclients = 0;
+bool burst = false;			/* all clients at once */
+
+
+/* parse a comma separated list of client counts, e.g. "1,10,100" */
+
+int parse_counts (char *list, int *counts)
+{
+    int   n = 0;
+    char *count;
+
+    for (count = strtok (list, ","); count != NULL && n < MAXSTEPS; count = strtok (NULL, ","))
+	counts[n++] = atoi (count);
+
+    return n;
+}
+
+
+int compare_ns (const void *a, const void *b)
+{
+    long x = *(const long *) a;
+    long y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+long elapsed_ns (struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000000L + (end.tv_nsec - start->tv_nsec);
+}
+
+
+int send_cmd (int sockfd, int n)
+{
+    CmdMsg cmd_msg;
+
+    (void) memset (&cmd_msg, 0, sizeof cmd_msg);
+    cmd_msg.hdr.msgId = CMD_TYPE;
+    cmd_msg.hdr.srcId = ANY_TASK;
+    (void) sprintf (cmd_msg.cmd, "PING %d", n);
+
+    return net_send (sockfd, (char *) &cmd_msg, sizeof cmd_msg, BLOCKING);
+}
+
+
+int recv_rsp (int sockfd)
+{
+    RspMsg rsp_msg;
+    int    status;
+
+    if ((status = net_recv (sockfd, (char *) &rsp_msg, sizeof rsp_msg, BLOCKING)) > 0 &&
+	rsp_msg.hdr.msgId != RSP_TYPE) {
+	(void)fprintf (stderr, "cmdbench: Invalid response received.\n");
+	return ERROR;
+    }
+    return status;
+}
+
+
+/* connect clients until there are count */
+
+int connect_clients (char *server, char *hostname, int count)
+{
+    int sockfd;
+
+    while (nclients < count) {
+	if ((sockfd = net_connect (server, hostname, ANY_TASK, BLOCKING)) < 0) {
+	    (void)fprintf (stderr, "cmdbench: net_connect() error after %d clients: %s: %s\n",
+				    nclients, NET_ERRSTR(sockfd), strerror (errno));
+	    return sockfd;
+	}
+	clients[nclients++] = sockfd;
+    }
+    return 0;
+}
+
+
+/* time count commands, or rounds of commands, with the clients connected */
+
+int measure (int count)
+{
+    long *samples;
+    long  total = 0;
+    int   status = 0;
+    int   i, j;
+    struct timespec start;
+
+    samples = (long *) malloc (count * sizeof (long));
+
+    for (i = 0; i < count && status >= 0; i++) {
+	clock_gettime (CLOCK_MONOTONIC, &start);
+
+	if (burst) {
+	    for (j = 0; j < nclients && status >= 0; j++)
+		if ((status = send_cmd (clients[j], i)) <= 0)
+		    status = ERROR;
+	    for (j = 0; j < nclients && status >= 0; j++)
+		if ((status = recv_rsp (clients[j])) <= 0)
+		    status = ERROR;
+	}
+	else if ((status = send_cmd (clients[i % nclients], i)) <= 0 ||
+		 (status = recv_rsp (clients[i % nclients])) <= 0)
+	    status = ERROR;
+
+	samples[i] = elapsed_ns (&start);
+	total += samples[i];
+    }
+
+    if (status < 0) {
+	(void)fprintf (stderr, "cmdbench: Command %d failed, errno=%d\n", i - 1, errno);
+	free (samples);
+	return ERROR;
+    }
+
+    qsort (samples, count, sizeof (long), compare_ns);
+
+    (void)printf ("%5d clients: %s (us): mean %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f\n",
+		  nclients, burst ? "round of commands" : "command round trip",
+		  total / 1e3 / count, samples[count / 2] / 1e3,
+		  samples[count * 99 / 100] / 1e3, samples[count - 1] / 1e3);
+    free (samples);
+
+    return 0;
+}
+
+
+int main (int argc, char **argv)
+{
+    char server[128] = LSCS_CMD_SRV;
+    char hostname[128] = "localhost";
+    char list[256] = "1,10,100,500";
+    int  counts[MAXSTEPS];
+    int  nsteps;
+    int  count = 10000;
+    int  status = 0;
+    int  i;
+
+    for (i = 1; i < argc; i++) {
+	if (!strcmp (argv[i], "-s") && i + 1 < argc)
+	    (void) strncpy (server, argv[++i], sizeof server - 1);
+
+	else if (!strcmp (argv[i], "-h") && i + 1 < argc)
+	    (void) strncpy (hostname, argv[++i], sizeof hostname - 1);
+
+	else if (!strcmp (argv[i], "-n") && i + 1 < argc)
+	    (void) strncpy (list, argv[++i], sizeof list - 1);
+
+	else if (!strcmp (argv[i], "-c") && i + 1 < argc)
+	    count = atoi (argv[++i]);
+
+	else if (!strcmp (argv[i], "-b"))
+	    burst = true;
+
+	else {
+	    (void)fprintf (stderr, "Usage: cmdbench [-s endpoint] [-h host] [-n clients,...] [-c count] [-b]\n");
+	    exit (1);
+	}
+    }
+
+    nsteps = parse_counts (list, counts);
+
+    for (i = 0; i < nsteps; i++) {
+	if (counts[i] < 1 || counts[i] > MAXCLIENTS || (i > 0 && counts[i] < counts[i - 1])) {
+	    (void)fprintf (stderr, "cmdbench: Client counts must rise, from 1 to %d\n", MAXCLIENTS);
+	    exit (1);
+	}
+    }
+    if (count < 1 || count > MAXSAMPLES) {
+	(void)fprintf (stderr, "cmdbench: count must be 1-%d\n", MAXSAMPLES);
+	exit (1);
+    }
+
+    for (i = 0; i < nsteps && status == 0; i++) {
+	if ((status = connect_clients (server, hostname, counts[i])) == 0)
+	    status = measure (count);
+    }
+
+    for (i = 0; i < nclients; i++)
+	net_close (clients[i]);
+
+    return (status < 0) ? 1 : 0;
+}
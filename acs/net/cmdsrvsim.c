@@ -4,6 +4,11 @@
  * @file cmdsrvsim.c
  *      GLC Net Services Test Command Server.
  *
+ *      Answers each command from any number of clients with
+ *      "<command>: Completed.", using the net_server event loop.  -q
+ *      stops it printing the commands, for benchmarks (see cmdbench.c),
+ *      and -O sets the endpoint's latency options, as for netrtt.
+ *
  * @par Project
  *      TMT Primary Mirror Control System (M1CS) \n
  *      Jet Propulsion Laboratory, Pasadena, CA
@@ -20,176 +25,170 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <unistd.h>
+#include <signal.h>
 #include <errno.h>
-#include <netdb.h>
 
 #include "net_glc.h"
 #include "GlcMsg.h"
 
-#define MAXCLIENTS	20
 #define MAXMSGLEN	1024
 
-int listenfd = ERROR;
-int cli_fd[MAXCLIENTS];
+bool quiet = false;			/* don't print commands */
+net_server *server = NULL;
+
+
+int  on_accept (net_server *srv, int sockfd, void *arg);
+int  process_msg (net_server *srv, int sockfd, void *arg);
+void on_closed (net_server *srv, int sockfd, void *arg);
+int  send_rsp (int sockfd, char *cmdstr);
+
 
+void stop (int sig)
+{
+    net_server_stop (server);
+}
 
-void event_loop ();
-int  process_msg (int sockfd);
+
+/* parse a latency option list, e.g. "nodelay,recvbuf", or "none" */
+
+int parse_opts (char *list)
+{
+    int   opts = 0;
+    char *opt;
+
+    for (opt = strtok (list, ","); opt != NULL; opt = strtok (NULL, ",")) {
+	if      (!strcmp (opt, "nodelay"))   opts |= NET_OPT_NODELAY;
+	else if (!strcmp (opt, "quickack"))  opts |= NET_OPT_QUICKACK;
+	else if (!strcmp (opt, "lowdelay"))  opts |= NET_OPT_LOWDELAY;
+	else if (!strcmp (opt, "recvbuf"))   opts |= NET_OPT_RECVBUF;
+	else if (strcmp (opt, "none")) {
+	    (void)fprintf (stderr, "cmdsrvsim: Unknown option %s\n", opt);
+	    exit (1);
+	}
+    }
+    return opts;
+}
 
 
 int main (int argc, char **argv)
 {
-    char server[128] = LSEB_CMD_SRV;
+    char endpt[128] = LSCS_CMD_SRV;
+    int  opts = -1;
+    int  status;
     int  i;
 
+    net_server_callbacks callbacks = {on_accept, process_msg, on_closed, NULL};
+
     for (i = 1; i < argc; i++) {
-	if (!strcmp (argv[i], "-s"))
-	    (void) strncpy (server, argv[++i], sizeof server);
+	if (!strcmp (argv[i], "-s") && i + 1 < argc)
+	    (void) strncpy (endpt, argv[++i], sizeof endpt - 1);
+
+	else if (!strcmp (argv[i], "-O") && i + 1 < argc)
+	    opts = parse_opts (argv[++i]);
+
+	else if (!strcmp (argv[i], "-q"))
+	    quiet = true;
+
+	else {
+	    (void)fprintf (stderr, "Usage: cmdsrvsim [-s endpoint] [-O nodelay,quickack,lowdelay,recvbuf|none] [-q]\n");
+	    exit (1);
+	}
     }
 
-    for (i = 0; i < MAXCLIENTS; i++)
-    	cli_fd[i] = ERROR;
+    if (opts >= 0 && (status = net_setendptopts (endpt, opts)) < 0) {
+	(void)fprintf (stderr, "cmdsrvsim: net_setendptopts() error: %s\n", NET_ERRSTR(status));
+	exit (status);
+    }
 
     /* initialize server's network connection */
 
-    if ((listenfd = net_init (server)) < 0 ) {
-	(void)fprintf (stderr, "cmdsrvsim: net_init() error: %s, errno=%d\n",
-				NET_ERRSTR(listenfd), errno);
-	exit (listenfd);
+    if ((status = net_server_create (endpt, &callbacks, &server)) < 0) {
+	(void)fprintf (stderr, "cmdsrvsim: net_server_create() error: %s, errno=%d\n",
+				NET_ERRSTR(status), errno);
+	exit (status);
     }
-    else
-        printf ("cmdsrvsim: Listening on socket %d...\n", listenfd);
+    (void)printf ("cmdsrvsim: Listening on %s...\n", endpt);
 
-    /* Main event loop */
+    (void) signal (SIGINT, stop);
+    (void) signal (SIGTERM, stop);
 
-    event_loop ();
+    /* Main event loop, until interrupted */
 
-    if (listenfd != ERROR)
-        net_close (listenfd);
+    if ((status = net_server_run (server)) < 0)
+	(void)fprintf (stderr, "cmdsrvsim: net_server_run() error: %s.\n", strerror (errno));
 
-    for (i = 0; i < MAXCLIENTS; i++)
-	if (cli_fd[i] != ERROR)
-	    net_close (cli_fd[i]);
+    (void)printf ("cmdsrvsim: Closing %d connections...\n", net_server_nclients (server));
+    net_server_destroy (server);
 
-    return 0;
+    return (status < 0) ? 1 : 0;
 }
 
 
-void event_loop ()
+int on_accept (net_server *srv, int sockfd, void *arg)
 {
-    fd_set read_fds;       /* file descriptors to be polled */
-    int  nfds;
-    int  sockfd;
-    int  i;
+    if (!quiet)
+	(void)printf ("cmdsrvsim: Connection accepted...\n");
+    return 0;
+}
 
-    while (1) {
-
-        FD_ZERO (&read_fds);
-        FD_SET (listenfd, &read_fds);
-
-	for (i = 0; i < MAXCLIENTS; i++)
-	    if (cli_fd[i] != ERROR) FD_SET (cli_fd[i], &read_fds);
-
-        nfds = select (FD_SETSIZE, &read_fds, (fd_set *) 0, (fd_set *) 0,
-                       (struct timeval *) 0);
-        if (nfds <= 0)  {
-            if (errno == EINTR)  {
-                continue;
-            }
-            // error on select
-            (void)fprintf (stderr, "cmdsrvsim: select() error: %s.", strerror (errno));
-            exit (-1);
-        }
-        else {
-            if (FD_ISSET (listenfd, &read_fds)) {
-
-		/* accept new client connection */
-		if ((sockfd = net_accept (listenfd, BLOCKING)) < 0) {
-		    (void)fprintf (stderr, "cmdsrvsim: net_accept() error: %s, errno=%d\n",
-					    NET_ERRSTR(sockfd), errno);
-		    net_close (listenfd);
-		    exit (sockfd);
-		}
-		(void)printf ("cmdsrvsim: Connection accepted...\n");
-
-		int n = 0;
-
-		while (n < MAXCLIENTS && cli_fd[n] != ERROR)
-		    n++;
-
-		if (n < MAXCLIENTS)
-		    cli_fd[n] = sockfd;
-		else {
-		    (void)fprintf (stderr, "cmdsrvsim: Max client connections exceeded.\n");
-		    net_close (sockfd);
-		}
-
-                if (--nfds <= 0)
-                    continue;
-            }
-
-	    for (i = 0; i < MAXCLIENTS; i++)
-		if (cli_fd[i] != ERROR && FD_ISSET (cli_fd[i], &read_fds)) {
-
-		    /* service client's request */
-		    (void) process_msg (i);
-		    if (--nfds <= 0)
-			break;
-		}
-        }
-    }
+
+void on_closed (net_server *srv, int sockfd, void *arg)
+{
+    if (!quiet)
+	(void)printf ("cmdsrvsim: Closing connection...\n");
 }
 
 
-int process_msg (int indx)
+/* service one client request, returning net_recv()'s status */
+
+int process_msg (net_server *srv, int sockfd, void *arg)
 {
     char msg[MAXMSGLEN];
     int  len;
 
-    int  send_rsp (int sockfd, char *cmdstr, int csn);
-
     (void) memset (msg, 0, sizeof msg);
 
-    if ((len = net_recv (cli_fd[indx], msg, MAXMSGLEN, BLOCKING)) < 0) {
-	(void)fprintf (stderr, "cmdsrvsim: net_recv() error: %s, errno=%d\n",
-				NET_ERRSTR(len), errno);
-	return len;
-    }
-    else if (len == NEOF) {
-	(void)printf ("cmdsrvsim: Closing broken connection...\n");
-	net_close (cli_fd[indx]);
-	cli_fd[indx] = ERROR;
+    if ((len = net_recv (sockfd, msg, MAXMSGLEN, NON_BLOCKING)) <= 0) {
+	if (len < 0 && len != NWOULDBLOCK)
+	    (void)fprintf (stderr, "cmdsrvsim: net_recv() error: %s, errno=%d\n",
+				    NET_ERRSTR(len), errno);
 	return len;
     }
 
-    if (((MsgHdr *) msg)->msgId == CMD_TYPE) {
+    if (len >= (int) sizeof (MsgHdr) && ((MsgHdr *) msg)->msgId == CMD_TYPE) {
 
 	((CmdMsg *) msg)->cmd[MAX_CMD_LEN - 1] = '\0';
-    	(void)printf ("%s\n", ((CmdMsg *) msg)->cmd);
-	send_rsp (cli_fd[indx], ((CmdMsg *) msg)->cmd, ((CmdMsg *) msg)->hdr.seqNo);
+	if (!quiet)
+	    (void)printf ("%s\n", ((CmdMsg *) msg)->cmd);
+	if (send_rsp (sockfd, ((CmdMsg *) msg)->cmd) == NEOF)
+	    return NEOF;
     }
     else
-    	(void)fprintf (stderr, "cmdsrvsim: Invalid message received.\n");
+	(void)fprintf (stderr, "cmdsrvsim: Invalid message received.\n");
 
     return len;
 }
 
 
-int send_rsp (int sockfd, char *cmdstr, int csn)
+int send_rsp (int sockfd, char *cmdstr)
 {
     char	cmd[MAX_CMD_LEN] = "\0";
     int		status;
     RspMsg	rsp_msg;
 
+    (void) memset (&rsp_msg, 0, sizeof rsp_msg);
     rsp_msg.hdr.msgId = RSP_TYPE;
-    rsp_msg.hdr.seqNo = csn;
+    rsp_msg.hdr.srcId = LSCS_CMD_TASK;
     (void) sscanf (cmdstr, "%80s", cmd);
     (void) sprintf (rsp_msg.rsp, "%s: Completed.", cmd);
 
-    if ((status = net_send (sockfd, (char *) &rsp_msg, sizeof rsp_msg, BLOCKING)) <= 0)
+    /* non-blocking, as the socket is for receiving, so a client that
+       has stopped reading cannot hold up the others */
+
+    if ((status = net_send (sockfd, (char *) &rsp_msg, sizeof rsp_msg, NON_BLOCKING)) <= 0)
         (void)fprintf (stderr, "cmdsrvsim: net_send() error: %s, errno=%d\n",
                                 NET_ERRSTR(status), errno);
     return status;
 }
-
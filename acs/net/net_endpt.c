@@ -29,33 +29,33 @@
 
 endpt_entry net_endpt[] = {
 
-/*  endpoint     type    server       port */
+/*  endpoint     type    server       port  options */
 
-    {SGW_SRV,    TCP,    SGW_TASK,    8001},
-    {CTL_SRV,    TCP,    CTL_TASK,    8002},
-    {MON_SRV,    TCP,    MON_TASK,    8003},
-    {APP_SRV1,   TCP,    SRV1_TASK,   8004},
-    {APP_SRV2,   TCP,    SRV2_TASK,   8005},
-    {APP_SRV3,   TCP,    APP1_TASK,   8006},
-    {APP_SRV4,   TCP,    APP2_TASK,   8007},
-    {APP_SRV5,   TCP,    APP3_TASK,   8008},
-    {APP_SRV6,   TCP,    APP4_TASK,   8009},
-    {APP_SRV7,   TCP,    APP5_TASK,   8010},
-    {APP_SRV8,   TCP,    APP6_TASK,   8011},
-    {APP_SRV9,   TCP,    APP7_TASK,   8012},
-    {APP_SRV10,  TCP,    APP8_TASK,   8013},
-    {APP_SRV11,  TCP,    SRV11_TASK,  8014},
-    {APP_SRV12,  TCP,    SRV12_TASK,  8015},
-    {APP_SRV13,  TCP,    SRV13_TASK,  8016},
-    {APP_SRV14,  TCP,    SRV14_TASK,  8017},
-    {APP_SRV15,  TCP,    SRV15_TASK,  8018},
-    {APP_SRV16,  TCP,    SRV16_TASK,  8019},
-    {APP_SRV17,  TCP,    SRV17_TASK,  8020},
-    {APP_SRV18,  TCP,    SRV18_TASK,  8021},
-    {APP_SRV19,  TCP,    SRV19_TASK,  8022},
-    {APP_SRV20,  TCP,    SRV20_TASK,  8023},
+    {SGW_SRV,    TCP,    SGW_TASK,    8001, NET_OPT_DEFAULT},
+    {CTL_SRV,    TCP,    CTL_TASK,    8002, NET_OPT_DEFAULT},
+    {MON_SRV,    TCP,    MON_TASK,    8003, NET_OPT_DEFAULT},
+    {APP_SRV1,   TCP,    SRV1_TASK,   8004, NET_OPT_DEFAULT},
+    {APP_SRV2,   TCP,    SRV2_TASK,   8005, NET_OPT_DEFAULT},
+    {APP_SRV3,   TCP,    APP1_TASK,   8006, NET_OPT_DEFAULT},
+    {APP_SRV4,   TCP,    APP2_TASK,   8007, NET_OPT_DEFAULT},
+    {APP_SRV5,   TCP,    APP3_TASK,   8008, NET_OPT_DEFAULT},
+    {APP_SRV6,   TCP,    APP4_TASK,   8009, NET_OPT_DEFAULT},
+    {APP_SRV7,   TCP,    APP5_TASK,   8010, NET_OPT_DEFAULT},
+    {APP_SRV8,   TCP,    APP6_TASK,   8011, NET_OPT_DEFAULT},
+    {APP_SRV9,   TCP,    APP7_TASK,   8012, NET_OPT_DEFAULT},
+    {APP_SRV10,  TCP,    APP8_TASK,   8013, NET_OPT_DEFAULT},
+    {APP_SRV11,  TCP,    SRV11_TASK,  8014, NET_OPT_DEFAULT},
+    {APP_SRV12,  TCP,    SRV12_TASK,  8015, NET_OPT_DEFAULT},
+    {APP_SRV13,  TCP,    SRV13_TASK,  8016, NET_OPT_DEFAULT},
+    {APP_SRV14,  TCP,    SRV14_TASK,  8017, NET_OPT_DEFAULT},
+    {APP_SRV15,  TCP,    SRV15_TASK,  8018, NET_OPT_DEFAULT},
+    {APP_SRV16,  TCP,    SRV16_TASK,  8019, NET_OPT_DEFAULT},
+    {APP_SRV17,  TCP,    SRV17_TASK,  8020, NET_OPT_DEFAULT},
+    {APP_SRV18,  TCP,    SRV18_TASK,  8021, NET_OPT_DEFAULT},
+    {APP_SRV19,  TCP,    SRV19_TASK,  8022, NET_OPT_DEFAULT},
+    {APP_SRV20,  TCP,    SRV20_TASK,  8023, NET_OPT_DEFAULT},
 
-    {ANT_BRDCST, BRDCST, 0,	      8101}
+    {ANT_BRDCST, BRDCST, 0,	      8101, 0}
 };
 
 /* port numbers bound to by a client, so that a listener can
@@ -34,10 +34,18 @@
 #else
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "net_appl.h"
 #include "net.h"
 
@@ -51,10 +59,22 @@ struct msg_hdr_dcl {
     int msg_len;		/* length of user's message in bytes */
 };
 
-/* external variable declarations */
+/* send and receive flags for a call's I/O mode, which leave the
+   descriptor's own mode alone */
+
+#define NET_IO_FLAGS(mode)	((mode) == NON_BLOCKING ? MSG_DONTWAIT : 0)
+
+/* how long a call waits for the rest of a message it has started; a
+   blocking call on a descriptor set non-blocking waits as long as it takes */
 
-extern sockfd_entry net_sockfd[];
+#define NET_IO_TIMEOUT(sock, mode) \
+	((mode) == BLOCKING ? NET_WAIT_FOREVER : (sock)->timeout)
+
+static int net_recv_buffered ();
+static int net_fill_rbuf ();
+static int net_read_rest ();
 static int net_read_excess ();
+static void net_rearm_quickack ();
 
 #ifdef FUNCT_HDR
 /* ***************************************************************************
@@ -65,7 +85,13 @@ static int net_read_excess ();
 * Description:
 *	net_send() sends a message to a connected endpoint in a connection-
 *	oriented communication.  net_send() preserves message boundaries
-*	between the sender and receiver.
+*	between the sender and receiver.  The message and its header are
+*	written with a single sendmsg() call, so that a small message is
+*	not split into two segments, the second held back by Nagle's
+*	algorithm until the peer's (delayed) ACK of the first.
+*
+*	The mode applies to this call only (MSG_DONTWAIT), so calls in
+*	either mode can be mixed on a socket without changing it.
 *
 * Return Values:
 *	On success, net_send() returns the number of bytes sent.  If a
@@ -85,15 +111,19 @@ static int net_read_excess ();
 *	NBADMODE	when the mode is not a valid I/O mode.
 *
 *	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and no
-*			messages could be sent immediately.  It is
-*			possible, however, that a partial message may have
-*			been sent when this error is returned.
+*			messages could be sent immediately.  Once part of a
+*			message is sent, net_send() waits for the socket to
+*			take the rest, for up to the socket's timeout (see
+*			net_settimeout()), so this is returned with a
+*			partial message sent only if the peer has stopped
+*			reading.
 *
 *	ERROR		on a system call error, with errno containing the
 *			error indication.
 *
 * Environment Access:
-*	None.
+*	May be called from several threads on different sockets, and on
+*	one socket while another thread receives on it.
 *
 * Performance:
 *	N/A
@@ -113,18 +143,19 @@ char *msg;				/* message to be sent */
 int length;				/* message length in bytes */
 io_mode mode;				/* send I/O mode */
 {
+    sockfd_entry *sock;			/* socket's entry */
     int status;				/* return status */
     int nwritten;			/* number of bytes written */
     int nleft;				/* remaining bytes to write */
-    int ndelay;				/* number of delays before quitting */
-    char *msgptr;			/* output buffer */
+    struct iovec iov[2];		/* header and message */
+    struct msghdr out;			/* remaining output buffers */
+    struct timespec deadline = {0, 0};	/* to finish by, once started */
 
     struct msg_hdr_dcl msg_hdr = {NET_HDR_ID, 0};
 
     /* validate socket descriptor */
 
-    if (sockfd < 0 || sockfd >= NET_MAX_FD ||
-				    net_sockfd[sockfd].type == UNDEF)
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type == UNDEF)
 	return NBADFD;
 
     /* validate msg pointer */
@@ -137,56 +168,30 @@ io_mode mode;				/* send I/O mode */
     if (length < NET_MIN_MSG_LEN || length > NET_MAX_MSG_LEN)
 	return NBADLENGTH;
 
-    /* validate and set socket I/O mode */
+    /* validate I/O mode */
 
     if (mode != BLOCKING && mode != NON_BLOCKING)
 	return NBADMODE;
 
-    if ((status = net_setiomode (sockfd, mode)) < 0)
-	return status;
-
-    /* output internal message header */
+    /* output internal message header and user's message together, so
+       that a small message goes out in one segment */
 
     msg_hdr.hdr_id  = htonl (NET_HDR_ID);
     msg_hdr.msg_len = htonl (length);
-    msgptr = (char *) &msg_hdr;
-    nleft  = sizeof (msg_hdr);
-
-    while (nleft > 0) {
-
-	nwritten = write (sockfd, msgptr, nleft);
-
-	if (nwritten == ERROR) {
-	    if (errno == EINTR) {
-		errno = 0;
-		continue;
-	    }
-	    else if (errno == EWOULDBLOCK)
-		return NWOULDBLOCK;
-
-	    /* if broken pipe, return NEOF */
-	    else if (errno == EPIPE)
-		return NEOF;
-
-	    else
-		return ERROR;
-	}
-	else if (nwritten == 0)
-	    return NEOF;
 
-	/* update amount written */
+    iov[0].iov_base = (char *) &msg_hdr;
+    iov[0].iov_len  = sizeof (msg_hdr);
+    iov[1].iov_base = msg;
+    iov[1].iov_len  = length;
 
-	nleft  -= nwritten;
-	msgptr += nwritten;
-    }
-    /* output actual user's message */
-
-    ndelay = 0;
-    nleft  = length;
+    (void) memset ((char *) &out, 0, sizeof (out));
+    out.msg_iov    = iov;
+    out.msg_iovlen = 2;
+    nleft = sizeof (msg_hdr) + length;
 
     while (nleft > 0) {
 
-	nwritten = write (sockfd, msg, nleft);
+	nwritten = sendmsg (sockfd, &out, NET_IO_FLAGS(mode));
 
 	if (nwritten == ERROR) {
 	    if (errno == EINTR) {
@@ -194,16 +199,18 @@ io_mode mode;				/* send I/O mode */
 		continue;
 	    }
 	    else if (errno == EWOULDBLOCK) {
-		struct timeval delay;
 
-		delay.tv_sec  = 0;
-		delay.tv_usec = NET_MIN_USEC_DELAY;
+		/* nothing sent yet, so the caller can try again */
 
-		if (++ndelay > NET_MAX_NDELAY)
+		if (mode == NON_BLOCKING && nleft == sizeof (msg_hdr) + length)
 		    return NWOULDBLOCK;
 
-		(void) select (0, (fd_set *)0, (fd_set *)0, (fd_set *)0,
-								&delay);
+		/* else finish the message, rather than leave the
+		   connection out of sync */
+
+		if ((status = net_wait (sockfd, POLLOUT,
+			   NET_IO_TIMEOUT(sock, mode), &deadline)) < 0)
+		    return status;
 		continue;
 	    }
 
@@ -217,14 +224,23 @@ io_mode mode;				/* send I/O mode */
 	else if (nwritten == 0)
 	    return NEOF;
 
-	/* update amount written */
+	/* update amount written, skipping the buffers done with */
 
 	nleft -= nwritten;
-	msg   += nwritten;
+
+	while (out.msg_iovlen > 0 && nwritten >= (int) out.msg_iov->iov_len) {
+	    nwritten -= out.msg_iov->iov_len;
+	    out.msg_iov++;
+	    out.msg_iovlen--;
+	}
+	if (out.msg_iovlen > 0) {
+	    out.msg_iov->iov_base = (char *) out.msg_iov->iov_base + nwritten;
+	    out.msg_iov->iov_len -= nwritten;
+	}
     }
-    /* return number of bytes written */
+    /* return number of bytes of user's message written */
 
-    return (length - nleft);
+    return (length);
 }
 
 #ifdef FUNCT_HDR
@@ -239,7 +255,16 @@ io_mode mode;				/* send I/O mode */
 *	boundaries between the sender and receiver.  The received message
 *	will be placed into the array buff for up to maxlen bytes.  If the
 *	message is too long to fit in the supplied buffer, it will be
-*	truncated and the excess bytes discarded.
+*	truncated and the excess bytes discarded.  As for net_send(), the
+*	mode applies to this call only.
+*
+*	On a socket with the NET_OPT_RECVBUF option, net_recv() reads as
+*	much as is available into the socket's receive buffer and returns
+*	the first message from it, keeping the rest for later calls.  A
+*	burst of small messages then takes one read() rather than two per
+*	message.  Since the socket may no longer be readable while messages
+*	wait in the buffer, a caller that polls the socket must also check
+*	net_pending().
 *
 * Return Values:
 *	On success, net_recv() returns the number of bytes received.  If a
@@ -261,15 +286,21 @@ io_mode mode;				/* send I/O mode */
 *			sync.
 *
 *	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and no
-*			messages were available to be received.  It is
-*			possible, however, that a partial message may have
-*			been received when this error is returned.
+*			messages were available to be received.  Once part
+*			of a message is received, net_recv() waits for the
+*			rest for up to the socket's timeout (see
+*			net_settimeout()), and a partial message may have
+*			been received when this error is returned.  With a
+*			receive buffer, a partial message is kept there,
+*			and returned whole by a later call.
 *
 *	ERROR		on a system call error, with errno containing the
 *			error indication.
 *
 * Environment Access:
-*	None.
+*	May be called from several threads on different sockets, and on
+*	one socket while another thread sends on it, but not from two
+*	threads receiving on the same socket.
 *
 * Performance:
 *	N/A
@@ -289,20 +320,20 @@ char *buff;				/* buffer area to receive msg into */
 int maxlen;				/* length in bytes of buffer area */
 io_mode mode;				/* receive I/O mode */
 {
+    sockfd_entry *sock;			/* socket's entry */
     int status;				/* return status */
     int nread;				/* number of bytes read */
     int nleft;				/* remaining bytes to read */
     int nbytes;				/* number of bytes placed in buff */
     int nexcess;			/* number of excess bytes */
-    int ndelay;				/* number of delays before quitting */
     char *bufptr;			/* input buffer pointer */
     struct msg_hdr_dcl msg_hdr;		/* internal message header */
+    struct timespec deadline = {0, 0};	/* to finish by, once started */
 
 
     /* validate socket descriptor */
 
-    if (sockfd < 0 || sockfd >= NET_MAX_FD ||
-				    net_sockfd[sockfd].type == UNDEF)
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type == UNDEF)
 	return NBADFD;
 
     /* validate buff pointer */
@@ -315,13 +346,15 @@ io_mode mode;				/* receive I/O mode */
     if (maxlen < NET_MIN_MSG_LEN)
 	return NBADLENGTH;
 
-    /* validate and set socket I/O mode */
+    /* validate I/O mode */
 
     if (mode != BLOCKING && mode != NON_BLOCKING)
 	return NBADMODE;
 
-    if ((status = net_setiomode (sockfd, mode)) < 0)
-	return status;
+    /* with a receive buffer, messages are taken from that instead */
+
+    if (sock->rbuf != NULL)
+	return net_recv_buffered (sockfd, sock, buff, maxlen, mode);
 
     /* read internal message header */
 
@@ -330,16 +363,27 @@ io_mode mode;				/* receive I/O mode */
 
     while (nleft > 0) {
 
-	nread = read (sockfd, bufptr, nleft);
+	nread = recv (sockfd, bufptr, nleft, NET_IO_FLAGS(mode));
 
 	if (nread == ERROR) {
 	    if (errno == EINTR) {
 		errno = 0;
 		continue;
 	    }
-	    else if (errno == EWOULDBLOCK)
-		return NWOULDBLOCK;
+	    else if (errno == EWOULDBLOCK) {
+
+		/* nothing read yet, so the caller can try again */
 
+		if (mode == NON_BLOCKING && nleft == sizeof (msg_hdr))
+		    return NWOULDBLOCK;
+
+		/* else finish the header, rather than lose sync */
+
+		if ((status = net_wait (sockfd, POLLIN,
+			   NET_IO_TIMEOUT(sock, mode), &deadline)) < 0)
+		    return status;
+		continue;
+	    }
 	    else
 		return ERROR;
 	}
@@ -358,16 +402,277 @@ io_mode mode;				/* receive I/O mode */
 
     /* read message into user's buffer */
 
-    nbytes = 0;
-    ndelay = 0;
     if (ntohl (msg_hdr.msg_len) < maxlen)
-	nleft = ntohl (msg_hdr.msg_len);
+	nbytes = ntohl (msg_hdr.msg_len);
     else
-	nleft = maxlen;
+	nbytes = maxlen;
 
-    while (nleft > 0) {
+    if ((status = net_read_rest (sockfd, sock, buff, nbytes, mode)) < 0 ||
+							status == NEOF)
+	return (status);
+
+    /* read and discard excess bytes */
+
+    nexcess = ntohl (msg_hdr.msg_len) - maxlen;
+    if (nexcess > 0) {
+	status = net_read_excess (sockfd, sock, nexcess, mode);
+	if (status < 0)
+	    return (status);
+    }
+
+    net_rearm_quickack (sockfd, sock);
+
+    /* return number of bytes placed in user's buffer */
+
+    return (nbytes);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	int net_pending (sockfd)
+* 
+* Description:
+*	net_pending() counts the complete messages waiting in a socket's
+*	receive buffer (see NET_OPT_RECVBUF), which net_recv() will return
+*	without reading the socket.  A caller that waits for the socket to
+*	become readable must first receive these, since they may be all
+*	that has arrived.
+*
+* Return Values:
+*	net_pending() returns the number of complete messages buffered,
+*	0 if there is no receive buffer.
+*
+*	On failure, it returns:
+*
+*	NBADFD		when sockfd is not a valid socket descriptor.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+int net_pending (sockfd)
+int sockfd;				/* endpoint socket descriptor */
+{
+    sockfd_entry *entry;		/* socket's entry */
+    struct msg_hdr_dcl msg_hdr;		/* internal message header */
+    int msg_len;			/* length of its message */
+    int offset;				/* of the next message in rbuf */
+    int end;				/* of the buffered data */
+    int nmsgs;				/* number of complete messages */
+
+    if ((entry = net_getsockfd (sockfd)) == NULL || entry->type == UNDEF)
+	return NBADFD;
+
+    offset = entry->rstart;
+    end    = entry->rstart + entry->rcount;
+    nmsgs  = 0;
+
+    while (entry->rbuf != NULL && end - offset >= (int) sizeof (msg_hdr)) {
+
+	(void) memcpy ((char *) &msg_hdr, entry->rbuf + offset, sizeof (msg_hdr));
+
+	/* an out of sync header counts, for net_recv() to report */
+
+	if (ntohl (msg_hdr.hdr_id) != NET_HDR_ID ||
+				(int) ntohl (msg_hdr.msg_len) < 0) {
+	    nmsgs++;
+	    break;
+	}
+
+	/* compared before adding, so that no length can overflow offset */
+
+	msg_len = ntohl (msg_hdr.msg_len);
+	if (msg_len > end - offset - (int) sizeof (msg_hdr))
+	    break;
+
+	offset += sizeof (msg_hdr) + msg_len;
+	nmsgs++;
+    }
+    return nmsgs;
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static int net_recv_buffered (sockfd, entry, buff, maxlen, mode)
+* 
+* Description:
+*	net_recv_buffered() is net_recv() for a socket with a receive
+*	buffer.  It reads until the buffer holds a complete message, or as
+*	much of one as fits, then copies the message out of the buffer.
+*	A message bigger than the buffer is finished with direct reads.
+*
+* Return Values:
+*	As for net_recv().  When NWOULDBLOCK is returned, whatever part of
+*	a message has arrived stays buffered, so that the connection stays
+*	in sync.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	One read() per call at most while messages fit in the buffer, and
+*	none while complete messages are already buffered.
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static int net_recv_buffered (sockfd, entry, buff, maxlen, mode)
+int sockfd;				/* endpoint socket descriptor */
+sockfd_entry *entry;			/* socket's entry */
+char *buff;				/* buffer area to receive msg into */
+int maxlen;				/* length in bytes of buffer area */
+io_mode mode;				/* receive I/O mode */
+{
+    struct msg_hdr_dcl msg_hdr;		/* internal message header */
+    int msg_len;			/* length of user's message */
+    int navail;				/* bytes of it buffered */
+    int nbytes;				/* number of bytes placed in buff */
+    int nrest;				/* bytes of it still to read */
+    int status;				/* return status */
+
+    /* read until the next message is buffered, or fills the buffer */
+
+    for (;;) {
+	if (entry->rcount >= (int) sizeof (msg_hdr)) {
+
+	    (void) memcpy ((char *) &msg_hdr, entry->rbuf + entry->rstart,
+							  sizeof (msg_hdr));
+
+	    /* check message header id and length */
+
+	    if (ntohl (msg_hdr.hdr_id) != NET_HDR_ID ||
+				(int) ntohl (msg_hdr.msg_len) < 0)
+		return NSYNCERR;
+
+	    msg_len = ntohl (msg_hdr.msg_len);
+
+	    if (entry->rcount >= (int) sizeof (msg_hdr) + msg_len ||
+		entry->rcount == NET_RECVBUF_SIZE)
+		break;
+	}
+
+	if ((status = net_fill_rbuf (sockfd, entry, mode)) <= 0)
+	    return status;
+    }
+
+    /* take the header and what is buffered of the message */
+
+    entry->rstart += sizeof (msg_hdr);
+    entry->rcount -= sizeof (msg_hdr);
+
+    navail = (entry->rcount < msg_len) ? entry->rcount : msg_len;
+    nbytes = (navail < maxlen) ? navail : maxlen;
+
+    (void) memcpy (buff, entry->rbuf + entry->rstart, nbytes);
+    entry->rstart += navail;
+    entry->rcount -= navail;
+    if (entry->rcount == 0)
+	entry->rstart = 0;
+
+    /* read the rest of a message too big for the buffer directly */
+
+    nrest = msg_len - navail;
+    if (nrest > 0 && nbytes < maxlen) {
+	int ndirect = (nrest < maxlen - nbytes) ? nrest : maxlen - nbytes;
+
+	if ((status = net_read_rest (sockfd, entry, buff + nbytes, ndirect,
+						       mode)) < 0 || status == NEOF)
+	    return (status);
+
+	nbytes += ndirect;
+	nrest  -= ndirect;
+    }
+    if (nrest > 0 && (status = net_read_excess (sockfd, entry, nrest, mode)) < 0)
+	return (status);
+
+    /* a buffer no longer wanted goes once it is empty */
+
+    if (entry->rcount == 0 && !(entry->opts & NET_OPT_RECVBUF)) {
+	free (entry->rbuf);
+	entry->rbuf = NULL;
+    }
+
+    net_rearm_quickack (sockfd, entry);
+
+    return (nbytes);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static int net_fill_rbuf (sockfd, entry, mode)
+* 
+* Description:
+*	net_fill_rbuf() moves what is left in a socket's receive buffer to
+*	the start, and reads as much as will fit after it with one recv().
+*	A BLOCKING call waits until something arrives.
+*
+* Return Values:
+*	On success, net_fill_rbuf() returns the number of bytes read.  If a
+*	broken connection condition is detected, it returns NEOF.
+*
+*	On failure, it returns:
+*
+*	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and nothing was
+*			available to be received.
+*
+*	ERROR		on a system call error, with errno containing the
+*			error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static int net_fill_rbuf (sockfd, entry, mode)
+int sockfd;				/* endpoint socket descriptor */
+sockfd_entry *entry;			/* socket's entry */
+io_mode mode;				/* receive I/O mode */
+{
+    int status;				/* return status */
+    int nread;				/* number of bytes read */
+    struct timespec deadline = {0, 0};	/* unused, as waits are unbounded */
+
+    if (entry->rstart > 0) {
+	(void) memmove (entry->rbuf, entry->rbuf + entry->rstart, entry->rcount);
+	entry->rstart = 0;
+    }
 
-	nread = read (sockfd, buff, nleft);
+    for (;;) {
+	nread = recv (sockfd, entry->rbuf + entry->rcount,
+		      NET_RECVBUF_SIZE - entry->rcount, NET_IO_FLAGS(mode));
 
 	if (nread == ERROR) {
 	    if (errno == EINTR) {
@@ -375,41 +680,105 @@ io_mode mode;				/* receive I/O mode */
 		continue;
 	    }
 	    else if (errno == EWOULDBLOCK) {
-		struct timeval delay;
-
-		delay.tv_sec  = 0;
-		delay.tv_usec = NET_MIN_USEC_DELAY;
-
-		if (++ndelay > NET_MAX_NDELAY)
+		if (mode == NON_BLOCKING)
 		    return NWOULDBLOCK;
 
-		(void) select (0, (fd_set *)0, (fd_set *)0, (fd_set *)0,
-								&delay);
+		if ((status = net_wait (sockfd, POLLIN, NET_WAIT_FOREVER,
+							&deadline)) < 0)
+		    return status;
 		continue;
 	    }
+
 	    else
 		return ERROR;
 	}
 	else if (nread == 0)
 	    return NEOF;
 
-	/* update amount read */
-
-	nleft  -= nread;
-	nbytes += nread;
-	buff   += nread;
+	entry->rcount += nread;
+	return nread;
     }
-    /* read and discard excess bytes */
+}
 
-    nexcess = ntohl (msg_hdr.msg_len) - maxlen;
-    if (nexcess > 0) {
-	status = net_read_excess (sockfd, nexcess);
-	if (status < 0)
-	    return (status);
-    }
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static int net_read_rest (sockfd, entry, buff, nbytes, mode)
+* 
+* Description:
+*	net_read_rest() reads the given number of bytes of a message whose
+*	header has been read.  Having started on the message, it waits
+*	for the rest in NON_BLOCKING mode too, up to the socket's timeout,
+*	and in BLOCKING mode as long as it takes.
+*
+* Return Values:
+*	On success, net_read_rest() returns the number of bytes read.  If a
+*	broken connection condition is detected, it returns NEOF.
+*
+*	On failure, it returns:
+*
+*	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and the rest of
+*			the message did not arrive in time.
+*
+*	ERROR		on a system call error, with errno containing the
+*			error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
 
-    /* return number of bytes placed in user's buffer */
+static int net_read_rest (sockfd, entry, buff, nbytes, mode)
+int sockfd;				/* endpoint socket descriptor */
+sockfd_entry *entry;			/* socket's entry */
+char *buff;				/* buffer area to read into */
+int nbytes;				/* number of bytes to read */
+io_mode mode;				/* receive I/O mode */
+{
+    int status;				/* return status */
+    int nread;				/* number of bytes read */
+    int nleft;				/* remaining bytes to read */
+    struct timespec deadline = {0, 0};	/* to finish by */
+
+    nleft  = nbytes;
+
+    while (nleft > 0) {
+
+	nread = recv (sockfd, buff, nleft, NET_IO_FLAGS(mode));
+
+	if (nread == ERROR) {
+	    if (errno == EINTR) {
+		errno = 0;
+		continue;
+	    }
+	    else if (errno == EWOULDBLOCK) {
+		if ((status = net_wait (sockfd, POLLIN,
+			   NET_IO_TIMEOUT(entry, mode), &deadline)) < 0)
+		    return status;
+		continue;
+	    }
+	    else
+		return ERROR;
+	}
+	else if (nread == 0)
+	    return NEOF;
 
+	/* update amount read */
+
+	nleft -= nread;
+	buff  += nread;
+    }
     return (nbytes);
 }
 
@@ -417,7 +786,7 @@ io_mode mode;				/* receive I/O mode */
 /* ***************************************************************************
 *
 * Synopsis:
-*       static int net_read_excess (sockfd, nexcess)
+*       static int net_read_excess (sockfd, entry, nexcess, mode)
 * 
 * Description:
 *	net_read_excess() reads and discards excess bytes from a connected
@@ -431,8 +800,8 @@ io_mode mode;				/* receive I/O mode */
 *
 *	On failure, it returns:
 *
-*	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and no
-*			messages were available to be received.
+*	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and the excess
+*			did not arrive within the socket's timeout.
 *
 *	ERROR		on a system call error, with errno containing the
 *			error indication.
@@ -454,24 +823,26 @@ io_mode mode;				/* receive I/O mode */
 
 #define NET_BUFSIZE	4096		/* size of read buffer */
 
-static int net_read_excess (sockfd, nexcess)
+static int net_read_excess (sockfd, entry, nexcess, mode)
 int sockfd;				/* endpoint socket descriptor */
+sockfd_entry *entry;			/* socket's entry */
 int nexcess;				/* number of excess bytes to discard */
+io_mode mode;				/* receive I/O mode */
 {
+    int status;				/* return status */
     int nread;				/* number of bytes read */
     int nleft;				/* remaining bytes to read */
-    int ndelay;				/* number of delays before quitting */
     char buff[NET_BUFSIZE];		/* excess read buffer */
+    struct timespec deadline = {0, 0};	/* to finish by */
 
-    ndelay = 0;
     nleft  = nexcess;
 
     while (nleft > 0) {
 
 	/* read excess bytes in NET_BUFSIZE increments */
 
-	nread = read (sockfd, buff,
-			      (nleft > NET_BUFSIZE)? NET_BUFSIZE : nleft);
+	nread = recv (sockfd, buff, (nleft > NET_BUFSIZE)? NET_BUFSIZE : nleft,
+						       NET_IO_FLAGS(mode));
 
 	if (nread == ERROR) {
 	    if (errno == EINTR) {
@@ -479,16 +850,9 @@ int nexcess;				/* number of excess bytes to discard */
 		continue;
 	    }
 	    else if (errno == EWOULDBLOCK) {
-		struct timeval delay;
-
-		delay.tv_sec  = 0;
-		delay.tv_usec = NET_MIN_USEC_DELAY;
-
-		if (++ndelay > NET_MAX_NDELAY)
-		    return NWOULDBLOCK;
-
-		(void) select (0, (fd_set *)0, (fd_set *)0, (fd_set *)0,
-								&delay);
+		if ((status = net_wait (sockfd, POLLIN,
+			   NET_IO_TIMEOUT(entry, mode), &deadline)) < 0)
+		    return status;
 		continue;
 	    }
 	    else
@@ -504,3 +868,140 @@ int nexcess;				/* number of excess bytes to discard */
     return (nexcess - nleft);
 }
 
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static void net_rearm_quickack (sockfd, entry)
+* 
+* Description:
+*	net_rearm_quickack() turns TCP_QUICKACK back on after a message is
+*	received on a socket with the NET_OPT_QUICKACK option, since the
+*	kernel drops out of quick ACK mode by itself.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	Does nothing where TCP_QUICKACK is not available.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static void net_rearm_quickack (sockfd, entry)
+int sockfd;				/* endpoint socket descriptor */
+sockfd_entry *entry;			/* socket's entry */
+{
+#ifdef TCP_QUICKACK
+    int on = 1;				/* option flag for setsockopt() */
+
+    if (entry->opts & NET_OPT_QUICKACK)
+	(void) setsockopt (sockfd, IPPROTO_TCP, TCP_QUICKACK, (char *) &on,
+							       sizeof on);
+#endif
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       int net_wait (sockfd, events, timeout, deadline)
+* 
+* Description:
+*	net_wait() waits for a NON_BLOCKING socket to become readable
+*	(POLLIN) or writable (POLLOUT), for the rest of a message that has
+*	been started.  The first call for a message sets the deadline,
+*	timeout milliseconds on; later calls for the same message wait
+*	only for what is left of it, so the timeout bounds the whole
+*	message rather than each wait.  A timeout of NET_WAIT_FOREVER
+*	waits as long as it takes.
+*
+* Return Values:
+*	net_wait() returns SUCCESS when the socket is ready, has an error
+*	or hang up pending (which the next read() or write() reports), or
+*	the wait was interrupted by a signal.
+*
+*	On failure, it returns:
+*
+*	NWOULDBLOCK	when the deadline has passed.
+*
+*	ERROR		on a poll() call error, with errno containing the
+*			error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	Returns as soon as the socket is ready, so a message split across
+*	segments costs no more than the time between them.
+*
+* Portability:
+*	Uses poll() and CLOCK_MONOTONIC.
+*
+* Notes:
+*	The deadline is zeroed by the caller before the first call.
+* 
+*************************************************************************** */
+#endif
+
+int net_wait (sockfd, events, timeout, deadline)
+int sockfd;				/* socket descriptor */
+int events;				/* POLLIN or POLLOUT */
+int timeout;				/* ms allowed, or NET_WAIT_FOREVER */
+struct timespec *deadline;		/* to finish by; zero until set */
+{
+    struct pollfd pfd;			/* socket to wait on */
+    struct timespec now;		/* current time */
+    long msecs;				/* time left, in ms */
+    int nready;				/* poll() result */
+
+    msecs = -1;
+
+    if (timeout != NET_WAIT_FOREVER) {
+	(void) clock_gettime (CLOCK_MONOTONIC, &now);
+
+	if (deadline->tv_sec == 0 && deadline->tv_nsec == 0) {
+	    deadline->tv_sec  = now.tv_sec + timeout / 1000;
+	    deadline->tv_nsec = now.tv_nsec + (timeout % 1000) * 1000000L;
+	    if (deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	    }
+	}
+
+	/* round up, so as not to spin in the last millisecond */
+
+	msecs = (deadline->tv_sec - now.tv_sec) * 1000L +
+		(deadline->tv_nsec - now.tv_nsec + 999999L) / 1000000L;
+	if (msecs <= 0)
+	    return NWOULDBLOCK;
+    }
+
+    pfd.fd      = sockfd;
+    pfd.events  = events;
+    pfd.revents = 0;
+
+    nready = poll (&pfd, 1, (int) msecs);
+
+    if (nready == ERROR) {
+	if (errno == EINTR) {
+	    errno = 0;
+	    return (0);
+	}
+	return ERROR;
+    }
+    else if (nready == 0)
+	return NWOULDBLOCK;
+
+    return (0);
+}
@@ -0,0 +1,604 @@
+/* net_server.c -- Network Server Event Loop */
+
+/*----------------------------------------------------------------------------
+ * Copyright (c) 2022, California Institute of Technology
+ * Permission is granted to make and distribute copies of this software
+ * without fee, provided the above copyright notice and this permission notice
+ * are preserved on all copies.  All other rights reserved.  The software is
+ * provided "as is" without express or implied warranty, and no representation
+ * is made about its suitability for any purpose.
+ *
+ * Description:
+ *	This module contains an event loop for a server with many client
+ *	connections.  The server's listening socket and every connection
+ *	accepted on it are watched by one edge-triggered epoll instance, so
+ *	each wakeup costs in proportion to the sockets that are ready, not
+ *	to the number open, and there is no FD_SETSIZE limit.  The
+ *	application handles connections, messages and disconnections with
+ *	callbacks.
+ *
+ *--------------------------------------------------------------------------*/
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "net_appl.h"
+#include "net.h"
+
+#define NET_SERVER_MAX_EVENTS	64	/* events taken per epoll_wait() */
+
+/* a client connection, as registered with epoll */
+
+typedef struct net_client {
+    int sockfd;				/* connected socket descriptor */
+    int index;				/* in the server's clients[] */
+} net_client;
+
+/* a server's event loop */
+
+struct net_server {
+    int listenfd;			/* listening socket descriptor */
+    int epfd;				/* epoll instance */
+    net_server_callbacks callbacks;	/* application's handlers */
+    net_client **clients;		/* open connections */
+    int nclients;			/* number of open connections */
+    int maxclients;			/* size of clients[] */
+    volatile sig_atomic_t stopping;	/* set by net_server_stop() */
+};
+
+static void net_server_accept ();
+static int net_server_add ();
+static void net_server_service ();
+static void net_server_remove ();
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	int net_server_create (endpt, callbacks, srvp)
+*
+* Description:
+*	net_server_create() initializes a server's endpoint, as net_init()
+*	does, and an event loop for it.  net_server_run() then accepts
+*	connections on it and calls the application's callbacks:
+*
+*	on_accept	with each new connection.  It returns a negative
+*			value to refuse the connection, which is then
+*			closed.  May be NULL to accept all.
+*
+*	on_readable	when a connection has data.  It receives one
+*			message with net_recv (sockfd, ..., NON_BLOCKING)
+*			and returns net_recv()'s status.  It is called
+*			again until it returns NWOULDBLOCK, since an edge-
+*			triggered socket is not reported again until more
+*			arrives.  If it returns NEOF or an error, the
+*			connection is closed.
+*
+*	Every accepted connection is given NET_OPT_RECVBUF, whatever the
+*	endpoint's options, and on_accept must not turn it off.  One thread
+*	serves all the connections, and without the buffer a NON_BLOCKING
+*	net_recv() that has read part of a message waits for the rest, up
+*	to the socket's timeout, while the other clients wait too.  With
+*	it, a partial message stays buffered, net_recv() returns
+*	NWOULDBLOCK, and the message is finished on the connection's next
+*	edge.  Only messages longer than NET_RECVBUF_SIZE are still read
+*	with waits.
+*
+*	on_closed	just before a connection is closed, whether by the
+*			peer or after an error.  May be NULL.
+*
+*	Each is passed the server, the connection's socket descriptor and
+*	the callbacks' arg.  Responses are sent with net_send() as usual.
+*
+* Return Values:
+*	net_server_create() returns SUCCESS on success, with *srvp set to
+*	the new server.
+*
+*	On failure, it returns:
+*
+*	NBADADDR	when callbacks, on_readable or srvp is not a valid
+*			pointer.
+*
+*	Any of net_init()'s return values.
+*
+*	ERROR		on an epoll_create1() or allocation error, with
+*			errno containing the error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	Uses epoll, so is only available on Linux.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+int net_server_create (endpt, callbacks, srvp)
+char *endpt;				/* server's endpoint name */
+net_server_callbacks *callbacks;	/* application's handlers */
+net_server **srvp;			/* returned server */
+{
+    net_server *srv;			/* new server */
+    struct epoll_event event;		/* listening socket's registration */
+    int status;				/* return status */
+
+    if (callbacks == NULL || callbacks->on_readable == NULL || srvp == NULL)
+	return NBADADDR;
+
+    if ((srv = (net_server *) calloc (1, sizeof (net_server))) == NULL)
+	return ERROR;
+
+    srv->callbacks = *callbacks;
+    srv->epfd      = ERROR;
+
+    if ((srv->listenfd = net_init (endpt)) < 0) {
+	status = srv->listenfd;
+	free (srv);
+	return status;
+    }
+
+    /* the listening socket is registered with no client */
+
+    event.events   = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+
+    if ((srv->epfd = epoll_create1 (EPOLL_CLOEXEC)) == ERROR ||
+	epoll_ctl (srv->epfd, EPOLL_CTL_ADD, srv->listenfd, &event) == ERROR) {
+	net_server_destroy (srv);
+	return ERROR;
+    }
+
+    *srvp = srv;
+
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	int net_server_run (srv)
+*
+* Description:
+*	net_server_run() waits for connections and messages, and calls the
+*	server's callbacks for them, until net_server_stop() is called.
+*	Each wakeup handles every socket that is ready, up to
+*	NET_SERVER_MAX_EVENTS at a time.
+*
+*	A connection that cannot be accepted (for instance, when out of
+*	descriptors) is left until the next one arrives.
+*
+* Return Values:
+*	net_server_run() returns SUCCESS once stopped.
+*
+*	On failure, it returns:
+*
+*	NBADADDR	when srv is not a valid pointer.
+*
+*	ERROR		on an epoll_wait() call error, with errno
+*			containing the error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	O(ready sockets) per wakeup, however many are open.
+*
+* Portability:
+*	Linux only.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+int net_server_run (srv)
+net_server *srv;			/* server to run */
+{
+    struct epoll_event events[NET_SERVER_MAX_EVENTS];
+    int nready;				/* number of sockets ready */
+    int i;
+
+    if (srv == NULL)
+	return NBADADDR;
+
+    srv->stopping = 0;
+
+    while (!srv->stopping) {
+
+	nready = epoll_wait (srv->epfd, events, NET_SERVER_MAX_EVENTS, -1);
+
+	if (nready == ERROR) {
+	    if (errno == EINTR) {
+		errno = 0;
+		continue;
+	    }
+	    return ERROR;
+	}
+
+	/* a client is only ever removed while its own event is handled,
+	   so the rest of the events stay valid */
+
+	for (i = 0; i < nready; i++) {
+	    if (events[i].data.ptr == NULL)
+		net_server_accept (srv);
+	    else
+		net_server_service (srv, (net_client *) events[i].data.ptr);
+	}
+    }
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	void net_server_stop (srv)
+*
+* Description:
+*	net_server_stop() makes net_server_run() return once it has handled
+*	the sockets that are ready.  It is meant to be called from a
+*	callback, or from a signal handler, whose signal also interrupts
+*	the wait.  The connections stay open, and net_server_run() can be
+*	called again.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	Async-signal-safe.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+void net_server_stop (srv)
+net_server *srv;			/* server to stop */
+{
+    if (srv != NULL)
+	srv->stopping = 1;
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	int net_server_nclients (srv)
+*
+* Description:
+*	net_server_nclients() counts a server's open connections.
+*
+* Return Values:
+*	net_server_nclients() returns the number of open connections.
+*
+*	On failure, it returns:
+*
+*	NBADADDR	when srv is not a valid pointer.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+int net_server_nclients (srv)
+net_server *srv;			/* server */
+{
+    if (srv == NULL)
+	return NBADADDR;
+
+    return srv->nclients;
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*	void net_server_destroy (srv)
+*
+* Description:
+*	net_server_destroy() closes a server's connections, calling
+*	on_closed for each, and its listening socket, and frees it.  It
+*	must not be called while net_server_run() is running.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+void net_server_destroy (srv)
+net_server *srv;			/* server to destroy */
+{
+    if (srv == NULL)
+	return;
+
+    while (srv->nclients > 0)
+	net_server_remove (srv, srv->clients[srv->nclients - 1]);
+
+    if (srv->epfd != ERROR)
+	(void) close (srv->epfd);
+
+    (void) net_close (srv->listenfd);
+
+    free (srv->clients);
+    free (srv);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static void net_server_accept (srv)
+*
+* Description:
+*	net_server_accept() accepts every connection waiting on the
+*	server's listening socket, since an edge-triggered socket is not
+*	reported again for those already queued, and adds those the
+*	application takes to the event loop.  Each is given a receive
+*	buffer (NET_OPT_RECVBUF) on top of the endpoint's options.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+static void net_server_accept (srv)
+net_server *srv;			/* server */
+{
+    sockfd_entry *sock;			/* accepted socket's entry */
+    int sockfd;				/* accepted socket descriptor */
+
+    for (;;) {
+	sockfd = net_accept (srv->listenfd, NON_BLOCKING);
+
+	if (sockfd == NWOULDBLOCK)
+	    return;
+
+	else if (sockfd < 0) {
+
+	    /* a connection reset before it was accepted is just skipped */
+
+	    if (errno == ECONNABORTED || errno == EINTR)
+		continue;
+	    return;
+	}
+
+	/* a partial message must wait in the buffer for the next edge,
+	   not hold up every other client in net_recv() */
+
+	if ((sock = net_getsockfd (sockfd)) == NULL ||
+	    net_setsockopts (sockfd, sock->opts | NET_OPT_RECVBUF) != 0) {
+	    (void) net_close (sockfd);
+	    continue;
+	}
+
+	if (srv->callbacks.on_accept != NULL &&
+	    srv->callbacks.on_accept (srv, sockfd, srv->callbacks.arg) < 0) {
+	    (void) net_close (sockfd);
+	    continue;
+	}
+
+	if (net_server_add (srv, sockfd) == ERROR) {
+	    if (srv->callbacks.on_closed != NULL)
+		srv->callbacks.on_closed (srv, sockfd, srv->callbacks.arg);
+	    (void) net_close (sockfd);
+	}
+    }
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static int net_server_add (srv, sockfd)
+*
+* Description:
+*	net_server_add() registers an accepted connection with the
+*	server's epoll instance, for input edges and the peer's hang up.
+*	A message that arrived before it was registered is reported at
+*	once.
+*
+* Return Values:
+*	net_server_add() returns SUCCESS on success, and ERROR on an
+*	allocation or epoll_ctl() error, with errno containing the error
+*	indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+static int net_server_add (srv, sockfd)
+net_server *srv;			/* server */
+int sockfd;				/* accepted socket descriptor */
+{
+    net_client *client;			/* new client */
+    net_client **clients;		/* resized client list */
+    struct epoll_event event;		/* client's registration */
+
+    if (srv->nclients == srv->maxclients) {
+	int maxclients = (srv->maxclients > 0) ? 2 * srv->maxclients : 64;
+
+	clients = (net_client **) realloc (srv->clients,
+					   maxclients * sizeof (net_client *));
+	if (clients == NULL)
+	    return ERROR;
+
+	srv->clients    = clients;
+	srv->maxclients = maxclients;
+    }
+
+    if ((client = (net_client *) malloc (sizeof (net_client))) == NULL)
+	return ERROR;
+
+    client->sockfd = sockfd;
+    client->index  = srv->nclients;
+
+    event.events   = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = client;
+
+    if (epoll_ctl (srv->epfd, EPOLL_CTL_ADD, sockfd, &event) == ERROR) {
+	free (client);
+	return ERROR;
+    }
+
+    srv->clients[srv->nclients++] = client;
+
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static void net_server_service (srv, client)
+*
+* Description:
+*	net_server_service() calls on_readable for a connection until it
+*	has taken everything that has arrived, then closes the connection
+*	if the peer has gone or receiving failed.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	Messages already in a receive buffer (see NET_OPT_RECVBUF) are
+*	taken too, since net_recv() returns those before NWOULDBLOCK.
+*
+*************************************************************************** */
+#endif
+
+static void net_server_service (srv, client)
+net_server *srv;			/* server */
+net_client *client;			/* client with input */
+{
+    int status;				/* on_readable()'s net_recv() status */
+
+    do {
+	status = srv->callbacks.on_readable (srv, client->sockfd,
+					     srv->callbacks.arg);
+    } while (status > 0);
+
+    if (status != NWOULDBLOCK)
+	net_server_remove (srv, client);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static void net_server_remove (srv, client)
+*
+* Description:
+*	net_server_remove() calls on_closed for a connection, closes it,
+*	which also removes it from the epoll instance, and drops it from
+*	the server's list of clients.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	O(1); the last client in the list takes the removed one's place.
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+*
+*************************************************************************** */
+#endif
+
+static void net_server_remove (srv, client)
+net_server *srv;			/* server */
+net_client *client;			/* client to remove */
+{
+    net_client *last;			/* client moved into its place */
+
+    if (srv->callbacks.on_closed != NULL)
+	srv->callbacks.on_closed (srv, client->sockfd, srv->callbacks.arg);
+
+    (void) net_close (client->sockfd);
+
+    last = srv->clients[--srv->nclients];
+    last->index = client->index;
+    srv->clients[client->index] = last;
+
+    free (client);
+}
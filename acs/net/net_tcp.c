@@ -47,7 +47,9 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h> 
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
 #include <signal.h>
@@ -56,12 +58,21 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "net_appl.h"
 #include "net.h"
 
 /* global variable definitions */
 
-sockfd_entry net_sockfd[NET_MAX_FD] = { {UNDEF, BLOCKING} };
+/* the socket descriptor table, in chunks of NET_FD_CHUNK entries, each
+   allocated when a descriptor in its range is first opened and kept */
+
+static sockfd_entry *net_sockfd[NET_MAX_FD / NET_FD_CHUNK];
+
+static endpt_entry *net_findendpt ();
+static sockfd_entry *net_newsockfd ();
+static void net_freesockfd ();
+static int net_applyopts ();
 
 #ifdef FUNCT_HDR
 /* ***************************************************************************
@@ -95,15 +106,58 @@ sockfd_entry net_sockfd[NET_MAX_FD] = { {UNDEF, BLOCKING} };
 int net_getservport (endpt, type)
 char *endpt;				/* server's endpoint name */
 endpt_type type;			/* server's endpoint type */
+{
+    endpt_entry *entry;			/* server's endpoint entry */
+
+    if ((entry = net_findendpt (endpt, type)) == NULL)
+	return ERROR;
+
+    return entry->port;
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static endpt_entry *net_findendpt (endpt, type)
+* 
+* Description:
+*	net_findendpt() looks up a server's endpoint entry by name.
+*
+* Return Values:
+*	net_findendpt() returns a pointer to the endpoint entry on success,
+*	and NULL if the endpoint name could not be found.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static endpt_entry *net_findendpt (endpt, type)
+char *endpt;				/* server's endpoint name */
+endpt_type type;			/* server's endpoint type */
 {
     int i;				/* loop index */
 
+    if (endpt == NULL)
+	return NULL;
+
     for (i = 0; i < NET_MAX_ENDPTS; i++) {
 	if ((net_endpt[i].type == type) &&
 				(strcmp (net_endpt[i].name, endpt) == 0))
-	    return net_endpt[i].port;
+	    return &net_endpt[i];
     }
-    return ERROR;
+    return NULL;
 }
 
 #ifdef FUNCT_HDR
@@ -153,7 +207,8 @@ int net_init (endpt)
 char *endpt;				/* server's endpoint name */
 {
     struct sockaddr_in server;		/* server's socket address */
-    int	port;				/* server's port number */
+    endpt_entry *entry;			/* server's endpoint entry */
+    sockfd_entry *sock;			/* listen socket's entry */
     int listenfd;			/* server's listen socket */
 
     /* initialize server's address */
@@ -164,10 +219,10 @@ char *endpt;				/* server's endpoint name */
 
     /* get port number associated with endpoint name */
 
-    if (endpt == NULL || (port = net_getservport (endpt, TCP)) == ERROR)
+    if ((entry = net_findendpt (endpt, TCP)) == NULL)
 	return NBADENDPT;
     else
-	server.sin_port = htons (port);
+	server.sin_port = htons (entry->port);
 
     /* create listening socket and bind to local address */
 
@@ -175,16 +230,19 @@ char *endpt;				/* server's endpoint name */
 	return ERROR;
 
     if (bind (listenfd, (struct sockaddr *) &server,
-					    sizeof (server)) == ERROR) {
+					    sizeof (server)) == ERROR ||
+	(sock = net_newsockfd (listenfd)) == NULL) {
 	(void) close (listenfd);
 	return ERROR;
     }
-    /* listen for connection requests */
+    /* listen for connection requests, from many clients at once */
 
-    (void) listen (listenfd, 5);
+    (void) listen (listenfd, NET_LISTEN_BACKLOG);
 
-    net_sockfd[listenfd].type = TCP;
-    net_sockfd[listenfd].mode = BLOCKING;
+    /* accepted connections take the endpoint's options, as they are now */
+
+    sock->opts = entry->opts;
+    sock->type = TCP;
 
     return listenfd;
 }
@@ -199,7 +257,9 @@ char *endpt;				/* server's endpoint name */
 *	net_accept() accepts a connection request from and establishes a
 *	full-duplex TCP connection with a client process that issued a
 *	net_connect() call to connect to a server.  The server must have
-*	previously called net_init() prior to calling net_accept().
+*	previously called net_init() prior to calling net_accept().  The
+*	connection takes the latency options the endpoint had at
+*	net_init() (see net_setendptopts()).
 *
 * Return Values:
 *	On success, net_accept() returns a file descriptor for the
@@ -239,16 +299,17 @@ int listenfd;				/* listen socket descriptor */
 io_mode mode;				/* listen socket I/O mode */
 {
     int sockfd;				/* connected socket descriptor */
+    sockfd_entry *listener;		/* listen socket's entry */
+    sockfd_entry *sock;			/* connected socket's entry */
     struct sockaddr_in	client;		/* client's socket address */
     socklen_t client_len;		/* length of client's address */
     int status;				/* return status */
-    int on = 1;				/* option flag for setsockopt() */
     struct linger off = {1, 0};		/* linger flag for setsockopt() */
 
     /* validate socket descriptor and I/O mode */
 
-    if (listenfd < 0 || listenfd >= NET_MAX_FD ||
-					net_sockfd[listenfd].type == UNDEF)
+    if ((listener = net_getsockfd (listenfd)) == NULL ||
+					listener->type == UNDEF)
 	return NBADFD;
 
     if (mode != BLOCKING && mode != NON_BLOCKING)
@@ -275,21 +336,22 @@ io_mode mode;				/* listen socket I/O mode */
     /* set option to not linger */
 
     if (setsockopt (sockfd, SOL_SOCKET, SO_LINGER, (char *) &off,
-						   sizeof off) == ERROR) {
+						   sizeof off) == ERROR ||
+	(sock = net_newsockfd (sockfd)) == NULL) {
 	(void) close (sockfd);
 	return ERROR;
     }
 
-    /* set option to not delay-send */
+    /* set the listening endpoint's latency options */
 
-    if (setsockopt (sockfd, IPPROTO_TCP, TCP_NODELAY, (char *) &on,
-						      sizeof on) == ERROR) {
+    if (net_applyopts (sockfd, sock, listener->opts) == ERROR) {
+	net_freesockfd (sock);
 	(void) close (sockfd);
 	return ERROR;
     }
 
-    net_sockfd[sockfd].type = TCP;
-    net_sockfd[sockfd].mode = BLOCKING;
+    sock->timeout = listener->timeout;
+    sock->type    = TCP;
 
     /* ignore broken pipe signals */
 
@@ -309,7 +371,8 @@ io_mode mode;				/* listen socket I/O mode */
 *	process and is called by a client process to establish a
 *	connection with a server.  Once the connection request is accepted
 *	by a server calling net_accept(), messages can be exchanged over
-*	the established connection.
+*	the established connection.  The connection takes the endpoint's
+*	latency options (see net_setendptopts()).
 *
 * Return Values:
 *	On success, net_connect() returns a file descriptor for the
@@ -327,7 +390,8 @@ io_mode mode;				/* listen socket I/O mode */
 *	NBADMODE	when the mode is not a valid I/O mode.
 *
 *	NWOULDBLOCK	when the I/O mode is NON_BLOCKING and the
-*			connection cannot be completed immediately.
+*			connection is not completed within
+*			NET_DEFAULT_TIMEOUT milliseconds.
 *
 *	ERROR		on a system call error, with errno containing the
 *			error indication.
@@ -356,10 +420,12 @@ io_mode mode;				/* I/O mode of connection attempt */
 {
     struct sockaddr_in client;		/* client's socket address */
     struct sockaddr_in server;		/* server's socket address */
-    int	port;				/* server's port number */
+    endpt_entry *entry;			/* server's endpoint entry */
+    sockfd_entry *sock;			/* connected socket's entry */
     struct hostent *hostp;		/* server's host entry pointer */
     int sockfd;				/* connecting socket descriptor */
-    int ndelay = 0;			/* number of delays before quitting */
+    int status;				/* return status */
+    struct timespec deadline = {0, 0};	/* to be connected by */
     int on = 1;				/* option flag for setsockopt() */
 
     /* initialize server's address */
@@ -369,10 +435,10 @@ io_mode mode;				/* I/O mode of connection attempt */
 
     /* get port number associated with endpoint name */
 
-    if (endpt == NULL || (port = net_getservport (endpt, TCP)) == ERROR)
+    if ((entry = net_findendpt (endpt, TCP)) == NULL)
 	return NBADENDPT;
     else
-	server.sin_port = htons (port);
+	server.sin_port = htons (entry->port);
 
     /* get server's host address */
 
@@ -434,18 +500,14 @@ again:
 					     sizeof (server)) == ERROR) {
 
 	if (errno == EINPROGRESS || errno == EALREADY) {
-	    /* try to complete connection for non-blocking socket only */
+	    /* try to complete connection for non-blocking socket only,
+	       until it is writable; connect() then gives the outcome */
 
-	    struct timeval delay;
-
-	    delay.tv_sec  = 0;
-	    delay.tv_usec = NET_MIN_USEC_DELAY;
-
-	    if (++ndelay > NET_MAX_NDELAY) {
+	    if ((status = net_wait (sockfd, POLLOUT, NET_DEFAULT_TIMEOUT,
+						       &deadline)) < 0) {
 		(void) close (sockfd);
-		return NWOULDBLOCK;
+		return status;
 	    }
-	    (void) select (0, (fd_set *)0, (fd_set *)0, (fd_set *)0, &delay);
 	    goto again;
 	}
 	else if (errno != EISCONN) {
@@ -454,8 +516,21 @@ again:
 	}
     }
 
-    net_sockfd[sockfd].type = TCP;
-    net_sockfd[sockfd].mode = mode;
+    /* set the endpoint's latency options */
+
+    if ((sock = net_newsockfd (sockfd)) == NULL) {
+	(void) close (sockfd);
+	return ERROR;
+    }
+
+    if (net_applyopts (sockfd, sock, entry->opts) == ERROR) {
+	net_freesockfd (sock);
+	(void) close (sockfd);
+	return ERROR;
+    }
+
+    sock->mode = mode;
+    sock->type = TCP;
 
     /* ignore broken pipe signals */
 
@@ -503,18 +578,22 @@ again:
 int net_close (sockfd)
 int sockfd;				/* socket descriptor to be closed */
 {
+    sockfd_entry *sock;			/* socket's entry */
+
     /* validate socket descriptor */
 
-    if (sockfd < 0 || sockfd >= NET_MAX_FD ||
-				net_sockfd[sockfd].type == UNDEF)
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type == UNDEF)
 	return NBADFD;
 
+    /* free the entry first, since once the descriptor is closed another
+       thread may be given it; anything still buffered is lost with the
+       connection */
+
+    net_freesockfd (sock);
+
     if (close (sockfd) == ERROR)
 	return ERROR;
 
-    net_sockfd[sockfd].type = UNDEF;
-    net_sockfd[sockfd].mode = BLOCKING;
-
     return (0);
 }
 
@@ -572,12 +651,12 @@ int namelen;				/* hostname length in bytes */
     struct sockaddr_in peer;		/* peer's socket address */
     socklen_t peer_len = sizeof (peer);	/* length of peer's address */
     struct hostent *hostp;		/* peer's host entry pointer */
+    sockfd_entry *sock;			/* socket's entry */
     int i;				/* loop index */
 
     /* validate socket descriptor */
 
-    if (sockfd < 0 || sockfd >= NET_MAX_FD ||
-				net_sockfd[sockfd].type != TCP)
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type != TCP)
 	return NBADFD;
 
     /* validate name pointers */
@@ -637,7 +716,10 @@ int namelen;				/* hostname length in bytes */
 * 
 * Description:
 *	net_setiomode() sets the I/O mode of the supplied socket descriptor.
-*	Mode can be either BLOCKING or NON_BLOCKING.
+*	Mode can be either BLOCKING or NON_BLOCKING.  net_accept() uses it
+*	for the listening socket; net_send() and net_recv() do not need it,
+*	as they take their mode per call, and a BLOCKING call on a
+*	NON_BLOCKING descriptor waits all the same.
 *
 * Return Values:
 *	net_setiomode() returns SUCCESS on success.
@@ -668,15 +750,16 @@ int net_setiomode (sockfd, mode)
 int sockfd;				/* socket descriptor */
 io_mode mode;				/* socket I/O mode */
 {
+    sockfd_entry *sock;			/* socket's entry */
     int on  = 1;			/* on/off flags for ioctl() */
     int off = 0;
 
-    if (net_sockfd[sockfd].type == UNDEF)
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type == UNDEF)
 	return NBADFD;
 
     /* change socket I/O mode if different */
 
-    if (net_sockfd[sockfd].mode != mode ) {
+    if (sock->mode != mode ) {
 
 	if (mode == NON_BLOCKING) {
 
@@ -691,8 +774,423 @@ io_mode mode;				/* socket I/O mode */
 	    if (ioctl (sockfd, FIONBIO, (char *) &off) == ERROR)
 		return ERROR;
 	}
-	net_sockfd[sockfd].mode = mode;
+	sock->mode = mode;
     }
     return (0);
 }
 
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       int net_setendptopts (endpt, opts)
+* 
+* Description:
+*	net_setendptopts() sets the latency and receive options of a
+*	server's endpoint:
+*	any combination of
+*
+*	NET_OPT_NODELAY		send each message at once, rather than
+*				holding small ones back (Nagle) until
+*				earlier data is acknowledged.
+*
+*	NET_OPT_QUICKACK	acknowledge received data at once, rather
+*				than delaying the ACK in the hope of sending
+*				it with a reply.
+*
+*	NET_OPT_LOWDELAY	mark packets low delay in the IP TOS field.
+*
+*	NET_OPT_RECVBUF		read ahead into a receive buffer, so that
+*				net_recv() can take several messages from
+*				one read() (see net_pending()).
+*
+*	Endpoints start with NET_OPT_DEFAULT.  The options apply to sockets
+*	from later net_init(), net_connect() and net_accept() calls for the
+*	endpoint; sockets already open keep theirs, but can be changed with
+*	net_setsockopts().  Both ends set their own.
+*
+* Return Values:
+*	net_setendptopts() returns SUCCESS on success.
+*
+*	On failure, it returns:
+*
+*	NBADENDPT	when the endpoint name is not a valid endpoint.
+*
+* Environment Access:
+*	Modifies the endpoint table, so is not to be called while another
+*	task may be opening connections.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+int net_setendptopts (endpt, opts)
+char *endpt;				/* server's endpoint name */
+int opts;				/* NET_OPT_* latency options */
+{
+    endpt_entry *entry;			/* server's endpoint entry */
+
+    if ((entry = net_findendpt (endpt, TCP)) == NULL)
+	return NBADENDPT;
+
+    entry->opts = opts;
+
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       int net_setsockopts (sockfd, opts)
+* 
+* Description:
+*	net_setsockopts() sets the latency options, as for
+*	net_setendptopts(), of a connected socket.  Options not given are
+*	turned off.
+*
+* Return Values:
+*	net_setsockopts() returns SUCCESS on success.
+*
+*	On failure, it returns:
+*
+*	NBADFD		when sockfd is not a valid socket descriptor.
+*
+*	ERROR		on a setsockopt() call error, with errno containing
+*			the error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+int net_setsockopts (sockfd, opts)
+int sockfd;				/* connected socket descriptor */
+int opts;				/* NET_OPT_* latency options */
+{
+    sockfd_entry *sock;			/* socket's entry */
+
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type != TCP)
+	return NBADFD;
+
+    return net_applyopts (sockfd, sock, opts);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       int net_settimeout (sockfd, msecs)
+* 
+* Description:
+*	net_settimeout() sets how long, in milliseconds, NON_BLOCKING
+*	net_send() and net_recv() calls on a socket wait for the rest of a
+*	message they have started on, before giving up with NWOULDBLOCK.
+*	The time is for the whole message, however many segments it comes
+*	in, and each segment is taken as soon as the socket is ready.  With
+*	NET_WAIT_FOREVER they wait as long as it takes.
+*
+*	Sockets start with NET_DEFAULT_TIMEOUT; sockets from net_accept()
+*	take the listening socket's.
+*
+* Return Values:
+*	net_settimeout() returns SUCCESS on success.
+*
+*	On failure, it returns:
+*
+*	NBADFD		when sockfd is not a valid socket descriptor.
+*
+*	NBADLENGTH	when msecs is neither positive nor
+*			NET_WAIT_FOREVER.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	A call that gives up part way through a message leaves the
+*	connection out of sync, so the timeout is best kept well above the
+*	time a message takes to arrive.
+* 
+*************************************************************************** */
+#endif
+
+int net_settimeout (sockfd, msecs)
+int sockfd;				/* socket descriptor */
+int msecs;				/* timeout, or NET_WAIT_FOREVER */
+{
+    sockfd_entry *sock;			/* socket's entry */
+
+    if ((sock = net_getsockfd (sockfd)) == NULL || sock->type != TCP)
+	return NBADFD;
+
+    if (msecs <= 0 && msecs != NET_WAIT_FOREVER)
+	return NBADLENGTH;
+
+    sock->timeout = msecs;
+
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static int net_applyopts (sockfd, sock, opts)
+* 
+* Description:
+*	net_applyopts() sets the socket options for a set of latency
+*	options, and records them for net_recv() to re-arm TCP_QUICKACK,
+*	which the kernel turns off again by itself.  It also allocates the
+*	receive buffer for NET_OPT_RECVBUF; one no longer wanted is freed
+*	by net_recv() once it has been emptied.
+*
+* Return Values:
+*	net_applyopts() returns SUCCESS on success, and ERROR on a
+*	setsockopt() call or allocation error, with errno containing the
+*	error indication.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	TCP_QUICKACK is Linux only, and is skipped elsewhere.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static int net_applyopts (sockfd, sock, opts)
+int sockfd;				/* socket descriptor */
+sockfd_entry *sock;			/* socket's entry */
+int opts;				/* NET_OPT_* latency options */
+{
+    int flag;				/* option flag for setsockopt() */
+
+    flag = (opts & NET_OPT_NODELAY) ? 1 : 0;
+    if (setsockopt (sockfd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag,
+						      sizeof flag) == ERROR)
+	return ERROR;
+
+#ifdef TCP_QUICKACK
+    flag = (opts & NET_OPT_QUICKACK) ? 1 : 0;
+    if (setsockopt (sockfd, IPPROTO_TCP, TCP_QUICKACK, (char *) &flag,
+						       sizeof flag) == ERROR)
+	return ERROR;
+#endif
+
+#ifdef IPTOS_LOWDELAY
+    flag = (opts & NET_OPT_LOWDELAY) ? IPTOS_LOWDELAY : 0;
+    if (setsockopt (sockfd, IPPROTO_IP, IP_TOS, (char *) &flag,
+						 sizeof flag) == ERROR)
+	return ERROR;
+#endif
+
+    if ((opts & NET_OPT_RECVBUF) && sock->rbuf == NULL) {
+
+	if ((sock->rbuf = malloc (NET_RECVBUF_SIZE)) == NULL)
+	    return ERROR;
+
+	sock->rstart = 0;
+	sock->rcount = 0;
+    }
+    else if (!(opts & NET_OPT_RECVBUF) && sock->rbuf != NULL &&
+					  sock->rcount == 0) {
+	free (sock->rbuf);
+	sock->rbuf = NULL;
+    }
+
+    sock->opts = opts;
+
+    return (0);
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       sockfd_entry *net_getsockfd (sockfd)
+* 
+* Description:
+*	net_getsockfd() looks up a socket descriptor's entry in the socket
+*	descriptor table.  The entry's type is UNDEF unless the descriptor
+*	is open through the net services.
+*
+* Return Values:
+*	net_getsockfd() returns a pointer to the entry, or NULL if no
+*	descriptor in its range has been opened, or it is out of range.
+*
+* Environment Access:
+*	Reads the socket descriptor table without locking; chunks are
+*	only ever added.
+*
+* Performance:
+*	Two array lookups.
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+sockfd_entry *net_getsockfd (sockfd)
+int sockfd;				/* socket descriptor */
+{
+    sockfd_entry *chunk;		/* chunk holding its entry */
+
+    if (sockfd < 0 || sockfd >= NET_MAX_FD)
+	return NULL;
+
+    chunk = __atomic_load_n (&net_sockfd[sockfd / NET_FD_CHUNK],
+							__ATOMIC_ACQUIRE);
+    if (chunk == NULL)
+	return NULL;
+
+    return &chunk[sockfd % NET_FD_CHUNK];
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static sockfd_entry *net_newsockfd (sockfd)
+* 
+* Description:
+*	net_newsockfd() returns the entry for a newly opened socket
+*	descriptor, first allocating the chunk of the table that holds it
+*	if need be.  The entry is set to the defaults; the caller sets its
+*	type last, once the rest is filled in.
+*
+* Return Values:
+*	net_newsockfd() returns a pointer to the entry on success, and NULL
+*	with errno set to EMFILE if the descriptor is beyond NET_MAX_FD, or
+*	ENOMEM if the chunk cannot be allocated.
+*
+* Environment Access:
+*	Adds chunks to the socket descriptor table with an atomic compare
+*	and swap, so that threads opening sockets at once need no lock; a
+*	thread that loses the race frees its chunk and uses the winner's.
+*
+* Performance:
+*	One allocation per NET_FD_CHUNK descriptors.
+*
+* Portability:
+*	Uses the GCC __atomic builtins.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static sockfd_entry *net_newsockfd (sockfd)
+int sockfd;				/* newly opened socket descriptor */
+{
+    sockfd_entry *chunk;		/* chunk allocated for it */
+    sockfd_entry *expected = NULL;	/* for the compare and swap */
+    sockfd_entry *sock;			/* its entry */
+    int i;				/* loop index */
+
+    if (sockfd < 0 || sockfd >= NET_MAX_FD) {
+	errno = EMFILE;
+	return NULL;
+    }
+
+    if ((sock = net_getsockfd (sockfd)) == NULL) {
+
+	if ((chunk = (sockfd_entry *) calloc (NET_FD_CHUNK,
+					      sizeof (sockfd_entry))) == NULL) {
+	    errno = ENOMEM;
+	    return NULL;
+	}
+	for (i = 0; i < NET_FD_CHUNK; i++)
+	    net_freesockfd (&chunk[i]);
+
+	if (!__atomic_compare_exchange_n (&net_sockfd[sockfd / NET_FD_CHUNK],
+					  &expected, chunk, 0,
+					  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	    free (chunk);
+
+	sock = net_getsockfd (sockfd);
+    }
+
+    net_freesockfd (sock);
+
+    return sock;
+}
+
+#ifdef FUNCT_HDR
+/* ***************************************************************************
+*
+* Synopsis:
+*       static void net_freesockfd (sock)
+* 
+* Description:
+*	net_freesockfd() frees a socket's receive buffer, if any, and sets
+*	its entry back to the defaults, with type UNDEF.
+*
+* Return Values:
+*	None.
+*
+* Environment Access:
+*	None.
+*
+* Performance:
+*	N/A
+*
+* Portability:
+*	None.
+*
+* Notes:
+*	None.
+* 
+*************************************************************************** */
+#endif
+
+static void net_freesockfd (sock)
+sockfd_entry *sock;			/* socket's entry */
+{
+    sock->type = UNDEF;
+
+    if (sock->rbuf != NULL)
+	free (sock->rbuf);
+
+    sock->mode    = BLOCKING;
+    sock->opts    = 0;
+    sock->rbuf    = NULL;
+    sock->rstart  = 0;
+    sock->rcount  = 0;
+    sock->timeout = NET_DEFAULT_TIMEOUT;
+}
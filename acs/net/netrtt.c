@@ -0,0 +1,250 @@
+/**
+ *****************************************************************************
+ *
+ * @file netrtt.c
+ *	Net Services Round Trip Time Benchmark.
+ *
+ *	Times net_send()/net_recv() request/response round trips over a
+ *	net_connect()/net_accept() connection, as a command client and
+ *	server exchange them.  Run a server with -S, then a client against
+ *	it:
+ *
+ *	    netrtt -S &
+ *	    netrtt -h localhost -n 1000 -l 128
+ *
+ *	To compare with how messages used to go out, give both ends -2,
+ *	which sends the header and the message with two write() calls, and
+ *	-O none, which turns TCP_NODELAY off as net_connect() used to
+ *	leave it.  The write-write-read pattern then waits on the peer's
+ *	delayed ACK, typically 40 ms a round trip on Linux.
+ *
+ *	With -p, each round trip is a burst of requests sent back to back,
+ *	then their responses, as when commands are pipelined, which is
+ *	where -O recvbuf saves receive calls.
+ *
+ * @par Project
+ *	TMT Primary Mirror Control System (M1CS)
+ *	Jet Propulsion Laboratory, Pasadena, CA
+ *
+ * Copyright (c) 2015-2022, California Institute of Technology
+ *
+ *****************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "net_glc.h"
+
+#define NET_HDR_ID	0x3c54543e	/* as net_io.c frames messages */
+#define MAXMSGLEN	65536
+#define MAXSAMPLES	1000000
+
+bool split = false;			/* send as two write()s, as net_send() used to */
+
+
+/* send a message as net_send() does, or as it used to */
+
+int send_msg (int sockfd, char *msg, int len)
+{
+    uint32_t hdr[2];
+
+    if (!split)
+	return net_send (sockfd, msg, len, BLOCKING);
+
+    hdr[0] = htonl (NET_HDR_ID);
+    hdr[1] = htonl (len);
+
+    if (write (sockfd, hdr, sizeof hdr) != sizeof hdr ||
+	write (sockfd, msg, len) != len)
+	return ERROR;
+
+    return len;
+}
+
+
+/* parse a latency option list, e.g. "nodelay,quickack", or "none" */
+
+int parse_opts (char *list)
+{
+    int   opts = 0;
+    char *opt;
+
+    for (opt = strtok (list, ","); opt != NULL; opt = strtok (NULL, ",")) {
+	if      (!strcmp (opt, "nodelay"))   opts |= NET_OPT_NODELAY;
+	else if (!strcmp (opt, "quickack"))  opts |= NET_OPT_QUICKACK;
+	else if (!strcmp (opt, "lowdelay"))  opts |= NET_OPT_LOWDELAY;
+	else if (!strcmp (opt, "recvbuf"))   opts |= NET_OPT_RECVBUF;
+	else if (strcmp (opt, "none")) {
+	    (void)fprintf (stderr, "netrtt: Unknown option %s\n", opt);
+	    exit (1);
+	}
+    }
+    return opts;
+}
+
+
+/* echo every message back to the client, until it disconnects */
+
+void serve (char *server)
+{
+    static char msg[MAXMSGLEN];
+    int  listenfd;
+    int  sockfd;
+    int  len;
+
+    if ((listenfd = net_init (server)) < 0) {
+	(void)fprintf (stderr, "netrtt: net_init() error: %s, errno=%d\n",
+				NET_ERRSTR(listenfd), errno);
+	exit (listenfd);
+    }
+    (void)printf ("netrtt: Echoing on %s...\n", server);
+
+    while ((sockfd = net_accept (listenfd, BLOCKING)) >= 0) {
+
+	while ((len = net_recv (sockfd, msg, sizeof msg, BLOCKING)) > 0) {
+	    if (send_msg (sockfd, msg, len) <= 0)
+		break;
+	}
+	net_close (sockfd);
+    }
+
+    (void)fprintf (stderr, "netrtt: net_accept() error: %s, errno=%d\n",
+			    NET_ERRSTR(sockfd), errno);
+    net_close (listenfd);
+}
+
+
+int compare_ns (const void *a, const void *b)
+{
+    long x = *(const long *) a;
+    long y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* time count round trips of depth len-byte messages each */
+
+int measure (char *server, char *hostname, int count, int len, int depth)
+{
+    static char msg[MAXMSGLEN];
+    long *rtt;
+    long  total = 0;
+    int   sockfd;
+    int   status = 0;
+    int   i, j;
+    struct timespec start, end;
+
+    if ((sockfd = net_connect (server, hostname, ANY_TASK, BLOCKING)) < 0) {
+	(void)fprintf (stderr, "netrtt: net_connect() error: %s: %s\n",
+				NET_ERRSTR(sockfd), strerror (errno));
+	return sockfd;
+    }
+
+    rtt = (long *) malloc (count * sizeof (long));
+    (void) memset (msg, 'x', len);
+
+    for (i = 0; i < count; i++) {
+	clock_gettime (CLOCK_MONOTONIC, &start);
+
+	for (j = 0; j < depth && (status = send_msg (sockfd, msg, len)) > 0; j++)
+	    ;
+	for (j = 0; j < depth && status > 0; j++)
+	    status = net_recv (sockfd, msg, sizeof msg, BLOCKING);
+
+	if (status <= 0) {
+	    (void)fprintf (stderr, "netrtt: Round trip %d failed: %s, errno=%d\n",
+				    i, NET_ERRSTR(status), errno);
+	    count = i;
+	    break;
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &end);
+	rtt[i] = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	total += rtt[i];
+    }
+    net_close (sockfd);
+
+    if (count > 0) {
+	qsort (rtt, count, sizeof (long), compare_ns);
+
+	(void)printf ("Round trip (us), %d x %d x %d bytes%s: mean %.1f  min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+		      count, depth, len, split ? ", split writes" : "",
+		      total / 1e3 / count, rtt[0] / 1e3, rtt[count / 2] / 1e3,
+		      rtt[count * 9 / 10] / 1e3, rtt[count * 99 / 100] / 1e3,
+		      rtt[count - 1] / 1e3);
+    }
+    free (rtt);
+
+    return 0;
+}
+
+
+int main (int argc, char **argv)
+{
+    char server[128] = LSCS_CMD_SRV;
+    char hostname[128] = "localhost";
+    bool serving = false;
+    int  count = 1000;
+    int  len = 128;
+    int  depth = 1;
+    int  opts = -1;
+    int  i;
+
+    for (i = 1; i < argc; i++) {
+	if (!strcmp (argv[i], "-S"))
+	    serving = true;
+
+	else if (!strcmp (argv[i], "-s") && i + 1 < argc)
+	    (void) strncpy (server, argv[++i], sizeof server - 1);
+
+	else if (!strcmp (argv[i], "-h") && i + 1 < argc)
+	    (void) strncpy (hostname, argv[++i], sizeof hostname - 1);
+
+	else if (!strcmp (argv[i], "-n") && i + 1 < argc)
+	    count = atoi (argv[++i]);
+
+	else if (!strcmp (argv[i], "-l") && i + 1 < argc)
+	    len = atoi (argv[++i]);
+
+	else if (!strcmp (argv[i], "-p") && i + 1 < argc)
+	    depth = atoi (argv[++i]);
+
+	else if (!strcmp (argv[i], "-O") && i + 1 < argc)
+	    opts = parse_opts (argv[++i]);
+
+	else if (!strcmp (argv[i], "-2"))
+	    split = true;
+
+	else {
+	    (void)fprintf (stderr, "Usage: netrtt [-S] [-s endpoint] [-h host] [-n count] [-l length] [-p depth]\n"
+				   "              [-O nodelay,quickack,lowdelay,recvbuf|none] [-2]\n");
+	    exit (1);
+	}
+    }
+
+    if (count < 1 || count > MAXSAMPLES || len < 1 || len > MAXMSGLEN || depth < 1) {
+	(void)fprintf (stderr, "netrtt: count must be 1-%d, length 1-%d, depth at least 1\n",
+			       MAXSAMPLES, MAXMSGLEN);
+	exit (1);
+    }
+
+    if (opts >= 0 && (i = net_setendptopts (server, opts)) < 0) {
+	(void)fprintf (stderr, "netrtt: net_setendptopts() error: %s\n", NET_ERRSTR(i));
+	exit (i);
+    }
+
+    if (serving)
+	serve (server);
+    else
+	return measure (server, hostname, count, len, depth);
+
+    return 0;
+}
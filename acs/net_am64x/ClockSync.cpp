@@ -0,0 +1 @@
+../net-bench/ClockSync.cpp
\ No newline at end of file
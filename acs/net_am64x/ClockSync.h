@@ -0,0 +1 @@
+../net-bench/ClockSync.h
\ No newline at end of file
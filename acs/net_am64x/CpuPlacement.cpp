@@ -0,0 +1 @@
+../net-bench/CpuPlacement.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/CpuPlacement.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/CycleAssembler.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/CycleAssembler.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/IoUring.cpp
\ No newline at end of file
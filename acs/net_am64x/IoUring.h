@@ -0,0 +1 @@
+../net-bench/IoUring.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/LatencyHistogram.cpp
\ No newline at end of file
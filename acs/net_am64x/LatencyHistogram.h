@@ -0,0 +1 @@
+../net-bench/LatencyHistogram.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/PeriodicScheduler.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/PeriodicScheduler.h
\ No newline at end of file
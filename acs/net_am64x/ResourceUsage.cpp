@@ -0,0 +1 @@
+../net-bench/ResourceUsage.cpp
\ No newline at end of file
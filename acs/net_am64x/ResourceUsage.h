@@ -0,0 +1 @@
+../net-bench/ResourceUsage.h
\ No newline at end of file
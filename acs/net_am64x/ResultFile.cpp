@@ -0,0 +1 @@
+../net-bench/ResultFile.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/ResultFile.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/RtMemory.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/RtMemory.h
\ No newline at end of file
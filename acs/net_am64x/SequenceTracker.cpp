@@ -0,0 +1 @@
+../net-bench/SequenceTracker.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/SequenceTracker.h
\ No newline at end of file
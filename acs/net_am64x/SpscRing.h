@@ -0,0 +1 @@
+../net-bench/SpscRing.h
\ No newline at end of file
@@ -0,0 +1 @@
+../net-bench/TimeTag.h
\ No newline at end of file
@@ -24,6 +24,7 @@ int main(int argc, char *argv[])
     printf("sizeof()\tfloat32=%ld,\t\tfloat64=%ld\n", sizeof(float32), sizeof(float));
     printf("sizeof()\tMsgHdr=%ld,\t\tDataHdr=%ld,\t\tLscsDataHdr=%ld, \t\tTimeTag=%ld\n", sizeof(MsgHdr), 
            sizeof(DataHdr), sizeof(LscsDataHdr), sizeof(TimeTag));
+    printf("sizeof()\tDataHdrV2=%ld,\t\tTimeTagNs=%ld\n", sizeof(DataHdrV2), sizeof(TimeTagNs));
     printf("sizeof()\tCmdMsg=%ld,\t\tRspMsg=%ld,\t\tLogMsg=%ld\n", sizeof(CmdMsg), 
            sizeof(RspMsg), sizeof(LogMsg));
     printf("sizeof()\tRawDataMsg=%ld\n", sizeof(RawDataMsg));
@@ -31,6 +32,8 @@ int main(int argc, char *argv[])
            sizeof(ActRtData), sizeof(SensRtDataHdr), sizeof(SensRtData));
     printf("sizeof()\tSegRtData=%ld,\t\tSegRtDataMsg=%ld\n", sizeof(SegRtData), 
            sizeof(SegRtDataMsg));
+    printf("sizeof()\tSegRtDataMsgV2=%ld,\tActTargetMsg=%ld,\tActTargetMsgV2=%ld\n", sizeof(SegRtDataMsgV2),
+           sizeof(ActTargetMsg), sizeof(ActTargetMsgV2));
     printf("sizeof()\tWarpHarnStrain=%ld,\tWarpHarnStrainMsg=%ld\n", 
            sizeof(WarpHarnStrain), sizeof(WarpHarnStrainMsg));
     printf("sizeof()\tWarpHarnCalibCoef=%ld,\tWarpHarnCalib=%ld,\tWarpHarnCalibMsg=%ld\n",
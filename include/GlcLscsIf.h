@@ -75,6 +75,17 @@ typedef struct ActTargetMsg {
     ActTarget target[ACT_PER_SEG]; //!<
 } OS_PACK ActTargetMsg;
 
+/// As SegRtDataMsg and ActTargetMsg, with nanosecond time tags
+typedef struct SegRtDataMsgV2 {
+    DataHdrV2 hdr;
+    SegRtData data[SMPL_PER_MSG];
+} OS_PACK SegRtDataMsgV2;
+
+typedef struct ActTargetMsgV2 {
+    DataHdrV2 hdr;
+    ActTarget target[ACT_PER_SEG]; //!<
+} OS_PACK ActTargetMsgV2;
+
 //
 // Data structure definitions for event data returned from processing commands.
 //
@@ -88,6 +88,35 @@ typedef struct DataHdr {
     TimeTag time;
 } OS_PACK DataHdr;
 
+/// Nanosecond time tag, for DataHdrV2
+typedef struct TimeTagNs {
+    uint64_t tv_sec;
+    uint64_t tv_nsec;
+} OS_PACK TimeTagNs;
+
+/// Clocks a DataHdrV2 time tag can be taken from
+typedef enum time_clock_id {
+    TIME_CLOCK_REALTIME = 0,         //!< CLOCK_REALTIME, as DataHdr's gettimeofday()
+    TIME_CLOCK_MONOTONIC_RAW,        //!< CLOCK_MONOTONIC_RAW, comparable on one host only
+    TIME_CLOCK_TAI,                  //!< CLOCK_TAI, comparable across PTP-synchronized hosts
+    NUM_TIME_CLOCKS
+} TIME_CLOCK_ID;
+
+#define DATA_HDR_MAGIC       (0x4D31)   // "M1"
+#define DATA_HDR_VERSION_2   (2)
+
+/// Versioned data header with a nanosecond time tag.  A message with this
+/// header is told apart from the same message with a DataHdr by its length,
+/// and the magic number and version confirm it.
+typedef struct DataHdrV2 {
+    MsgHdr    hdr;
+    uint16_t  magic;    //!< DATA_HDR_MAGIC
+    uint8_t   version;  //!< DATA_HDR_VERSION_2
+    uint8_t   clockId;  //!< TIME_CLOCK_ID the time tag was taken from
+    uint32_t  spare;
+    TimeTagNs time;
+} OS_PACK DataHdrV2;
+
 /// Log severity levels
 typedef enum LogLevel {
     LOG_FATAL,    //!< For errors that cause the system to halt
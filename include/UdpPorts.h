@@ -4,6 +4,9 @@
 #define M1CS_DEFAULT_FIRST_UDP_PORT (30000)
 #define M1CS_DEFAULT_NUM_UDP_PORTS  (  492)
 
+// Clock offset exchanges between the hosts, apart from the data ports
+#define M1CS_DEFAULT_CLOCK_SYNC_UDP_PORT (29999)
+
 
 
 #endif   /*  INC_UdpPorts_h  */
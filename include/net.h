@@ -27,6 +27,7 @@
 #ifndef NET_H
 #define NET_H
 
+#include <time.h>
 #include "acs.h"
 
 #ifdef __cplusplus
@@ -34,16 +35,20 @@ extern "C" {
 #endif
 
 #define NET_MAX_ENDPTS       (23) //!< max number of remote endpoints
-#define NET_MAX_FD         (1024) //!< max number of open socket desc
+#define NET_MAX_FD        (65536) //!< max socket descriptor + 1
+#define NET_FD_CHUNK       (1024) //!< socket table entries allocated at once
 
 #define NET_MIN_MSG_LEN  (sizeof (char)) //!< minimum message length
 #define NET_MAX_MSG_LEN      (4097*1024) //!< maximum message length (> 4Mb)
 
 #define NET_MAX_UDP_LEN     (4096) //!< maximum UDP packet length
 
-#define NET_MIN_USEC_DELAY (20000) //!< minimum delay in microseconds
-#define NET_MAX_NDELAY        (10) //!< max number of delays before
-                                   //!< returning NWOULDBLOCK
+#define NET_RECVBUF_SIZE   (16384) //!< receive buffer size (NET_OPT_RECVBUF)
+
+#define NET_LISTEN_BACKLOG (SOMAXCONN) //!< pending connections per listener
+
+#define NET_DEFAULT_TIMEOUT  (200) //!< ms to finish a message once started,
+                                   //!< before returning NWOULDBLOCK
 
 typedef enum {
     UNDEF, TCP, UDP, BRDCST
@@ -56,19 +61,30 @@ typedef struct endpt_entry {
     endpt_type type;        //!< endpoint protocol
     int        pname;       //!< server's name
     int        port;        //!< endpoint port number
+    int        opts;        //!< NET_OPT_* latency options for its sockets
 } endpt_entry;
 
 /// open socket descriptor entry
 
 typedef struct sockfd_entry {
     endpt_type type;        //!< socket type
-    io_mode    mode;        //!< socket I/O mode
+    io_mode    mode;        //!< descriptor's I/O mode (net_setiomode); net_send
+                            //!< and net_recv use MSG_DONTWAIT instead
+    int        opts;        //!< NET_OPT_* latency options in effect
+    char       *rbuf;       //!< receive buffer, or NULL
+    int        rstart;      //!< offset of the first byte buffered
+    int        rcount;      //!< number of bytes buffered
+    int        timeout;     //!< ms to finish a started message, or
+                            //!< NET_WAIT_FOREVER
 } sockfd_entry;
  
 extern endpt_entry net_endpt[];  //!< list of endpoint entries
 extern int           net_port[]; //!< list of port numbers bound to
                                  //!< by a client
 
+sockfd_entry *net_getsockfd (int sockfd);
+int net_wait (int sockfd, int events, int timeout, struct timespec *deadline);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
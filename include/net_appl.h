@@ -118,8 +118,49 @@ int net_send (int sockfd, char *msg, int length, io_mode mode);
 int net_recv (int sockfd, char *buf, int maxlen, io_mode mode);
 int net_getpeername (int sockfd, int *pname, char *hostname, int namelen);
 int net_setiomode (int sockfd, io_mode mode);
+int net_setendptopts (char *endpt, int opts);
+int net_setsockopts (int sockfd, int opts);
+int net_pending (int sockfd);
+int net_settimeout (int sockfd, int msecs);
 int net_close (int sockfd);
 
+/// event loop serving an endpoint's connections (net_server_create).
+/// on_readable is called on each message's arrival, and until it returns
+/// NWOULDBLOCK; it receives one message with net_recv (..., NON_BLOCKING)
+/// and returns that call's status.  NEOF or an error closes the connection.
+/// Accepted connections always get NET_OPT_RECVBUF, so that one client's
+/// partial message waits in its buffer instead of stalling the others.
+
+typedef struct net_server net_server;
+
+typedef struct net_server_callbacks {
+    int  (*on_accept)   (net_server *srv, int sockfd, void *arg); //!< < 0 refuses; may be NULL
+    int  (*on_readable) (net_server *srv, int sockfd, void *arg); //!< net_recv() status
+    void (*on_closed)   (net_server *srv, int sockfd, void *arg); //!< before net_close; may be NULL
+    void *arg;                                                    //!< passed to each callback
+} net_server_callbacks;
+
+int  net_server_create (char *endpt, net_server_callbacks *callbacks, net_server **srvp);
+int  net_server_run (net_server *srv);
+void net_server_stop (net_server *srv);
+int  net_server_nclients (net_server *srv);
+void net_server_destroy (net_server *srv);
+
+/// latency and receive options, per endpoint (net_setendptopts) or per socket
+/// (net_setsockopts).  Sockets from net_connect() and net_accept() take
+/// their endpoint's options.
+
+#define NET_OPT_NODELAY   (0x01)  //!< TCP_NODELAY: send small messages at once
+#define NET_OPT_QUICKACK  (0x02)  //!< TCP_QUICKACK: ACK at once, re-armed by net_recv
+#define NET_OPT_LOWDELAY  (0x04)  //!< IP_TOS low delay, for routers that honor it
+#define NET_OPT_RECVBUF   (0x08)  //!< read ahead into a buffer, many messages per read()
+
+#define NET_OPT_DEFAULT   (NET_OPT_NODELAY)
+
+/// net_settimeout() value to wait as long as it takes to finish a message
+
+#define NET_WAIT_FOREVER  (-1)
+
 /// function return values
 
 #define NEOF         (0)